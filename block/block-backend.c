@@ -1392,6 +1392,19 @@ typedef struct BlkAioEmAIOCB {
     BlkRwCo rwco;
     int bytes;
     bool has_returned;
+    union {
+        struct {
+            unsigned int *nr_zones;
+            BlockZoneDescriptor *zones;
+        } zone_report;
+        struct {
+            BlockZoneOp op;
+            int64_t len;
+        } zone_mgmt;
+        struct {
+            int64_t *offset;
+        } zone_append;
+    };
 } BlkAioEmAIOCB;
 
 static AioContext *blk_aio_em_aiocb_get_aio_context(BlockAIOCB *acb_)
@@ -1422,13 +1435,12 @@ static void blk_aio_complete_bh(void *opaque)
     blk_aio_complete(acb);
 }
 
-static BlockAIOCB *blk_aio_prwv(BlockBackend *blk, int64_t offset, int bytes,
-                                void *iobuf, CoroutineEntry co_entry,
-                                BdrvRequestFlags flags,
-                                BlockCompletionFunc *cb, void *opaque)
+static BlkAioEmAIOCB *blk_aio_em_get(BlockBackend *blk, int64_t offset,
+                                     int bytes, void *iobuf,
+                                     BdrvRequestFlags flags,
+                                     BlockCompletionFunc *cb, void *opaque)
 {
     BlkAioEmAIOCB *acb;
-    Coroutine *co;
 
     blk_inc_in_flight(blk);
     acb = blk_aio_get(&blk_aio_em_aiocb_info, blk, cb, opaque);
@@ -1441,6 +1453,14 @@ static BlockAIOCB *blk_aio_prwv(BlockBackend *blk, int64_t offset, int bytes,
     };
     acb->bytes = bytes;
     acb->has_returned = false;
+    return acb;
+}
+
+static BlockAIOCB *blk_aio_em_start(BlkAioEmAIOCB *acb,
+                                    CoroutineEntry co_entry)
+{
+    BlockBackend *blk = acb->rwco.blk;
+    Coroutine *co;
 
     co = qemu_coroutine_create(co_entry, acb);
     bdrv_coroutine_enter(blk_bs(blk), co);
@@ -1454,6 +1474,17 @@ static BlockAIOCB *blk_aio_prwv(BlockBackend *blk, int64_t offset, int bytes,
     return &acb->common;
 }
 
+static BlockAIOCB *blk_aio_prwv(BlockBackend *blk, int64_t offset, int bytes,
+                                void *iobuf, CoroutineEntry co_entry,
+                                BdrvRequestFlags flags,
+                                BlockCompletionFunc *cb, void *opaque)
+{
+    BlkAioEmAIOCB *acb;
+
+    acb = blk_aio_em_get(blk, offset, bytes, iobuf, flags, cb, opaque);
+    return blk_aio_em_start(acb, co_entry);
+}
+
 static void blk_aio_read_entry(void *opaque)
 {
     BlkAioEmAIOCB *acb = opaque;
@@ -1660,6 +1691,131 @@ int blk_pdiscard(BlockBackend *blk, int64_t offset, int bytes)
     return blk_prw(blk, offset, NULL, bytes, blk_pdiscard_entry, 0);
 }
 
+/* To be called between exactly one pair of blk_inc/dec_in_flight() */
+static int coroutine_fn
+blk_do_zone_report(BlockBackend *blk, int64_t offset,
+                   unsigned int *nr_zones, BlockZoneDescriptor *zones)
+{
+    blk_wait_while_drained(blk);
+
+    if (!blk_is_available(blk)) {
+        return -ENOMEDIUM;
+    }
+
+    return bdrv_co_zone_report(blk_bs(blk), offset, nr_zones, zones);
+}
+
+static void blk_aio_zone_report_entry(void *opaque)
+{
+    BlkAioEmAIOCB *acb = opaque;
+    BlkRwCo *rwco = &acb->rwco;
+
+    rwco->ret = blk_do_zone_report(rwco->blk, rwco->offset,
+                                   acb->zone_report.nr_zones,
+                                   acb->zone_report.zones);
+    blk_aio_complete(acb);
+}
+
+/*
+ * Report up to *@nr_zones zones starting with the zone containing @offset.
+ * On completion *@nr_zones holds the number of zones stored in @zones.
+ */
+BlockAIOCB *blk_aio_zone_report(BlockBackend *blk, int64_t offset,
+                                unsigned int *nr_zones,
+                                BlockZoneDescriptor *zones,
+                                BlockCompletionFunc *cb, void *opaque)
+{
+    BlkAioEmAIOCB *acb;
+
+    acb = blk_aio_em_get(blk, offset, 0, NULL, 0, cb, opaque);
+    acb->zone_report.nr_zones = nr_zones;
+    acb->zone_report.zones = zones;
+    return blk_aio_em_start(acb, blk_aio_zone_report_entry);
+}
+
+/* To be called between exactly one pair of blk_inc/dec_in_flight() */
+static int coroutine_fn
+blk_do_zone_mgmt(BlockBackend *blk, BlockZoneOp op, int64_t offset,
+                 int64_t len)
+{
+    blk_wait_while_drained(blk);
+
+    if (!blk_is_available(blk)) {
+        return -ENOMEDIUM;
+    }
+
+    if (offset < 0 || len < 0 || offset > blk_getlength(blk) - len) {
+        return -EINVAL;
+    }
+
+    return bdrv_co_zone_mgmt(blk_bs(blk), op, offset, len);
+}
+
+static void blk_aio_zone_mgmt_entry(void *opaque)
+{
+    BlkAioEmAIOCB *acb = opaque;
+    BlkRwCo *rwco = &acb->rwco;
+
+    rwco->ret = blk_do_zone_mgmt(rwco->blk, acb->zone_mgmt.op, rwco->offset,
+                                 acb->zone_mgmt.len);
+    blk_aio_complete(acb);
+}
+
+/* Apply @op to all zones in [@offset, @offset + @len) */
+BlockAIOCB *blk_aio_zone_mgmt(BlockBackend *blk, BlockZoneOp op,
+                              int64_t offset, int64_t len,
+                              BlockCompletionFunc *cb, void *opaque)
+{
+    BlkAioEmAIOCB *acb;
+
+    acb = blk_aio_em_get(blk, offset, 0, NULL, 0, cb, opaque);
+    acb->zone_mgmt.op = op;
+    acb->zone_mgmt.len = len;
+    return blk_aio_em_start(acb, blk_aio_zone_mgmt_entry);
+}
+
+/* To be called between exactly one pair of blk_inc/dec_in_flight() */
+static int coroutine_fn
+blk_do_zone_append(BlockBackend *blk, int64_t *offset, QEMUIOVector *qiov,
+                   BdrvRequestFlags flags)
+{
+    int ret;
+
+    blk_wait_while_drained(blk);
+
+    ret = blk_check_byte_request(blk, *offset, qiov->size);
+    if (ret < 0) {
+        return ret;
+    }
+
+    return bdrv_co_zone_append(blk_bs(blk), offset, qiov, flags);
+}
+
+static void blk_aio_zone_append_entry(void *opaque)
+{
+    BlkAioEmAIOCB *acb = opaque;
+    BlkRwCo *rwco = &acb->rwco;
+
+    rwco->ret = blk_do_zone_append(rwco->blk, acb->zone_append.offset,
+                                   rwco->iobuf, rwco->flags);
+    blk_aio_complete(acb);
+}
+
+/*
+ * Append @qiov to the zone starting at *@offset.  On success *@offset is
+ * updated to the position the data was written to.
+ */
+BlockAIOCB *blk_aio_zone_append(BlockBackend *blk, int64_t *offset,
+                                QEMUIOVector *qiov, BdrvRequestFlags flags,
+                                BlockCompletionFunc *cb, void *opaque)
+{
+    BlkAioEmAIOCB *acb;
+
+    acb = blk_aio_em_get(blk, *offset, qiov->size, qiov, flags, cb, opaque);
+    acb->zone_append.offset = offset;
+    return blk_aio_em_start(acb, blk_aio_zone_append_entry);
+}
+
 /* To be called between exactly one pair of blk_inc/dec_in_flight() */
 static int coroutine_fn blk_do_flush(BlockBackend *blk)
 {
@@ -1943,6 +2099,25 @@ int blk_get_max_iov(BlockBackend *blk)
     return blk->root->bs->bl.max_iov;
 }
 
+/* Returns the zoned characteristics; model is BLK_Z_NONE if not zoned */
+void blk_get_zone_info(BlockBackend *blk, BlockZoneInfo *info)
+{
+    BlockDriverState *bs = blk_bs(blk);
+
+    memset(info, 0, sizeof(*info));
+    if (!bs) {
+        return;
+    }
+
+    info->model = bs->bl.zoned;
+    info->zone_size = bs->bl.zone_size;
+    info->nr_zones = bs->bl.nr_zones;
+    info->max_append_sectors = bs->bl.max_append_sectors;
+    info->max_open_zones = bs->bl.max_open_zones;
+    info->max_active_zones = bs->bl.max_active_zones;
+    info->write_granularity = bs->bl.write_granularity;
+}
+
 void blk_set_guest_block_size(BlockBackend *blk, int align)
 {
     blk->guest_block_size = align;
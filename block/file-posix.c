@@ -76,6 +76,9 @@
 #define FS_NOCOW_FL                     0x00800000 /* Do not cow file */
 #endif
 #endif
+#ifdef CONFIG_BLKZONED
+#include <linux/blkzoned.h>
+#endif
 #if defined(CONFIG_FALLOCATE_PUNCH_HOLE) || defined(CONFIG_FALLOCATE_ZERO_RANGE)
 #include <linux/falloc.h>
 #endif
@@ -209,6 +212,13 @@ typedef struct RawPosixAIOData {
             PreallocMode prealloc;
             Error **errp;
         } truncate;
+        struct {
+            unsigned int *nr_zones;
+            BlockZoneDescriptor *zones;
+        } zone_report;
+        struct {
+            unsigned long op;
+        } zone_mgmt;
     };
 } RawPosixAIOData;
 
@@ -1175,60 +1185,292 @@ static int sg_get_max_transfer_length(int fd)
 #endif
 }
 
-static int sg_get_max_segments(int fd)
+/*
+ * Read the sysfs queue attribute @attribute of the block device @st.
+ * On success, store the value with the trailing newline removed in @val,
+ * which the caller must free, and return 0.  Return -errno on failure.
+ */
+static int get_sysfs_str_val(struct stat *st, const char *attribute,
+                             char **val)
 {
 #ifdef CONFIG_LINUX
-    char buf[32];
-    const char *end;
-    char *sysfspath = NULL;
+    g_autofree char *sysfspath = NULL;
+    size_t len;
     int ret;
-    int sysfd = -1;
-    long max_segments;
-    struct stat st;
 
-    if (fstat(fd, &st)) {
-        ret = -errno;
-        goto out;
+    sysfspath = g_strdup_printf("/sys/dev/block/%u:%u/queue/%s",
+                                major(st->st_rdev), minor(st->st_rdev),
+                                attribute);
+    ret = g_file_get_contents(sysfspath, val, &len, NULL);
+    if (!ret) {
+        return -ENOENT;
     }
 
-    sysfspath = g_strdup_printf("/sys/dev/block/%u:%u/queue/max_segments",
-                                major(st.st_rdev), minor(st.st_rdev));
-    sysfd = open(sysfspath, O_RDONLY);
-    if (sysfd == -1) {
-        ret = -errno;
-        goto out;
+    /* The file is ended with '\n' */
+    if (len && (*val)[len - 1] == '\n') {
+        (*val)[len - 1] = '\0';
     }
-    do {
-        ret = read(sysfd, buf, sizeof(buf) - 1);
-    } while (ret == -1 && errno == EINTR);
+    return 0;
+#else
+    return -ENOTSUP;
+#endif
+}
+
+static long get_sysfs_long_val(struct stat *st, const char *attribute)
+{
+    g_autofree char *str = NULL;
+    const char *end;
+    long val;
+    int ret;
+
+    ret = get_sysfs_str_val(st, attribute, &str);
     if (ret < 0) {
-        ret = -errno;
-        goto out;
-    } else if (ret == 0) {
-        ret = -EIO;
-        goto out;
+        return ret;
     }
-    buf[ret] = 0;
-    /* The file is ended with '\n', pass 'end' to accept that. */
-    ret = qemu_strtol(buf, &end, 10, &max_segments);
-    if (ret == 0 && end && *end == '\n') {
-        ret = max_segments;
+
+    ret = qemu_strtol(str, &end, 10, &val);
+    if (ret == 0 && end && *end == '\0') {
+        return val;
     }
+    return ret < 0 ? ret : -EINVAL;
+}
 
-out:
-    if (sysfd != -1) {
-        close(sysfd);
+static int sg_get_max_segments(int fd)
+{
+    struct stat st;
+
+    if (fstat(fd, &st)) {
+        return -errno;
     }
-    g_free(sysfspath);
-    return ret;
+    return get_sysfs_long_val(&st, "max_segments");
+}
+
+#ifdef CONFIG_BLKZONED
+static BlockZoneModel get_sysfs_zoned_model(struct stat *st)
+{
+    g_autofree char *val = NULL;
+
+    if (get_sysfs_str_val(st, "zoned", &val) < 0) {
+        return BLK_Z_NONE;
+    }
+
+    if (strcmp(val, "host-managed") == 0) {
+        return BLK_Z_HM;
+    } else if (strcmp(val, "host-aware") == 0) {
+        return BLK_Z_HA;
+    }
+    return BLK_Z_NONE;
+}
+
+static void parse_zone(BlockZoneDescriptor *zone, const struct blk_zone *blkz)
+{
+    zone->start = blkz->start << BDRV_SECTOR_BITS;
+    zone->length = blkz->len << BDRV_SECTOR_BITS;
+    zone->wp = blkz->wp << BDRV_SECTOR_BITS;
+#ifdef HAVE_BLK_ZONE_REP_CAPACITY
+    /* Older kernels leave the capacity unset */
+    zone->cap = (blkz->capacity ?: blkz->len) << BDRV_SECTOR_BITS;
 #else
-    return -ENOTSUP;
+    zone->cap = blkz->len << BDRV_SECTOR_BITS;
 #endif
+
+    switch (blkz->type) {
+    case BLK_ZONE_TYPE_SEQWRITE_REQ:
+        zone->type = BLK_ZT_SWR;
+        break;
+    case BLK_ZONE_TYPE_SEQWRITE_PREF:
+        zone->type = BLK_ZT_SWP;
+        break;
+    case BLK_ZONE_TYPE_CONVENTIONAL:
+    default:
+        zone->type = BLK_ZT_CONV;
+        break;
+    }
+
+    switch (blkz->cond) {
+    case BLK_ZONE_COND_EMPTY:
+        zone->state = BLK_ZS_EMPTY;
+        break;
+    case BLK_ZONE_COND_IMP_OPEN:
+        zone->state = BLK_ZS_IOPEN;
+        break;
+    case BLK_ZONE_COND_EXP_OPEN:
+        zone->state = BLK_ZS_EOPEN;
+        break;
+    case BLK_ZONE_COND_CLOSED:
+        zone->state = BLK_ZS_CLOSED;
+        break;
+    case BLK_ZONE_COND_READONLY:
+        zone->state = BLK_ZS_RDONLY;
+        break;
+    case BLK_ZONE_COND_FULL:
+        zone->state = BLK_ZS_FULL;
+        break;
+    case BLK_ZONE_COND_OFFLINE:
+        zone->state = BLK_ZS_OFFLINE;
+        break;
+    case BLK_ZONE_COND_NOT_WP:
+    default:
+        zone->state = BLK_ZS_NOT_WP;
+        break;
+    }
+}
+
+/*
+ * Report up to @nr_zones zones starting at the zone containing @offset,
+ * calling @fn for each of them.  Returns the number of zones reported or
+ * -errno.
+ */
+static int do_zone_report(int fd, int64_t offset, unsigned int nr_zones,
+                          void (*fn)(const struct blk_zone *blkz,
+                                     unsigned int idx, void *opaque),
+                          void *opaque)
+{
+    /* Report zones in chunks to keep the ioctl buffer small */
+    const unsigned int chunk = MIN(nr_zones, 4096u);
+    g_autofree struct blk_zone_report *rep = NULL;
+    int64_t sector = offset >> BDRV_SECTOR_BITS;
+    unsigned int n = 0, i;
+    int ret;
+
+    rep = g_malloc(sizeof(*rep) + chunk * sizeof(struct blk_zone));
+    while (n < nr_zones) {
+        rep->sector = sector;
+        rep->nr_zones = MIN(chunk, nr_zones - n);
+
+        do {
+            ret = ioctl(fd, BLKREPORTZONE, rep);
+        } while (ret != 0 && errno == EINTR);
+        if (ret != 0) {
+            return -errno;
+        }
+
+        if (!rep->nr_zones) {
+            break;
+        }
+
+        for (i = 0; i < rep->nr_zones; i++, n++) {
+            fn(&rep->zones[i], n, opaque);
+        }
+        sector = rep->zones[rep->nr_zones - 1].start +
+                 rep->zones[rep->nr_zones - 1].len;
+    }
+
+    return n;
+}
+
+static void zone_wp_fill(const struct blk_zone *blkz, unsigned int idx,
+                         void *opaque)
+{
+    uint64_t *wp = opaque;
+    BlockZoneDescriptor zone;
+
+    parse_zone(&zone, blkz);
+    if (zone.type == BLK_ZT_CONV) {
+        wp[idx] = zone.start | BDRV_ZT_CONV;
+        return;
+    }
+
+    switch (zone.state) {
+    case BLK_ZS_OFFLINE:
+    case BLK_ZS_RDONLY:
+        /* Zones without a usable write pointer accept no appends */
+        wp[idx] = zone.start + zone.length;
+        break;
+    case BLK_ZS_FULL:
+        wp[idx] = zone.start + zone.cap;
+        break;
+    default:
+        wp[idx] = zone.wp;
+        break;
+    }
+}
+
+/* Refresh the cached write pointers of @nr_zones zones starting at @offset */
+static int get_zones_wp(BlockDriverState *bs, int fd, int64_t offset,
+                        unsigned int nr_zones)
+{
+    unsigned int idx = offset / bs->bl.zone_size;
+    int ret;
+
+    assert(idx + nr_zones <= bs->bl.nr_zones);
+    ret = do_zone_report(fd, offset, nr_zones, zone_wp_fill,
+                         &bs->wps->wp[idx]);
+    return ret < 0 ? ret : 0;
+}
+
+static void raw_refresh_zoned_limits(BlockDriverState *bs, struct stat *st,
+                                     Error **errp)
+{
+    BDRVRawState *s = bs->opaque;
+    BlockZoneModel zoned = get_sysfs_zoned_model(st);
+    long val;
+    int ret;
+
+    bs->bl.zoned = zoned;
+    if (zoned == BLK_Z_NONE) {
+        goto no_zones;
+    }
+
+    val = get_sysfs_long_val(st, "chunk_sectors");
+    if (val <= 0 || !is_power_of_2(val)) {
+        error_setg(errp, "Invalid zone size %ld sectors", val);
+        goto no_zones;
+    }
+    bs->bl.zone_size = val << BDRV_SECTOR_BITS;
+
+    val = get_sysfs_long_val(st, "nr_zones");
+    if (val <= 0) {
+        error_setg(errp, "Invalid number of zones %ld", val);
+        goto no_zones;
+    }
+    bs->bl.nr_zones = val;
+
+    val = get_sysfs_long_val(st, "zone_append_max_bytes");
+    bs->bl.max_append_sectors = val > 0 ? val >> BDRV_SECTOR_BITS : 0;
+
+    val = get_sysfs_long_val(st, "max_open_zones");
+    bs->bl.max_open_zones = val > 0 ? val : 0;
+
+    val = get_sysfs_long_val(st, "max_active_zones");
+    bs->bl.max_active_zones = val > 0 ? val : 0;
+
+    /*
+     * Writes to sequential zones must be aligned to the physical block
+     * size, which may be larger than the logical block size.
+     */
+    val = get_sysfs_long_val(st, "physical_block_size");
+    bs->bl.write_granularity = val > 0 ? val : bs->bl.request_alignment;
+
+    g_free(bs->wps);
+    bs->wps = g_malloc0(sizeof(BlockZoneWps) +
+                        sizeof(uint64_t) * bs->bl.nr_zones);
+    qemu_co_mutex_init(&bs->wps->colock);
+    ret = get_zones_wp(bs, s->fd, 0, bs->bl.nr_zones);
+    if (ret < 0) {
+        error_setg_errno(errp, -ret, "report wps failed");
+        goto no_zones;
+    }
+    return;
+
+no_zones:
+    bs->bl.zoned = BLK_Z_NONE;
+    g_free(bs->wps);
+    bs->wps = NULL;
 }
+#else /* !CONFIG_BLKZONED */
+static void raw_refresh_zoned_limits(BlockDriverState *bs, struct stat *st,
+                                     Error **errp)
+{
+    bs->bl.zoned = BLK_Z_NONE;
+}
+#endif
 
 static void raw_refresh_limits(BlockDriverState *bs, Error **errp)
 {
     BDRVRawState *s = bs->opaque;
+    Error *local_err = NULL;
+    struct stat st;
 
     if (bs->sg) {
         int ret = sg_get_max_transfer_length(s->fd);
@@ -1244,9 +1486,17 @@ static void raw_refresh_limits(BlockDriverState *bs, Error **errp)
         }
     }
 
-    raw_probe_alignment(bs, s->fd, errp);
+    raw_probe_alignment(bs, s->fd, &local_err);
     bs->bl.min_mem_alignment = s->buf_align;
     bs->bl.opt_mem_alignment = MAX(s->buf_align, qemu_real_host_page_size);
+    if (local_err) {
+        error_propagate(errp, local_err);
+        return;
+    }
+
+    if (!bs->sg && !fstat(s->fd, &st) && S_ISBLK(st.st_mode)) {
+        raw_refresh_zoned_limits(bs, &st, errp);
+    }
 }
 
 static int check_for_dasd(int fd)
@@ -1829,6 +2079,64 @@ static int allocate_first_block(int fd, size_t max_size)
     return ret;
 }
 
+#ifdef CONFIG_BLKZONED
+static void zone_report_fill(const struct blk_zone *blkz, unsigned int idx,
+                             void *opaque)
+{
+    BlockZoneDescriptor *zones = opaque;
+
+    parse_zone(&zones[idx], blkz);
+}
+
+static int handle_aiocb_zone_report(void *opaque)
+{
+    RawPosixAIOData *aiocb = opaque;
+    int ret;
+
+    ret = do_zone_report(aiocb->aio_fildes, aiocb->aio_offset,
+                         *aiocb->zone_report.nr_zones, zone_report_fill,
+                         aiocb->zone_report.zones);
+    if (ret < 0) {
+        return ret;
+    }
+
+    *aiocb->zone_report.nr_zones = ret;
+    return 0;
+}
+
+/* Re-read the write pointers of the zones in the request's range */
+static int handle_aiocb_zone_wps(void *opaque)
+{
+    RawPosixAIOData *aiocb = opaque;
+    BlockDriverState *bs = aiocb->bs;
+    unsigned int idx = aiocb->aio_offset / bs->bl.zone_size;
+    unsigned int nr_zones = DIV_ROUND_UP(aiocb->aio_nbytes, bs->bl.zone_size);
+
+    nr_zones = MIN(nr_zones, bs->bl.nr_zones - idx);
+    return get_zones_wp(bs, aiocb->aio_fildes,
+                        (int64_t)idx * bs->bl.zone_size, nr_zones);
+}
+
+static int handle_aiocb_zone_mgmt(void *opaque)
+{
+    RawPosixAIOData *aiocb = opaque;
+    struct blk_zone_range range = {
+        .sector = aiocb->aio_offset >> BDRV_SECTOR_BITS,
+        .nr_sectors = aiocb->aio_nbytes >> BDRV_SECTOR_BITS,
+    };
+    int ret, wps_ret;
+
+    do {
+        ret = ioctl(aiocb->aio_fildes, aiocb->zone_mgmt.op, &range);
+    } while (ret != 0 && errno == EINTR);
+    ret = ret < 0 ? -errno : 0;
+
+    /* Even a failed operation may have changed some of the zones */
+    wps_ret = handle_aiocb_zone_wps(aiocb);
+    return ret < 0 ? ret : wps_ret;
+}
+#endif
+
 static int handle_aiocb_truncate(void *opaque)
 {
     RawPosixAIOData *aiocb = opaque;
@@ -2026,11 +2334,175 @@ static int coroutine_fn raw_co_preadv(BlockDriverState *bs, uint64_t offset,
     return raw_co_prw(bs, offset, bytes, qiov, QEMU_AIO_READ);
 }
 
+#ifdef CONFIG_BLKZONED
+/* Called with wps->colock held */
+static int coroutine_fn raw_co_refresh_wps(BlockDriverState *bs,
+                                           int64_t offset, int64_t len)
+{
+    BDRVRawState *s = bs->opaque;
+    RawPosixAIOData acb = (RawPosixAIOData) {
+        .bs         = bs,
+        .aio_fildes = s->fd,
+        .aio_type   = QEMU_AIO_ZONE_REPORT,
+        .aio_offset = offset,
+        .aio_nbytes = len,
+    };
+
+    return raw_thread_pool_submit(bs, handle_aiocb_zone_wps, &acb);
+}
+
+/*
+ * Write to a zoned device and keep the cached write pointer of the zone in
+ * sync.  With @append set, *@offset is the start of the zone on entry and
+ * the offset the data was written to on return.
+ */
+static int coroutine_fn raw_co_zoned_pwritev(BlockDriverState *bs,
+                                             int64_t *offset, uint64_t bytes,
+                                             QEMUIOVector *qiov, bool append)
+{
+    BlockZoneWps *wps = bs->wps;
+    unsigned int idx = *offset / bs->bl.zone_size;
+    uint64_t *wp;
+    int ret;
+
+    if (idx >= bs->bl.nr_zones) {
+        return -EINVAL;
+    }
+    wp = &wps->wp[idx];
+
+    qemu_co_mutex_lock(&wps->colock);
+    if (append) {
+        if (BDRV_ZT_IS_CONV(*wp) ||
+            *wp + bytes > *offset + bs->bl.zone_size) {
+            ret = -EINVAL;
+            goto out;
+        }
+        *offset = *wp;
+    }
+
+    ret = raw_co_prw(bs, *offset, bytes, qiov, QEMU_AIO_WRITE);
+    if (ret < 0) {
+        raw_co_refresh_wps(bs, *offset, bytes);
+    } else if (!BDRV_ZT_IS_CONV(*wp) && *offset <= *wp &&
+               *offset + bytes > *wp) {
+        *wp = *offset + bytes;
+    }
+    trace_file_zone_write(bs, *offset, bytes, append, ret);
+
+out:
+    qemu_co_mutex_unlock(&wps->colock);
+    return ret;
+}
+
+static int coroutine_fn raw_co_zone_report(BlockDriverState *bs,
+                                           int64_t offset,
+                                           unsigned int *nr_zones,
+                                           BlockZoneDescriptor *zones)
+{
+    BDRVRawState *s = bs->opaque;
+    RawPosixAIOData acb = (RawPosixAIOData) {
+        .bs         = bs,
+        .aio_fildes = s->fd,
+        .aio_type   = QEMU_AIO_ZONE_REPORT,
+        .aio_offset = offset,
+        .zone_report = {
+            .nr_zones   = nr_zones,
+            .zones      = zones,
+        },
+    };
+
+    trace_file_zone_report(bs, offset, *nr_zones);
+    return raw_thread_pool_submit(bs, handle_aiocb_zone_report, &acb);
+}
+
+static int coroutine_fn raw_co_zone_mgmt(BlockDriverState *bs, BlockZoneOp op,
+                                         int64_t offset, int64_t len)
+{
+    BDRVRawState *s = bs->opaque;
+    int64_t zone_mask = bs->bl.zone_size - 1;
+    int64_t capacity = bs->total_sectors << BDRV_SECTOR_BITS;
+    RawPosixAIOData acb;
+    unsigned long zo;
+    int ret;
+
+    if (offset & zone_mask) {
+        return -EINVAL;
+    }
+    /* The last zone may be smaller than the others */
+    if (offset + len > capacity ||
+        (offset + len < capacity && (len & zone_mask))) {
+        return -EINVAL;
+    }
+
+    switch (op) {
+    case BLK_ZO_OPEN:
+        zo = BLKOPENZONE;
+        break;
+    case BLK_ZO_CLOSE:
+        zo = BLKCLOSEZONE;
+        break;
+    case BLK_ZO_FINISH:
+        zo = BLKFINISHZONE;
+        break;
+    case BLK_ZO_RESET:
+        zo = BLKRESETZONE;
+        break;
+    default:
+        return -ENOTSUP;
+    }
+
+    acb = (RawPosixAIOData) {
+        .bs         = bs,
+        .aio_fildes = s->fd,
+        .aio_type   = QEMU_AIO_ZONE_MGMT,
+        .aio_offset = offset,
+        .aio_nbytes = len,
+        .zone_mgmt  = {
+            .op = zo,
+        },
+    };
+
+    qemu_co_mutex_lock(&bs->wps->colock);
+    ret = raw_thread_pool_submit(bs, handle_aiocb_zone_mgmt, &acb);
+    qemu_co_mutex_unlock(&bs->wps->colock);
+
+    trace_file_zone_mgmt(bs, op, offset, len, ret);
+    return ret;
+}
+
+static int coroutine_fn raw_co_zone_append(BlockDriverState *bs,
+                                           int64_t *offset,
+                                           QEMUIOVector *qiov,
+                                           BdrvRequestFlags flags)
+{
+    int64_t max_append = (int64_t)bs->bl.max_append_sectors <<
+                         BDRV_SECTOR_BITS;
+
+    if (*offset & (bs->bl.zone_size - 1)) {
+        return -EINVAL;
+    }
+    if (qiov->size % bs->bl.write_granularity) {
+        return -EINVAL;
+    }
+    if (max_append && qiov->size > max_append) {
+        return -EINVAL;
+    }
+
+    return raw_co_zoned_pwritev(bs, offset, qiov->size, qiov, true);
+}
+#endif
+
 static int coroutine_fn raw_co_pwritev(BlockDriverState *bs, uint64_t offset,
                                        uint64_t bytes, QEMUIOVector *qiov,
                                        int flags)
 {
     assert(flags == 0);
+#ifdef CONFIG_BLKZONED
+    if (bs->wps) {
+        int64_t zoned_offset = offset;
+        return raw_co_zoned_pwritev(bs, &zoned_offset, bytes, qiov, false);
+    }
+#endif
     return raw_co_prw(bs, offset, bytes, qiov, QEMU_AIO_WRITE);
 }
 
@@ -2128,6 +2600,8 @@ static void raw_close(BlockDriverState *bs)
         qemu_close(s->fd);
         s->fd = -1;
     }
+    g_free(bs->wps);
+    bs->wps = NULL;
 }
 
 /**
@@ -3621,6 +4095,13 @@ static BlockDriver bdrv_host_device = {
 #ifdef __linux__
     .bdrv_co_ioctl          = hdev_co_ioctl,
 #endif
+
+    /* zoned device */
+#ifdef CONFIG_BLKZONED
+    .bdrv_co_zone_report    = raw_co_zone_report,
+    .bdrv_co_zone_mgmt      = raw_co_zone_mgmt,
+    .bdrv_co_zone_append    = raw_co_zone_append,
+#endif
 };
 
 #if defined(__linux__) || defined(__FreeBSD__) || defined(__FreeBSD_kernel__)
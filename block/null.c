@@ -14,6 +14,7 @@
 #include "qapi/error.h"
 #include "qapi/qmp/qdict.h"
 #include "qapi/qmp/qstring.h"
+#include "qemu/host-utils.h"
 #include "qemu/module.h"
 #include "qemu/option.h"
 #include "block/block_int.h"
@@ -21,11 +22,23 @@
 
 #define NULL_OPT_LATENCY "latency-ns"
 #define NULL_OPT_ZEROES  "read-zeroes"
+#define NULL_OPT_ZONE_SIZE "zone-size"
+
+typedef struct NullZone {
+    uint64_t wp;
+    BlockZoneState state;
+} NullZone;
 
 typedef struct {
     int64_t length;
     int64_t latency_ns;
     bool read_zeroes;
+
+    /* Emulated host-managed zones, all of them sequential write required */
+    uint64_t zone_size;
+    unsigned int nr_zones;
+    NullZone *zones;
+    CoMutex zone_lock;
 } BDRVNullState;
 
 static QemuOptsList runtime_opts = {
@@ -48,6 +61,12 @@ static QemuOptsList runtime_opts = {
             .type = QEMU_OPT_BOOL,
             .help = "return zeroes when read",
         },
+        {
+            .name = NULL_OPT_ZONE_SIZE,
+            .type = QEMU_OPT_SIZE,
+            .help = "emulate a host-managed zoned device with zones of "
+                    "this size",
+        },
         { /* end of list */ }
     },
 };
@@ -76,6 +95,85 @@ static void null_aio_parse_filename(const char *filename, QDict *options,
     }
 }
 
+static void null_zones_init(BDRVNullState *s)
+{
+    unsigned int i;
+
+    /* The last zone may be smaller than the others */
+    s->nr_zones = DIV_ROUND_UP(s->length, s->zone_size);
+    s->zones = g_new(NullZone, s->nr_zones);
+    for (i = 0; i < s->nr_zones; i++) {
+        s->zones[i].wp = i * s->zone_size;
+        s->zones[i].state = BLK_ZS_EMPTY;
+    }
+    qemu_co_mutex_init(&s->zone_lock);
+}
+
+static uint64_t null_zone_start(BDRVNullState *s, unsigned int idx)
+{
+    return idx * s->zone_size;
+}
+
+static uint64_t null_zone_end(BDRVNullState *s, unsigned int idx)
+{
+    return MIN(null_zone_start(s, idx) + s->zone_size, s->length);
+}
+
+/*
+ * Check that a write of @bytes at @offset is sequential in its zone and
+ * move the write pointer past it.  Called with zone_lock held.
+ */
+static int null_zone_write(BDRVNullState *s, uint64_t offset, uint64_t bytes)
+{
+    unsigned int idx = offset / s->zone_size;
+    NullZone *zone = &s->zones[idx];
+
+    if (offset != zone->wp || offset + bytes > null_zone_end(s, idx)) {
+        return -EINVAL;
+    }
+    if (!bytes) {
+        return 0;
+    }
+
+    zone->wp += bytes;
+    if (zone->wp == null_zone_end(s, idx)) {
+        zone->state = BLK_ZS_FULL;
+    } else if (zone->state != BLK_ZS_EOPEN) {
+        zone->state = BLK_ZS_IOPEN;
+    }
+    return 0;
+}
+
+static void null_zone_mgmt_one(BDRVNullState *s, BlockZoneOp op,
+                               unsigned int idx)
+{
+    NullZone *zone = &s->zones[idx];
+
+    switch (op) {
+    case BLK_ZO_OPEN:
+        if (zone->state != BLK_ZS_FULL) {
+            zone->state = BLK_ZS_EOPEN;
+        }
+        break;
+    case BLK_ZO_CLOSE:
+        if (zone->state == BLK_ZS_IOPEN || zone->state == BLK_ZS_EOPEN) {
+            zone->state = zone->wp == null_zone_start(s, idx) ?
+                          BLK_ZS_EMPTY : BLK_ZS_CLOSED;
+        }
+        break;
+    case BLK_ZO_FINISH:
+        zone->wp = null_zone_end(s, idx);
+        zone->state = BLK_ZS_FULL;
+        break;
+    case BLK_ZO_RESET:
+        zone->wp = null_zone_start(s, idx);
+        zone->state = BLK_ZS_EMPTY;
+        break;
+    default:
+        g_assert_not_reached();
+    }
+}
+
 static int null_file_open(BlockDriverState *bs, QDict *options, int flags,
                           Error **errp)
 {
@@ -94,11 +192,55 @@ static int null_file_open(BlockDriverState *bs, QDict *options, int flags,
         ret = -EINVAL;
     }
     s->read_zeroes = qemu_opt_get_bool(opts, NULL_OPT_ZEROES, false);
+    s->zone_size = qemu_opt_get_size(opts, NULL_OPT_ZONE_SIZE, 0);
     qemu_opts_del(opts);
+
+    if (!ret && s->zone_size) {
+        if (!bs->drv->bdrv_co_zone_report) {
+            error_setg(errp, "zone-size is not supported by %s",
+                       bs->drv->format_name);
+            return -ENOTSUP;
+        }
+        if (!is_power_of_2(s->zone_size) ||
+            s->zone_size < BDRV_SECTOR_SIZE || s->zone_size > (1ULL << 31)) {
+            error_setg(errp, "zone-size must be a power of 2 between %d and "
+                       "%llu", BDRV_SECTOR_SIZE, 1ULL << 31);
+            return -EINVAL;
+        }
+        if (s->length % BDRV_SECTOR_SIZE) {
+            error_setg(errp, "size of a zoned device must be a multiple of "
+                       "%d", BDRV_SECTOR_SIZE);
+            return -EINVAL;
+        }
+        null_zones_init(s);
+    }
+
     bs->supported_write_flags = BDRV_REQ_FUA;
     return ret;
 }
 
+static void null_close(BlockDriverState *bs)
+{
+    BDRVNullState *s = bs->opaque;
+
+    g_free(s->zones);
+}
+
+static void null_refresh_limits(BlockDriverState *bs, Error **errp)
+{
+    BDRVNullState *s = bs->opaque;
+
+    if (!s->zones) {
+        return;
+    }
+
+    bs->bl.zoned = BLK_Z_HM;
+    bs->bl.zone_size = s->zone_size;
+    bs->bl.nr_zones = s->nr_zones;
+    bs->bl.max_append_sectors = s->zone_size >> BDRV_SECTOR_BITS;
+    bs->bl.write_granularity = BDRV_SECTOR_SIZE;
+}
+
 static int64_t null_getlength(BlockDriverState *bs)
 {
     BDRVNullState *s = bs->opaque;
@@ -132,6 +274,101 @@ static coroutine_fn int null_co_pwritev(BlockDriverState *bs,
                                         uint64_t offset, uint64_t bytes,
                                         QEMUIOVector *qiov, int flags)
 {
+    BDRVNullState *s = bs->opaque;
+
+    if (s->zones) {
+        int ret;
+
+        qemu_co_mutex_lock(&s->zone_lock);
+        ret = null_zone_write(s, offset, bytes);
+        qemu_co_mutex_unlock(&s->zone_lock);
+        if (ret < 0) {
+            return ret;
+        }
+    }
+
+    return null_co_common(bs);
+}
+
+static int coroutine_fn null_co_zone_report(BlockDriverState *bs,
+                                            int64_t offset,
+                                            unsigned int *nr_zones,
+                                            BlockZoneDescriptor *zones)
+{
+    BDRVNullState *s = bs->opaque;
+    unsigned int idx = offset / s->zone_size;
+    unsigned int i;
+
+    if (offset < 0 || offset >= s->length) {
+        return -EINVAL;
+    }
+
+    qemu_co_mutex_lock(&s->zone_lock);
+    *nr_zones = MIN(*nr_zones, s->nr_zones - idx);
+    for (i = 0; i < *nr_zones; i++, idx++) {
+        zones[i] = (BlockZoneDescriptor) {
+            .start  = null_zone_start(s, idx),
+            .length = null_zone_end(s, idx) - null_zone_start(s, idx),
+            .cap    = null_zone_end(s, idx) - null_zone_start(s, idx),
+            .wp     = s->zones[idx].wp,
+            .type   = BLK_ZT_SWR,
+            .state  = s->zones[idx].state,
+        };
+    }
+    qemu_co_mutex_unlock(&s->zone_lock);
+
+    return null_co_common(bs);
+}
+
+static int coroutine_fn null_co_zone_mgmt(BlockDriverState *bs,
+                                          BlockZoneOp op,
+                                          int64_t offset, int64_t len)
+{
+    BDRVNullState *s = bs->opaque;
+    int64_t zone_mask = s->zone_size - 1;
+    unsigned int idx;
+
+    if (offset < 0 || len <= 0 || (offset & zone_mask)) {
+        return -EINVAL;
+    }
+    /* The last zone may be smaller than the others */
+    if (offset + len > s->length ||
+        (offset + len < s->length && (len & zone_mask))) {
+        return -EINVAL;
+    }
+
+    qemu_co_mutex_lock(&s->zone_lock);
+    for (idx = offset / s->zone_size;
+         null_zone_start(s, idx) < offset + len; idx++) {
+        null_zone_mgmt_one(s, op, idx);
+    }
+    qemu_co_mutex_unlock(&s->zone_lock);
+
+    return null_co_common(bs);
+}
+
+static int coroutine_fn null_co_zone_append(BlockDriverState *bs,
+                                            int64_t *offset,
+                                            QEMUIOVector *qiov,
+                                            BdrvRequestFlags flags)
+{
+    BDRVNullState *s = bs->opaque;
+    int ret;
+
+    if (*offset < 0 || *offset >= s->length ||
+        (*offset & (s->zone_size - 1)) ||
+        qiov->size % BDRV_SECTOR_SIZE) {
+        return -EINVAL;
+    }
+
+    qemu_co_mutex_lock(&s->zone_lock);
+    *offset = s->zones[*offset / s->zone_size].wp;
+    ret = null_zone_write(s, *offset, qiov->size);
+    qemu_co_mutex_unlock(&s->zone_lock);
+    if (ret < 0) {
+        return ret;
+    }
+
     return null_co_common(bs);
 }
 
@@ -270,6 +507,7 @@ static int64_t null_allocated_file_size(BlockDriverState *bs)
 static const char *const null_strong_runtime_opts[] = {
     BLOCK_OPT_SIZE,
     NULL_OPT_ZEROES,
+    NULL_OPT_ZONE_SIZE,
 
     NULL
 };
@@ -280,6 +518,7 @@ static BlockDriver bdrv_null_co = {
     .instance_size          = sizeof(BDRVNullState),
 
     .bdrv_file_open         = null_file_open,
+    .bdrv_close             = null_close,
     .bdrv_parse_filename    = null_co_parse_filename,
     .bdrv_getlength         = null_getlength,
     .bdrv_get_allocated_file_size = null_allocated_file_size,
@@ -288,9 +527,14 @@ static BlockDriver bdrv_null_co = {
     .bdrv_co_pwritev        = null_co_pwritev,
     .bdrv_co_flush_to_disk  = null_co_flush,
     .bdrv_reopen_prepare    = null_reopen_prepare,
+    .bdrv_refresh_limits    = null_refresh_limits,
 
     .bdrv_co_block_status   = null_co_block_status,
 
+    .bdrv_co_zone_report    = null_co_zone_report,
+    .bdrv_co_zone_mgmt      = null_co_zone_mgmt,
+    .bdrv_co_zone_append    = null_co_zone_append,
+
     .bdrv_refresh_filename  = null_refresh_filename,
     .strong_runtime_opts    = null_strong_runtime_opts,
 };
@@ -301,6 +545,7 @@ static BlockDriver bdrv_null_aio = {
     .instance_size          = sizeof(BDRVNullState),
 
     .bdrv_file_open         = null_file_open,
+    .bdrv_close             = null_close,
     .bdrv_parse_filename    = null_aio_parse_filename,
     .bdrv_getlength         = null_getlength,
     .bdrv_get_allocated_file_size = null_allocated_file_size,
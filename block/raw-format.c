@@ -371,12 +371,26 @@ static int raw_get_info(BlockDriverState *bs, BlockDriverInfo *bdi)
 
 static void raw_refresh_limits(BlockDriverState *bs, Error **errp)
 {
+    BDRVRawState *s = bs->opaque;
+    BlockLimits *file_bl = &bs->file->bs->bl;
+
     if (bs->probed) {
         /* To make it easier to protect the first sector, any probed
          * image is restricted to read-modify-write on sub-sector
          * operations. */
         bs->bl.request_alignment = BDRV_SECTOR_SIZE;
     }
+
+    /* Zones can only be passed through if the whole device is exposed */
+    if (!s->offset && !s->has_size) {
+        bs->bl.zoned = file_bl->zoned;
+        bs->bl.zone_size = file_bl->zone_size;
+        bs->bl.nr_zones = file_bl->nr_zones;
+        bs->bl.max_append_sectors = file_bl->max_append_sectors;
+        bs->bl.max_open_zones = file_bl->max_open_zones;
+        bs->bl.max_active_zones = file_bl->max_active_zones;
+        bs->bl.write_granularity = file_bl->write_granularity;
+    }
 }
 
 static int coroutine_fn raw_co_truncate(BlockDriverState *bs, int64_t offset,
@@ -419,6 +433,28 @@ static int raw_co_ioctl(BlockDriverState *bs, unsigned long int req, void *buf)
     return bdrv_co_ioctl(bs->file->bs, req, buf);
 }
 
+static int coroutine_fn raw_co_zone_report(BlockDriverState *bs,
+                                           int64_t offset,
+                                           unsigned int *nr_zones,
+                                           BlockZoneDescriptor *zones)
+{
+    return bdrv_co_zone_report(bs->file->bs, offset, nr_zones, zones);
+}
+
+static int coroutine_fn raw_co_zone_mgmt(BlockDriverState *bs, BlockZoneOp op,
+                                         int64_t offset, int64_t len)
+{
+    return bdrv_co_zone_mgmt(bs->file->bs, op, offset, len);
+}
+
+static int coroutine_fn raw_co_zone_append(BlockDriverState *bs,
+                                           int64_t *offset,
+                                           QEMUIOVector *qiov,
+                                           BdrvRequestFlags flags)
+{
+    return bdrv_co_zone_append(bs->file->bs, offset, qiov, flags);
+}
+
 static int raw_has_zero_init(BlockDriverState *bs)
 {
     return bdrv_has_zero_init(bs->file->bs);
@@ -604,6 +640,9 @@ BlockDriver bdrv_raw = {
     .bdrv_eject           = &raw_eject,
     .bdrv_lock_medium     = &raw_lock_medium,
     .bdrv_co_ioctl        = &raw_co_ioctl,
+    .bdrv_co_zone_report  = &raw_co_zone_report,
+    .bdrv_co_zone_mgmt    = &raw_co_zone_mgmt,
+    .bdrv_co_zone_append  = &raw_co_zone_append,
     .create_opts          = &raw_create_opts,
     .bdrv_has_zero_init   = &raw_has_zero_init,
     .strong_runtime_opts  = raw_strong_runtime_opts,
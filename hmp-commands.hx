@@ -988,8 +988,8 @@ ERST
         .args_type  = "value:o",
         .params     = "value",
         .help       = "set cache size (in bytes) for XBZRLE migrations,"
-                      "the cache size will be rounded down to the nearest "
-                      "power of 2.\n"
+                      "the cache size will be rounded down to a multiple "
+                      "of the page size.\n"
                       "The cache size affects the number of cache misses."
                       "In case of a high cache miss ratio you need to increase"
                       " the cache size",
@@ -30,6 +30,13 @@
 #include "sysemu/sysemu.h"
 #include "sysemu/runstate.h"
 
+/*
+ * The config space exposed by vhost-user-blk stops before the secure erase
+ * and zoned fields, which are not negotiated with the backend.
+ */
+#define VHOST_USER_BLK_CFG_SIZE offsetof(struct virtio_blk_config, \
+                                         max_secure_erase_sectors)
+
 static const int user_feature_bits[] = {
     VIRTIO_BLK_F_SIZE_MAX,
     VIRTIO_BLK_F_SEG_MAX,
@@ -53,7 +60,7 @@ static void vhost_user_blk_update_config(VirtIODevice *vdev, uint8_t *config)
 {
     VHostUserBlk *s = VHOST_USER_BLK(vdev);
 
-    memcpy(config, &s->blkcfg, sizeof(struct virtio_blk_config));
+    memcpy(config, &s->blkcfg, VHOST_USER_BLK_CFG_SIZE);
 }
 
 static void vhost_user_blk_set_config(VirtIODevice *vdev, const uint8_t *config)
@@ -85,7 +92,7 @@ static int vhost_user_blk_handle_config_change(struct vhost_dev *dev)
     VHostUserBlk *s = VHOST_USER_BLK(dev->vdev);
 
     ret = vhost_dev_get_config(dev, (uint8_t *)&blkcfg,
-                               sizeof(struct virtio_blk_config));
+                               VHOST_USER_BLK_CFG_SIZE);
     if (ret < 0) {
         error_report("get config space failed");
         return -1;
@@ -94,7 +101,7 @@ static int vhost_user_blk_handle_config_change(struct vhost_dev *dev)
     /* valid for resize only */
     if (blkcfg.capacity != s->blkcfg.capacity) {
         s->blkcfg.capacity = blkcfg.capacity;
-        memcpy(dev->vdev->config, &s->blkcfg, sizeof(struct virtio_blk_config));
+        memcpy(dev->vdev->config, &s->blkcfg, VHOST_USER_BLK_CFG_SIZE);
         virtio_notify_config(dev->vdev);
     }
 
@@ -451,7 +458,7 @@ static void vhost_user_blk_device_realize(DeviceState *dev, Error **errp)
     }
 
     virtio_init(vdev, "virtio-blk", VIRTIO_ID_BLOCK,
-                sizeof(struct virtio_blk_config));
+                VHOST_USER_BLK_CFG_SIZE);
 
     s->virtqs = g_new(VirtQueue *, s->num_queues);
     for (i = 0; i < s->num_queues; i++) {
@@ -478,7 +485,7 @@ reconnect:
     }
 
     ret = vhost_dev_get_config(&s->dev, (uint8_t *)&s->blkcfg,
-                               sizeof(struct virtio_blk_config));
+                               VHOST_USER_BLK_CFG_SIZE);
     if (ret < 0) {
         error_report("vhost-user-blk: get block config failed");
         goto reconnect;
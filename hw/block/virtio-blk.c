@@ -45,6 +45,8 @@ static VirtIOFeature feature_sizes[] = {
      .end = endof(struct virtio_blk_config, discard_sector_alignment)},
     {.flags = 1ULL << VIRTIO_BLK_F_WRITE_ZEROES,
      .end = endof(struct virtio_blk_config, write_zeroes_may_unmap)},
+    {.flags = 1ULL << VIRTIO_BLK_F_ZONED,
+     .end = endof(struct virtio_blk_config, zoned)},
     {}
 };
 
@@ -69,7 +71,7 @@ static void virtio_blk_init_request(VirtIOBlock *s, VirtQueue *vq,
 
 static void virtio_blk_free_request(VirtIOBlockReq *req)
 {
-    g_free(req);
+    virtqueue_element_free(req);
 }
 
 static void virtio_blk_req_complete(VirtIOBlockReq *req, unsigned char status)
@@ -253,16 +255,6 @@ out:
 
 #endif
 
-static VirtIOBlockReq *virtio_blk_get_request(VirtIOBlock *s, VirtQueue *vq)
-{
-    VirtIOBlockReq *req = virtqueue_pop(vq, sizeof(VirtIOBlockReq));
-
-    if (req) {
-        virtio_blk_init_request(s, vq, req);
-    }
-    return req;
-}
-
 static int virtio_blk_handle_scsi_req(VirtIOBlockReq *req)
 {
     int status = VIRTIO_BLK_S_OK;
@@ -446,19 +438,51 @@ static int multireq_compare(const void *a, const void *b)
     }
 }
 
+/*
+ * Update the merge statistics after submitting @num_reqs requests of which
+ * @merged were combined with a neighbour.  The moving average of the merge
+ * ratio decides whether requests are held back for the merge window, and
+ * the MultiReqBuffer limit grows while full buffers keep merging well and
+ * shrinks back when they do not.
+ */
+static void virtio_blk_merge_account(VirtIOBlock *s, unsigned int num_reqs,
+                                     unsigned int merged)
+{
+    unsigned int ratio = merged * VIRTIO_BLK_MERGE_RATIO_ONE / num_reqs;
+
+    s->merged_reqs += merged;
+    s->unmerged_reqs += num_reqs - merged;
+    s->merge_ratio = (s->merge_ratio * 7 + ratio) / 8;
+
+    if (num_reqs >= s->merge_max_reqs &&
+        ratio >= VIRTIO_BLK_MERGE_RATIO_ONE / 2) {
+        s->merge_max_reqs = MIN(s->merge_max_reqs * 2,
+                                VIRTIO_BLK_MAX_MERGE_REQS);
+    } else if (ratio < VIRTIO_BLK_MERGE_RATIO_ONE / 4) {
+        s->merge_max_reqs = MAX(s->merge_max_reqs / 2,
+                                VIRTIO_BLK_MIN_MERGE_REQS);
+    }
+
+    trace_virtio_blk_merge_account(s, num_reqs, merged, s->merge_ratio,
+                                   s->merge_max_reqs);
+}
+
 static void virtio_blk_submit_multireq(BlockBackend *blk, MultiReqBuffer *mrb)
 {
     int i = 0, start = 0, num_reqs = 0, niov = 0, nb_sectors = 0;
+    unsigned int merged = 0;
+    VirtIOBlock *s = mrb->reqs[0]->dev;
     uint32_t max_transfer;
     int64_t sector_num = 0;
 
     if (mrb->num_reqs == 1) {
         submit_requests(blk, mrb, 0, 1, -1);
+        virtio_blk_merge_account(s, 1, 0);
         mrb->num_reqs = 0;
         return;
     }
 
-    max_transfer = blk_get_max_transfer(mrb->reqs[0]->dev->blk);
+    max_transfer = blk_get_max_transfer(s->blk);
 
     qsort(mrb->reqs, mrb->num_reqs, sizeof(*mrb->reqs),
           &multireq_compare);
@@ -478,6 +502,7 @@ static void virtio_blk_submit_multireq(BlockBackend *blk, MultiReqBuffer *mrb)
                 nb_sectors > (max_transfer -
                               req->qiov.size) / BDRV_SECTOR_SIZE) {
                 submit_requests(blk, mrb, start, num_reqs, niov);
+                merged += num_reqs > 1 ? num_reqs : 0;
                 num_reqs = 0;
             }
         }
@@ -494,6 +519,8 @@ static void virtio_blk_submit_multireq(BlockBackend *blk, MultiReqBuffer *mrb)
     }
 
     submit_requests(blk, mrb, start, num_reqs, niov);
+    merged += num_reqs > 1 ? num_reqs : 0;
+    virtio_blk_merge_account(s, mrb->num_reqs, merged);
     mrb->num_reqs = 0;
 }
 
@@ -613,6 +640,326 @@ err:
     return err_status;
 }
 
+typedef struct ZoneCmdData {
+    VirtIOBlockReq *req;
+    struct iovec *in_iov;
+    unsigned in_num;
+    union {
+        struct {
+            unsigned int nr_zones;
+            BlockZoneDescriptor *zones;
+        } zone_report_data;
+        struct {
+            int64_t offset;
+        } zone_append_data;
+    };
+} ZoneCmdData;
+
+static uint8_t virtio_blk_zone_status(int ret)
+{
+    switch (-ret) {
+    case 0:
+        return VIRTIO_BLK_S_OK;
+    case EIO:
+        return VIRTIO_BLK_S_IOERR;
+#ifdef ETOOMANYREFS
+    case ETOOMANYREFS:
+        return VIRTIO_BLK_S_ZONE_OPEN_RESOURCE;
+#endif
+    case EOVERFLOW:
+        return VIRTIO_BLK_S_ZONE_ACTIVE_RESOURCE;
+    default:
+        return VIRTIO_BLK_S_ZONE_INVALID_CMD;
+    }
+}
+
+static void virtio_blk_zone_report_complete(void *opaque, int ret)
+{
+    ZoneCmdData *data = opaque;
+    VirtIOBlockReq *req = data->req;
+    VirtIOBlock *s = req->dev;
+    VirtIODevice *vdev = VIRTIO_DEVICE(s);
+    unsigned int nrz = data->zone_report_data.nr_zones;
+    BlockZoneDescriptor *zones = data->zone_report_data.zones;
+    struct virtio_blk_zone_report hdr = {};
+    struct virtio_blk_zone_descriptor desc;
+    size_t n, offset;
+    unsigned int i;
+    uint8_t status = VIRTIO_BLK_S_OK;
+
+    aio_context_acquire(blk_get_aio_context(s->conf.conf.blk));
+    trace_virtio_blk_zone_report_complete(vdev, req, nrz, ret);
+    if (ret) {
+        status = virtio_blk_zone_status(ret);
+        goto out;
+    }
+
+    virtio_stq_p(vdev, &hdr.nr_zones, nrz);
+    n = iov_from_buf(data->in_iov, data->in_num, 0, &hdr, sizeof(hdr));
+    if (n != sizeof(hdr)) {
+        status = VIRTIO_BLK_S_ZONE_INVALID_CMD;
+        goto out;
+    }
+
+    offset = sizeof(hdr);
+    for (i = 0; i < nrz; i++) {
+        memset(&desc, 0, sizeof(desc));
+        virtio_stq_p(vdev, &desc.z_start,
+                     zones[i].start >> BDRV_SECTOR_BITS);
+        virtio_stq_p(vdev, &desc.z_cap, zones[i].cap >> BDRV_SECTOR_BITS);
+        virtio_stq_p(vdev, &desc.z_wp, zones[i].wp >> BDRV_SECTOR_BITS);
+        /* BlockZoneType and BlockZoneState share the virtio encoding */
+        desc.z_type = zones[i].type;
+        desc.z_state = zones[i].state;
+
+        n = iov_from_buf(data->in_iov, data->in_num, offset,
+                         &desc, sizeof(desc));
+        if (n != sizeof(desc)) {
+            status = VIRTIO_BLK_S_ZONE_INVALID_CMD;
+            goto out;
+        }
+        offset += sizeof(desc);
+    }
+
+out:
+    virtio_blk_req_complete(req, status);
+    virtio_blk_free_request(req);
+    aio_context_release(blk_get_aio_context(s->conf.conf.blk));
+    g_free(zones);
+    g_free(data);
+}
+
+static void virtio_blk_handle_zone_report(VirtIOBlockReq *req,
+                                          struct iovec *in_iov,
+                                          unsigned in_num)
+{
+    VirtIOBlock *s = req->dev;
+    VirtIODevice *vdev = VIRTIO_DEVICE(s);
+    BlockZoneInfo zi;
+    unsigned int nr_zones;
+    ZoneCmdData *data;
+    int64_t offset;
+    uint64_t capacity;
+    size_t in_len = iov_size(in_iov, in_num);
+
+    blk_get_geometry(s->blk, &capacity);
+    blk_get_zone_info(s->blk, &zi);
+    offset = virtio_ldq_p(vdev, &req->out.sector) << BDRV_SECTOR_BITS;
+
+    if (in_len < sizeof(struct virtio_blk_zone_report) ||
+        offset >= capacity << BDRV_SECTOR_BITS) {
+        virtio_blk_req_complete(req, VIRTIO_BLK_S_ZONE_INVALID_CMD);
+        virtio_blk_free_request(req);
+        return;
+    }
+
+    /* Never report more zones than the device has */
+    nr_zones = MIN((in_len - sizeof(struct virtio_blk_zone_report)) /
+                   sizeof(struct virtio_blk_zone_descriptor),
+                   zi.nr_zones);
+    trace_virtio_blk_handle_zone_report(vdev, req,
+                                        offset >> BDRV_SECTOR_BITS, nr_zones);
+
+    data = g_new(ZoneCmdData, 1);
+    data->req = req;
+    data->in_iov = in_iov;
+    data->in_num = in_num;
+    data->zone_report_data.nr_zones = nr_zones;
+    data->zone_report_data.zones = g_new0(BlockZoneDescriptor, nr_zones);
+
+    blk_aio_zone_report(s->blk, offset, &data->zone_report_data.nr_zones,
+                        data->zone_report_data.zones,
+                        virtio_blk_zone_report_complete, data);
+}
+
+static void virtio_blk_zone_mgmt_complete(void *opaque, int ret)
+{
+    VirtIOBlockReq *req = opaque;
+    VirtIOBlock *s = req->dev;
+
+    aio_context_acquire(blk_get_aio_context(s->conf.conf.blk));
+    trace_virtio_blk_zone_mgmt_complete(VIRTIO_DEVICE(s), req, ret);
+    virtio_blk_req_complete(req, virtio_blk_zone_status(ret));
+    virtio_blk_free_request(req);
+    aio_context_release(blk_get_aio_context(s->conf.conf.blk));
+}
+
+static void virtio_blk_handle_zone_mgmt(VirtIOBlockReq *req, BlockZoneOp op,
+                                        bool all)
+{
+    VirtIOBlock *s = req->dev;
+    VirtIODevice *vdev = VIRTIO_DEVICE(s);
+    BlockZoneInfo zi;
+    uint64_t capacity;
+    int64_t offset, len;
+
+    blk_get_geometry(s->blk, &capacity);
+    blk_get_zone_info(s->blk, &zi);
+    capacity <<= BDRV_SECTOR_BITS;
+
+    if (all) {
+        offset = 0;
+        len = capacity;
+    } else {
+        offset = virtio_ldq_p(vdev, &req->out.sector) << BDRV_SECTOR_BITS;
+        len = zi.zone_size;
+        /* The last zone may be smaller than the others */
+        if (offset < capacity && offset + len > capacity) {
+            len = capacity - offset;
+        }
+    }
+
+    trace_virtio_blk_handle_zone_mgmt(vdev, req, op,
+                                      offset >> BDRV_SECTOR_BITS,
+                                      len >> BDRV_SECTOR_BITS);
+
+    if (!zi.zone_size || offset >= capacity || offset % zi.zone_size) {
+        virtio_blk_req_complete(req, VIRTIO_BLK_S_ZONE_INVALID_CMD);
+        virtio_blk_free_request(req);
+        return;
+    }
+
+    blk_aio_zone_mgmt(s->blk, op, offset, len,
+                      virtio_blk_zone_mgmt_complete, req);
+}
+
+static void virtio_blk_zone_append_complete(void *opaque, int ret)
+{
+    ZoneCmdData *data = opaque;
+    VirtIOBlockReq *req = data->req;
+    VirtIOBlock *s = req->dev;
+    VirtIODevice *vdev = VIRTIO_DEVICE(s);
+    int64_t append_sector;
+    uint8_t status = VIRTIO_BLK_S_OK;
+
+    aio_context_acquire(blk_get_aio_context(s->conf.conf.blk));
+    if (ret) {
+        status = virtio_blk_zone_status(ret);
+        block_acct_failed(blk_get_stats(s->blk), &req->acct);
+        goto out;
+    }
+
+    append_sector = data->zone_append_data.offset >> BDRV_SECTOR_BITS;
+    trace_virtio_blk_zone_append_complete(vdev, req, append_sector, ret);
+
+    virtio_stq_p(vdev, &append_sector, append_sector);
+    if (iov_from_buf(data->in_iov, data->in_num, 0, &append_sector,
+                     sizeof(append_sector)) != sizeof(append_sector)) {
+        status = VIRTIO_BLK_S_ZONE_INVALID_CMD;
+        block_acct_failed(blk_get_stats(s->blk), &req->acct);
+        goto out;
+    }
+    block_acct_done(blk_get_stats(s->blk), &req->acct);
+
+out:
+    virtio_blk_req_complete(req, status);
+    virtio_blk_free_request(req);
+    aio_context_release(blk_get_aio_context(s->conf.conf.blk));
+    g_free(data);
+}
+
+static void virtio_blk_handle_zone_append(VirtIOBlockReq *req,
+                                          struct iovec *out_iov,
+                                          unsigned out_num,
+                                          struct iovec *in_iov,
+                                          unsigned in_num)
+{
+    VirtIOBlock *s = req->dev;
+    VirtIODevice *vdev = VIRTIO_DEVICE(s);
+    ZoneCmdData *data;
+    int64_t offset;
+
+    offset = virtio_ldq_p(vdev, &req->out.sector) << BDRV_SECTOR_BITS;
+    qemu_iovec_init_external(&req->qiov, out_iov, out_num);
+    trace_virtio_blk_handle_zone_append(vdev, req,
+                                        offset >> BDRV_SECTOR_BITS,
+                                        req->qiov.size >> BDRV_SECTOR_BITS);
+
+    if (iov_size(in_iov, in_num) < sizeof(int64_t) ||
+        !virtio_blk_sect_range_ok(s, offset >> BDRV_SECTOR_BITS,
+                                  req->qiov.size)) {
+        virtio_blk_req_complete(req, VIRTIO_BLK_S_ZONE_INVALID_CMD);
+        block_acct_invalid(blk_get_stats(s->blk), BLOCK_ACCT_WRITE);
+        virtio_blk_free_request(req);
+        return;
+    }
+
+    data = g_new(ZoneCmdData, 1);
+    data->req = req;
+    data->in_iov = in_iov;
+    data->in_num = in_num;
+    data->zone_append_data.offset = offset;
+
+    block_acct_start(blk_get_stats(s->blk), &req->acct, req->qiov.size,
+                     BLOCK_ACCT_WRITE);
+    blk_aio_zone_append(s->blk, &data->zone_append_data.offset, &req->qiov, 0,
+                        virtio_blk_zone_append_complete, data);
+}
+
+/*
+ * The zoned commands are dispatched on the type without masking
+ * VIRTIO_BLK_T_OUT: VIRTIO_BLK_T_ZONE_APPEND is the only one that has it
+ * set, and it would otherwise be taken for VIRTIO_BLK_T_SECURE_ERASE.
+ * The management commands sent with VIRTIO_BLK_T_OUT are not zoned
+ * commands and are rejected by the caller.
+ *
+ * Returns false if @type is not a zoned command.
+ */
+static bool virtio_blk_handle_zone_request(VirtIOBlockReq *req, uint32_t type,
+                                           struct iovec *out_iov,
+                                           unsigned out_num,
+                                           struct iovec *in_iov,
+                                           unsigned in_num)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(req->dev);
+
+    switch (type) {
+    case VIRTIO_BLK_T_ZONE_APPEND:
+    case VIRTIO_BLK_T_ZONE_REPORT:
+    case VIRTIO_BLK_T_ZONE_OPEN:
+    case VIRTIO_BLK_T_ZONE_CLOSE:
+    case VIRTIO_BLK_T_ZONE_FINISH:
+    case VIRTIO_BLK_T_ZONE_RESET:
+    case VIRTIO_BLK_T_ZONE_RESET_ALL:
+        break;
+    default:
+        return false;
+    }
+
+    if (!virtio_vdev_has_feature(vdev, VIRTIO_BLK_F_ZONED)) {
+        virtio_blk_req_complete(req, VIRTIO_BLK_S_UNSUPP);
+        virtio_blk_free_request(req);
+        return true;
+    }
+
+    switch (type) {
+    case VIRTIO_BLK_T_ZONE_APPEND:
+        virtio_blk_handle_zone_append(req, out_iov, out_num, in_iov, in_num);
+        break;
+    case VIRTIO_BLK_T_ZONE_REPORT:
+        virtio_blk_handle_zone_report(req, in_iov, in_num);
+        break;
+    case VIRTIO_BLK_T_ZONE_OPEN:
+        virtio_blk_handle_zone_mgmt(req, BLK_ZO_OPEN, false);
+        break;
+    case VIRTIO_BLK_T_ZONE_CLOSE:
+        virtio_blk_handle_zone_mgmt(req, BLK_ZO_CLOSE, false);
+        break;
+    case VIRTIO_BLK_T_ZONE_FINISH:
+        virtio_blk_handle_zone_mgmt(req, BLK_ZO_FINISH, false);
+        break;
+    case VIRTIO_BLK_T_ZONE_RESET:
+        virtio_blk_handle_zone_mgmt(req, BLK_ZO_RESET, false);
+        break;
+    case VIRTIO_BLK_T_ZONE_RESET_ALL:
+        virtio_blk_handle_zone_mgmt(req, BLK_ZO_RESET, true);
+        break;
+    default:
+        g_assert_not_reached();
+    }
+    return true;
+}
+
 static int virtio_blk_handle_request(VirtIOBlockReq *req, MultiReqBuffer *mrb)
 {
     uint32_t type;
@@ -653,6 +1000,11 @@ static int virtio_blk_handle_request(VirtIOBlockReq *req, MultiReqBuffer *mrb)
 
     type = virtio_ldl_p(vdev, &req->out.type);
 
+    if (virtio_blk_handle_zone_request(req, type & ~VIRTIO_BLK_T_BARRIER,
+                                       out_iov, out_num, in_iov, in_num)) {
+        return 0;
+    }
+
     /* VIRTIO_BLK_T_OUT defines the command direction. VIRTIO_BLK_T_BARRIER
      * is an optional flag. Although a guest should not send this flag if
      * not negotiated we ignored it in the past. So keep ignoring it. */
@@ -685,7 +1037,7 @@ static int virtio_blk_handle_request(VirtIOBlockReq *req, MultiReqBuffer *mrb)
 
         /* merge would exceed maximum number of requests or IO direction
          * changes */
-        if (mrb->num_reqs > 0 && (mrb->num_reqs == VIRTIO_BLK_MAX_MERGE_REQS ||
+        if (mrb->num_reqs > 0 && (mrb->num_reqs >= s->merge_max_reqs ||
                                   is_write != mrb->is_write ||
                                   !s->conf.request_merging)) {
             virtio_blk_submit_multireq(s->blk, mrb);
@@ -767,12 +1119,68 @@ static int virtio_blk_handle_request(VirtIOBlockReq *req, MultiReqBuffer *mrb)
     return 0;
 }
 
+static void virtio_blk_merge_timer_cb(void *opaque)
+{
+    VirtIOBlock *s = opaque;
+    AioContext *ctx = blk_get_aio_context(s->blk);
+
+    aio_context_acquire(ctx);
+    if (s->mrb.num_reqs) {
+        trace_virtio_blk_merge_window_expired(s, s->mrb.num_reqs);
+        blk_io_plug(s->blk);
+        virtio_blk_submit_multireq(s->blk, &s->mrb);
+        blk_io_unplug(s->blk);
+    }
+    blk_dec_in_flight(s->blk);
+    aio_context_release(ctx);
+}
+
+/*
+ * Decide whether the requests in s->mrb may wait for the next handler pass
+ * so that sequential requests arriving shortly after can be merged.  Only
+ * done while recent submissions actually merged, to avoid adding latency
+ * for random I/O.  The deadline is set by the first held request; held
+ * requests count as in flight so that draining submits them.
+ */
+static bool virtio_blk_merge_window_hold(VirtIOBlock *s)
+{
+    AioContext *ctx = blk_get_aio_context(s->blk);
+
+    if (!s->conf.merge_window_us || !s->conf.request_merging ||
+        s->merge_ratio < VIRTIO_BLK_MERGE_RATIO_ONE / 2) {
+        return false;
+    }
+
+    if (s->merge_timer && timer_pending(s->merge_timer)) {
+        return true;
+    }
+
+    if (s->merge_timer && s->merge_timer_ctx != ctx) {
+        timer_free(s->merge_timer);
+        s->merge_timer = NULL;
+    }
+    if (!s->merge_timer) {
+        s->merge_timer = aio_timer_new(ctx, QEMU_CLOCK_REALTIME, SCALE_US,
+                                       virtio_blk_merge_timer_cb, s);
+        s->merge_timer_ctx = ctx;
+    }
+
+    blk_inc_in_flight(s->blk);
+    timer_mod(s->merge_timer, qemu_clock_get_us(QEMU_CLOCK_REALTIME) +
+                              s->conf.merge_window_us);
+    trace_virtio_blk_merge_window_hold(s, s->mrb.num_reqs);
+    return true;
+}
+
 bool virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
 {
-    VirtIOBlockReq *req;
-    MultiReqBuffer mrb = {};
+    VirtIOBlockReq *reqs[VIRTIO_BLK_POP_BATCH];
+    MultiReqBuffer local_mrb = {};
+    MultiReqBuffer *mrb = s->conf.merge_window_us ? &s->mrb : &local_mrb;
     bool suppress_notifications = virtio_queue_get_notification(vq);
     bool progress = false;
+    bool failed = false;
+    unsigned int i, n;
 
     aio_context_acquire(blk_get_aio_context(s->blk));
     blk_io_plug(s->blk);
@@ -782,12 +1190,23 @@ bool virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
             virtio_queue_set_notification(vq, 0);
         }
 
-        while ((req = virtio_blk_get_request(s, vq))) {
+        while (!failed &&
+               (n = virtqueue_pop_batch(vq, sizeof(VirtIOBlockReq),
+                                        (void **)reqs, ARRAY_SIZE(reqs)))) {
             progress = true;
-            if (virtio_blk_handle_request(req, &mrb)) {
-                virtqueue_detach_element(req->vq, &req->elem, 0);
-                virtio_blk_free_request(req);
-                break;
+            for (i = 0; i < n; i++) {
+                if (failed) {
+                    /* The device is broken, drop the rest of the batch */
+                    virtqueue_detach_element(vq, &reqs[i]->elem, 0);
+                    virtio_blk_free_request(reqs[i]);
+                    continue;
+                }
+                virtio_blk_init_request(s, vq, reqs[i]);
+                if (virtio_blk_handle_request(reqs[i], mrb)) {
+                    virtqueue_detach_element(vq, &reqs[i]->elem, 0);
+                    virtio_blk_free_request(reqs[i]);
+                    failed = true;
+                }
             }
         }
 
@@ -796,8 +1215,8 @@ bool virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq)
         }
     } while (!virtio_queue_empty(vq));
 
-    if (mrb.num_reqs) {
-        virtio_blk_submit_multireq(s->blk, &mrb);
+    if (mrb->num_reqs && !virtio_blk_merge_window_hold(s)) {
+        virtio_blk_submit_multireq(s->blk, mrb);
     }
 
     blk_io_unplug(s->blk);
@@ -979,6 +1398,22 @@ static void virtio_blk_update_config(VirtIODevice *vdev, uint8_t *config)
         blkcfg.write_zeroes_may_unmap = 1;
         virtio_stl_p(vdev, &blkcfg.max_write_zeroes_seg, 1);
     }
+    if (virtio_has_feature(s->host_features, VIRTIO_BLK_F_ZONED)) {
+        BlockZoneInfo zi;
+
+        blk_get_zone_info(s->blk, &zi);
+        virtio_stl_p(vdev, &blkcfg.zoned.zone_sectors,
+                     zi.zone_size >> BDRV_SECTOR_BITS);
+        virtio_stl_p(vdev, &blkcfg.zoned.max_open_zones, zi.max_open_zones);
+        virtio_stl_p(vdev, &blkcfg.zoned.max_active_zones,
+                     zi.max_active_zones);
+        virtio_stl_p(vdev, &blkcfg.zoned.max_append_sectors,
+                     zi.max_append_sectors);
+        virtio_stl_p(vdev, &blkcfg.zoned.write_granularity,
+                     zi.write_granularity);
+        blkcfg.zoned.model = zi.model == BLK_Z_HM ? VIRTIO_BLK_Z_HM :
+                                                    VIRTIO_BLK_Z_HA;
+    }
     memcpy(config, &blkcfg, s->config_size);
 }
 
@@ -1207,6 +1642,18 @@ static void virtio_blk_device_realize(DeviceState *dev, Error **errp)
         return;
     }
 
+    if (virtio_has_feature(s->host_features, VIRTIO_BLK_F_ZONED)) {
+        BlockZoneInfo zi;
+
+        blk_get_zone_info(conf->conf.blk, &zi);
+        if (zi.model == BLK_Z_NONE) {
+            virtio_clear_feature(&s->host_features, VIRTIO_BLK_F_ZONED);
+        } else if (zi.model == BLK_Z_HM) {
+            /* Discarding data in a sequential zone would move its wp */
+            virtio_clear_feature(&s->host_features, VIRTIO_BLK_F_DISCARD);
+        }
+    }
+
     virtio_blk_set_config_size(s, s->host_features);
 
     virtio_init(vdev, "virtio-blk", VIRTIO_ID_BLOCK, s->config_size);
@@ -1214,6 +1661,8 @@ static void virtio_blk_device_realize(DeviceState *dev, Error **errp)
     s->blk = conf->conf.blk;
     s->rq = NULL;
     s->sector_mask = (s->conf.conf.logical_block_size / BDRV_SECTOR_SIZE) - 1;
+    s->merge_max_reqs = VIRTIO_BLK_MIN_MERGE_REQS;
+    s->merge_ratio = VIRTIO_BLK_MERGE_RATIO_ONE;
 
     for (i = 0; i < conf->num_queues; i++) {
         virtio_add_queue(vdev, conf->queue_size, virtio_blk_handle_output);
@@ -1248,6 +1697,10 @@ static void virtio_blk_device_unrealize(DeviceState *dev)
     unsigned i;
 
     blk_drain(s->blk);
+    if (s->merge_timer) {
+        timer_free(s->merge_timer);
+        s->merge_timer = NULL;
+    }
     del_boot_device_lchs(dev, "/disk@0,0");
     virtio_blk_data_plane_destroy(s->dataplane);
     s->dataplane = NULL;
@@ -1266,6 +1719,10 @@ static void virtio_blk_instance_init(Object *obj)
     device_add_bootindex_property(obj, &s->conf.conf.bootindex,
                                   "bootindex", "/disk@0,0",
                                   DEVICE(obj));
+    object_property_add_uint64_ptr(obj, "merged-requests",
+                                   &s->merged_reqs, OBJ_PROP_FLAG_READ);
+    object_property_add_uint64_ptr(obj, "unmerged-requests",
+                                   &s->unmerged_reqs, OBJ_PROP_FLAG_READ);
 }
 
 static const VMStateDescription vmstate_virtio_blk = {
@@ -1293,12 +1750,16 @@ static Property virtio_blk_properties[] = {
                     true),
     DEFINE_PROP_UINT16("num-queues", VirtIOBlock, conf.num_queues,
                        VIRTIO_BLK_AUTO_NUM_QUEUES),
+    DEFINE_PROP_UINT32("merge-window-us", VirtIOBlock, conf.merge_window_us,
+                       0),
     DEFINE_PROP_UINT16("queue-size", VirtIOBlock, conf.queue_size, 256),
     DEFINE_PROP_BOOL("seg-max-adjust", VirtIOBlock, conf.seg_max_adjust, true),
     DEFINE_PROP_LINK("iothread", VirtIOBlock, conf.iothread, TYPE_IOTHREAD,
                      IOThread *),
     DEFINE_PROP_BIT64("discard", VirtIOBlock, host_features,
                       VIRTIO_BLK_F_DISCARD, true),
+    DEFINE_PROP_BIT64("zoned", VirtIOBlock, host_features,
+                      VIRTIO_BLK_F_ZONED, true),
     DEFINE_PROP_BIT64("write-zeroes", VirtIOBlock, host_features,
                       VIRTIO_BLK_F_WRITE_ZEROES, true),
     DEFINE_PROP_UINT32("max-discard-sectors", VirtIOBlock,
@@ -46,6 +46,12 @@ struct NetRxPkt {
     eth_ip6_hdr_info ip6hdr_info;
     eth_ip4_hdr_info ip4hdr_info;
     eth_l4_hdr_info  l4hdr_info;
+
+    /* Last RSS hash, reused for back-to-back packets of the same flow */
+    uint8_t rss_cache_input[36];
+    uint8_t rss_cache_key[sizeof(uint32_t) + 36];
+    size_t rss_cache_len;
+    uint32_t rss_cache_hash;
 };
 
 void net_rx_pkt_init(struct NetRxPkt **pkt, bool has_virt_hdr)
@@ -394,11 +400,24 @@ net_rx_pkt_calc_rss_hash(struct NetRxPkt *pkt,
         break;
     }
 
+    /* Toeplitz only uses the first rss_length + 4 bytes of the key */
+    if (rss_length && rss_length == pkt->rss_cache_len &&
+        !memcmp(rss_input, pkt->rss_cache_input, rss_length) &&
+        !memcmp(key, pkt->rss_cache_key, rss_length + sizeof(uint32_t))) {
+        trace_net_rx_pkt_rss_hash_cached(rss_length, pkt->rss_cache_hash);
+        return pkt->rss_cache_hash;
+    }
+
     net_toeplitz_key_init(&key_data, key);
     net_toeplitz_add(&rss_hash, rss_input, rss_length, &key_data);
 
     trace_net_rx_pkt_rss_hash(rss_length, rss_hash);
 
+    memcpy(pkt->rss_cache_input, rss_input, rss_length);
+    memcpy(pkt->rss_cache_key, key, rss_length + sizeof(uint32_t));
+    pkt->rss_cache_len = rss_length;
+    pkt->rss_cache_hash = rss_hash;
+
     return rss_hash;
 }
 
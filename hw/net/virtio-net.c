@@ -44,6 +44,8 @@
 #include "hw/pci/pci.h"
 #include "net_rx_pkt.h"
 #include "hw/virtio/vhost.h"
+#include "sysemu/iothread.h"
+#include "block/aio-wait.h"
 
 #define VIRTIO_NET_VM_VERSION    11
 
@@ -58,6 +60,16 @@
 #define VIRTIO_NET_RX_QUEUE_MIN_SIZE VIRTIO_NET_RX_QUEUE_DEFAULT_SIZE
 #define VIRTIO_NET_TX_QUEUE_MIN_SIZE VIRTIO_NET_TX_QUEUE_DEFAULT_SIZE
 
+/* Number of TX buffers taken off the ring per virtqueue_pop_batch() */
+#define VIRTIO_NET_TX_POP_BATCH 32
+
+/* Packets RSS may hand over to a queue pair serviced by another thread */
+#define VIRTIO_NET_RSS_STEER_MAX 256
+/* Size of the preallocated steered packets, bigger ones are allocated */
+#define VIRTIO_NET_RSS_STEER_SLOT_SIZE 2048
+#define VIRTIO_NET_RSS_STEER_SLOT_STRIDE \
+    (sizeof(VirtioNetSteeredPacket) + VIRTIO_NET_RSS_STEER_SLOT_SIZE)
+
 #define VIRTIO_NET_IP4_ADDR_SIZE   8        /* ipv4 saddr + daddr */
 
 #define VIRTIO_NET_TCP_FLAG         0x3F
@@ -189,6 +201,158 @@ static bool virtio_net_started(VirtIONet *n, uint8_t status)
         (n->status & VIRTIO_NET_S_LINK_UP) && vdev->vm_running;
 }
 
+/*
+ * Queue pairs serviced by an iothread run without the BQL, so they must
+ * signal the guest through the irqfd set up by virtio_net_start_ioeventfd().
+ */
+static void virtio_net_notify(VirtIODevice *vdev, VirtQueue *vq)
+{
+    if (qemu_mutex_iothread_locked()) {
+        virtio_notify(vdev, vq);
+    } else {
+        virtio_notify_irqfd(vdev, vq);
+    }
+}
+
+/*
+ * Device-wide state (filters, offloads, number of queues, ...) is read by
+ * every queue pair.  Main loop code changing it takes all iothread locks,
+ * always in the same order.
+ */
+static void virtio_net_lock_queues(VirtIONet *n)
+{
+    int i;
+
+    for (i = 0; i < n->num_ctxs; i++) {
+        aio_context_acquire(n->ctxs[i]);
+    }
+}
+
+static void virtio_net_unlock_queues(VirtIONet *n)
+{
+    int i;
+
+    for (i = n->num_ctxs - 1; i >= 0; i--) {
+        aio_context_release(n->ctxs[i]);
+    }
+}
+
+static void virtio_net_queue_lock(VirtIONetQueue *q)
+{
+    if (q->ctx) {
+        aio_context_acquire(q->ctx);
+    }
+}
+
+static void virtio_net_queue_unlock(VirtIONetQueue *q)
+{
+    if (q->ctx) {
+        aio_context_release(q->ctx);
+    }
+}
+
+/*
+ * Until virtio_net_start_ioeventfd() has set up irqfds, the BHs and timer
+ * of a queue pair serviced by an iothread cannot notify the guest.  They
+ * are kicked again once the irqfds are in place.
+ */
+static bool virtio_net_queue_can_run(VirtIONetQueue *q)
+{
+    return !q->ctx || q->n->dataplane_started;
+}
+
+/* Context: any thread */
+static VirtioNetSteeredPacket *virtio_net_steer_alloc(VirtIONetQueue *q,
+                                                      size_t size)
+{
+    VirtioNetSteeredPacket *pkt = NULL;
+
+    if (size <= VIRTIO_NET_RSS_STEER_SLOT_SIZE) {
+        qemu_spin_lock(&q->steer_free_lock);
+        pkt = QSLIST_FIRST(&q->steer_free);
+        if (pkt) {
+            QSLIST_REMOVE_HEAD(&q->steer_free, next);
+        }
+        qemu_spin_unlock(&q->steer_free_lock);
+    }
+    if (!pkt) {
+        pkt = g_malloc(sizeof(*pkt) + size);
+        pkt->pooled = false;
+    }
+    return pkt;
+}
+
+/* Context: any thread */
+static void virtio_net_steer_free(VirtIONetQueue *q,
+                                  VirtioNetSteeredPacket *pkt)
+{
+    if (!pkt->pooled) {
+        g_free(pkt);
+        return;
+    }
+    qemu_spin_lock(&q->steer_free_lock);
+    QSLIST_INSERT_HEAD(&q->steer_free, pkt, next);
+    qemu_spin_unlock(&q->steer_free_lock);
+}
+
+/*
+ * Context: thread servicing @src.  Hand a packet received on @src over to
+ * the thread servicing @q, so that a flow is delivered by the same thread
+ * as its guest queue.  A hash requested by the guest is already in the
+ * header.
+ *
+ * Returns false if @q has too many packets in flight.  The packet is then
+ * left to the net layer to queue, and @src is flushed once @q catches up.
+ */
+static bool virtio_net_steer(VirtIONetQueue *src, VirtIONetQueue *q,
+                             const uint8_t *buf, size_t size)
+{
+    VirtioNetSteeredPacket *pkt;
+
+    if (qatomic_fetch_inc(&q->steer_count) >= VIRTIO_NET_RSS_STEER_MAX) {
+        qatomic_dec(&q->steer_count);
+
+        /*
+         * Ask for a flush, then look again in case @q drained in the
+         * meantime.  Pairs with the barrier in virtio_net_steer_flush().
+         */
+        qatomic_set(&src->steer_wait, true);
+        smp_mb();
+        if (qatomic_fetch_inc(&q->steer_count) >= VIRTIO_NET_RSS_STEER_MAX) {
+            qatomic_dec(&q->steer_count);
+            return false;
+        }
+    }
+
+    /* The backend reuses @buf once we return, so it has to be copied */
+    pkt = virtio_net_steer_alloc(q, size);
+    pkt->size = size;
+    memcpy(pkt->data, buf, size);
+    QSLIST_INSERT_HEAD_ATOMIC(&q->steer_list, pkt, next);
+    qemu_bh_schedule(q->steer_bh);
+    return true;
+}
+
+/* Context: all producers for @q stopped */
+static void virtio_net_steer_purge(VirtIONetQueue *q)
+{
+    QSLIST_HEAD(, VirtioNetSteeredPacket) list;
+    VirtioNetSteeredPacket *pkt, *next_pkt;
+
+    QSLIST_MOVE_ATOMIC(&list, &q->steer_list);
+    QSLIST_FOREACH_SAFE(pkt, &list, next, next_pkt) {
+        virtio_net_steer_free(q, pkt);
+        qatomic_dec(&q->steer_count);
+    }
+    while ((pkt = QSIMPLEQ_FIRST(&q->steer_pending))) {
+        QSIMPLEQ_REMOVE_HEAD(&q->steer_pending, pending_next);
+        virtio_net_steer_free(q, pkt);
+        qatomic_dec(&q->steer_count);
+    }
+}
+
+static void virtio_net_steer_flush(VirtIONetQueue *q);
+
 static void virtio_net_announce_notify(VirtIONet *net)
 {
     VirtIODevice *vdev = VIRTIO_DEVICE(net);
@@ -342,7 +506,7 @@ static void virtio_net_drop_tx_queue_data(VirtIODevice *vdev, VirtQueue *vq)
 {
     unsigned int dropped = virtqueue_drop_all(vq);
     if (dropped) {
-        virtio_notify(vdev, vq);
+        virtio_net_notify(vdev, vq);
     }
 }
 
@@ -369,11 +533,14 @@ static void virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
         queue_started =
             virtio_net_started(n, queue_status) && !n->vhost_started;
 
+        virtio_net_queue_lock(q);
         if (queue_started) {
             qemu_flush_queued_packets(ncs);
+            virtio_net_steer_flush(q);
         }
 
         if (!q->tx_waiting) {
+            virtio_net_queue_unlock(q);
             continue;
         }
 
@@ -400,6 +567,7 @@ static void virtio_net_set_status(struct VirtIODevice *vdev, uint8_t status)
                 virtio_net_drop_tx_queue_data(vdev, q->tx_vq);
             }
         }
+        virtio_net_queue_unlock(q);
     }
 }
 
@@ -409,10 +577,12 @@ static void virtio_net_set_link_status(NetClientState *nc)
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
     uint16_t old_status = n->status;
 
+    virtio_net_lock_queues(n);
     if (nc->link_down)
         n->status &= ~VIRTIO_NET_S_LINK_UP;
     else
         n->status |= VIRTIO_NET_S_LINK_UP;
+    virtio_net_unlock_queues(n);
 
     if (n->status != old_status)
         virtio_notify_config(vdev);
@@ -527,6 +697,8 @@ static void virtio_net_reset(VirtIODevice *vdev)
     VirtIONet *n = VIRTIO_NET(vdev);
     int i;
 
+    virtio_net_lock_queues(n);
+
     /* Reset back to compatibility mode */
     n->promisc = 1;
     n->allmulti = 0;
@@ -558,7 +730,12 @@ static void virtio_net_reset(VirtIODevice *vdev)
             qemu_flush_or_purge_queued_packets(nc->peer, true);
             assert(!virtio_net_get_subqueue(nc)->async_tx.elem);
         }
+        if (n->vqs[i].steer_bh) {
+            virtio_net_steer_purge(&n->vqs[i]);
+        }
     }
+
+    virtio_net_unlock_queues(n);
 }
 
 static void peer_test_vnet_hdr(VirtIONet *n)
@@ -888,6 +1065,8 @@ static void virtio_net_set_features(VirtIODevice *vdev, uint64_t features)
         features &= ~(1ULL << VIRTIO_NET_F_MTU);
     }
 
+    virtio_net_lock_queues(n);
+
     virtio_net_set_multiqueue(n,
                               virtio_has_feature(features, VIRTIO_NET_F_RSS) ||
                               virtio_has_feature(features, VIRTIO_NET_F_MQ));
@@ -927,6 +1106,8 @@ static void virtio_net_set_features(VirtIODevice *vdev, uint64_t features)
         memset(n->vlans, 0xff, MAX_VLAN >> 3);
     }
 
+    virtio_net_unlock_queues(n);
+
     if (virtio_has_feature(features, VIRTIO_NET_F_STANDBY)) {
         qapi_event_send_failover_negotiated(n->netclient_name);
         qatomic_set(&n->primary_should_be_hidden, false);
@@ -1371,6 +1552,7 @@ static void virtio_net_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
         iov2 = iov = g_memdup(elem->out_sg, sizeof(struct iovec) * elem->out_num);
         s = iov_to_buf(iov, iov_cnt, 0, &ctrl, sizeof(ctrl));
         iov_discard_front(&iov, &iov_cnt, sizeof(ctrl));
+        virtio_net_lock_queues(n);
         if (s != sizeof(ctrl)) {
             status = VIRTIO_NET_ERR;
         } else if (ctrl.class == VIRTIO_NET_CTRL_RX) {
@@ -1386,6 +1568,7 @@ static void virtio_net_handle_ctrl(VirtIODevice *vdev, VirtQueue *vq)
         } else if (ctrl.class == VIRTIO_NET_CTRL_GUEST_OFFLOADS) {
             status = virtio_net_handle_offloads(n, ctrl.cmd, iov, iov_cnt);
         }
+        virtio_net_unlock_queues(n);
 
         s = iov_from_buf(elem->in_sg, elem->in_num, 0, &status, sizeof(status));
         assert(s == sizeof(status));
@@ -1403,8 +1586,18 @@ static void virtio_net_handle_rx(VirtIODevice *vdev, VirtQueue *vq)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
     int queue_index = vq2q(virtio_get_queue_index(vq));
+    VirtIONetQueue *q = &n->vqs[queue_index];
 
+    virtio_net_queue_lock(q);
     qemu_flush_queued_packets(qemu_get_subqueue(n->nic, queue_index));
+    virtio_net_steer_flush(q);
+    virtio_net_queue_unlock(q);
+}
+
+static bool virtio_net_handle_rx_aio(VirtIODevice *vdev, VirtQueue *vq)
+{
+    virtio_net_handle_rx(vdev, vq);
+    return true;
 }
 
 static bool virtio_net_can_receive(NetClientState *nc)
@@ -1611,7 +1804,7 @@ static int virtio_net_process_rss(NetClientState *nc, const uint8_t *buf,
 {
     VirtIONet *n = qemu_get_nic_opaque(nc);
     unsigned int index = nc->queue_index, new_index = index;
-    struct NetRxPkt *pkt = n->rx_pkt;
+    struct NetRxPkt *pkt = virtio_net_get_subqueue(nc)->rx_pkt;
     uint8_t net_hash_type;
     uint32_t hash;
     bool isip4, isip6, isudp, istcp;
@@ -1678,6 +1871,11 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
         int index = virtio_net_process_rss(nc, buf, size);
         if (index >= 0) {
             NetClientState *nc2 = qemu_get_subqueue(n->nic, index);
+
+            if (n->vqs[index].ctx != q->ctx) {
+                return virtio_net_steer(q, &n->vqs[index], buf, size) ?
+                       size : 0;
+            }
             return virtio_net_receive_rcu(nc2, buf, size, true);
         }
     }
@@ -1771,7 +1969,7 @@ static ssize_t virtio_net_receive_rcu(NetClientState *nc, const uint8_t *buf,
     }
 
     virtqueue_flush(q->rx_vq, i);
-    virtio_notify(vdev, q->rx_vq);
+    virtio_net_notify(vdev, q->rx_vq);
 
     return size;
 }
@@ -1784,6 +1982,66 @@ static ssize_t virtio_net_do_receive(NetClientState *nc, const uint8_t *buf,
     return virtio_net_receive_rcu(nc, buf, size, false);
 }
 
+/* Context: @q's AioContext held, or the main loop */
+static void virtio_net_steer_flush(VirtIONetQueue *q)
+{
+    VirtIONet *n = q->n;
+    NetClientState *nc = qemu_get_subqueue(n->nic, q - n->vqs);
+    QSLIST_HEAD(, VirtioNetSteeredPacket) list;
+    QSIMPLEQ_HEAD(, VirtioNetSteeredPacket) fifo =
+        QSIMPLEQ_HEAD_INITIALIZER(fifo);
+    VirtioNetSteeredPacket *pkt, *next_pkt;
+    bool drained = false;
+    int i;
+
+    if (!virtio_net_queue_can_run(q)) {
+        return;
+    }
+
+    /* Producers push at the head, restore arrival order */
+    QSLIST_MOVE_ATOMIC(&list, &q->steer_list);
+    QSLIST_FOREACH_SAFE(pkt, &list, next, next_pkt) {
+        QSIMPLEQ_INSERT_HEAD(&fifo, pkt, pending_next);
+    }
+    QSIMPLEQ_CONCAT(&q->steer_pending, &fifo);
+
+    RCU_READ_LOCK_GUARD();
+    while ((pkt = QSIMPLEQ_FIRST(&q->steer_pending))) {
+        /* Kept until the guest refills the ring, see virtio_net_handle_rx */
+        if (virtio_net_receive_rcu(nc, pkt->data, pkt->size, true) <= 0) {
+            break;
+        }
+        QSIMPLEQ_REMOVE_HEAD(&q->steer_pending, pending_next);
+        virtio_net_steer_free(q, pkt);
+        qatomic_dec(&q->steer_count);
+        drained = true;
+    }
+
+    if (!drained) {
+        return;
+    }
+    /* Wake up the queues whose packets didn't fit, see virtio_net_steer() */
+    smp_mb();
+    for (i = 0; i < n->max_queues; i++) {
+        if (n->vqs[i].steer_bh && qatomic_read(&n->vqs[i].steer_wait)) {
+            qemu_bh_schedule(n->vqs[i].steer_bh);
+        }
+    }
+}
+
+static void virtio_net_steer_bh(void *opaque)
+{
+    VirtIONetQueue *q = opaque;
+    VirtIONet *n = q->n;
+
+    virtio_net_queue_lock(q);
+    virtio_net_steer_flush(q);
+    if (qatomic_xchg(&q->steer_wait, false)) {
+        qemu_flush_queued_packets(qemu_get_subqueue(n->nic, q - n->vqs));
+    }
+    virtio_net_queue_unlock(q);
+}
+
 static void virtio_net_rsc_extract_unit4(VirtioNetRscChain *chain,
                                          const uint8_t *buf,
                                          VirtioNetRscUnit *unit)
@@ -2398,21 +2656,138 @@ static void virtio_net_tx_complete(NetClientState *nc, ssize_t len)
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
 
     virtqueue_push(q->tx_vq, q->async_tx.elem, 0);
-    virtio_notify(vdev, q->tx_vq);
+    virtio_net_notify(vdev, q->tx_vq);
 
-    g_free(q->async_tx.elem);
+    virtqueue_element_free(q->async_tx.elem);
     q->async_tx.elem = NULL;
 
     virtio_queue_set_notification(q->tx_vq, 1);
     virtio_net_flush_tx(q);
 }
 
+/* Give back elements of a popped batch that were not processed */
+static void virtio_net_tx_unpop(VirtIONetQueue *q, VirtQueueElement **elems,
+                                unsigned int num)
+{
+    while (num--) {
+        virtqueue_unpop(q->tx_vq, elems[num], 0);
+        virtqueue_element_free(elems[num]);
+    }
+}
+
+/* Drop the elements of a popped batch once the device is broken */
+static void virtio_net_tx_detach(VirtIONetQueue *q, VirtQueueElement **elems,
+                                 unsigned int num)
+{
+    while (num--) {
+        virtqueue_detach_element(q->tx_vq, elems[num], 0);
+        virtqueue_element_free(elems[num]);
+    }
+}
+
+/* Complete transmitted elements of a popped batch */
+static void virtio_net_tx_push(VirtIONetQueue *q, VirtQueueElement **elems,
+                               unsigned int num)
+{
+    unsigned int i;
+
+    if (!num) {
+        return;
+    }
+    for (i = 0; i < num; i++) {
+        virtqueue_fill(q->tx_vq, elems[i], 0, i);
+        virtqueue_element_free(elems[i]);
+    }
+    virtqueue_flush(q->tx_vq, num);
+    virtio_net_notify(VIRTIO_DEVICE(q->n), q->tx_vq);
+}
+
+/*
+ * Transmit a popped batch through qemu_sendv_packet_batch(), so that a
+ * backend with receive_batch sees it in one call.  Whatever it doesn't
+ * take goes packet by packet through the asynchronous path.  Returns the
+ * number of packets processed, or -EINVAL/-EBUSY like the caller.
+ */
+static int32_t virtio_net_flush_tx_batch(VirtIONetQueue *q,
+                                         VirtQueueElement **elems,
+                                         unsigned int num_elems)
+{
+    VirtIONet *n = q->n;
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    NetClientState *nc =
+        qemu_get_subqueue(n->nic, vq2q(virtio_get_queue_index(q->tx_vq)));
+    NetBatchPacket pkts[VIRTIO_NET_TX_POP_BATCH];
+    g_autofree struct iovec *sg = NULL;
+    unsigned int i, num_valid, sg_used = 0, sg_len = 0;
+    int sent;
+
+    assert(num_elems <= ARRAY_SIZE(pkts));
+    assert(n->host_hdr_len <= n->guest_hdr_len);
+
+    /* Dropping the header never needs more than one extra entry */
+    for (i = 0; i < num_elems; i++) {
+        sg_len += elems[i]->out_num + 1;
+    }
+    sg = g_new(struct iovec, sg_len);
+
+    for (i = 0; i < num_elems; i++) {
+        struct iovec *out_sg = elems[i]->out_sg;
+        unsigned int out_num = elems[i]->out_num;
+
+        if (out_num < 1) {
+            virtio_error(vdev, "virtio-net header not in first element");
+            break;
+        }
+        if (n->has_vnet_hdr &&
+            iov_size(out_sg, out_num) < n->guest_hdr_len) {
+            virtio_error(vdev, "virtio-net header incorrect");
+            break;
+        }
+        if (n->host_hdr_len != n->guest_hdr_len) {
+            unsigned sg_num = iov_copy(sg + sg_used, sg_len - sg_used,
+                                       out_sg, out_num,
+                                       0, n->host_hdr_len);
+            sg_num += iov_copy(sg + sg_used + sg_num,
+                               sg_len - sg_used - sg_num,
+                               out_sg, out_num,
+                               n->guest_hdr_len, -1);
+            out_sg = sg + sg_used;
+            out_num = sg_num;
+            sg_used += sg_num;
+        }
+        pkts[i].iov = out_sg;
+        pkts[i].iovcnt = out_num;
+    }
+    num_valid = i;
+    if (num_valid < num_elems) {
+        /* The device is broken, nothing after the bad element is sent */
+        virtio_net_tx_detach(q, elems + num_valid, num_elems - num_valid);
+    }
+
+    sent = qemu_sendv_packet_batch(nc, pkts, num_valid);
+    for (i = sent; i < num_valid; i++) {
+        if (qemu_sendv_packet_async(nc, pkts[i].iov, pkts[i].iovcnt,
+                                    virtio_net_tx_complete) == 0) {
+            virtio_queue_set_notification(q->tx_vq, 0);
+            virtio_net_tx_push(q, elems, i);
+            q->async_tx.elem = elems[i];
+            virtio_net_tx_unpop(q, elems + i + 1, num_valid - i - 1);
+            return num_valid < num_elems ? -EINVAL : -EBUSY;
+        }
+    }
+
+    virtio_net_tx_push(q, elems, num_valid);
+    return num_valid < num_elems ? -EINVAL : num_valid;
+}
+
 /* TX */
 static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
 {
     VirtIONet *n = q->n;
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    VirtQueueElement *elems[VIRTIO_NET_TX_POP_BATCH];
     VirtQueueElement *elem;
+    unsigned int i, num_elems;
     int32_t num_packets = 0;
     int queue_index = vq2q(virtio_get_queue_index(q->tx_vq));
     if (!(vdev->status & VIRTIO_CONFIG_S_DRIVER_OK)) {
@@ -2424,86 +2799,101 @@ static int32_t virtio_net_flush_tx(VirtIONetQueue *q)
         return num_packets;
     }
 
-    for (;;) {
-        ssize_t ret;
-        unsigned int out_num;
-        struct iovec sg[VIRTQUEUE_MAX_SIZE], sg2[VIRTQUEUE_MAX_SIZE + 1], *out_sg;
-        struct virtio_net_hdr_mrg_rxbuf mhdr;
-
-        elem = virtqueue_pop(q->tx_vq, sizeof(VirtQueueElement));
-        if (!elem) {
+    while (num_packets < n->tx_burst) {
+        num_elems = virtqueue_pop_batch(q->tx_vq, sizeof(VirtQueueElement),
+                                        (void **)elems,
+                                        MIN(ARRAY_SIZE(elems),
+                                            n->tx_burst - num_packets));
+        if (!num_elems) {
             break;
         }
 
-        out_num = elem->out_num;
-        out_sg = elem->out_sg;
-        if (out_num < 1) {
-            virtio_error(vdev, "virtio-net header not in first element");
-            virtqueue_detach_element(q->tx_vq, elem, 0);
-            g_free(elem);
-            return -EINVAL;
+        if (!n->needs_vnet_hdr_swap) {
+            int32_t ret = virtio_net_flush_tx_batch(q, elems, num_elems);
+
+            if (ret < 0) {
+                return ret;
+            }
+            num_packets += ret;
+            continue;
         }
 
-        if (n->has_vnet_hdr) {
-            if (iov_to_buf(out_sg, out_num, 0, &mhdr, n->guest_hdr_len) <
-                n->guest_hdr_len) {
-                virtio_error(vdev, "virtio-net header incorrect");
-                virtqueue_detach_element(q->tx_vq, elem, 0);
-                g_free(elem);
+        for (i = 0; i < num_elems; i++) {
+            ssize_t ret;
+            unsigned int out_num;
+            struct iovec sg[VIRTQUEUE_MAX_SIZE], sg2[VIRTQUEUE_MAX_SIZE + 1];
+            struct iovec *out_sg;
+            struct virtio_net_hdr_mrg_rxbuf mhdr;
+
+            elem = elems[i];
+            out_num = elem->out_num;
+            out_sg = elem->out_sg;
+            if (out_num < 1) {
+                virtio_error(vdev, "virtio-net header not in first element");
+                virtio_net_tx_detach(q, elems + i, num_elems - i);
                 return -EINVAL;
             }
-            if (n->needs_vnet_hdr_swap) {
-                virtio_net_hdr_swap(vdev, (void *) &mhdr);
-                sg2[0].iov_base = &mhdr;
-                sg2[0].iov_len = n->guest_hdr_len;
-                out_num = iov_copy(&sg2[1], ARRAY_SIZE(sg2) - 1,
-                                   out_sg, out_num,
-                                   n->guest_hdr_len, -1);
-                if (out_num == VIRTQUEUE_MAX_SIZE) {
-                    goto drop;
+
+            if (n->has_vnet_hdr) {
+                if (iov_to_buf(out_sg, out_num, 0, &mhdr, n->guest_hdr_len) <
+                    n->guest_hdr_len) {
+                    virtio_error(vdev, "virtio-net header incorrect");
+                    virtio_net_tx_detach(q, elems + i, num_elems - i);
+                    return -EINVAL;
                 }
-                out_num += 1;
-                out_sg = sg2;
-            }
-        }
-        /*
-         * If host wants to see the guest header as is, we can
-         * pass it on unchanged. Otherwise, copy just the parts
-         * that host is interested in.
-         */
-        assert(n->host_hdr_len <= n->guest_hdr_len);
-        if (n->host_hdr_len != n->guest_hdr_len) {
-            unsigned sg_num = iov_copy(sg, ARRAY_SIZE(sg),
+                if (n->needs_vnet_hdr_swap) {
+                    virtio_net_hdr_swap(vdev, (void *) &mhdr);
+                    sg2[0].iov_base = &mhdr;
+                    sg2[0].iov_len = n->guest_hdr_len;
+                    out_num = iov_copy(&sg2[1], ARRAY_SIZE(sg2) - 1,
                                        out_sg, out_num,
-                                       0, n->host_hdr_len);
-            sg_num += iov_copy(sg + sg_num, ARRAY_SIZE(sg) - sg_num,
-                             out_sg, out_num,
-                             n->guest_hdr_len, -1);
-            out_num = sg_num;
-            out_sg = sg;
-        }
+                                       n->guest_hdr_len, -1);
+                    if (out_num == VIRTQUEUE_MAX_SIZE) {
+                        goto drop;
+                    }
+                    out_num += 1;
+                    out_sg = sg2;
+                }
+            }
+            /*
+             * If host wants to see the guest header as is, we can
+             * pass it on unchanged. Otherwise, copy just the parts
+             * that host is interested in.
+             */
+            assert(n->host_hdr_len <= n->guest_hdr_len);
+            if (n->host_hdr_len != n->guest_hdr_len) {
+                unsigned sg_num = iov_copy(sg, ARRAY_SIZE(sg),
+                                           out_sg, out_num,
+                                           0, n->host_hdr_len);
+                sg_num += iov_copy(sg + sg_num, ARRAY_SIZE(sg) - sg_num,
+                                 out_sg, out_num,
+                                 n->guest_hdr_len, -1);
+                out_num = sg_num;
+                out_sg = sg;
+            }
 
-        ret = qemu_sendv_packet_async(qemu_get_subqueue(n->nic, queue_index),
-                                      out_sg, out_num, virtio_net_tx_complete);
-        if (ret == 0) {
-            virtio_queue_set_notification(q->tx_vq, 0);
-            q->async_tx.elem = elem;
-            return -EBUSY;
-        }
+            ret = qemu_sendv_packet_async(qemu_get_subqueue(n->nic,
+                                                            queue_index),
+                                          out_sg, out_num,
+                                          virtio_net_tx_complete);
+            if (ret == 0) {
+                virtio_queue_set_notification(q->tx_vq, 0);
+                q->async_tx.elem = elem;
+                virtio_net_tx_unpop(q, elems + i + 1, num_elems - i - 1);
+                return -EBUSY;
+            }
 
 drop:
-        virtqueue_push(q->tx_vq, elem, 0);
-        virtio_notify(vdev, q->tx_vq);
-        g_free(elem);
-
-        if (++num_packets >= n->tx_burst) {
-            break;
+            virtqueue_push(q->tx_vq, elem, 0);
+            virtio_net_notify(vdev, q->tx_vq);
+            virtqueue_element_free(elem);
+            num_packets++;
         }
     }
     return num_packets;
 }
 
-static void virtio_net_handle_tx_timer(VirtIODevice *vdev, VirtQueue *vq)
+static void virtio_net_do_handle_tx_timer(VirtIODevice *vdev, VirtQueue *vq)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
     VirtIONetQueue *q = &n->vqs[vq2q(virtio_get_queue_index(vq))];
@@ -2534,7 +2924,23 @@ static void virtio_net_handle_tx_timer(VirtIODevice *vdev, VirtQueue *vq)
     }
 }
 
-static void virtio_net_handle_tx_bh(VirtIODevice *vdev, VirtQueue *vq)
+static void virtio_net_handle_tx_timer(VirtIODevice *vdev, VirtQueue *vq)
+{
+    VirtIONet *n = VIRTIO_NET(vdev);
+    VirtIONetQueue *q = &n->vqs[vq2q(virtio_get_queue_index(vq))];
+
+    virtio_net_queue_lock(q);
+    virtio_net_do_handle_tx_timer(vdev, vq);
+    virtio_net_queue_unlock(q);
+}
+
+static bool virtio_net_handle_tx_timer_aio(VirtIODevice *vdev, VirtQueue *vq)
+{
+    virtio_net_handle_tx_timer(vdev, vq);
+    return true;
+}
+
+static void virtio_net_do_handle_tx_bh(VirtIODevice *vdev, VirtQueue *vq)
 {
     VirtIONet *n = VIRTIO_NET(vdev);
     VirtIONetQueue *q = &n->vqs[vq2q(virtio_get_queue_index(vq))];
@@ -2556,13 +2962,28 @@ static void virtio_net_handle_tx_bh(VirtIODevice *vdev, VirtQueue *vq)
     qemu_bh_schedule(q->tx_bh);
 }
 
-static void virtio_net_tx_timer(void *opaque)
+static void virtio_net_handle_tx_bh(VirtIODevice *vdev, VirtQueue *vq)
+{
+    VirtIONet *n = VIRTIO_NET(vdev);
+    VirtIONetQueue *q = &n->vqs[vq2q(virtio_get_queue_index(vq))];
+
+    virtio_net_queue_lock(q);
+    virtio_net_do_handle_tx_bh(vdev, vq);
+    virtio_net_queue_unlock(q);
+}
+
+static bool virtio_net_handle_tx_bh_aio(VirtIODevice *vdev, VirtQueue *vq)
+{
+    virtio_net_handle_tx_bh(vdev, vq);
+    return true;
+}
+
+static void virtio_net_do_tx_timer(VirtIONetQueue *q)
 {
-    VirtIONetQueue *q = opaque;
     VirtIONet *n = q->n;
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
     /* This happens when device was stopped but BH wasn't. */
-    if (!vdev->vm_running) {
+    if (!vdev->vm_running || !virtio_net_queue_can_run(q)) {
         /* Make sure tx waiting is set, so we'll run when restarted. */
         assert(q->tx_waiting);
         return;
@@ -2579,15 +3000,23 @@ static void virtio_net_tx_timer(void *opaque)
     virtio_net_flush_tx(q);
 }
 
-static void virtio_net_tx_bh(void *opaque)
+static void virtio_net_tx_timer(void *opaque)
 {
     VirtIONetQueue *q = opaque;
+
+    virtio_net_queue_lock(q);
+    virtio_net_do_tx_timer(q);
+    virtio_net_queue_unlock(q);
+}
+
+static void virtio_net_do_tx_bh(VirtIONetQueue *q)
+{
     VirtIONet *n = q->n;
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
     int32_t ret;
 
     /* This happens when device was stopped but BH wasn't. */
-    if (!vdev->vm_running) {
+    if (!vdev->vm_running || !virtio_net_queue_can_run(q)) {
         /* Make sure tx waiting is set, so we'll run when restarted. */
         assert(q->tx_waiting);
         return;
@@ -2628,9 +3057,19 @@ static void virtio_net_tx_bh(void *opaque)
     }
 }
 
+static void virtio_net_tx_bh(void *opaque)
+{
+    VirtIONetQueue *q = opaque;
+
+    virtio_net_queue_lock(q);
+    virtio_net_do_tx_bh(q);
+    virtio_net_queue_unlock(q);
+}
+
 static void virtio_net_add_queue(VirtIONet *n, int index)
 {
     VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    AioContext *ctx = n->vqs[index].ctx;
 
     n->vqs[index].rx_vq = virtio_add_queue(vdev, n->net_conf.rx_queue_size,
                                            virtio_net_handle_rx);
@@ -2639,18 +3078,59 @@ static void virtio_net_add_queue(VirtIONet *n, int index)
         n->vqs[index].tx_vq =
             virtio_add_queue(vdev, n->net_conf.tx_queue_size,
                              virtio_net_handle_tx_timer);
-        n->vqs[index].tx_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
-                                              virtio_net_tx_timer,
-                                              &n->vqs[index]);
+        if (ctx) {
+            n->vqs[index].tx_timer = aio_timer_new(ctx, QEMU_CLOCK_VIRTUAL,
+                                                   SCALE_NS,
+                                                   virtio_net_tx_timer,
+                                                   &n->vqs[index]);
+        } else {
+            n->vqs[index].tx_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL,
+                                                  virtio_net_tx_timer,
+                                                  &n->vqs[index]);
+        }
     } else {
         n->vqs[index].tx_vq =
             virtio_add_queue(vdev, n->net_conf.tx_queue_size,
                              virtio_net_handle_tx_bh);
-        n->vqs[index].tx_bh = qemu_bh_new(virtio_net_tx_bh, &n->vqs[index]);
+        if (ctx) {
+            n->vqs[index].tx_bh = aio_bh_new(ctx, virtio_net_tx_bh,
+                                             &n->vqs[index]);
+        } else {
+            n->vqs[index].tx_bh = qemu_bh_new(virtio_net_tx_bh,
+                                              &n->vqs[index]);
+        }
     }
 
     n->vqs[index].tx_waiting = 0;
     n->vqs[index].n = n;
+    net_rx_pkt_init(&n->vqs[index].rx_pkt, false);
+
+    QSLIST_INIT(&n->vqs[index].steer_list);
+    QSIMPLEQ_INIT(&n->vqs[index].steer_pending);
+    QSLIST_INIT(&n->vqs[index].steer_free);
+    qemu_spin_init(&n->vqs[index].steer_free_lock);
+    /* Packets are only steered between threads when there are iothreads */
+    if (n->num_ctxs) {
+        VirtIONetQueue *q = &n->vqs[index];
+        int i;
+
+        q->steer_pool = g_malloc(VIRTIO_NET_RSS_STEER_MAX *
+                                 VIRTIO_NET_RSS_STEER_SLOT_STRIDE);
+        for (i = 0; i < VIRTIO_NET_RSS_STEER_MAX; i++) {
+            VirtioNetSteeredPacket *pkt =
+                q->steer_pool + i * VIRTIO_NET_RSS_STEER_SLOT_STRIDE;
+
+            pkt->pooled = true;
+            QSLIST_INSERT_HEAD(&q->steer_free, pkt, next);
+        }
+    }
+    if (ctx) {
+        n->vqs[index].steer_bh = aio_bh_new(ctx, virtio_net_steer_bh,
+                                            &n->vqs[index]);
+    } else {
+        n->vqs[index].steer_bh = qemu_bh_new(virtio_net_steer_bh,
+                                             &n->vqs[index]);
+    }
 }
 
 static void virtio_net_del_queue(VirtIONet *n, int index)
@@ -2672,6 +3152,14 @@ static void virtio_net_del_queue(VirtIONet *n, int index)
     }
     q->tx_waiting = 0;
     virtio_del_queue(vdev, index * 2 + 1);
+    net_rx_pkt_uninit(q->rx_pkt);
+    q->rx_pkt = NULL;
+    qemu_bh_delete(q->steer_bh);
+    q->steer_bh = NULL;
+    virtio_net_steer_purge(q);
+    QSLIST_INIT(&q->steer_free);
+    g_free(q->steer_pool);
+    q->steer_pool = NULL;
 }
 
 static void virtio_net_change_num_queues(VirtIONet *n, int new_max_queues)
@@ -2719,6 +3207,237 @@ static void virtio_net_set_multiqueue(VirtIONet *n, int multiqueue)
     virtio_net_set_queues(n);
 }
 
+/* Context: QEMU global mutex held */
+static bool virtio_net_iothreads_setup(VirtIONet *n, Error **errp)
+{
+    VirtIODevice *vdev = VIRTIO_DEVICE(n);
+    BusState *qbus = qdev_get_parent_bus(DEVICE(vdev));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    uint32_t num_ctxs = n->net_conf.num_iothreads;
+    g_autofree AioContext **ctxs = NULL;
+    g_autofree IOThread **iothreads = NULL;
+    int i;
+
+    if (!num_ctxs) {
+        return true;
+    }
+
+    if (!k->set_guest_notifiers || !k->ioeventfd_assign) {
+        error_setg(errp, "device is incompatible with iothreads "
+                   "(transport does not support notifiers)");
+        return false;
+    }
+    if (!virtio_device_ioeventfd_enabled(vdev)) {
+        error_setg(errp, "ioeventfd is required for iothreads");
+        return false;
+    }
+    /* RSC chains are shared by all queue pairs */
+    if (virtio_has_feature(n->host_features, VIRTIO_NET_F_RSC_EXT)) {
+        error_setg(errp, "iothreads are incompatible with guest_rsc_ext");
+        return false;
+    }
+    for (i = 0; i < n->max_queues; i++) {
+        if (get_vhost_net(n->nic_conf.peers.ncs[i])) {
+            error_setg(errp, "iothreads are incompatible with vhost");
+            return false;
+        }
+    }
+
+    ctxs = g_new(AioContext *, num_ctxs);
+    iothreads = g_new(IOThread *, num_ctxs);
+    for (i = 0; i < num_ctxs; i++) {
+        IOThread *iothread = n->net_conf.iothreads[i] ?
+                             iothread_by_id(n->net_conf.iothreads[i]) : NULL;
+
+        if (!iothread) {
+            error_setg(errp, "iothreads[%d]: no iothread named '%s'",
+                       i, n->net_conf.iothreads[i] ?: "");
+            while (--i >= 0) {
+                object_unref(OBJECT(iothreads[i]));
+            }
+            return false;
+        }
+        /* The iothread must not go away while the device uses it */
+        object_ref(OBJECT(iothread));
+        iothreads[i] = iothread;
+        ctxs[i] = iothread_get_aio_context(iothread);
+    }
+
+    /*
+     * The first queue pair stays in the main loop: it is the one net
+     * filters attach to and announcements are sent on.  The others are
+     * spread over the iothreads, provided their backend can follow.
+     */
+    for (i = 1; i < n->max_queues; i++) {
+        NetClientState *peer = n->nic_conf.peers.ncs[i];
+
+        if (!peer || !peer->info->set_aio_context ||
+            !QTAILQ_EMPTY(&peer->filters)) {
+            continue;
+        }
+        n->vqs[i].ctx = ctxs[(i - 1) % num_ctxs];
+    }
+
+    n->num_ctxs = num_ctxs;
+    n->ctxs = g_steal_pointer(&ctxs);
+    n->iothreads = g_steal_pointer(&iothreads);
+    return true;
+}
+
+/* Context: QEMU global mutex held, once the iothreads are detached */
+static void virtio_net_iothreads_cleanup(VirtIONet *n)
+{
+    int i;
+
+    for (i = 0; i < n->num_ctxs; i++) {
+        object_unref(OBJECT(n->iothreads[i]));
+    }
+    g_free(n->iothreads);
+    n->iothreads = NULL;
+    g_free(n->ctxs);
+    n->ctxs = NULL;
+    n->num_ctxs = 0;
+}
+
+/* Context: iothread, detaches its queue pairs' virtqueue handlers */
+static void virtio_net_detach_bh(void *opaque)
+{
+    VirtIONet *n = opaque;
+    AioContext *ctx = qemu_get_current_aio_context();
+    int queues = n->multiqueue ? n->max_queues : 1;
+    int i;
+
+    for (i = 0; i < queues; i++) {
+        VirtIONetQueue *q = &n->vqs[i];
+
+        if (q->ctx != ctx) {
+            continue;
+        }
+        virtio_queue_aio_set_host_notifier_handler(q->rx_vq, ctx, NULL);
+        virtio_queue_aio_set_host_notifier_handler(q->tx_vq, ctx, NULL);
+    }
+}
+
+/*
+ * Context: QEMU global mutex held.  Returns once every handler, BH and
+ * timer already dispatched in the iothreads has completed.
+ */
+static void virtio_net_detach_iothreads(VirtIONet *n)
+{
+    int i;
+
+    for (i = 0; i < n->num_ctxs; i++) {
+        aio_context_acquire(n->ctxs[i]);
+        aio_wait_bh_oneshot(n->ctxs[i], virtio_net_detach_bh, n);
+        aio_context_release(n->ctxs[i]);
+    }
+}
+
+/* Context: QEMU global mutex held */
+static int virtio_net_start_ioeventfd(VirtIODevice *vdev)
+{
+    VirtIONet *n = VIRTIO_NET(vdev);
+    BusState *qbus = qdev_get_parent_bus(DEVICE(vdev));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int queues = n->multiqueue ? n->max_queues : 1;
+    int i, r;
+
+    r = virtio_device_start_ioeventfd_impl(vdev);
+    if (r < 0 || !n->num_ctxs) {
+        return r;
+    }
+
+    /*
+     * virtio_net_guest_notifier_mask() only deals with vhost, let the
+     * transport mask the irqfds itself.
+     */
+    n->saved_use_guest_notifier_mask = vdev->use_guest_notifier_mask;
+    vdev->use_guest_notifier_mask = false;
+    r = k->set_guest_notifiers(qbus->parent, virtio_get_num_queues(vdev),
+                               true);
+    if (r != 0) {
+        vdev->use_guest_notifier_mask = n->saved_use_guest_notifier_mask;
+        virtio_error(vdev, "virtio-net: failed to set guest notifier (%d)", r);
+        return 0;
+    }
+
+    virtio_net_lock_queues(n);
+    n->dataplane_started = true;
+    virtio_net_unlock_queues(n);
+
+    for (i = 0; i < queues; i++) {
+        VirtIONetQueue *q = &n->vqs[i];
+        NetClientState *nc = qemu_get_subqueue(n->nic, i);
+
+        if (!q->ctx) {
+            continue;
+        }
+
+        aio_context_acquire(q->ctx);
+        event_notifier_set_handler(virtio_queue_get_host_notifier(q->rx_vq),
+                                   NULL);
+        event_notifier_set_handler(virtio_queue_get_host_notifier(q->tx_vq),
+                                   NULL);
+        virtio_queue_aio_set_host_notifier_handler(q->rx_vq, q->ctx,
+                                                   virtio_net_handle_rx_aio);
+        virtio_queue_aio_set_host_notifier_handler(q->tx_vq, q->ctx,
+            q->tx_timer ? virtio_net_handle_tx_timer_aio :
+                          virtio_net_handle_tx_bh_aio);
+        qemu_net_set_aio_context(nc->peer, q->ctx);
+
+        /* Restart TX held back by virtio_net_queue_can_run() */
+        if (q->tx_waiting && i < n->curr_queues &&
+            virtio_net_started(n, vdev->status)) {
+            if (q->tx_timer) {
+                timer_mod(q->tx_timer, qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL) +
+                                       n->tx_timeout);
+            } else {
+                qemu_bh_schedule(q->tx_bh);
+            }
+        }
+        qemu_flush_queued_packets(nc);
+        qemu_bh_schedule(q->steer_bh);
+        aio_context_release(q->ctx);
+    }
+    return 0;
+}
+
+/* Context: QEMU global mutex held */
+static void virtio_net_stop_ioeventfd(VirtIODevice *vdev)
+{
+    VirtIONet *n = VIRTIO_NET(vdev);
+    BusState *qbus = qdev_get_parent_bus(DEVICE(vdev));
+    VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    int queues = n->multiqueue ? n->max_queues : 1;
+    int i;
+
+    if (n->dataplane_started) {
+        virtio_net_detach_iothreads(n);
+
+        /* Backends go back to the main loop, which notifies with the BQL */
+        for (i = 0; i < queues; i++) {
+            VirtIONetQueue *q = &n->vqs[i];
+
+            if (!q->ctx) {
+                continue;
+            }
+            aio_context_acquire(q->ctx);
+            qemu_net_set_aio_context(qemu_get_subqueue(n->nic, i)->peer, NULL);
+            aio_context_release(q->ctx);
+        }
+
+        virtio_net_lock_queues(n);
+        n->dataplane_started = false;
+        virtio_net_unlock_queues(n);
+
+        k->set_guest_notifiers(qbus->parent, virtio_get_num_queues(vdev),
+                               false);
+        vdev->use_guest_notifier_mask = n->saved_use_guest_notifier_mask;
+    }
+
+    virtio_device_stop_ioeventfd_impl(vdev);
+}
+
 static int virtio_net_post_load_device(void *opaque, int version_id)
 {
     VirtIONet *n = opaque;
@@ -3333,6 +4052,11 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
         return;
     }
     n->vqs = g_malloc0(sizeof(VirtIONetQueue) * n->max_queues);
+    if (!virtio_net_iothreads_setup(n, errp)) {
+        g_free(n->vqs);
+        virtio_cleanup(vdev);
+        return;
+    }
     n->curr_queues = 1;
     n->tx_timeout = n->net_conf.txtimer;
 
@@ -3397,8 +4121,6 @@ static void virtio_net_device_realize(DeviceState *dev, Error **errp)
 
     QTAILQ_INIT(&n->rsc_chains);
     n->qdev = dev;
-
-    net_rx_pkt_init(&n->rx_pkt, false);
 }
 
 static void virtio_net_device_unrealize(DeviceState *dev)
@@ -3409,6 +4131,7 @@ static void virtio_net_device_unrealize(DeviceState *dev)
 
     /* This will stop vhost backend if appropriate. */
     virtio_net_set_status(vdev, 0);
+    virtio_net_detach_iothreads(n);
 
     g_free(n->netclient_name);
     n->netclient_name = NULL;
@@ -3437,7 +4160,7 @@ static void virtio_net_device_unrealize(DeviceState *dev)
     qemu_del_nic(n->nic);
     virtio_net_rsc_cleanup(n);
     g_free(n->rss_data.indirections_table);
-    net_rx_pkt_uninit(n->rx_pkt);
+    virtio_net_iothreads_cleanup(n);
     virtio_cleanup(vdev);
 }
 
@@ -3562,6 +4285,8 @@ static Property virtio_net_properties[] = {
     DEFINE_PROP_INT32("speed", VirtIONet, net_conf.speed, SPEED_UNKNOWN),
     DEFINE_PROP_STRING("duplex", VirtIONet, net_conf.duplex_str),
     DEFINE_PROP_BOOL("failover", VirtIONet, failover, false),
+    DEFINE_PROP_ARRAY("iothreads", VirtIONet, net_conf.num_iothreads,
+                      net_conf.iothreads, qdev_prop_string, char *),
     DEFINE_PROP_END_OF_LIST(),
 };
 
@@ -3582,6 +4307,8 @@ static void virtio_net_class_init(ObjectClass *klass, void *data)
     vdc->bad_features = virtio_net_bad_features;
     vdc->reset = virtio_net_reset;
     vdc->set_status = virtio_net_set_status;
+    vdc->start_ioeventfd = virtio_net_start_ioeventfd;
+    vdc->stop_ioeventfd = virtio_net_stop_ioeventfd;
     vdc->guest_notifier_mask = virtio_net_guest_notifier_mask;
     vdc->guest_notifier_pending = virtio_net_guest_notifier_pending;
     vdc->legacy_features |= (0x1 << VIRTIO_NET_F_GSO);
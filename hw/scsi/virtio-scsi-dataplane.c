@@ -21,6 +21,30 @@
 #include "hw/virtio/virtio-bus.h"
 #include "hw/virtio/virtio-access.h"
 
+/* Context: virtqueue AioContext, pushes requests completed elsewhere */
+static void virtio_scsi_complete_bh(void *opaque)
+{
+    VirtIOSCSIQueue *q = opaque;
+    VirtIODevice *vdev = VIRTIO_DEVICE(q->s);
+    QSLIST_HEAD(, VirtIOSCSIReq) reqs;
+    VirtIOSCSIReq *req, *next;
+
+    QSLIST_MOVE_ATOMIC(&reqs, &q->complete_list);
+    if (QSLIST_EMPTY(&reqs)) {
+        return;
+    }
+
+    /* The event virtqueue is also popped from the main loop */
+    aio_context_acquire(q->ctx);
+    QSLIST_FOREACH_SAFE(req, &reqs, complete_next, next) {
+        virtqueue_push(q->vq, &req->elem,
+                       req->qsgl.size + req->resp_iov.size);
+        virtio_scsi_free_req(req);
+    }
+    virtio_notify_irqfd(vdev, q->vq);
+    aio_context_release(q->ctx);
+}
+
 /* Context: QEMU global mutex held */
 void virtio_scsi_dataplane_setup(VirtIOSCSI *s, Error **errp)
 {
@@ -28,8 +52,17 @@ void virtio_scsi_dataplane_setup(VirtIOSCSI *s, Error **errp)
     VirtIODevice *vdev = VIRTIO_DEVICE(s);
     BusState *qbus = qdev_get_parent_bus(DEVICE(vdev));
     VirtioBusClass *k = VIRTIO_BUS_GET_CLASS(qbus);
+    g_autofree AioContext **ctxs = NULL;
+    g_autofree IOThread **iothreads = NULL;
+    uint32_t num_ctxs = 1;
+    int i;
 
-    if (vs->conf.iothread) {
+    if (vs->conf.iothread && vs->conf.num_iothreads) {
+        error_setg(errp, "iothread and iothreads are mutually exclusive");
+        return;
+    }
+
+    if (vs->conf.iothread || vs->conf.num_iothreads) {
         if (!k->set_guest_notifiers || !k->ioeventfd_assign) {
             error_setg(errp,
                        "device is incompatible with iothread "
@@ -40,26 +73,143 @@ void virtio_scsi_dataplane_setup(VirtIOSCSI *s, Error **errp)
             error_setg(errp, "ioeventfd is required for iothread");
             return;
         }
-        s->ctx = iothread_get_aio_context(vs->conf.iothread);
+    } else if (!virtio_device_ioeventfd_enabled(vdev)) {
+        return;
+    }
+
+    if (vs->conf.num_iothreads) {
+        num_ctxs = vs->conf.num_iothreads;
+        ctxs = g_new(AioContext *, num_ctxs);
+        iothreads = g_new(IOThread *, num_ctxs);
+        for (i = 0; i < num_ctxs; i++) {
+            IOThread *iothread = vs->conf.iothreads[i] ?
+                                 iothread_by_id(vs->conf.iothreads[i]) : NULL;
+
+            if (!iothread) {
+                error_setg(errp, "iothreads[%d]: no iothread named '%s'",
+                           i, vs->conf.iothreads[i] ?: "");
+                while (--i >= 0) {
+                    object_unref(OBJECT(iothreads[i]));
+                }
+                return;
+            }
+            /* The iothread must not go away while the device uses it */
+            object_ref(OBJECT(iothread));
+            iothreads[i] = iothread;
+            ctxs[i] = iothread_get_aio_context(iothread);
+        }
     } else {
-        if (!virtio_device_ioeventfd_enabled(vdev)) {
-            return;
+        ctxs = g_new(AioContext *, 1);
+        ctxs[0] = vs->conf.iothread ?
+                  iothread_get_aio_context(vs->conf.iothread) :
+                  qemu_get_aio_context();
+    }
+
+    s->ctx = ctxs[0];
+    s->num_ctxs = num_ctxs;
+    s->ctxs = g_steal_pointer(&ctxs);
+    s->iothreads = g_steal_pointer(&iothreads);
+
+    /*
+     * The control and event virtqueues stay in the first AioContext,
+     * request virtqueues are spread over all of them.
+     */
+    s->queues = g_new0(VirtIOSCSIQueue,
+                       vs->conf.num_queues + VIRTIO_SCSI_VQ_NUM_FIXED);
+    for (i = 0; i < vs->conf.num_queues + VIRTIO_SCSI_VQ_NUM_FIXED; i++) {
+        VirtIOSCSIQueue *q = &s->queues[i];
+
+        q->s = s;
+        q->vq = virtio_get_queue(vdev, i);
+        q->ctx = i < VIRTIO_SCSI_VQ_NUM_FIXED ? s->ctx :
+                 s->ctxs[(i - VIRTIO_SCSI_VQ_NUM_FIXED) % s->num_ctxs];
+        QSLIST_INIT(&q->complete_list);
+        q->complete_bh = aio_bh_new(q->ctx, virtio_scsi_complete_bh, q);
+    }
+}
+
+/* Context: QEMU global mutex held */
+void virtio_scsi_dataplane_cleanup(VirtIOSCSI *s)
+{
+    VirtIOSCSICommon *vs = VIRTIO_SCSI_COMMON(s);
+    int i;
+
+    if (!s->queues) {
+        return;
+    }
+    for (i = 0; i < vs->conf.num_queues + VIRTIO_SCSI_VQ_NUM_FIXED; i++) {
+        qemu_bh_delete(s->queues[i].complete_bh);
+    }
+    g_free(s->queues);
+    s->queues = NULL;
+    if (s->iothreads) {
+        for (i = 0; i < s->num_ctxs; i++) {
+            object_unref(OBJECT(s->iothreads[i]));
         }
-        s->ctx = qemu_get_aio_context();
+        g_free(s->iothreads);
+        s->iothreads = NULL;
     }
+    g_free(s->ctxs);
+    s->ctxs = NULL;
+    s->num_ctxs = 0;
+    s->ctx = NULL;
+}
+
+/* Context: QEMU global mutex held, picks the home AioContext of a new LUN */
+AioContext *virtio_scsi_dataplane_next_ctx(VirtIOSCSI *s)
+{
+    return s->ctxs[s->next_ctx++ % s->num_ctxs];
 }
 
+bool virtio_scsi_dataplane_owns_ctx(VirtIOSCSI *s, AioContext *ctx)
+{
+    int i;
+
+    for (i = 0; i < s->num_ctxs; i++) {
+        if (s->ctxs[i] == ctx) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Context: any thread.  A request may complete in the AioContext of its
+ * LUN, which need not be the one that runs its virtqueue.  Hand it over
+ * without taking any lock; the virtqueue's AioContext pushes it to the
+ * guest and coalesces the notification.
+ *
+ * Returns true if @req was handed over and must not be touched anymore.
+ */
+bool virtio_scsi_dataplane_defer_req(VirtIOSCSI *s, VirtIOSCSIReq *req)
+{
+    VirtIOSCSIQueue *q;
+
+    if (!s->dataplane_started || s->dataplane_fenced) {
+        return false;
+    }
+
+    q = &s->queues[virtio_get_queue_index(req->vq)];
+    if (q->ctx == qemu_get_current_aio_context()) {
+        return false;
+    }
+
+    QSLIST_INSERT_HEAD_ATOMIC(&q->complete_list, req, complete_next);
+    qemu_bh_schedule(q->complete_bh);
+    return true;
+}
+
+/*
+ * Request virtqueues are only touched from their own AioContext, so no
+ * lock is taken here; each request acquires the AioContext of its LUN.
+ */
 static bool virtio_scsi_data_plane_handle_cmd(VirtIODevice *vdev,
                                               VirtQueue *vq)
 {
-    bool progress;
     VirtIOSCSI *s = VIRTIO_SCSI(vdev);
 
-    virtio_scsi_acquire(s);
     assert(s->ctx && s->dataplane_started);
-    progress = virtio_scsi_handle_cmd_vq(s, vq);
-    virtio_scsi_release(s);
-    return progress;
+    return virtio_scsi_handle_cmd_vq(s, vq);
 }
 
 static bool virtio_scsi_data_plane_handle_ctrl(VirtIODevice *vdev,
@@ -91,6 +241,7 @@ static bool virtio_scsi_data_plane_handle_event(VirtIODevice *vdev,
 static int virtio_scsi_vring_init(VirtIOSCSI *s, VirtQueue *vq, int n,
                                   VirtIOHandleAIOOutput fn)
 {
+    AioContext *ctx = s->queues[n].ctx;
     BusState *qbus = BUS(qdev_get_parent_bus(DEVICE(s)));
     int rc;
 
@@ -103,21 +254,55 @@ static int virtio_scsi_vring_init(VirtIOSCSI *s, VirtQueue *vq, int n,
         return rc;
     }
 
-    virtio_queue_aio_set_host_notifier_handler(vq, s->ctx, fn);
+    aio_context_acquire(ctx);
+    virtio_queue_aio_set_host_notifier_handler(vq, ctx, fn);
+    aio_context_release(ctx);
     return 0;
 }
 
-/* Context: BH in IOThread */
+/* Context: BH in IOThread, detaches the virtqueues it runs */
 static void virtio_scsi_dataplane_stop_bh(void *opaque)
 {
     VirtIOSCSI *s = opaque;
     VirtIOSCSICommon *vs = VIRTIO_SCSI_COMMON(s);
+    AioContext *ctx = qemu_get_current_aio_context();
     int i;
 
-    virtio_queue_aio_set_host_notifier_handler(vs->ctrl_vq, s->ctx, NULL);
-    virtio_queue_aio_set_host_notifier_handler(vs->event_vq, s->ctx, NULL);
-    for (i = 0; i < vs->conf.num_queues; i++) {
-        virtio_queue_aio_set_host_notifier_handler(vs->cmd_vqs[i], s->ctx, NULL);
+    for (i = 0; i < vs->conf.num_queues + VIRTIO_SCSI_VQ_NUM_FIXED; i++) {
+        VirtIOSCSIQueue *q = &s->queues[i];
+
+        if (q->ctx == ctx) {
+            virtio_queue_aio_set_host_notifier_handler(q->vq, ctx, NULL);
+        }
+    }
+}
+
+/* Context: BH in IOThread, pushes completions still in flight */
+static void virtio_scsi_dataplane_flush_bh(void *opaque)
+{
+    VirtIOSCSI *s = opaque;
+    VirtIOSCSICommon *vs = VIRTIO_SCSI_COMMON(s);
+    AioContext *ctx = qemu_get_current_aio_context();
+    int i;
+
+    for (i = 0; i < vs->conf.num_queues + VIRTIO_SCSI_VQ_NUM_FIXED; i++) {
+        VirtIOSCSIQueue *q = &s->queues[i];
+
+        if (q->ctx == ctx) {
+            virtio_scsi_complete_bh(q);
+        }
+    }
+}
+
+/* Context: QEMU global mutex held */
+static void virtio_scsi_dataplane_run_bh(VirtIOSCSI *s, QEMUBHFunc *cb)
+{
+    int i;
+
+    for (i = 0; i < s->num_ctxs; i++) {
+        aio_context_acquire(s->ctxs[i]);
+        aio_wait_bh_oneshot(s->ctxs[i], cb, s);
+        aio_context_release(s->ctxs[i]);
     }
 }
 
@@ -147,7 +332,6 @@ int virtio_scsi_dataplane_start(VirtIODevice *vdev)
         goto fail_guest_notifiers;
     }
 
-    aio_context_acquire(s->ctx);
     rc = virtio_scsi_vring_init(s, vs->ctrl_vq, 0,
                                 virtio_scsi_data_plane_handle_ctrl);
     if (rc) {
@@ -168,18 +352,23 @@ int virtio_scsi_dataplane_start(VirtIODevice *vdev)
 
     s->dataplane_starting = false;
     s->dataplane_started = true;
-    aio_context_release(s->ctx);
     return 0;
 
 fail_vrings:
-    aio_wait_bh_oneshot(s->ctx, virtio_scsi_dataplane_stop_bh, s);
-    aio_context_release(s->ctx);
+    virtio_scsi_dataplane_run_bh(s, virtio_scsi_dataplane_stop_bh);
     for (i = 0; i < vs->conf.num_queues + 2; i++) {
         virtio_bus_set_host_notifier(VIRTIO_BUS(qbus), i, false);
         virtio_bus_cleanup_host_notifier(VIRTIO_BUS(qbus), i);
     }
     k->set_guest_notifiers(qbus->parent, vs->conf.num_queues + 2, false);
 fail_guest_notifiers:
+    if (s->num_ctxs > 1) {
+        /*
+         * The main loop cannot take over virtqueues whose LUNs complete
+         * requests in several IOThreads.
+         */
+        virtio_error(vdev, "virtio-scsi: iothreads require guest notifiers");
+    }
     s->dataplane_fenced = true;
     s->dataplane_starting = false;
     s->dataplane_started = true;
@@ -207,12 +396,13 @@ void virtio_scsi_dataplane_stop(VirtIODevice *vdev)
     }
     s->dataplane_stopping = true;
 
-    aio_context_acquire(s->ctx);
-    aio_wait_bh_oneshot(s->ctx, virtio_scsi_dataplane_stop_bh, s);
-    aio_context_release(s->ctx);
+    virtio_scsi_dataplane_run_bh(s, virtio_scsi_dataplane_stop_bh);
 
     blk_drain_all(); /* ensure there are no in-flight requests */
 
+    /* Push requests that completed in another AioContext than their vq */
+    virtio_scsi_dataplane_run_bh(s, virtio_scsi_dataplane_flush_bh);
+
     for (i = 0; i < vs->conf.num_queues + 2; i++) {
         virtio_bus_set_host_notifier(VIRTIO_BUS(qbus), i, false);
         virtio_bus_cleanup_host_notifier(VIRTIO_BUS(qbus), i);
@@ -1,4 +1,5 @@
 #include "qemu/osdep.h"
+#include "qapi/qapi-commands-misc.h"
 #include "hw/virtio/vhost.h"
 #include "hw/virtio/vhost-user.h"
 
@@ -15,3 +16,8 @@ bool vhost_user_init(VhostUserState *user, CharBackend *chr, Error **errp)
 void vhost_user_cleanup(VhostUserState *user)
 {
 }
+
+VhostIOTLBInfoList *qmp_query_vhost_iotlb(Error **errp)
+{
+    return NULL;
+}
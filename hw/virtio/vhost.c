@@ -15,6 +15,7 @@
 
 #include "qemu/osdep.h"
 #include "qapi/error.h"
+#include "qapi/qapi-commands-misc.h"
 #include "hw/virtio/vhost.h"
 #include "qemu/atomic.h"
 #include "qemu/range.h"
@@ -458,6 +459,14 @@ static void vhost_begin(MemoryListener *listener)
     dev->n_tmp_sections = 0;
 }
 
+static void vhost_iotlb_cache_flush(struct vhost_dev *dev)
+{
+    if (dev->iotlb_cache) {
+        iova_tree_destroy(dev->iotlb_cache);
+        dev->iotlb_cache = iova_tree_new();
+    }
+}
+
 static void vhost_commit(MemoryListener *listener)
 {
     struct vhost_dev *dev = container_of(listener, struct vhost_dev,
@@ -497,6 +506,9 @@ static void vhost_commit(MemoryListener *listener)
         goto out;
     }
 
+    /* Cached translations point to the old user addresses */
+    vhost_iotlb_cache_flush(dev);
+
     /* Rebuild the regions list from the new sections list */
     regions_size = offsetof(struct vhost_memory, regions) +
                        dev->n_mem_sections * sizeof dev->mem->regions[0];
@@ -698,7 +710,15 @@ static void vhost_iommu_unmap_notify(IOMMUNotifier *n, IOMMUTLBEntry *iotlb)
     struct vhost_iommu *iommu = container_of(n, struct vhost_iommu, n);
     struct vhost_dev *hdev = iommu->hdev;
     hwaddr iova = iotlb->iova + iommu->iommu_offset;
+    DMAMap map = {
+        .iova = iova,
+        .size = iotlb->addr_mask,
+    };
 
+    if (hdev->iotlb_cache) {
+        iova_tree_remove(hdev->iotlb_cache, &map);
+    }
+    hdev->iotlb_stats.invalidations++;
     if (vhost_backend_invalidate_device_iotlb(hdev, iova,
                                               iotlb->addr_mask + 1)) {
         error_report("Fail to invalidate device iotlb");
@@ -1010,20 +1030,90 @@ static int vhost_memory_region_lookup(struct vhost_dev *hdev,
     return -EFAULT;
 }
 
+/* Smallest vIOMMU page; IOTLB updates never start in the middle of one */
+#define VHOST_IOTLB_MIN_PAGE_SIZE 4096
+
+static const DMAMap *vhost_iotlb_cache_lookup(struct vhost_dev *dev,
+                                              uint64_t iova, int write)
+{
+    const DMAMap *map = iova_tree_find_address(dev->iotlb_cache, iova);
+
+    if (map && (map->perm & (write ? IOMMU_WO : IOMMU_RO))) {
+        return map;
+    }
+    return NULL;
+}
+
+/*
+ * Cache the translation of [iova, iova + len) to @uaddr.  Neighbours that
+ * are contiguous both in IOVA and in user address space, with the same
+ * permissions, are merged so that a later miss can be answered with the
+ * whole range at once.
+ */
+static const DMAMap *vhost_iotlb_cache_insert(struct vhost_dev *dev,
+                                              uint64_t iova, uint64_t uaddr,
+                                              uint64_t len,
+                                              IOMMUAccessFlags perm)
+{
+    IOVATree *tree = dev->iotlb_cache;
+    DMAMap map = {
+        .iova = iova,
+        .translated_addr = uaddr,
+        .size = len - 1,
+        .perm = perm,
+    };
+    const DMAMap *found;
+    DMAMap old;
+
+    /* Drop stale translations first */
+    iova_tree_remove(tree, &map);
+
+    found = iova ? iova_tree_find_address(tree, iova - 1) : NULL;
+    if (found && found->perm == perm &&
+        found->translated_addr + found->size + 1 == uaddr) {
+        old = *found;
+        iova_tree_remove(tree, &old);
+        map.iova = old.iova;
+        map.translated_addr = old.translated_addr;
+        map.size += old.size + 1;
+    }
+
+    found = iova + len ? iova_tree_find_address(tree, iova + len) : NULL;
+    if (found && found->perm == perm &&
+        found->translated_addr == uaddr + len) {
+        old = *found;
+        iova_tree_remove(tree, &old);
+        map.size += old.size + 1;
+    }
+
+    iova_tree_insert(tree, &map);
+    return iova_tree_find_address(tree, iova);
+}
+
 int vhost_device_iotlb_miss(struct vhost_dev *dev, uint64_t iova, int write)
 {
     IOMMUTLBEntry iotlb;
+    const DMAMap *map;
     uint64_t uaddr, len;
+    hwaddr start;
     int ret = -EFAULT;
 
     RCU_READ_LOCK_GUARD();
 
     trace_vhost_iotlb_miss(dev, 1);
+    dev->iotlb_stats.misses++;
+
+    map = vhost_iotlb_cache_lookup(dev, iova, write);
+    if (map) {
+        dev->iotlb_stats.cache_hits++;
+    } else {
+        iotlb = address_space_get_iotlb_entry(dev->vdev->dma_as,
+                                              iova, write,
+                                              MEMTXATTRS_UNSPECIFIED);
+        if (iotlb.target_as == NULL) {
+            goto done;
+        }
 
-    iotlb = address_space_get_iotlb_entry(dev->vdev->dma_as,
-                                          iova, write,
-                                          MEMTXATTRS_UNSPECIFIED);
-    if (iotlb.target_as != NULL) {
         ret = vhost_memory_region_lookup(dev, iotlb.translated_addr,
                                          &uaddr, &len);
         if (ret) {
@@ -1034,17 +1124,30 @@ int vhost_device_iotlb_miss(struct vhost_dev *dev, uint64_t iova, int write)
         }
 
         len = MIN(iotlb.addr_mask + 1, len);
-        iova = iova & ~iotlb.addr_mask;
+        map = vhost_iotlb_cache_insert(dev, iova & ~iotlb.addr_mask, uaddr,
+                                       len, iotlb.perm);
+    }
 
-        ret = vhost_backend_update_device_iotlb(dev, iova, uaddr,
-                                                len, iotlb.perm);
-        if (ret) {
-            trace_vhost_iotlb_miss(dev, 4);
-            error_report("Fail to update device iotlb");
-            goto out;
-        }
+    /*
+     * Send everything from the missing page to the end of the contiguous
+     * range in one message.  The backend has no entry covering @iova, so
+     * it cannot have one starting at @start either.
+     */
+    start = MAX(map->iova, iova & ~(hwaddr)(VHOST_IOTLB_MIN_PAGE_SIZE - 1));
+    len = map->iova + map->size - start + 1;
+    trace_vhost_iotlb_update(dev, start, len, map->perm);
+    dev->iotlb_stats.updates++;
+    ret = vhost_backend_update_device_iotlb(dev, start,
+                                            map->translated_addr +
+                                            (start - map->iova),
+                                            len, map->perm);
+    if (ret) {
+        trace_vhost_iotlb_miss(dev, 4);
+        error_report("Fail to update device iotlb");
+        goto out;
     }
 
+done:
     trace_vhost_iotlb_miss(dev, 2);
 
 out:
@@ -1747,7 +1850,8 @@ int vhost_dev_start(struct vhost_dev *hdev, VirtIODevice *vdev)
     }
     if (vhost_dev_has_iommu(hdev) &&
         hdev->vhost_ops->vhost_set_iotlb_callback) {
-            hdev->vhost_ops->vhost_set_iotlb_callback(hdev, true);
+        hdev->iotlb_cache = iova_tree_new();
+        hdev->vhost_ops->vhost_set_iotlb_callback(hdev, true);
 
         /* Update used ring information for IOTLB to work correctly,
          * vhost-kernel code requires for this.*/
@@ -1798,6 +1902,10 @@ void vhost_dev_stop(struct vhost_dev *hdev, VirtIODevice *vdev)
         }
         memory_listener_unregister(&hdev->iommu_listener);
     }
+    if (hdev->iotlb_cache) {
+        iova_tree_destroy(hdev->iotlb_cache);
+        hdev->iotlb_cache = NULL;
+    }
     vhost_log_put(hdev, true);
     hdev->started = false;
     hdev->vdev = NULL;
@@ -1812,3 +1920,33 @@ int vhost_net_set_backend(struct vhost_dev *hdev,
 
     return -1;
 }
+
+VhostIOTLBInfoList *qmp_query_vhost_iotlb(Error **errp)
+{
+    VhostIOTLBInfoList *head = NULL;
+    VhostIOTLBInfoList **prev = &head;
+    struct vhost_dev *hdev;
+
+    QLIST_FOREACH(hdev, &vhost_devices, entry) {
+        VhostIOTLBInfoList *elem;
+        VhostIOTLBInfo *info;
+
+        if (!hdev->started || !hdev->iotlb_cache) {
+            continue;
+        }
+
+        info = g_new0(VhostIOTLBInfo, 1);
+        info->device = object_get_canonical_path(OBJECT(hdev->vdev));
+        info->vq_index = hdev->vq_index;
+        info->misses = hdev->iotlb_stats.misses;
+        info->cache_hits = hdev->iotlb_stats.cache_hits;
+        info->updates = hdev->iotlb_stats.updates;
+        info->invalidations = hdev->iotlb_stats.invalidations;
+
+        elem = g_new0(VhostIOTLBInfoList, 1);
+        elem->value = info;
+        *prev = elem;
+        prev = &elem->next;
+    }
+    return head;
+}
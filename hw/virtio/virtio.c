@@ -130,6 +130,7 @@ struct VirtQueue
     EventNotifier guest_notifier;
     EventNotifier host_notifier;
     bool host_notifier_enabled;
+    VirtQueueElementPool *elem_pool;
     QLIST_ENTRY(VirtQueue) node;
 };
 
@@ -738,7 +739,8 @@ void virtqueue_unpop(VirtQueue *vq, const VirtQueueElement *elem,
 {
 
     if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
-        virtqueue_packed_rewind(vq, 1);
+        /* The packed ring is consumed one descriptor at a time */
+        virtqueue_packed_rewind(vq, elem->ndescs);
     } else {
         virtqueue_split_rewind(vq, 1);
     }
@@ -1388,7 +1390,73 @@ void virtqueue_map(VirtIODevice *vdev, VirtQueueElement *elem)
                                                                         false);
 }
 
-static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_num)
+/*
+ * Elements handed out by virtqueue_pop_batch() come from a per-virtqueue
+ * pool of equally sized slots.  A slot is big enough for the device's
+ * request structure plus VIRTQUEUE_POOL_MAX_SG scatter-gather entries;
+ * larger chains fall back to g_malloc().  Slots are recycled by
+ * virtqueue_element_free() instead of going back to the allocator.
+ *
+ * The pool is only touched from the context that processes the virtqueue,
+ * so it needs no locking.  If the virtqueue is deleted while elements are
+ * still owned by the device, the pool is orphaned and freed together with
+ * its last outstanding element.
+ */
+#define VIRTQUEUE_POOL_MAX_SG 16
+
+struct VirtQueueElementPool {
+    size_t sz;
+    size_t slot_size;
+    unsigned int outstanding;
+    unsigned int nr_free;
+    unsigned int max_free;
+    bool orphaned;
+    void **free_slots;
+};
+
+static VirtQueueElementPool *virtqueue_pool_new(size_t sz,
+                                                unsigned int max_free)
+{
+    VirtQueueElementPool *pool = g_new0(VirtQueueElementPool, 1);
+
+    pool->sz = sz;
+    pool->slot_size = QEMU_ALIGN_UP(sz, __alignof__(hwaddr)) +
+        VIRTQUEUE_POOL_MAX_SG * (sizeof(hwaddr) + sizeof(struct iovec));
+    pool->max_free = max_free;
+    pool->free_slots = g_new(void *, max_free);
+    return pool;
+}
+
+static void virtqueue_pool_free(VirtQueueElementPool *pool)
+{
+    unsigned int i;
+
+    for (i = 0; i < pool->nr_free; i++) {
+        g_free(pool->free_slots[i]);
+    }
+    g_free(pool->free_slots);
+    g_free(pool);
+}
+
+/* Detach the element pool from @vq, e.g. when the queue is deleted */
+static void virtqueue_pool_release(VirtQueue *vq)
+{
+    VirtQueueElementPool *pool = vq->elem_pool;
+
+    if (!pool) {
+        return;
+    }
+
+    vq->elem_pool = NULL;
+    if (pool->outstanding) {
+        pool->orphaned = true;
+    } else {
+        virtqueue_pool_free(pool);
+    }
+}
+
+static void *virtqueue_alloc_element(VirtQueueElementPool *pool, size_t sz,
+                                     unsigned out_num, unsigned in_num)
 {
     VirtQueueElement *elem;
     size_t in_addr_ofs = QEMU_ALIGN_UP(sz, __alignof__(elem->in_addr[0]));
@@ -1399,7 +1467,17 @@ static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_nu
     size_t out_sg_end = out_sg_ofs + out_num * sizeof(elem->out_sg[0]);
 
     assert(sz >= sizeof(VirtQueueElement));
-    elem = g_malloc(out_sg_end);
+    if (pool && (pool->sz != sz || out_sg_end > pool->slot_size)) {
+        pool = NULL;
+    }
+
+    if (!pool) {
+        elem = g_malloc(out_sg_end);
+    } else if (pool->nr_free) {
+        elem = pool->free_slots[--pool->nr_free];
+    } else {
+        elem = g_malloc(pool->slot_size);
+    }
     trace_virtqueue_alloc_element(elem, sz, in_num, out_num);
     elem->out_num = out_num;
     elem->in_num = in_num;
@@ -1407,13 +1485,54 @@ static void *virtqueue_alloc_element(size_t sz, unsigned out_num, unsigned in_nu
     elem->out_addr = (void *)elem + out_addr_ofs;
     elem->in_sg = (void *)elem + in_sg_ofs;
     elem->out_sg = (void *)elem + out_sg_ofs;
+    elem->pool = pool;
+    if (pool) {
+        pool->outstanding++;
+    }
     return elem;
 }
 
-static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
+/* virtqueue_element_free:
+ * @elem: element returned by virtqueue_pop(), virtqueue_pop_batch() or
+ *        qemu_get_virtqueue_element(), may be NULL
+ *
+ * Free an element, returning it to its virtqueue's pool if it came from one.
+ * Callers of virtqueue_pop_batch() must use this instead of g_free().
+ */
+void virtqueue_element_free(void *opaque)
+{
+    VirtQueueElement *elem = opaque;
+    VirtQueueElementPool *pool;
+
+    if (!elem) {
+        return;
+    }
+
+    pool = elem->pool;
+    if (!pool) {
+        g_free(elem);
+        return;
+    }
+
+    pool->outstanding--;
+    if (!pool->orphaned && pool->nr_free < pool->max_free) {
+        pool->free_slots[pool->nr_free++] = elem;
+        return;
+    }
+
+    g_free(elem);
+    if (pool->orphaned && !pool->outstanding) {
+        virtqueue_pool_free(pool);
+    }
+}
+
+/* Called within rcu_read_lock().  Takes the head at vq->last_avail_idx,
+ * callers must have checked that it is available.  */
+static void *virtqueue_split_pop_head(VirtQueue *vq,
+                                      VRingMemoryRegionCaches *caches,
+                                      size_t sz, VirtQueueElementPool *pool)
 {
     unsigned int i, head, max;
-    VRingMemoryRegionCaches *caches;
     MemoryRegionCache indirect_desc_cache = MEMORY_REGION_CACHE_INVALID;
     MemoryRegionCache *desc_cache;
     int64_t len;
@@ -1425,14 +1544,6 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
     VRingDesc desc;
     int rc;
 
-    RCU_READ_LOCK_GUARD();
-    if (virtio_queue_empty_rcu(vq)) {
-        goto done;
-    }
-    /* Needed after virtio_queue_empty(), see comment in
-     * virtqueue_num_heads(). */
-    smp_rmb();
-
     /* When we start there are none of either input nor output. */
     out_num = in_num = elem_entries = 0;
 
@@ -1447,23 +1558,8 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
         goto done;
     }
 
-    if (virtio_vdev_has_feature(vdev, VIRTIO_RING_F_EVENT_IDX)) {
-        vring_set_avail_event(vq, vq->last_avail_idx);
-    }
-
     i = head;
 
-    caches = vring_get_region_caches(vq);
-    if (!caches) {
-        virtio_error(vdev, "Region caches not initialized");
-        goto done;
-    }
-
-    if (caches->desc.len < max * sizeof(VRingDesc)) {
-        virtio_error(vdev, "Cannot map descriptor ring");
-        goto done;
-    }
-
     desc_cache = &caches->desc;
     vring_split_desc_read(vdev, &desc, desc_cache, i);
     if (desc.flags & VRING_DESC_F_INDIRECT) {
@@ -1522,7 +1618,7 @@ static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
     }
 
     /* Now copy what we have collected and mapped */
-    elem = virtqueue_alloc_element(sz, out_num, in_num);
+    elem = virtqueue_alloc_element(pool, sz, out_num, in_num);
     elem->index = head;
     elem->ndescs = 1;
     for (i = 0; i < out_num; i++) {
@@ -1547,10 +1643,94 @@ err_undo_map:
     goto done;
 }
 
-static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
+/* Called within rcu_read_lock().  */
+static VRingMemoryRegionCaches *virtqueue_get_desc_caches(VirtQueue *vq)
+{
+    VRingMemoryRegionCaches *caches = vring_get_region_caches(vq);
+
+    if (!caches) {
+        virtio_error(vq->vdev, "Region caches not initialized");
+        return NULL;
+    }
+
+    if (caches->desc.len < vq->vring.num * sizeof(VRingDesc)) {
+        virtio_error(vq->vdev, "Cannot map descriptor ring");
+        return NULL;
+    }
+
+    return caches;
+}
+
+static void *virtqueue_split_pop(VirtQueue *vq, size_t sz)
 {
-    unsigned int i, max;
     VRingMemoryRegionCaches *caches;
+    VirtQueueElement *elem = NULL;
+
+    RCU_READ_LOCK_GUARD();
+    if (virtio_queue_empty_rcu(vq)) {
+        return NULL;
+    }
+    /* Needed after virtio_queue_empty(), see comment in
+     * virtqueue_num_heads(). */
+    smp_rmb();
+
+    caches = virtqueue_get_desc_caches(vq);
+    if (caches) {
+        elem = virtqueue_split_pop_head(vq, caches, sz, NULL);
+    }
+
+    if (virtio_vdev_has_feature(vq->vdev, VIRTIO_RING_F_EVENT_IDX)) {
+        vring_set_avail_event(vq, vq->last_avail_idx);
+    }
+
+    return elem;
+}
+
+static unsigned int virtqueue_split_pop_batch(VirtQueue *vq, size_t sz,
+                                              void **elems, unsigned int max)
+{
+    VRingMemoryRegionCaches *caches;
+    unsigned int n = 0;
+    int num_heads;
+
+    RCU_READ_LOCK_GUARD();
+    if (unlikely(!vq->vring.avail)) {
+        return 0;
+    }
+
+    /* A single avail index read and read barrier covers the whole batch */
+    num_heads = virtqueue_num_heads(vq, vq->last_avail_idx);
+    if (num_heads <= 0) {
+        return 0;
+    }
+
+    caches = virtqueue_get_desc_caches(vq);
+    if (!caches) {
+        return 0;
+    }
+
+    max = MIN(max, num_heads);
+    while (n < max) {
+        elems[n] = virtqueue_split_pop_head(vq, caches, sz, vq->elem_pool);
+        if (!elems[n]) {
+            break;
+        }
+        n++;
+    }
+
+    if (virtio_vdev_has_feature(vq->vdev, VIRTIO_RING_F_EVENT_IDX)) {
+        vring_set_avail_event(vq, vq->last_avail_idx);
+    }
+
+    return n;
+}
+
+/* Called within rcu_read_lock().  */
+static void *virtqueue_packed_pop_rcu(VirtQueue *vq,
+                                      VRingMemoryRegionCaches *caches,
+                                      size_t sz, VirtQueueElementPool *pool)
+{
+    unsigned int i, max;
     MemoryRegionCache indirect_desc_cache = MEMORY_REGION_CACHE_INVALID;
     MemoryRegionCache *desc_cache;
     int64_t len;
@@ -1563,7 +1743,6 @@ static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
     uint16_t id;
     int rc;
 
-    RCU_READ_LOCK_GUARD();
     if (virtio_queue_packed_empty_rcu(vq)) {
         goto done;
     }
@@ -1580,17 +1759,6 @@ static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
 
     i = vq->last_avail_idx;
 
-    caches = vring_get_region_caches(vq);
-    if (!caches) {
-        virtio_error(vdev, "Region caches not initialized");
-        goto done;
-    }
-
-    if (caches->desc.len < max * sizeof(VRingDesc)) {
-        virtio_error(vdev, "Cannot map descriptor ring");
-        goto done;
-    }
-
     desc_cache = &caches->desc;
     vring_packed_desc_read(vdev, &desc, desc_cache, i, true);
     id = desc.id;
@@ -1648,7 +1816,7 @@ static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
     } while (rc == VIRTQUEUE_READ_DESC_MORE);
 
     /* Now copy what we have collected and mapped */
-    elem = virtqueue_alloc_element(sz, out_num, in_num);
+    elem = virtqueue_alloc_element(pool, sz, out_num, in_num);
     for (i = 0; i < out_num; i++) {
         elem->out_addr[i] = addr[i];
         elem->out_sg[i] = iov[i];
@@ -1682,6 +1850,51 @@ err_undo_map:
     goto done;
 }
 
+static void *virtqueue_packed_pop(VirtQueue *vq, size_t sz)
+{
+    VRingMemoryRegionCaches *caches;
+
+    RCU_READ_LOCK_GUARD();
+    if (virtio_queue_packed_empty_rcu(vq)) {
+        return NULL;
+    }
+
+    caches = virtqueue_get_desc_caches(vq);
+    if (!caches) {
+        return NULL;
+    }
+
+    return virtqueue_packed_pop_rcu(vq, caches, sz, NULL);
+}
+
+static unsigned int virtqueue_packed_pop_batch(VirtQueue *vq, size_t sz,
+                                               void **elems, unsigned int max)
+{
+    VRingMemoryRegionCaches *caches;
+    unsigned int n = 0;
+
+    RCU_READ_LOCK_GUARD();
+    if (virtio_queue_packed_empty_rcu(vq)) {
+        return 0;
+    }
+
+    caches = virtqueue_get_desc_caches(vq);
+    if (!caches) {
+        return 0;
+    }
+
+    /* Availability is per descriptor here, so each head is still checked */
+    while (n < max) {
+        elems[n] = virtqueue_packed_pop_rcu(vq, caches, sz, vq->elem_pool);
+        if (!elems[n]) {
+            break;
+        }
+        n++;
+    }
+
+    return n;
+}
+
 void *virtqueue_pop(VirtQueue *vq, size_t sz)
 {
     if (virtio_device_disabled(vq->vdev)) {
@@ -1695,6 +1908,36 @@ void *virtqueue_pop(VirtQueue *vq, size_t sz)
     }
 }
 
+/* virtqueue_pop_batch:
+ * @vq: The #VirtQueue
+ * @sz: size of the device request structure embedding #VirtQueueElement
+ * @elems: array receiving at least @max elements
+ * @max: maximum number of elements to pop
+ *
+ * Pop up to @max elements in one pass over the ring, taking the RCU read
+ * lock and region caches only once.  Elements are allocated from a pool
+ * owned by @vq and must be released with virtqueue_element_free().
+ *
+ * Returns: the number of elements stored in @elems
+ */
+unsigned int virtqueue_pop_batch(VirtQueue *vq, size_t sz, void **elems,
+                                 unsigned int max)
+{
+    if (virtio_device_disabled(vq->vdev) || !max) {
+        return 0;
+    }
+
+    if (!vq->elem_pool) {
+        vq->elem_pool = virtqueue_pool_new(sz, vq->vring.num);
+    }
+
+    if (virtio_vdev_has_feature(vq->vdev, VIRTIO_F_RING_PACKED)) {
+        return virtqueue_packed_pop_batch(vq, sz, elems, max);
+    } else {
+        return virtqueue_split_pop_batch(vq, sz, elems, max);
+    }
+}
+
 static unsigned int virtqueue_packed_drop_all(VirtQueue *vq)
 {
     VRingMemoryRegionCaches *caches;
@@ -1828,7 +2071,7 @@ void *qemu_get_virtqueue_element(VirtIODevice *vdev, QEMUFile *f, size_t sz)
     assert(ARRAY_SIZE(data.in_addr) >= data.in_num);
     assert(ARRAY_SIZE(data.out_addr) >= data.out_num);
 
-    elem = virtqueue_alloc_element(sz, data.out_num, data.in_num);
+    elem = virtqueue_alloc_element(NULL, sz, data.out_num, data.in_num);
     elem->index = data.index;
 
     for (i = 0; i < elem->in_num; i++) {
@@ -2425,6 +2668,7 @@ void virtio_delete_queue(VirtQueue *vq)
     vq->handle_aio_output = NULL;
     g_free(vq->used_elems);
     vq->used_elems = NULL;
+    virtqueue_pool_release(vq);
     virtio_virtqueue_reset_region_cache(vq);
 }
 
@@ -3697,6 +3941,7 @@ static void virtio_device_free_virtqueues(VirtIODevice *vdev)
         if (vdev->vq[i].vring.num == 0) {
             break;
         }
+        virtqueue_pool_release(&vdev->vq[i]);
         virtio_virtqueue_reset_region_cache(&vdev->vq[i]);
     }
     g_free(vdev->vq);
@@ -3722,7 +3967,7 @@ static Property virtio_properties[] = {
     DEFINE_PROP_END_OF_LIST(),
 };
 
-static int virtio_device_start_ioeventfd_impl(VirtIODevice *vdev)
+int virtio_device_start_ioeventfd_impl(VirtIODevice *vdev)
 {
     VirtioBusState *qbus = VIRTIO_BUS(qdev_get_parent_bus(DEVICE(vdev)));
     int i, n, r, err;
@@ -3784,7 +4029,7 @@ int virtio_device_start_ioeventfd(VirtIODevice *vdev)
     return virtio_bus_start_ioeventfd(vbus);
 }
 
-static void virtio_device_stop_ioeventfd_impl(VirtIODevice *vdev)
+void virtio_device_stop_ioeventfd_impl(VirtIODevice *vdev)
 {
     VirtioBusState *qbus = VIRTIO_BUS(qdev_get_parent_bus(DEVICE(vdev)));
     int n, r;
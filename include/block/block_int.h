@@ -453,6 +453,27 @@ struct BlockDriver {
     int coroutine_fn (*bdrv_co_ioctl)(BlockDriverState *bs,
                                       unsigned long int req, void *buf);
 
+    /*
+     * Zoned block devices.  Offsets and lengths are in bytes.
+     *
+     * bdrv_co_zone_report() fills up to *@nr_zones descriptors starting with
+     * the zone containing @offset and updates *@nr_zones to the number of
+     * zones reported.  bdrv_co_zone_append() writes @qiov at the write
+     * pointer of the zone starting at *@offset and returns the offset the
+     * data was written to in *@offset.
+     */
+    int coroutine_fn (*bdrv_co_zone_report)(BlockDriverState *bs,
+                                            int64_t offset,
+                                            unsigned int *nr_zones,
+                                            BlockZoneDescriptor *zones);
+    int coroutine_fn (*bdrv_co_zone_mgmt)(BlockDriverState *bs,
+                                          BlockZoneOp op,
+                                          int64_t offset, int64_t len);
+    int coroutine_fn (*bdrv_co_zone_append)(BlockDriverState *bs,
+                                            int64_t *offset,
+                                            QEMUIOVector *qiov,
+                                            BdrvRequestFlags flags);
+
     /* List of options for creating images, terminated by name == NULL */
     QemuOptsList *create_opts;
 
@@ -686,8 +707,39 @@ typedef struct BlockLimits {
 
     /* maximum number of iovec elements */
     int max_iov;
+
+    /* Zoned model of the device, BLK_Z_NONE for regular devices */
+    BlockZoneModel zoned;
+
+    /* Size of a zone in bytes, a power of 2 */
+    uint32_t zone_size;
+
+    /* Number of zones of the device */
+    uint32_t nr_zones;
+
+    /* Maximum sectors in a zone append write, 0 if not supported */
+    uint32_t max_append_sectors;
+
+    /* Maximum number of open and active zones, 0 for no limit */
+    uint32_t max_open_zones;
+    uint32_t max_active_zones;
+
+    /* Minimum write alignment for sequential write required zones */
+    uint32_t write_granularity;
 } BlockLimits;
 
+/*
+ * Write pointers of the zones of a zoned block device, in bytes.  The write
+ * pointer of a conventional zone is its start offset with BDRV_ZT_CONV set.
+ */
+#define BDRV_ZT_CONV            (1ULL << 63)
+#define BDRV_ZT_IS_CONV(wp)     ((wp) & BDRV_ZT_CONV)
+
+typedef struct BlockZoneWps {
+    CoMutex colock;
+    uint64_t wp[];
+} BlockZoneWps;
+
 typedef struct BdrvOpBlocker BdrvOpBlocker;
 
 typedef struct BdrvAioNotifier {
@@ -873,6 +925,9 @@ struct BlockDriverState {
     /* I/O Limits */
     BlockLimits bl;
 
+    /* Cached zone write pointers, if the driver tracks them */
+    BlockZoneWps *wps;
+
     /* Flags honored during pwrite (so far: BDRV_REQ_FUA,
      * BDRV_REQ_WRITE_UNCHANGED).
      * If a driver does not support BDRV_REQ_WRITE_UNCHANGED, those
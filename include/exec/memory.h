@@ -44,6 +44,11 @@ DECLARE_OBJ_CHECKERS(IOMMUMemoryRegion, IOMMUMemoryRegionClass,
 
 extern bool global_dirty_log;
 
+/* Users of the global dirty log, see memory_global_dirty_log_start() */
+#define GLOBAL_DIRTY_MIGRATION  (1U << 0)
+#define GLOBAL_DIRTY_LIMIT      (1U << 1)
+#define GLOBAL_DIRTY_MASK       (GLOBAL_DIRTY_MIGRATION | GLOBAL_DIRTY_LIMIT)
+
 typedef struct MemoryRegionOps MemoryRegionOps;
 
 struct ReservedRegion {
@@ -559,6 +564,18 @@ struct MemoryListener {
      */
     void (*log_sync)(MemoryListener *listener, MemoryRegionSection *section);
 
+    /**
+     * @log_sync_global:
+     *
+     * This is the global version of @log_sync when the listener does
+     * not have a way to synchronize the log with finer granularity.
+     * When the listener registers with @log_sync_global defined, then
+     * its @log_sync must be NULL.  Vice versa.
+     *
+     * @listener: The #MemoryListener.
+     */
+    void (*log_sync_global)(MemoryListener *listener);
+
     /**
      * @log_clear:
      *
@@ -1989,13 +2006,23 @@ void memory_listener_unregister(MemoryListener *listener);
 
 /**
  * memory_global_dirty_log_start: begin dirty logging for all regions
+ *
+ * Logging starts with the first user and goes on until all of them
+ * have called memory_global_dirty_log_stop().
+ *
+ * @flags: the users that need the log, a mask of GLOBAL_DIRTY_*
  */
-void memory_global_dirty_log_start(void);
+void memory_global_dirty_log_start(unsigned int flags);
 
 /**
  * memory_global_dirty_log_stop: end dirty logging for all regions
+ *
+ * Logging stops once no user is left.
+ *
+ * @flags: the users that do not need the log anymore, a mask of
+ *         GLOBAL_DIRTY_*
  */
-void memory_global_dirty_log_stop(void);
+void memory_global_dirty_log_stop(unsigned int flags);
 
 void mtree_info(bool flatview, bool dispatch_tree, bool owner, bool disabled);
 
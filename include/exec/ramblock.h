@@ -59,6 +59,20 @@ struct RAMBlock {
      */
     unsigned long *clear_bmap;
     uint8_t clear_bmap_shift;
+
+    /*
+     * With the mapped-ram migration format every block owns a fixed
+     * region of the migration file: a bitmap of the pages present in
+     * the file at @bitmap_offset, then the pages themselves at
+     * @pages_offset.  @file_bmap is the in-memory copy of the bitmap,
+     * only used on the source.
+     */
+    unsigned long *file_bmap;
+    uint64_t bitmap_offset;
+    uint64_t pages_offset;
+
+    /* XBZRLE page cache statistics, see migration/page_cache.h */
+    struct PageCacheStats *xbzrle_stats;
 };
 #endif
 #endif
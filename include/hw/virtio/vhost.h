@@ -4,6 +4,7 @@
 #include "hw/virtio/vhost-backend.h"
 #include "hw/virtio/virtio.h"
 #include "exec/memory.h"
+#include "qemu/iova-tree.h"
 
 /* Generic structures common for any vhost based device. */
 
@@ -54,6 +55,13 @@ struct vhost_iommu {
     QLIST_ENTRY(vhost_iommu) iommu_next;
 };
 
+typedef struct VhostIOTLBStats {
+    uint64_t misses;
+    uint64_t cache_hits;
+    uint64_t updates;
+    uint64_t invalidations;
+} VhostIOTLBStats;
+
 typedef struct VhostDevConfigOps {
     /* Vhost device config space changed callback
      */
@@ -90,6 +98,9 @@ struct vhost_dev {
     QLIST_ENTRY(vhost_dev) entry;
     QLIST_HEAD(, vhost_iommu) iommu_list;
     IOMMUNotifier n;
+    /* vIOMMU translations already sent to the backend, in user addresses */
+    IOVATree *iotlb_cache;
+    VhostIOTLBStats iotlb_stats;
     const VhostDevConfigOps *config_ops;
 };
 
@@ -44,25 +44,7 @@ struct VirtIOBlkConf
     uint32_t max_discard_sectors;
     uint32_t max_write_zeroes_sectors;
     bool x_enable_wce_if_config_wce;
-};
-
-struct VirtIOBlockDataPlane;
-
-struct VirtIOBlockReq;
-struct VirtIOBlock {
-    VirtIODevice parent_obj;
-    BlockBackend *blk;
-    void *rq;
-    QEMUBH *bh;
-    VirtIOBlkConf conf;
-    unsigned short sector_mask;
-    bool original_wce;
-    VMChangeStateEntry *change;
-    bool dataplane_disabled;
-    bool dataplane_started;
-    struct VirtIOBlockDataPlane *dataplane;
-    uint64_t host_features;
-    size_t config_size;
+    uint32_t merge_window_us;
 };
 
 typedef struct VirtIOBlockReq {
@@ -81,7 +63,16 @@ typedef struct VirtIOBlockReq {
     BlockAcctCookie acct;
 } VirtIOBlockReq;
 
-#define VIRTIO_BLK_MAX_MERGE_REQS 32
+/*
+ * The number of requests collected before a MultiReqBuffer is submitted
+ * starts at VIRTIO_BLK_MIN_MERGE_REQS and grows up to
+ * VIRTIO_BLK_MAX_MERGE_REQS while the guest issues sequential I/O.
+ */
+#define VIRTIO_BLK_MIN_MERGE_REQS 32
+#define VIRTIO_BLK_MAX_MERGE_REQS 128
+
+/* Number of requests taken off a virtqueue per virtqueue_pop_batch() */
+#define VIRTIO_BLK_POP_BATCH 16
 
 typedef struct MultiReqBuffer {
     VirtIOBlockReq *reqs[VIRTIO_BLK_MAX_MERGE_REQS];
@@ -89,6 +80,37 @@ typedef struct MultiReqBuffer {
     bool is_write;
 } MultiReqBuffer;
 
+/* merge_ratio is a moving average of the fraction of merged requests */
+#define VIRTIO_BLK_MERGE_RATIO_ONE 256
+
+struct VirtIOBlockDataPlane;
+
+struct VirtIOBlockReq;
+struct VirtIOBlock {
+    VirtIODevice parent_obj;
+    BlockBackend *blk;
+    void *rq;
+    QEMUBH *bh;
+    VirtIOBlkConf conf;
+    unsigned short sector_mask;
+    bool original_wce;
+    VMChangeStateEntry *change;
+    bool dataplane_disabled;
+    bool dataplane_started;
+    struct VirtIOBlockDataPlane *dataplane;
+    uint64_t host_features;
+    size_t config_size;
+
+    /* Requests held back for merging with the next handler pass */
+    MultiReqBuffer mrb;
+    QEMUTimer *merge_timer;
+    AioContext *merge_timer_ctx;
+    unsigned int merge_max_reqs;
+    unsigned int merge_ratio;
+    uint64_t merged_reqs;
+    uint64_t unmerged_reqs;
+};
+
 bool virtio_blk_handle_vq(VirtIOBlock *s, VirtQueue *vq);
 void virtio_blk_process_queued_requests(VirtIOBlock *s, bool is_bh);
 
@@ -20,6 +20,7 @@
 #include "net/announce.h"
 #include "qemu/option_int.h"
 #include "qom/object.h"
+#include "sysemu/iothread.h"
 
 #define TYPE_VIRTIO_NET "virtio-net-device"
 OBJECT_DECLARE_SIMPLE_TYPE(VirtIONet, VIRTIO_NET)
@@ -45,6 +46,8 @@ typedef struct virtio_net_conf
     char *duplex_str;
     uint8_t duplex;
     char *primary_id_str;
+    uint32_t num_iothreads;
+    char **iothreads;
 } virtio_net_conf;
 
 /* Coalesced packets type & status */
@@ -139,6 +142,16 @@ typedef struct VirtioNetRssData {
     uint16_t default_queue;
 } VirtioNetRssData;
 
+/* Packet steered by RSS to a queue pair serviced by another thread */
+typedef struct VirtioNetSteeredPacket {
+    QSLIST_ENTRY(VirtioNetSteeredPacket) next;
+    QSIMPLEQ_ENTRY(VirtioNetSteeredPacket) pending_next;
+    size_t size;
+    /* Slot of VirtIONetQueue::steer_pool, otherwise allocated on its own */
+    bool pooled;
+    uint8_t data[];
+} VirtioNetSteeredPacket;
+
 typedef struct VirtIONetQueue {
     VirtQueue *rx_vq;
     VirtQueue *tx_vq;
@@ -149,6 +162,19 @@ typedef struct VirtIONetQueue {
         VirtQueueElement *elem;
     } async_tx;
     struct VirtIONet *n;
+    AioContext *ctx;        /* NULL if serviced by the main loop */
+    struct NetRxPkt *rx_pkt;
+    /* Pushed by any thread, moved to steer_pending by steer_bh */
+    QSLIST_HEAD(, VirtioNetSteeredPacket) steer_list;
+    QSIMPLEQ_HEAD(, VirtioNetSteeredPacket) steer_pending;
+    unsigned int steer_count;
+    /* Packets were left queued for lack of room in another queue */
+    bool steer_wait;
+    QEMUBH *steer_bh;
+    /* Preallocated packets for the common, MTU-sized case */
+    void *steer_pool;
+    QSLIST_HEAD(, VirtioNetSteeredPacket) steer_free;
+    QemuSpin steer_free_lock;
 } VirtIONetQueue;
 
 struct VirtIONet {
@@ -213,7 +239,11 @@ struct VirtIONet {
     DeviceListener primary_listener;
     Notifier migration_state;
     VirtioNetRssData rss_data;
-    struct NetRxPkt *rx_pkt;
+    AioContext **ctxs;
+    IOThread **iothreads;       /* referenced owners of ctxs */
+    uint32_t num_ctxs;
+    bool dataplane_started;
+    bool saved_use_guest_notifier_mask;
 };
 
 void virtio_net_set_netclient_name(VirtIONet *n, const char *name,
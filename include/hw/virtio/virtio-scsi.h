@@ -62,10 +62,23 @@ struct VirtIOSCSIConf {
     CharBackend chardev;
     uint32_t boot_tpgt;
     IOThread *iothread;
+    uint32_t num_iothreads;
+    char **iothreads;
 };
 
 struct VirtIOSCSI;
 
+/* Per-virtqueue dataplane state, indexed by virtqueue number */
+typedef struct VirtIOSCSIQueue {
+    struct VirtIOSCSI *s;
+    VirtQueue *vq;
+    AioContext *ctx;
+
+    /* Requests completed outside @ctx, pushed to the guest by complete_bh */
+    QSLIST_HEAD(, VirtIOSCSIReq) complete_list;
+    QEMUBH *complete_bh;
+} VirtIOSCSIQueue;
+
 struct VirtIOSCSICommon {
     VirtIODevice parent_obj;
     VirtIOSCSIConf conf;
@@ -84,8 +97,21 @@ struct VirtIOSCSI {
     int resetting;
     bool events_dropped;
 
+    /*
+     * TMFs that reset devices are deferred to the main loop, because a
+     * device may live in a different AioContext than the control virtqueue.
+     */
+    QemuMutex tmf_bh_lock;
+    QEMUBH *tmf_bh;
+    QTAILQ_HEAD(, VirtIOSCSIReq) tmf_bh_list;
+
     /* Fields for dataplane below */
-    AioContext *ctx; /* one iothread per virtio-scsi-pci for now */
+    AioContext *ctx;            /* control and event virtqueues */
+    AioContext **ctxs;          /* request virtqueues, round-robin */
+    IOThread **iothreads;       /* referenced owners of ctxs, or NULL */
+    uint32_t num_ctxs;
+    uint32_t next_ctx;          /* home AioContext of the next plugged LUN */
+    VirtIOSCSIQueue *queues;
 
     bool dataplane_started;
     bool dataplane_starting;
@@ -107,11 +133,14 @@ typedef struct VirtIOSCSIReq {
     QEMUIOVector resp_iov;
 
     union {
-        /* Used for two-stage request submission */
+        /* Used for two-stage request submission and TMFs deferred to BH */
         QTAILQ_ENTRY(VirtIOSCSIReq) next;
 
         /* Used for cancellation of request during TMFs */
         int remaining;
+
+        /* Used for completions handed back to the virtqueue's AioContext */
+        QSLIST_ENTRY(VirtIOSCSIReq) complete_next;
     };
 
     SCSIRequest *sreq;
@@ -160,7 +189,11 @@ void virtio_scsi_push_event(VirtIOSCSI *s, SCSIDevice *dev,
                             uint32_t event, uint32_t reason);
 
 void virtio_scsi_dataplane_setup(VirtIOSCSI *s, Error **errp);
+void virtio_scsi_dataplane_cleanup(VirtIOSCSI *s);
 int virtio_scsi_dataplane_start(VirtIODevice *s);
 void virtio_scsi_dataplane_stop(VirtIODevice *s);
+bool virtio_scsi_dataplane_defer_req(VirtIOSCSI *s, VirtIOSCSIReq *req);
+AioContext *virtio_scsi_dataplane_next_ctx(VirtIOSCSI *s);
+bool virtio_scsi_dataplane_owns_ctx(VirtIOSCSI *s, AioContext *ctx);
 
 #endif /* QEMU_VIRTIO_SCSI_H */
@@ -182,6 +182,13 @@ struct VMStateDescription {
     int minimum_version_id;
     int minimum_version_id_old;
     MigrationPriority priority;
+    /*
+     * The state only depends on the device itself, and no other device
+     * relies on it while it is loaded.  With device-state-threads it is
+     * saved and loaded by a worker thread, concurrently with the other
+     * sections, so the hooks must not take the BQL or rely on holding it.
+     */
+    bool independent;
     LoadStateHandler *load_state_old;
     int (*pre_load)(void *opaque);
     int (*post_load)(void *opaque, int version_id);
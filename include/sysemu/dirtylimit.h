@@ -0,0 +1,52 @@
+/*
+ * Dirty page rate limit of virtual CPUs
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#ifndef SYSEMU_DIRTYLIMIT_H
+#define SYSEMU_DIRTYLIMIT_H
+
+/*
+ * Unlike cpu_throttle_set(), which puts every vCPU to sleep for the same
+ * share of time, the dirty page rate limit only slows down the vCPUs that
+ * dirty memory faster than their quota.  The rates are measured per vCPU
+ * from the KVM dirty rings.
+ *
+ * All functions must be called with the BQL held.
+ */
+
+/**
+ * dirtylimit_set_vcpu:
+ * @cpu_index: index of the vCPU to limit
+ * @quota: dirty page rate limit in MB/s, 0 to remove the limit
+ *
+ * Limit the dirty page rate of a single vCPU.
+ */
+void dirtylimit_set_vcpu(int cpu_index, uint64_t quota);
+
+/**
+ * dirtylimit_set_all:
+ * @quota: dirty page rate limit in MB/s, 0 to remove the limits
+ *
+ * Limit the dirty page rate of every vCPU to the same value.
+ */
+void dirtylimit_set_all(uint64_t quota);
+
+/**
+ * dirtylimit_set_period:
+ * @period_ms: interval between two measurements of the dirty page rates
+ *
+ * The sleep time of each vCPU is adjusted after every measurement.
+ */
+void dirtylimit_set_period(uint64_t period_ms);
+
+/**
+ * dirtylimit_in_service:
+ *
+ * Returns: %true if at least one vCPU has a dirty page rate limit.
+ */
+bool dirtylimit_in_service(void);
+
+#endif /* SYSEMU_DIRTYLIMIT_H */
@@ -558,4 +558,20 @@ int kvm_get_max_memslots(void);
 /* Notify resamplefd for EOI of specific interrupts. */
 void kvm_resample_fd_notify(int gsi);
 
+/**
+ * kvm_dirty_ring_enabled - return whether dirty pages are tracked with
+ *                          the per-vCPU KVM dirty rings
+ *
+ * When true, #CPUState.dirty_pages counts the pages dirtied by each vCPU.
+ */
+bool kvm_dirty_ring_enabled(void);
+
+/**
+ * kvm_dirty_ring_reap_all - harvest the dirty rings of all vCPUs
+ *
+ * Updates #CPUState.dirty_pages without kicking the vCPUs out of the
+ * guest.  Must be called with the BQL held.
+ */
+void kvm_dirty_ring_reap_all(void);
+
 #endif
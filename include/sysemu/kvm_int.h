@@ -23,12 +23,13 @@ typedef struct KVMSlot
     int old_flags;
     /* Dirty bitmap cache for the slot */
     unsigned long *dirty_bmap;
+    /* Offset of the slot in the ram_addr_t space */
+    ram_addr_t ram_start_offset;
 } KVMSlot;
 
 typedef struct KVMMemoryListener {
     MemoryListener listener;
-    /* Protects the slots and all inside them */
-    QemuMutex slots_lock;
+    /* Protected by the global kml_slots_lock in kvm-all.c */
     KVMSlot *slots;
     int as_id;
 } KVMMemoryListener;
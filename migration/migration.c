@@ -20,10 +20,14 @@
 #include "migration/blocker.h"
 #include "exec.h"
 #include "fd.h"
+#include "file.h"
 #include "socket.h"
 #include "sysemu/runstate.h"
 #include "sysemu/sysemu.h"
 #include "sysemu/cpu-throttle.h"
+#include "sysemu/cpus.h"
+#include "sysemu/dirtylimit.h"
+#include "sysemu/kvm.h"
 #include "rdma.h"
 #include "ram.h"
 #include "migration/global_state.h"
@@ -64,6 +68,19 @@
 #define BUFFER_DELAY     100
 #define XFER_LIMIT_RATIO (1000 / BUFFER_DELAY)
 
+/* Time in milliseconds between two decisions of the multifd auto-tuning */
+#define MULTIFD_AUTOTUNE_PERIOD 1000
+/* Percentage of the rate a change may cost before it is undone */
+#define MULTIFD_AUTOTUNE_UNDO 10
+/* Periods before trying again a change that was undone */
+#define MULTIFD_AUTOTUNE_HOLD 10
+/* Percentage of time above which the channels are compression/write bound */
+#define MULTIFD_AUTOTUNE_BUSY 60
+/* Percentage of time below which the channels are mostly waiting */
+#define MULTIFD_AUTOTUNE_IDLE 30
+/* Compressed percentage of the data below which compressing more pays */
+#define MULTIFD_AUTOTUNE_RATIO 90
+
 /* Time in milliseconds we are allowed to stop the source,
  * for sending the last part */
 #define DEFAULT_MIGRATE_SET_DOWNTIME 300
@@ -96,6 +113,23 @@
 #define DEFAULT_MIGRATE_MULTIFD_ZLIB_LEVEL 1
 /* 0: means nocompress, 1: best speed, ... 20: best compress ratio */
 #define DEFAULT_MIGRATE_MULTIFD_ZSTD_LEVEL 1
+/* 0: means fast LZ4, 1: fastest LZ4-HC, ... 12: best compress ratio */
+#define DEFAULT_MIGRATE_MULTIFD_LZ4_LEVEL 0
+/* Percentage of the packet size that compression must save */
+#define DEFAULT_MIGRATE_MULTIFD_LZ4_MIN_SAVING 10
+#define DEFAULT_MIGRATE_DIRTY_SYNC_THREADS 1
+/* Dirty page rate limit of each vCPU, in MB/s */
+#define DEFAULT_MIGRATE_VCPU_DIRTY_LIMIT 1
+/* Interval between two measurements of the vCPU dirty rates, in ms */
+#define DEFAULT_MIGRATE_VCPU_DIRTY_LIMIT_PERIOD 1000
+#define DEFAULT_MIGRATE_POSTCOPY_FAULT_THREADS 1
+#define MAX_POSTCOPY_FAULT_THREADS 16
+/* Host pages requested after sequential faults, 0 disables prefetching */
+#define DEFAULT_MIGRATE_POSTCOPY_PREFETCH_PAGES 0
+#define MAX_POSTCOPY_PREFETCH_PAGES 256
+/* Threads saving and loading independent device state, 0 disables them */
+#define DEFAULT_MIGRATE_DEVICE_STATE_THREADS 0
+#define MAX_DEVICE_STATE_THREADS 64
 
 /* Background transfer rate for postcopy, 0 means unlimited, note
  * that page requests can still exceed this limit.
@@ -116,6 +150,44 @@ static NotifierList migration_state_notifiers =
 
 static bool deferred_incoming;
 
+/* Steps of the multifd auto-tuning */
+typedef enum {
+    MULTIFD_AUTOTUNE_NONE,
+    MULTIFD_AUTOTUNE_ADD_CHANNEL,
+    MULTIFD_AUTOTUNE_DEL_CHANNEL,
+    MULTIFD_AUTOTUNE_RAISE_LEVEL,
+    MULTIFD_AUTOTUNE_LOWER_LEVEL,
+} MultiFDAutotuneAction;
+
+static const char *const multifd_autotune_action_str[] = {
+    [MULTIFD_AUTOTUNE_NONE] = "none",
+    [MULTIFD_AUTOTUNE_ADD_CHANNEL] = "add-channel",
+    [MULTIFD_AUTOTUNE_DEL_CHANNEL] = "del-channel",
+    [MULTIFD_AUTOTUNE_RAISE_LEVEL] = "raise-level",
+    [MULTIFD_AUTOTUNE_LOWER_LEVEL] = "lower-level",
+};
+
+/* Multifd auto-tuning, only used by the migration thread */
+typedef struct {
+    /* time of the last sample (ms), 0 before the first one */
+    int64_t time;
+    /* ram_counters at the last sample */
+    uint64_t pages;
+    uint64_t normal;
+    /* totals of the send channels at the last sample */
+    MultiFDSendStats stats;
+    /* rates measured in the last period, in pages per second */
+    double rate;
+    double net_rate;
+    /* step taken at the last sample */
+    MultiFDAutotuneAction action;
+    /* step undone recently, not taken again for hold periods */
+    MultiFDAutotuneAction held;
+    int hold;
+} MultiFDAutotuneState;
+
+static MultiFDAutotuneState multifd_autotune;
+
 /* Messages sent on the return path from destination to source */
 enum mig_rp_message_type {
     MIG_RP_MSG_INVALID = 0,  /* Must be 0 */
@@ -233,6 +305,10 @@ void migration_incoming_state_destroy(void)
         qemu_fclose(mis->from_src_file);
         mis->from_src_file = NULL;
     }
+    if (mis->postcopy_qemufile_dst) {
+        qemu_fclose(mis->postcopy_qemufile_dst);
+        mis->postcopy_qemufile_dst = NULL;
+    }
     if (mis->postcopy_remote_fds) {
         g_array_free(mis->postcopy_remote_fds, TRUE);
         mis->postcopy_remote_fds = NULL;
@@ -280,22 +356,18 @@ static void deferred_incoming_migration(Error **errp)
  * Send a message on the return channel back to the source
  * of the migration.
  */
-static int migrate_send_rp_message(MigrationIncomingState *mis,
-                                   enum mig_rp_message_type message_type,
-                                   uint16_t len, void *data)
+static int migrate_send_rp_message_locked(MigrationIncomingState *mis,
+                                          enum mig_rp_message_type message_type,
+                                          uint16_t len, void *data)
 {
-    int ret = 0;
-
     trace_migrate_send_rp_message((int)message_type, len);
-    qemu_mutex_lock(&mis->rp_mutex);
 
     /*
      * It's possible that the file handle got lost due to network
      * failures.
      */
     if (!mis->to_src_file) {
-        ret = -EIO;
-        goto error;
+        return -EIO;
     }
 
     qemu_put_be16(mis->to_src_file, (unsigned int)message_type);
@@ -304,36 +376,46 @@ static int migrate_send_rp_message(MigrationIncomingState *mis,
     qemu_fflush(mis->to_src_file);
 
     /* It's possible that qemu file got error during sending */
-    ret = qemu_file_get_error(mis->to_src_file);
+    return qemu_file_get_error(mis->to_src_file);
+}
+
+static int migrate_send_rp_message(MigrationIncomingState *mis,
+                                   enum mig_rp_message_type message_type,
+                                   uint16_t len, void *data)
+{
+    int ret;
 
-error:
+    qemu_mutex_lock(&mis->rp_mutex);
+    ret = migrate_send_rp_message_locked(mis, message_type, len, data);
     qemu_mutex_unlock(&mis->rp_mutex);
     return ret;
 }
 
-/* Request one page from the source VM at the given start address.
- *   rb: the RAMBlock to request the page in
+/* Request pages from the source VM at the given start address.
+ *   rb: the RAMBlock to request the pages in
  *   Start: Address offset within the RB
  *   Len: Length in bytes required - must be a multiple of pagesize
  */
 int migrate_send_rp_req_pages(MigrationIncomingState *mis, RAMBlock *rb,
-                              ram_addr_t start)
+                              ram_addr_t start, uint64_t len)
 {
     uint8_t bufc[12 + 1 + 255]; /* start (8), len (4), rbname up to 256 */
     size_t msglen = 12; /* start + len */
-    size_t len = qemu_ram_pagesize(rb);
     enum mig_rp_message_type msg_type;
     const char *rbname;
     int rbname_len;
+    int ret;
 
+    assert(len <= UINT32_MAX);
     *(uint64_t *)bufc = cpu_to_be64((uint64_t)start);
     *(uint32_t *)(bufc + 8) = cpu_to_be32((uint32_t)len);
 
     /*
-     * We maintain the last ramblock that we requested for page.  Note that we
-     * don't need locking because this function will only be called within the
-     * postcopy ram fault thread.
+     * We maintain the last ramblock that we requested for page.  The
+     * postcopy fault threads send requests concurrently, so keep rp_mutex
+     * until the request is sent.
      */
+    qemu_mutex_lock(&mis->rp_mutex);
     if (rb != mis->last_rb) {
         mis->last_rb = rb;
 
@@ -350,7 +432,9 @@ int migrate_send_rp_req_pages(MigrationIncomingState *mis, RAMBlock *rb,
         msg_type = MIG_RP_MSG_REQ_PAGES;
     }
 
-    return migrate_send_rp_message(mis, msg_type, msglen, bufc);
+    ret = migrate_send_rp_message_locked(mis, msg_type, msglen, bufc);
+    qemu_mutex_unlock(&mis->rp_mutex);
+    return ret;
 }
 
 static bool migration_colo_enabled;
@@ -386,11 +470,44 @@ void migrate_add_address(SocketAddress *address)
     addrs->value = QAPI_CLONE(SocketAddress, address);
 }
 
+/*
+ * The preempt channel is opened by connecting a second time to the
+ * address of the main channel.
+ */
+static bool migrate_postcopy_preempt_check(const char *uri, Error **errp)
+{
+    MigrationState *s = migrate_get_current();
+
+    if (!migrate_postcopy_preempt() || !strcmp(uri, "defer")) {
+        return true;
+    }
+
+    if (!strstart(uri, "tcp:", NULL) && !strstart(uri, "unix:", NULL) &&
+        !strstart(uri, "vsock:", NULL)) {
+        error_setg(errp, "postcopy-preempt requires a tcp:, unix: or vsock:"
+                   " URI");
+        return false;
+    }
+    if (s->parameters.tls_creds && *s->parameters.tls_creds) {
+        error_setg(errp, "postcopy-preempt is not compatible with TLS");
+        return false;
+    }
+    return true;
+}
+
 void qemu_start_incoming_migration(const char *uri, Error **errp)
 {
     const char *p = NULL;
 
     qapi_event_send_migration(MIGRATION_STATUS_SETUP);
+    if (migrate_use_mapped_ram() && strcmp(uri, "defer") &&
+        !strstart(uri, "file:", NULL)) {
+        error_setg(errp, "mapped-ram migration requires a file: URI");
+        return;
+    }
+    if (!migrate_postcopy_preempt_check(uri, errp)) {
+        return;
+    }
     if (!strcmp(uri, "defer")) {
         deferred_incoming_migration(errp);
     } else if (strstart(uri, "tcp:", &p) ||
@@ -405,6 +522,8 @@ void qemu_start_incoming_migration(const char *uri, Error **errp)
         exec_start_incoming_migration(p, errp);
     } else if (strstart(uri, "fd:", &p)) {
         fd_start_incoming_migration(p, errp);
+    } else if (strstart(uri, "file:", &p)) {
+        file_start_incoming_migration(p, errp);
     } else {
         error_setg(errp, "unknown migration protocol: %s", uri);
     }
@@ -415,6 +534,8 @@ static void process_incoming_migration_bh(void *opaque)
     Error *local_err = NULL;
     MigrationIncomingState *mis = opaque;
 
+    migration_phase_begin(mis->phases, MIGRATION_PHASE_RESUME, 0);
+
     /* If capability late_block_activate is set:
      * Only fire up the block code now if we're going to restart the
      * VM, else 'cont' will do it.
@@ -463,6 +584,7 @@ static void process_incoming_migration_bh(void *opaque)
     } else {
         runstate_set(global_state_get_runstate());
     }
+    migration_phase_end(mis->phases, MIGRATION_PHASE_RESUME, 0);
     /*
      * This must happen after any state changes since as soon as an external
      * observer sees this event they might start to prod at the VM assuming
@@ -652,8 +774,18 @@ void migration_ioc_process_incoming(QIOChannel *ioc, Error **errp)
         /*
          * Common migration only needs one channel, so we can start
          * right now.  Multifd needs more than one channel, we wait.
+         * Mapped-ram reads the pages straight from the file, it
+         * doesn't have any multifd channels.
          */
-        start_migration = !migrate_use_multifd();
+        start_migration = !migrate_use_multifd() || migrate_use_mapped_ram();
+    } else if (migrate_postcopy_preempt()) {
+        /* The second connection of postcopy preempt */
+        if (mis->postcopy_qemufile_dst) {
+            error_setg(errp, "Unexpected migration channel");
+            return;
+        }
+        postcopy_preempt_new_channel(mis, qemu_fopen_channel_input(ioc));
+        return;
     } else {
         /* Multiple connections */
         assert(migrate_use_multifd());
@@ -682,6 +814,10 @@ bool migration_has_all_channels(void)
 
     all_channels = multifd_recv_all_channels_created();
 
+    if (migrate_postcopy_preempt()) {
+        all_channels = all_channels && mis->postcopy_qemufile_dst != NULL;
+    }
+
     return all_channels && mis->from_src_file != NULL;
 }
 
@@ -835,6 +971,23 @@ MigrationParameters *qmp_query_migrate_parameters(Error **errp)
     params->multifd_zlib_level = s->parameters.multifd_zlib_level;
     params->has_multifd_zstd_level = true;
     params->multifd_zstd_level = s->parameters.multifd_zstd_level;
+    params->has_multifd_lz4_level = true;
+    params->multifd_lz4_level = s->parameters.multifd_lz4_level;
+    params->has_multifd_lz4_min_saving = true;
+    params->multifd_lz4_min_saving = s->parameters.multifd_lz4_min_saving;
+    params->has_dirty_sync_threads = true;
+    params->dirty_sync_threads = s->parameters.dirty_sync_threads;
+    params->has_vcpu_dirty_limit = true;
+    params->vcpu_dirty_limit = s->parameters.vcpu_dirty_limit;
+    params->has_x_vcpu_dirty_limit_period = true;
+    params->x_vcpu_dirty_limit_period =
+        s->parameters.x_vcpu_dirty_limit_period;
+    params->has_postcopy_fault_threads = true;
+    params->postcopy_fault_threads = s->parameters.postcopy_fault_threads;
+    params->has_postcopy_prefetch_pages = true;
+    params->postcopy_prefetch_pages = s->parameters.postcopy_prefetch_pages;
+    params->has_device_state_threads = true;
+    params->device_state_threads = s->parameters.device_state_threads;
     params->has_xbzrle_cache_size = true;
     params->xbzrle_cache_size = s->parameters.xbzrle_cache_size;
     params->has_max_postcopy_bandwidth = true;
@@ -955,8 +1108,12 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
     info->ram->page_size = qemu_target_page_size();
     info->ram->multifd_bytes = ram_counters.multifd_bytes;
     info->ram->pages_per_second = s->pages_per_second;
+    info->ram->dirty_sync_time = ram_counters.dirty_sync_time;
+    info->ram->last_dirty_sync_time = ram_counters.last_dirty_sync_time;
 
-    if (migrate_use_xbzrle()) {
+    if (migrate_use_xbzrle() ||
+        (migrate_use_multifd() &&
+         migrate_multifd_compression() == MULTIFD_COMPRESSION_XBZRLE)) {
         info->has_xbzrle_cache = true;
         info->xbzrle_cache = g_malloc0(sizeof(*info->xbzrle_cache));
         info->xbzrle_cache->cache_size = migrate_xbzrle_cache_size();
@@ -966,6 +1123,8 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
         info->xbzrle_cache->cache_miss_rate = xbzrle_counters.cache_miss_rate;
         info->xbzrle_cache->encoding_rate = xbzrle_counters.encoding_rate;
         info->xbzrle_cache->overflow = xbzrle_counters.overflow;
+        info->xbzrle_cache->blocks = xbzrle_block_stats();
+        info->xbzrle_cache->has_blocks = !!info->xbzrle_cache->blocks;
     }
 
     if (migrate_use_compression()) {
@@ -980,6 +1139,15 @@ static void populate_ram_info(MigrationInfo *info, MigrationState *s)
                                     compression_counters.compression_rate;
     }
 
+    /* The channels only exist while the migration is running */
+    if (migrate_use_multifd_autotune() &&
+        s->state == MIGRATION_STATUS_ACTIVE) {
+        info->has_multifd_active_channels = true;
+        info->multifd_active_channels = multifd_send_active_channels();
+        info->has_multifd_compression_level = true;
+        info->multifd_compression_level = multifd_send_compression_level();
+    }
+
     if (cpu_throttle_active()) {
         info->has_cpu_throttle_percentage = true;
         info->cpu_throttle_percentage = cpu_throttle_get_percentage();
@@ -1002,6 +1170,63 @@ static void populate_disk_info(MigrationInfo *info)
     }
 }
 
+void migration_phase_begin(MigrationPhaseRecord *phases,
+                           MigrationPhase phase, int64_t pos)
+{
+    MigrationPhaseRecord *rec = &phases[phase];
+
+    /* Only the first occurrence counts */
+    if (rec->start || rec->valid) {
+        return;
+    }
+    rec->start = get_clock();
+    rec->start_pos = pos;
+}
+
+void migration_phase_end(MigrationPhaseRecord *phases,
+                         MigrationPhase phase, int64_t pos)
+{
+    MigrationPhaseRecord *rec = &phases[phase];
+
+    if (!rec->start || rec->valid) {
+        return;
+    }
+    rec->time = (get_clock() - rec->start) / SCALE_US;
+    rec->bytes = pos - rec->start_pos;
+    rec->valid = true;
+    trace_migration_phase(MigrationPhase_str(phase), rec->time, rec->bytes);
+}
+
+static void populate_downtime_info(MigrationInfo *info, bool load,
+                                   MigrationPhaseRecord *phases)
+{
+    MigrationPhaseStatsList *head = NULL, **tail = &head;
+    int i;
+
+    /* The source side wins if this instance was migrated in and out */
+    qapi_free_MigrationSectionStatsList(info->sections);
+    info->sections = qemu_savevm_section_stats(load);
+    info->has_sections = !!info->sections;
+
+    for (i = 0; i < MIGRATION_PHASE__MAX; i++) {
+        MigrationPhaseStatsList *elem;
+
+        if (!phases[i].valid) {
+            continue;
+        }
+        elem = g_new0(MigrationPhaseStatsList, 1);
+        elem->value = g_new0(MigrationPhaseStats, 1);
+        elem->value->phase = i;
+        elem->value->time = phases[i].time;
+        elem->value->bytes = phases[i].bytes;
+        *tail = elem;
+        tail = &elem->next;
+    }
+    qapi_free_MigrationPhaseStatsList(info->phases);
+    info->phases = head;
+    info->has_phases = !!head;
+}
+
 static void fill_source_migration_info(MigrationInfo *info)
 {
     MigrationState *s = migrate_get_current();
@@ -1034,6 +1259,7 @@ static void fill_source_migration_info(MigrationInfo *info)
     case MIGRATION_STATUS_COMPLETED:
         populate_time_info(info, s);
         populate_ram_info(info, s);
+        populate_downtime_info(info, false, s->phases);
         break;
     case MIGRATION_STATUS_FAILED:
         info->has_status = true;
@@ -1113,6 +1339,77 @@ static bool migrate_caps_check(bool *cap_list,
         }
     }
 
+#ifdef CONFIG_LINUX
+    if (cap_list[MIGRATION_CAPABILITY_ZERO_COPY_SEND]) {
+        MigrationState *s = migrate_get_current();
+
+        if (!cap_list[MIGRATION_CAPABILITY_MULTIFD] ||
+            migrate_multifd_compression() != MULTIFD_COMPRESSION_NONE ||
+            (s->parameters.tls_creds && *s->parameters.tls_creds)) {
+            error_setg(errp,
+                       "Zero copy only available for non-compressed non-TLS multifd migration");
+            return false;
+        }
+    }
+#endif
+
+    if (cap_list[MIGRATION_CAPABILITY_MULTIFD_ZERO_PAGE] &&
+        !cap_list[MIGRATION_CAPABILITY_MULTIFD]) {
+        error_setg(errp, "Multifd zero page detection requires multifd");
+        return false;
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_MULTIFD_AUTOTUNE] &&
+        !cap_list[MIGRATION_CAPABILITY_MULTIFD]) {
+        error_setg(errp, "Multifd auto-tuning requires multifd");
+        return false;
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_MAPPED_RAM]) {
+        if (cap_list[MIGRATION_CAPABILITY_XBZRLE] ||
+            cap_list[MIGRATION_CAPABILITY_COMPRESS] ||
+            cap_list[MIGRATION_CAPABILITY_POSTCOPY_RAM] ||
+            cap_list[MIGRATION_CAPABILITY_X_COLO] ||
+            cap_list[MIGRATION_CAPABILITY_MULTIFD_ZERO_PAGE]) {
+            error_setg(errp, "Mapped-ram migration is incompatible with "
+                       "xbzrle, compress, postcopy-ram, x-colo and "
+                       "multifd-zero-page");
+            return false;
+        }
+        if (cap_list[MIGRATION_CAPABILITY_MULTIFD] &&
+            migrate_multifd_compression() != MULTIFD_COMPRESSION_NONE) {
+            error_setg(errp, "Mapped-ram migration is incompatible with "
+                       "multifd compression");
+            return false;
+        }
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_POSTCOPY_PREEMPT]) {
+        if (!cap_list[MIGRATION_CAPABILITY_POSTCOPY_RAM]) {
+            error_setg(errp, "Postcopy preempt requires postcopy-ram");
+            return false;
+        }
+        if (cap_list[MIGRATION_CAPABILITY_MULTIFD] ||
+            cap_list[MIGRATION_CAPABILITY_COMPRESS]) {
+            error_setg(errp, "Postcopy preempt is not compatible with "
+                       "multifd and compress");
+            return false;
+        }
+    }
+
+    if (cap_list[MIGRATION_CAPABILITY_DIRTY_LIMIT]) {
+        if (cap_list[MIGRATION_CAPABILITY_AUTO_CONVERGE]) {
+            error_setg(errp, "dirty-limit conflicts with auto-converge,"
+                       " only one of them can be enabled");
+            return false;
+        }
+        if (!kvm_dirty_ring_enabled()) {
+            error_setg(errp, "dirty-limit requires KVM with accelerator"
+                       " property 'dirty-ring-size' set");
+            return false;
+        }
+    }
+
     return true;
 }
 
@@ -1143,6 +1440,7 @@ static void fill_destination_migration_info(MigrationInfo *info)
     case MIGRATION_STATUS_COMPLETED:
         info->has_status = true;
         fill_destination_postcopy_migration_info(info);
+        populate_downtime_info(info, true, mis->phases);
         break;
     }
     info->status = mis->state;
@@ -1274,13 +1572,74 @@ static bool migrate_params_check(MigrationParameters *params, Error **errp)
         return false;
     }
 
+    if (params->has_multifd_lz4_level &&
+        (params->multifd_lz4_level > 12)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "multifd_lz4_level",
+                   "is invalid, it should be in the range of 0 to 12");
+        return false;
+    }
+
+    if (params->has_multifd_lz4_min_saving &&
+        (params->multifd_lz4_min_saving > 99)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "multifd_lz4_min_saving",
+                   "is invalid, it should be in the range of 0 to 99");
+        return false;
+    }
+
+    if (params->has_dirty_sync_threads && (params->dirty_sync_threads < 1)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "dirty_sync_threads",
+                   "is invalid, it should be in the range of 1 to 255");
+        return false;
+    }
+
+    if (params->has_vcpu_dirty_limit && (params->vcpu_dirty_limit < 1)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "vcpu_dirty_limit",
+                   "is invalid, it must be greater than or equal to 1 MB/s");
+        return false;
+    }
+
+    if (params->has_x_vcpu_dirty_limit_period &&
+        (params->x_vcpu_dirty_limit_period < 1 ||
+         params->x_vcpu_dirty_limit_period > 1000)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "x-vcpu-dirty-limit-period",
+                   "is invalid, it should be in the range of 1 to 1000 ms");
+        return false;
+    }
+
+    if (params->has_postcopy_fault_threads &&
+        (params->postcopy_fault_threads < 1 ||
+         params->postcopy_fault_threads > MAX_POSTCOPY_FAULT_THREADS)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "postcopy_fault_threads",
+                   "is invalid, it should be in the range of 1 to 16");
+        return false;
+    }
+
+    if (params->has_postcopy_prefetch_pages &&
+        (params->postcopy_prefetch_pages > MAX_POSTCOPY_PREFETCH_PAGES)) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "postcopy_prefetch_pages",
+                   "is invalid, it should be in the range of 0 to 256");
+        return false;
+    }
+
+    if (params->has_device_state_threads &&
+        params->device_state_threads > MAX_DEVICE_STATE_THREADS) {
+        error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
+                   "device_state_threads",
+                   "is invalid, it should be in the range of 0 to 64");
+        return false;
+    }
+
     if (params->has_xbzrle_cache_size &&
-        (params->xbzrle_cache_size < qemu_target_page_size() ||
-         !is_power_of_2(params->xbzrle_cache_size))) {
+        params->xbzrle_cache_size < qemu_target_page_size()) {
         error_setg(errp, QERR_INVALID_PARAMETER_VALUE,
                    "xbzrle_cache_size",
-                   "is invalid, it should be bigger than target page size"
-                   " and a power of 2");
+                   "is invalid, it should be at least the target page size");
         return false;
     }
 
@@ -1329,6 +1688,23 @@ static bool migrate_params_check(MigrationParameters *params, Error **errp)
         return false;
     }
 
+    if (migrate_use_mapped_ram() && migrate_use_multifd() &&
+        params->has_multifd_compression && params->multifd_compression) {
+        error_setg(errp, "Mapped-ram migration is incompatible with "
+                   "multifd compression");
+        return false;
+    }
+
+#ifdef CONFIG_LINUX
+    if (migrate_use_zero_copy_send() &&
+        ((params->has_multifd_compression && params->multifd_compression) ||
+         (params->tls_creds && *params->tls_creds))) {
+        error_setg(errp,
+                   "Zero copy only available for non-compressed non-TLS multifd migration");
+        return false;
+    }
+#endif
+
     return true;
 }
 
@@ -1423,6 +1799,30 @@ static void migrate_params_test_apply(MigrateSetParameters *params,
     if (params->has_announce_step) {
         dest->announce_step = params->announce_step;
     }
+    if (params->has_dirty_sync_threads) {
+        dest->dirty_sync_threads = params->dirty_sync_threads;
+    }
+    if (params->has_vcpu_dirty_limit) {
+        dest->vcpu_dirty_limit = params->vcpu_dirty_limit;
+    }
+    if (params->has_x_vcpu_dirty_limit_period) {
+        dest->x_vcpu_dirty_limit_period = params->x_vcpu_dirty_limit_period;
+    }
+    if (params->has_postcopy_fault_threads) {
+        dest->postcopy_fault_threads = params->postcopy_fault_threads;
+    }
+    if (params->has_postcopy_prefetch_pages) {
+        dest->postcopy_prefetch_pages = params->postcopy_prefetch_pages;
+    }
+    if (params->has_device_state_threads) {
+        dest->device_state_threads = params->device_state_threads;
+    }
+    if (params->has_multifd_lz4_level) {
+        dest->multifd_lz4_level = params->multifd_lz4_level;
+    }
+    if (params->has_multifd_lz4_min_saving) {
+        dest->multifd_lz4_min_saving = params->multifd_lz4_min_saving;
+    }
 
     if (params->has_block_bitmap_mapping) {
         dest->has_block_bitmap_mapping = true;
@@ -1540,6 +1940,32 @@ static void migrate_params_apply(MigrateSetParameters *params, Error **errp)
     if (params->has_announce_step) {
         s->parameters.announce_step = params->announce_step;
     }
+    if (params->has_dirty_sync_threads) {
+        s->parameters.dirty_sync_threads = params->dirty_sync_threads;
+    }
+    if (params->has_vcpu_dirty_limit) {
+        s->parameters.vcpu_dirty_limit = params->vcpu_dirty_limit;
+    }
+    if (params->has_x_vcpu_dirty_limit_period) {
+        s->parameters.x_vcpu_dirty_limit_period =
+            params->x_vcpu_dirty_limit_period;
+    }
+    if (params->has_postcopy_fault_threads) {
+        s->parameters.postcopy_fault_threads = params->postcopy_fault_threads;
+    }
+    if (params->has_postcopy_prefetch_pages) {
+        s->parameters.postcopy_prefetch_pages =
+            params->postcopy_prefetch_pages;
+    }
+    if (params->has_device_state_threads) {
+        s->parameters.device_state_threads = params->device_state_threads;
+    }
+    if (params->has_multifd_lz4_level) {
+        s->parameters.multifd_lz4_level = params->multifd_lz4_level;
+    }
+    if (params->has_multifd_lz4_min_saving) {
+        s->parameters.multifd_lz4_min_saving = params->multifd_lz4_min_saving;
+    }
 
     if (params->has_block_bitmap_mapping) {
         qapi_free_BitmapMigrationNodeAliasList(
@@ -1674,6 +2100,7 @@ static void migrate_fd_cleanup(MigrationState *s)
         qemu_mutex_lock_iothread();
 
         multifd_save_cleanup();
+        postcopy_preempt_close(s);
         qemu_mutex_lock(&s->qemu_file_lock);
         tmp = s->to_dst_file;
         s->to_dst_file = NULL;
@@ -1767,6 +2194,13 @@ static void migrate_fd_cancel(MigrationState *s)
     if (s->state == MIGRATION_STATUS_CANCELLING && f) {
         qemu_file_shutdown(f);
     }
+    if (s->state == MIGRATION_STATUS_CANCELLING) {
+        qemu_mutex_lock(&s->qemu_file_lock);
+        if (s->postcopy_qemufile_src) {
+            qemu_file_shutdown(s->postcopy_qemufile_src);
+        }
+        qemu_mutex_unlock(&s->qemu_file_lock);
+    }
     if (s->state == MIGRATION_STATUS_CANCELLING && s->block_inactive) {
         Error *local_err = NULL;
 
@@ -1882,6 +2316,7 @@ void migrate_init(MigrationState *s)
     s->mbps = 0.0;
     s->pages_per_second = 0.0;
     s->downtime = 0;
+    memset(s->phases, 0, sizeof(s->phases));
     s->expected_downtime = 0;
     s->setup_time = 0;
     s->start_postcopy = false;
@@ -1898,6 +2333,7 @@ void migrate_init(MigrationState *s)
     s->vm_was_running = false;
     s->iteration_initial_bytes = 0;
     s->threshold_size = 0;
+    memset(&multifd_autotune, 0, sizeof(multifd_autotune));
 }
 
 static GSList *migration_blockers;
@@ -1985,6 +2421,9 @@ void qmp_migrate_pause(Error **errp)
         /* Source side, during postcopy */
         qemu_mutex_lock(&ms->qemu_file_lock);
         ret = qemu_file_shutdown(ms->to_dst_file);
+        if (ms->postcopy_qemufile_src) {
+            qemu_file_shutdown(ms->postcopy_qemufile_src);
+        }
         qemu_mutex_unlock(&ms->qemu_file_lock);
         if (ret) {
             error_setg(errp, "Failed to pause source migration");
@@ -2103,6 +2542,14 @@ void qmp_migrate(const char *uri, bool has_blk, bool blk,
     MigrationState *s = migrate_get_current();
     const char *p = NULL;
 
+    if (migrate_use_mapped_ram() && !strstart(uri, "file:", NULL)) {
+        error_setg(errp, "mapped-ram migration requires a file: URI");
+        return;
+    }
+    if (!migrate_postcopy_preempt_check(uri, errp)) {
+        return;
+    }
+
     if (!migrate_prepare(s, has_blk && blk, has_inc && inc,
                          has_resume && resume, errp)) {
         /* Error detected, put into errp */
@@ -2121,6 +2568,8 @@ void qmp_migrate(const char *uri, bool has_blk, bool blk,
         exec_start_outgoing_migration(s, p, &local_err);
     } else if (strstart(uri, "fd:", &p)) {
         fd_start_outgoing_migration(s, p, &local_err);
+    } else if (strstart(uri, "file:", &p)) {
+        file_start_outgoing_migration(s, p, &local_err);
     } else {
         error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "uri",
                    "a valid migration protocol");
@@ -2338,6 +2787,62 @@ bool migrate_use_multifd(void)
     return s->enabled_capabilities[MIGRATION_CAPABILITY_MULTIFD];
 }
 
+#ifdef CONFIG_LINUX
+bool migrate_use_zero_copy_send(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_ZERO_COPY_SEND];
+}
+#endif
+
+bool migrate_use_mapped_ram(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_MAPPED_RAM];
+}
+
+bool migrate_dirty_limit(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_DIRTY_LIMIT];
+}
+
+bool migrate_postcopy_preempt(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_POSTCOPY_PREEMPT];
+}
+
+bool migrate_use_multifd_autotune(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_MULTIFD_AUTOTUNE];
+}
+
+bool migrate_use_multifd_zero_page(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->enabled_capabilities[MIGRATION_CAPABILITY_MULTIFD_ZERO_PAGE];
+}
+
 bool migrate_pause_before_switchover(void)
 {
     MigrationState *s;
@@ -2384,6 +2889,78 @@ int migrate_multifd_zstd_level(void)
     return s->parameters.multifd_zstd_level;
 }
 
+int migrate_multifd_lz4_level(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.multifd_lz4_level;
+}
+
+int migrate_multifd_lz4_min_saving(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.multifd_lz4_min_saving;
+}
+
+int migrate_dirty_sync_threads(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.dirty_sync_threads;
+}
+
+uint64_t migrate_vcpu_dirty_limit(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.vcpu_dirty_limit;
+}
+
+uint64_t migrate_vcpu_dirty_limit_period(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.x_vcpu_dirty_limit_period;
+}
+
+int migrate_postcopy_fault_threads(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.postcopy_fault_threads;
+}
+
+uint32_t migrate_postcopy_prefetch_pages(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.postcopy_prefetch_pages;
+}
+
+int migrate_device_state_threads(void)
+{
+    MigrationState *s;
+
+    s = migrate_get_current();
+
+    return s->parameters.device_state_threads;
+}
+
 int migrate_use_xbzrle(void)
 {
     MigrationState *s;
@@ -2745,6 +3322,25 @@ static int await_return_path_close_on_source(MigrationState *ms)
     return ms->rp_state.error;
 }
 
+/* How many bytes have we transferred since the beginning of the migration */
+static uint64_t migration_total_bytes(MigrationState *s)
+{
+    return qemu_ftell(s->to_dst_file) + ram_counters.multifd_bytes;
+}
+
+/*
+ * Fetch the vCPU state from the accelerator.  It is done again, for free,
+ * while the devices are saved; doing it first measures it on its own.
+ */
+static void migration_sync_cpu_states(MigrationState *s)
+{
+    migration_phase_begin(s->phases, MIGRATION_PHASE_SYNC,
+                          migration_total_bytes(s));
+    cpu_synchronize_all_states();
+    migration_phase_end(s->phases, MIGRATION_PHASE_SYNC,
+                        migration_total_bytes(s));
+}
+
 /*
  * Switch from normal iteration to postcopy
  * Returns non-0 on error
@@ -2769,7 +3365,11 @@ static int postcopy_start(MigrationState *ms)
 
     qemu_system_wakeup_request(QEMU_WAKEUP_REASON_OTHER, NULL);
     global_state_store();
+    migration_phase_begin(ms->phases, MIGRATION_PHASE_STOP,
+                          migration_total_bytes(ms));
     ret = vm_stop_force_state(RUN_STATE_FINISH_MIGRATE);
+    migration_phase_end(ms->phases, MIGRATION_PHASE_STOP,
+                        migration_total_bytes(ms));
     if (ret < 0) {
         goto fail;
     }
@@ -2780,6 +3380,9 @@ static int postcopy_start(MigrationState *ms)
         goto fail;
     }
 
+    migration_sync_cpu_states(ms);
+    migration_phase_begin(ms->phases, MIGRATION_PHASE_COMPLETE,
+                          migration_total_bytes(ms));
     ret = bdrv_inactivate_all();
     if (ret < 0) {
         goto fail;
@@ -2869,6 +3472,8 @@ static int postcopy_start(MigrationState *ms)
         goto fail_closefb;
     }
     qemu_fclose(fb);
+    migration_phase_end(ms->phases, MIGRATION_PHASE_COMPLETE,
+                        migration_total_bytes(ms));
 
     /* Send a notify to give a chance for anything that needs to happen
      * at the transition to postcopy and after the device state; in particular
@@ -2985,15 +3590,24 @@ static void migration_completion(MigrationState *s)
 
         if (!ret) {
             bool inactivate = !migrate_colo_enabled();
+            migration_phase_begin(s->phases, MIGRATION_PHASE_STOP,
+                                  migration_total_bytes(s));
             ret = vm_stop_force_state(RUN_STATE_FINISH_MIGRATE);
+            migration_phase_end(s->phases, MIGRATION_PHASE_STOP,
+                                migration_total_bytes(s));
             if (ret >= 0) {
                 ret = migration_maybe_pause(s, &current_active_state,
                                             MIGRATION_STATUS_DEVICE);
             }
             if (ret >= 0) {
+                migration_sync_cpu_states(s);
                 qemu_file_set_rate_limit(s->to_dst_file, INT64_MAX);
+                migration_phase_begin(s->phases, MIGRATION_PHASE_COMPLETE,
+                                      migration_total_bytes(s));
                 ret = qemu_savevm_state_complete_precopy(s->to_dst_file, false,
                                                          inactivate);
+                migration_phase_end(s->phases, MIGRATION_PHASE_COMPLETE,
+                                    migration_total_bytes(s));
             }
             if (inactivate && ret >= 0) {
                 s->block_inactive = true;
@@ -3146,6 +3760,9 @@ static MigThrError postcopy_pause(MigrationState *s)
         qemu_file_shutdown(file);
         qemu_fclose(file);
 
+        /* The recovered migration sends every page on the main channel */
+        postcopy_preempt_close(s);
+
         error_report("Detected IO failure for postcopy. "
                      "Migration paused.");
 
@@ -3231,12 +3848,6 @@ static MigThrError migration_detect_error(MigrationState *s)
     }
 }
 
-/* How many bytes have we transferred since the beginning of the migration */
-static uint64_t migration_total_bytes(MigrationState *s)
-{
-    return qemu_ftell(s->to_dst_file) + ram_counters.multifd_bytes;
-}
-
 static void migration_calculate_complete(MigrationState *s)
 {
     uint64_t bytes = migration_total_bytes(s);
@@ -3269,6 +3880,166 @@ static void update_iteration_initial_status(MigrationState *s)
     s->iteration_initial_pages = ram_get_total_transferred_pages();
 }
 
+static void multifd_autotune_apply(MultiFDAutotuneAction action)
+{
+    switch (action) {
+    case MULTIFD_AUTOTUNE_ADD_CHANNEL:
+        multifd_send_set_active_channels(multifd_send_active_channels() + 1);
+        break;
+    case MULTIFD_AUTOTUNE_DEL_CHANNEL:
+        multifd_send_set_active_channels(multifd_send_active_channels() - 1);
+        break;
+    case MULTIFD_AUTOTUNE_RAISE_LEVEL:
+        multifd_send_set_compression_level(
+            multifd_send_compression_level() + 1);
+        break;
+    case MULTIFD_AUTOTUNE_LOWER_LEVEL:
+        multifd_send_set_compression_level(
+            multifd_send_compression_level() - 1);
+        break;
+    default:
+        break;
+    }
+}
+
+static MultiFDAutotuneAction multifd_autotune_undo(MultiFDAutotuneAction action)
+{
+    switch (action) {
+    case MULTIFD_AUTOTUNE_ADD_CHANNEL:
+        return MULTIFD_AUTOTUNE_DEL_CHANNEL;
+    case MULTIFD_AUTOTUNE_DEL_CHANNEL:
+        return MULTIFD_AUTOTUNE_ADD_CHANNEL;
+    case MULTIFD_AUTOTUNE_RAISE_LEVEL:
+        return MULTIFD_AUTOTUNE_LOWER_LEVEL;
+    case MULTIFD_AUTOTUNE_LOWER_LEVEL:
+        return MULTIFD_AUTOTUNE_RAISE_LEVEL;
+    default:
+        return MULTIFD_AUTOTUNE_NONE;
+    }
+}
+
+/*
+ * migration_multifd_autotune: adjust the multifd channels and compression
+ *
+ * What matters for the total migration time is how fast the pages are
+ * sent compared to how fast the guest dirties them, so every period the
+ * rate of pages sent minus the dirty page rate is measured, together
+ * with the share of time the active channels spend compressing and
+ * writing.  One step is taken at a time:
+ *
+ *  - channels busy compressing: use one more channel, or when they are
+ *    all used, a faster compression level
+ *  - channels busy writing: the network is the limit, use a higher
+ *    compression level as long as the data compresses well
+ *  - channels mostly waiting for pages: use one channel less, the CPU
+ *    goes back to the guest
+ *
+ * A step after which the rate dropped is undone, and not tried again
+ * for a while.
+ *
+ * @s: Current migration state
+ * @current_time: time in milliseconds
+ */
+static void migration_multifd_autotune(MigrationState *s,
+                                       int64_t current_time)
+{
+    MultiFDAutotuneState *at = &multifd_autotune;
+    MultiFDAutotuneAction action = MULTIFD_AUTOTUNE_NONE;
+    MultiFDSendStats stats;
+    uint64_t pages, normal, time_spent, busy_time;
+    uint64_t compress, write, ratio;
+    double rate, net_rate;
+    int channels, active, level, min_level, max_level;
+    bool has_levels;
+
+    if (!migrate_use_multifd() || !migrate_use_multifd_autotune() ||
+        s->state != MIGRATION_STATUS_ACTIVE) {
+        return;
+    }
+    if (at->time && current_time < at->time + MULTIFD_AUTOTUNE_PERIOD) {
+        return;
+    }
+
+    multifd_send_stats(&stats);
+    normal = ram_counters.normal;
+    pages = normal + ram_counters.duplicate;
+    if (!at->time) {
+        /* First sample, nothing to compare with */
+        goto out;
+    }
+
+    channels = migrate_multifd_channels();
+    active = multifd_send_active_channels();
+    level = multifd_send_compression_level();
+    has_levels = multifd_send_compression_levels(&min_level, &max_level);
+
+    time_spent = current_time - at->time;
+    rate = (double)(pages - at->pages) * 1000 / time_spent;
+    net_rate = rate - ram_counters.dirty_pages_rate;
+    busy_time = time_spent * SCALE_MS * active;
+    compress = (stats.prepare_time - at->stats.prepare_time) * 100 / busy_time;
+    write = (stats.write_time - at->stats.write_time) * 100 / busy_time;
+    ratio = 100;
+    if (normal > at->normal) {
+        ratio = (stats.bytes - at->stats.bytes) * 100 /
+                ((normal - at->normal) * qemu_target_page_size());
+    }
+    trace_migration_multifd_autotune_sample(active, level, compress, write,
+                                            ratio, (uint64_t)rate,
+                                            ram_counters.dirty_pages_rate);
+
+    if (at->hold) {
+        at->hold--;
+    }
+
+    if (at->action != MULTIFD_AUTOTUNE_NONE &&
+        net_rate + at->rate * MULTIFD_AUTOTUNE_UNDO / 100 < at->net_rate) {
+        multifd_autotune_apply(multifd_autotune_undo(at->action));
+        trace_migration_multifd_autotune(
+            multifd_autotune_action_str[at->action], true,
+            multifd_send_active_channels(), multifd_send_compression_level());
+        at->held = at->action;
+        at->hold = MULTIFD_AUTOTUNE_HOLD;
+        at->action = MULTIFD_AUTOTUNE_NONE;
+        /* The next period measures the previous setting again */
+        goto out;
+    }
+
+    if (compress >= MULTIFD_AUTOTUNE_BUSY) {
+        if (active < channels) {
+            action = MULTIFD_AUTOTUNE_ADD_CHANNEL;
+        } else if (has_levels && level > min_level) {
+            action = MULTIFD_AUTOTUNE_LOWER_LEVEL;
+        }
+    } else if (write >= MULTIFD_AUTOTUNE_BUSY) {
+        if (has_levels && level < max_level &&
+            ratio < MULTIFD_AUTOTUNE_RATIO) {
+            action = MULTIFD_AUTOTUNE_RAISE_LEVEL;
+        }
+    } else if (compress + write < MULTIFD_AUTOTUNE_IDLE && active > 1) {
+        action = MULTIFD_AUTOTUNE_DEL_CHANNEL;
+    }
+    if (at->hold && action == at->held) {
+        action = MULTIFD_AUTOTUNE_NONE;
+    }
+
+    if (action != MULTIFD_AUTOTUNE_NONE) {
+        multifd_autotune_apply(action);
+        trace_migration_multifd_autotune(
+            multifd_autotune_action_str[action], false,
+            multifd_send_active_channels(), multifd_send_compression_level());
+    }
+    at->action = action;
+    at->rate = rate;
+    at->net_rate = net_rate;
+
+out:
+    at->time = current_time;
+    at->pages = pages;
+    at->normal = normal;
+    at->stats = stats;
+}
+
 static void migration_update_counters(MigrationState *s,
                                       int64_t current_time)
 {
@@ -3308,6 +4079,8 @@ static void migration_update_counters(MigrationState *s,
 
     trace_migrate_transferred(transferred, time_spent,
                               bandwidth, s->threshold_size);
+
+    migration_multifd_autotune(s, current_time);
 }
 
 /* Migration thread iteration status */
@@ -3359,6 +4132,11 @@ static void migration_iteration_finish(MigrationState *s)
     cpu_throttle_stop();
 
     qemu_mutex_lock_iothread();
+    /* Likewise for the vCPU dirty limits set by migration_dirty_limit_guest() */
+    if (s->dirty_limit_set) {
+        dirtylimit_set_all(0);
+        s->dirty_limit_set = false;
+    }
     switch (s->state) {
     case MIGRATION_STATUS_COMPLETED:
         migration_calculate_complete(s);
@@ -3486,6 +4264,15 @@ static void *migration_thread(void *opaque)
         qemu_savevm_send_postcopy_advise(s->to_dst_file);
     }
 
+    if (migrate_postcopy_preempt()) {
+        Error *local_err = NULL;
+
+        /* Requested pages then simply share the main channel */
+        if (postcopy_preempt_setup(s, &local_err)) {
+            warn_report_err(local_err);
+        }
+    }
+
     if (migrate_colo_enabled()) {
         /* Notify migration destination that we enable COLO */
         qemu_savevm_send_colo_enable(s->to_dst_file);
@@ -3694,6 +4481,30 @@ static Property migration_properties[] = {
     DEFINE_PROP_UINT8("multifd-zstd-level", MigrationState,
                       parameters.multifd_zstd_level,
                       DEFAULT_MIGRATE_MULTIFD_ZSTD_LEVEL),
+    DEFINE_PROP_UINT8("multifd-lz4-level", MigrationState,
+                      parameters.multifd_lz4_level,
+                      DEFAULT_MIGRATE_MULTIFD_LZ4_LEVEL),
+    DEFINE_PROP_UINT8("multifd-lz4-min-saving", MigrationState,
+                      parameters.multifd_lz4_min_saving,
+                      DEFAULT_MIGRATE_MULTIFD_LZ4_MIN_SAVING),
+    DEFINE_PROP_UINT8("dirty-sync-threads", MigrationState,
+                      parameters.dirty_sync_threads,
+                      DEFAULT_MIGRATE_DIRTY_SYNC_THREADS),
+    DEFINE_PROP_UINT64("vcpu-dirty-limit", MigrationState,
+                       parameters.vcpu_dirty_limit,
+                       DEFAULT_MIGRATE_VCPU_DIRTY_LIMIT),
+    DEFINE_PROP_UINT64("x-vcpu-dirty-limit-period", MigrationState,
+                       parameters.x_vcpu_dirty_limit_period,
+                       DEFAULT_MIGRATE_VCPU_DIRTY_LIMIT_PERIOD),
+    DEFINE_PROP_UINT8("postcopy-fault-threads", MigrationState,
+                      parameters.postcopy_fault_threads,
+                      DEFAULT_MIGRATE_POSTCOPY_FAULT_THREADS),
+    DEFINE_PROP_UINT32("postcopy-prefetch-pages", MigrationState,
+                       parameters.postcopy_prefetch_pages,
+                       DEFAULT_MIGRATE_POSTCOPY_PREFETCH_PAGES),
+    DEFINE_PROP_UINT8("device-state-threads", MigrationState,
+                      parameters.device_state_threads,
+                      DEFAULT_MIGRATE_DEVICE_STATE_THREADS),
     DEFINE_PROP_SIZE("xbzrle-cache-size", MigrationState,
                       parameters.xbzrle_cache_size,
                       DEFAULT_MIGRATE_XBZRLE_CACHE_SIZE),
@@ -3789,6 +4600,14 @@ static void migration_instance_init(Object *obj)
     params->has_multifd_compression = true;
     params->has_multifd_zlib_level = true;
     params->has_multifd_zstd_level = true;
+    params->has_multifd_lz4_level = true;
+    params->has_multifd_lz4_min_saving = true;
+    params->has_dirty_sync_threads = true;
+    params->has_vcpu_dirty_limit = true;
+    params->has_x_vcpu_dirty_limit_period = true;
+    params->has_postcopy_fault_threads = true;
+    params->has_postcopy_prefetch_pages = true;
+    params->has_device_state_threads = true;
     params->has_xbzrle_cache_size = true;
     params->has_max_postcopy_bandwidth = true;
     params->has_max_cpu_throttle = true;
@@ -44,6 +44,32 @@ struct PostcopyBlocktimeContext;
  */
 #define CLEAR_BITMAP_SHIFT_MAX            31
 
+/*
+ * Channels carrying RAM pages.  With postcopy preempt, the pages requested
+ * by the destination get their own channel during postcopy.
+ */
+enum {
+    RAM_CHANNEL_PRECOPY = 0,
+    RAM_CHANNEL_POSTCOPY = 1,
+    RAM_CHANNEL_MAX,
+};
+
+/* Time and bytes of a phase of the switchover, see MigrationPhase */
+typedef struct MigrationPhaseRecord {
+    /* clock and stream position when the phase started */
+    int64_t start;
+    int64_t start_pos;
+    /* time in microseconds, and bytes, once it has ended */
+    int64_t time;
+    uint64_t bytes;
+    bool valid;
+} MigrationPhaseRecord;
+
+void migration_phase_begin(MigrationPhaseRecord *phases,
+                           MigrationPhase phase, int64_t pos);
+void migration_phase_end(MigrationPhaseRecord *phases,
+                         MigrationPhase phase, int64_t pos);
+
 /* State for the incoming migration */
 struct MigrationIncomingState {
     QEMUFile *from_src_file;
@@ -59,9 +85,11 @@ struct MigrationIncomingState {
 
     size_t         largest_page_size;
     bool           have_fault_thread;
-    QemuThread     fault_thread;
+    /* Threads reading userfault_fd, see postcopy-fault-threads */
+    struct PostcopyFaultThread *fault_threads;
+    int            fault_thread_count;
     QemuSemaphore  fault_thread_sem;
-    /* Set this when we want the fault thread to quit */
+    /* Set this when we want the fault threads to quit */
     bool           fault_thread_quit;
 
     bool           have_listen_thread;
@@ -70,14 +98,23 @@ struct MigrationIncomingState {
 
     /* For the kernel to send us notifications */
     int       userfault_fd;
-    /* To notify the fault_thread to wake, e.g., when need to quit */
-    int       userfault_event_fd;
     QEMUFile *to_src_file;
     QemuMutex rp_mutex;    /* We send replies from multiple threads */
-    /* RAMBlock of last request sent to source */
+    /* RAMBlock of last request sent to source, protected by rp_mutex */
     RAMBlock *last_rb;
     void     *postcopy_tmp_page;
     void     *postcopy_tmp_zero_page;
+    /* RAMBlock of the last page received on each channel */
+    RAMBlock *last_recv_block[RAM_CHANNEL_MAX];
+
+    /* Postcopy preempt channel, only carries the requested pages */
+    QEMUFile *postcopy_qemufile_dst;
+    /* Host page being received on the preempt channel */
+    void     *postcopy_preempt_tmp_page;
+    bool      have_preempt_thread;
+    QemuThread preempt_thread;
+    /* Set when we want the preempt thread to quit */
+    bool      preempt_thread_quit;
     /* PostCopyFD's for external userfaultfds & handlers of shared memory */
     GArray   *postcopy_remote_fds;
 
@@ -101,9 +138,14 @@ struct MigrationIncomingState {
     bool postcopy_recover_triggered;
     QemuSemaphore postcopy_pause_sem_dst;
     QemuSemaphore postcopy_pause_sem_fault;
+    /* Number of fault threads waiting on postcopy_pause_sem_fault */
+    int postcopy_fault_threads_paused;
 
     /* List of listening socket addresses  */
     SocketAddressList *socket_address_list;
+
+    /* Phases of the switchover, kept for query-migrate */
+    MigrationPhaseRecord phases[MIGRATION_PHASE__MAX];
 };
 
 MigrationIncomingState *migration_incoming_get_current(void);
@@ -167,6 +209,12 @@ struct MigrationState
 
     int state;
 
+    /*
+     * Postcopy preempt channel, only carries the pages requested by the
+     * destination.  Protected by qemu_file_lock like to_dst_file.
+     */
+    QEMUFile *postcopy_qemufile_src;
+
     /* State related to return path */
     struct {
         QEMUFile     *from_dst_file;
@@ -183,6 +231,8 @@ struct MigrationState
     /* Timestamp when VM is down (ms) to migrate the last stuff */
     int64_t downtime_start;
     int64_t downtime;
+    /* Breakdown of the downtime */
+    MigrationPhaseRecord phases[MIGRATION_PHASE__MAX];
     int64_t expected_downtime;
     bool enabled_capabilities[MIGRATION_CAPABILITY__MAX];
     int64_t setup_time;
@@ -204,6 +254,9 @@ struct MigrationState
     /* Flag set once the migration thread called bdrv_inactivate_all */
     bool block_inactive;
 
+    /* Flag set once the dirty-limit capability limited the vCPUs */
+    bool dirty_limit_set;
+
     /* Migration is waiting for guest to unplug device */
     QemuSemaphore wait_unplug_sem;
 
@@ -301,11 +354,29 @@ bool migrate_validate_uuid(void);
 
 bool migrate_auto_converge(void);
 bool migrate_use_multifd(void);
+#ifdef CONFIG_LINUX
+bool migrate_use_zero_copy_send(void);
+#else
+#define migrate_use_zero_copy_send() (false)
+#endif
+bool migrate_use_multifd_zero_page(void);
+bool migrate_use_mapped_ram(void);
+bool migrate_dirty_limit(void);
+bool migrate_postcopy_preempt(void);
+bool migrate_use_multifd_autotune(void);
 bool migrate_pause_before_switchover(void);
 int migrate_multifd_channels(void);
 MultiFDCompression migrate_multifd_compression(void);
 int migrate_multifd_zlib_level(void);
 int migrate_multifd_zstd_level(void);
+int migrate_multifd_lz4_level(void);
+int migrate_multifd_lz4_min_saving(void);
+int migrate_dirty_sync_threads(void);
+uint64_t migrate_vcpu_dirty_limit(void);
+uint64_t migrate_vcpu_dirty_limit_period(void);
+int migrate_postcopy_fault_threads(void);
+uint32_t migrate_postcopy_prefetch_pages(void);
+int migrate_device_state_threads(void);
 
 int migrate_use_xbzrle(void);
 int64_t migrate_xbzrle_cache_size(void);
@@ -332,7 +403,7 @@ void migrate_send_rp_shut(MigrationIncomingState *mis,
 void migrate_send_rp_pong(MigrationIncomingState *mis,
                           uint32_t value);
 int migrate_send_rp_req_pages(MigrationIncomingState *mis, RAMBlock *rb,
-                              ram_addr_t start);
+                              ram_addr_t start, uint64_t len);
 void migrate_send_rp_recv_bitmap(MigrationIncomingState *mis,
                                  char *block_name);
 void migrate_send_rp_resume_ack(MigrationIncomingState *mis, uint32_t value);
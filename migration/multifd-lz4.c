@@ -0,0 +1,417 @@
+/*
+ * Multifd lz4 compression implementation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <lz4.h>
+#include <lz4hc.h>
+#include "qemu/rcu.h"
+#include "qemu/units.h"
+#include "exec/target_page.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "trace.h"
+#include "multifd.h"
+
+/*
+ * Each channel compresses its packets as one lz4 stream: a packet may
+ * reference the end of the previous packet of the channel, kept in the
+ * dictionary.  Both sides update the dictionary with the last
+ * LZ4_DICT_SIZE bytes of every packet, compressed or not.
+ *
+ * A packet is sent uncompressed when compression does not save enough;
+ * the receive side tells it by its size, as a compressed packet is
+ * always smaller than the pages.
+ */
+#define LZ4_DICT_SIZE (64 * KiB)
+
+/* Maximum number of packets sent without trying to compress them */
+#define LZ4_MAX_BACKOFF 64
+
+struct lz4_data {
+    /* stream for compression, LZ4_stream_t or LZ4_streamHC_t */
+    void *stream;
+    /* LZ4-HC compression level, 0 for fast LZ4 */
+    int level;
+    /* end of the previous packet */
+    uint8_t *dict;
+    uint32_t dict_size;
+    /* copy of the pages of the packet */
+    uint8_t *pages_buf;
+    /* compressed buffer */
+    uint8_t *zbuff;
+    /* size of compressed buffer */
+    uint32_t zbuff_len;
+    /* buffer written, zbuff or pages_buf */
+    uint8_t *out;
+    /* packets still to send without compressing them */
+    uint32_t skip;
+    /* packets to skip after the next poorly compressed packet */
+    uint32_t backoff;
+};
+
+/**
+ * lz4_dict_update: keep the end of a packet as the next dictionary
+ *
+ * @z: lz4 data of the channel
+ * @size: size of the uncompressed packet in pages_buf
+ */
+static void lz4_dict_update(struct lz4_data *z, uint32_t size)
+{
+    z->dict_size = MIN(size, LZ4_DICT_SIZE);
+    memcpy(z->dict, z->pages_buf + size - z->dict_size, z->dict_size);
+}
+
+/**
+ * lz4_stream_free: free the compression stream
+ *
+ * @z: lz4 data of the channel
+ */
+static void lz4_stream_free(struct lz4_data *z)
+{
+    if (z->level) {
+        LZ4_freeStreamHC(z->stream);
+    } else {
+        LZ4_freeStream(z->stream);
+    }
+    z->stream = NULL;
+}
+
+/**
+ * lz4_set_level: create the compression stream for a level
+ *
+ * Fast LZ4 and LZ4-HC need different streams.  The stream only holds
+ * the dictionary, that is loaded again for every packet, so it can be
+ * replaced between two packets.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @z: lz4 data of the channel
+ * @level: LZ4-HC compression level, 0 for fast LZ4
+ */
+static int lz4_set_level(struct lz4_data *z, int level)
+{
+    if (z->stream && z->level && level) {
+        LZ4_resetStreamHC_fast(z->stream, level);
+        z->level = level;
+        return 0;
+    }
+    if (z->stream) {
+        lz4_stream_free(z);
+    }
+    z->level = level;
+    if (level) {
+        z->stream = LZ4_createStreamHC();
+        if (z->stream) {
+            LZ4_resetStreamHC_fast(z->stream, level);
+        }
+    } else {
+        z->stream = LZ4_createStream();
+    }
+    return z->stream ? 0 : -1;
+}
+
+/**
+ * lz4_compress: compress the packet in pages_buf into zbuff
+ *
+ * Returns the compressed size, or 0 if it does not fit in @max_size
+ *
+ * @z: lz4 data of the channel
+ * @size: size of the uncompressed packet
+ * @max_size: maximum compressed size
+ */
+static int lz4_compress(struct lz4_data *z, uint32_t size, uint32_t max_size)
+{
+    const char *src = (const char *)z->pages_buf;
+    char *dst = (char *)z->zbuff;
+
+    if (z->level) {
+        LZ4_loadDictHC(z->stream, (const char *)z->dict, z->dict_size);
+        return LZ4_compress_HC_continue(z->stream, src, dst, size, max_size);
+    }
+    LZ4_loadDict(z->stream, (const char *)z->dict, z->dict_size);
+    return LZ4_compress_fast_continue(z->stream, src, dst, size, max_size, 1);
+}
+
+/* Multifd lz4 compression */
+
+/**
+ * lz4_send_setup: setup send side
+ *
+ * Setup each channel with lz4 compression, or LZ4-HC compression if
+ * the level, multifd-lz4-level unless auto-tuning changed it, is not 0.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    uint32_t page_count = MULTIFD_PACKET_SIZE / qemu_target_page_size();
+    struct lz4_data *z = g_new0(struct lz4_data, 1);
+
+    p->data = z;
+    if (lz4_set_level(z, multifd_send_compression_level())) {
+        g_free(z);
+        p->data = NULL;
+        error_setg(errp, "multifd %d: lz4 create stream failed", p->id);
+        return -1;
+    }
+
+    z->dict = g_malloc(LZ4_DICT_SIZE);
+    z->pages_buf = g_try_malloc(page_count * qemu_target_page_size());
+    /* Compression can only use less space, or the packet is sent as is */
+    z->zbuff_len = page_count * qemu_target_page_size();
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    if (!z->pages_buf || !z->zbuff) {
+        error_setg(errp, "multifd %d: out of memory for zbuff", p->id);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * lz4_send_cleanup: cleanup send side
+ *
+ * Close the channel and return memory.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void lz4_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    struct lz4_data *z = p->data;
+
+    if (!z) {
+        return;
+    }
+    if (z->stream) {
+        lz4_stream_free(z);
+    }
+    g_free(z->dict);
+    g_free(z->pages_buf);
+    g_free(z->zbuff);
+    g_free(p->data);
+    p->data = NULL;
+}
+
+/**
+ * lz4_send_prepare: prepare date to be able to send
+ *
+ * Create a compressed buffer with all the pages that we are going to
+ * send, or send them uncompressed if that does not save enough.
+ * After a packet that did not compress well, the channel does not try
+ * to compress the next ones, for a number of packets that doubles
+ * every time.  The compression level may have been changed by
+ * auto-tuning since the previous packet.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @used: number of pages used
+ */
+static int lz4_send_prepare(MultiFDSendParams *p, uint32_t used, Error **errp)
+{
+    struct iovec *iov = p->pages->iov;
+    struct lz4_data *z = p->data;
+    int min_saving = migrate_multifd_lz4_min_saving();
+    uint32_t size = used * qemu_target_page_size();
+    /* The compressed size must be strictly smaller to tell them apart */
+    uint32_t max_size = MIN((uint64_t)size * (100 - min_saving) / 100,
+                            size - 1);
+    int level = multifd_send_compression_level();
+    int ret = 0;
+    uint32_t i;
+
+    if (level != z->level && lz4_set_level(z, level)) {
+        error_setg(errp, "multifd %d: lz4 create stream failed", p->id);
+        return -1;
+    }
+
+    /*
+     * The guest may write the pages while we compress them, but the
+     * dictionary must be exactly what the destination received.
+     */
+    for (i = 0; i < used; i++) {
+        memcpy(z->pages_buf + i * qemu_target_page_size(), iov[i].iov_base,
+               iov[i].iov_len);
+    }
+
+    if (z->skip) {
+        z->skip--;
+    } else {
+        ret = lz4_compress(z, size, max_size);
+        if (ret > 0) {
+            z->backoff = 0;
+        } else if (min_saving) {
+            z->backoff = MIN(MAX(z->backoff * 2, 1), LZ4_MAX_BACKOFF);
+            z->skip = z->backoff;
+        }
+    }
+    lz4_dict_update(z, size);
+
+    if (ret > 0) {
+        z->out = z->zbuff;
+        p->next_packet_size = ret;
+    } else {
+        z->out = z->pages_buf;
+        p->next_packet_size = size;
+    }
+    trace_multifd_lz4_send_prepare(p->id, used, p->next_packet_size,
+                                   z->skip);
+    p->flags |= MULTIFD_FLAG_LZ4;
+
+    return 0;
+}
+
+/**
+ * lz4_send_write: do the actual write of the data
+ *
+ * Do the actual write of the compressed, or uncompressed, buffer.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @used: number of pages used
+ * @errp: pointer to an error
+ */
+static int lz4_send_write(MultiFDSendParams *p, uint32_t used, Error **errp)
+{
+    struct lz4_data *z = p->data;
+
+    return qio_channel_write_all(p->c, (void *)z->out, p->next_packet_size,
+                                 errp);
+}
+
+/**
+ * lz4_recv_setup: setup receive side
+ *
+ * Create the dictionary and buffers.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int lz4_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    uint32_t page_count = MULTIFD_PACKET_SIZE / qemu_target_page_size();
+    struct lz4_data *z = g_new0(struct lz4_data, 1);
+
+    p->data = z;
+    z->dict = g_malloc(LZ4_DICT_SIZE);
+    z->pages_buf = g_try_malloc(page_count * qemu_target_page_size());
+    z->zbuff_len = page_count * qemu_target_page_size();
+    z->zbuff = g_try_malloc(z->zbuff_len);
+    if (!z->pages_buf || !z->zbuff) {
+        error_setg(errp, "multifd %d: out of memory for zbuff", p->id);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * lz4_recv_cleanup: cleanup receive side
+ *
+ * Return memory.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void lz4_recv_cleanup(MultiFDRecvParams *p)
+{
+    struct lz4_data *z = p->data;
+
+    if (!z) {
+        return;
+    }
+    g_free(z->dict);
+    g_free(z->pages_buf);
+    g_free(z->zbuff);
+    g_free(p->data);
+    p->data = NULL;
+}
+
+/**
+ * lz4_recv_pages: read the data from the channel into actual pages
+ *
+ * Read the compressed buffer, and uncompress it into the actual
+ * pages.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @used: number of pages used
+ * @errp: pointer to an error
+ */
+static int lz4_recv_pages(MultiFDRecvParams *p, uint32_t used, Error **errp)
+{
+    uint32_t in_size = p->next_packet_size;
+    uint32_t expected_size = used * qemu_target_page_size();
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    struct lz4_data *z = p->data;
+    int ret;
+    int i;
+
+    if (flags != MULTIFD_FLAG_LZ4) {
+        error_setg(errp, "multifd %d: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_LZ4);
+        return -1;
+    }
+    if (in_size > expected_size) {
+        error_setg(errp, "multifd %d: packet size received %d size expected %d",
+                   p->id, in_size, expected_size);
+        return -1;
+    }
+
+    if (in_size == expected_size) {
+        /* Sent uncompressed */
+        ret = qio_channel_read_all(p->c, (void *)z->pages_buf, in_size, errp);
+        if (ret != 0) {
+            return ret;
+        }
+    } else {
+        ret = qio_channel_read_all(p->c, (void *)z->zbuff, in_size, errp);
+        if (ret != 0) {
+            return ret;
+        }
+        ret = LZ4_decompress_safe_usingDict((const char *)z->zbuff,
+                                            (char *)z->pages_buf,
+                                            in_size, expected_size,
+                                            (const char *)z->dict,
+                                            z->dict_size);
+        if (ret != expected_size) {
+            error_setg(errp, "multifd %d: packet size decompressed %d "
+                       "size expected %d", p->id, ret, expected_size);
+            return -1;
+        }
+    }
+    lz4_dict_update(z, expected_size);
+
+    for (i = 0; i < used; i++) {
+        struct iovec *iov = &p->pages->iov[i];
+
+        memcpy(iov->iov_base, z->pages_buf + i * qemu_target_page_size(),
+               iov->iov_len);
+    }
+    return 0;
+}
+
+static MultiFDMethods multifd_lz4_ops = {
+    .send_setup = lz4_send_setup,
+    .send_cleanup = lz4_send_cleanup,
+    .send_prepare = lz4_send_prepare,
+    .send_write = lz4_send_write,
+    .recv_setup = lz4_recv_setup,
+    .recv_cleanup = lz4_recv_cleanup,
+    .recv_pages = lz4_recv_pages
+};
+
+static void multifd_lz4_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_LZ4, &multifd_lz4_ops);
+}
+
+migration_init(multifd_lz4_register);
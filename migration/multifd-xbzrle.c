@@ -0,0 +1,352 @@
+/*
+ * Multifd XBZRLE compression implementation
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qemu/rcu.h"
+#include "exec/ramblock.h"
+#include "exec/target_page.h"
+#include "qapi/error.h"
+#include "migration.h"
+#include "trace.h"
+#include "multifd.h"
+#include "page_cache.h"
+#include "ram.h"
+#include "xbzrle.h"
+
+/*
+ * The channels share a single cache of the pages they sent.  The same
+ * page may be sent by different channels in different iterations, and
+ * the delta must be computed against the last version the destination
+ * received; a page is sent at most once between two multifd syncs and
+ * the syncs order the channels, so the copy in the cache is always the
+ * one the destination has.  Pages sent as zero pages, by the migration
+ * thread or by the zero page detection of the channels, are dropped
+ * from the cache.
+ */
+static PageCache *xbzrle_cache;
+
+/* Per page header, followed by the page data if the page is sent raw */
+#define MULTIFD_XBZRLE_RAW UINT32_MAX
+
+struct xbzrle_data {
+    /* copy of the guest page being encoded */
+    uint8_t *current_buf;
+    /* per page headers followed by the encoded pages */
+    uint8_t *buf;
+    /* size of buf */
+    uint32_t buf_len;
+};
+
+/**
+ * multifd_xbzrle_cache_zero_page: forget a page sent as a zero page
+ *
+ * Called for the zero pages that are not sent through xbzrle_send_prepare,
+ * so that no channel encodes the page against a stale copy.
+ *
+ * @block: RAMBlock of the page
+ * @offset: offset of the page in the block
+ */
+void multifd_xbzrle_cache_zero_page(RAMBlock *block, ram_addr_t offset)
+{
+    if (!xbzrle_cache) {
+        return;
+    }
+    cache_invalidate(xbzrle_cache, block->offset + offset);
+}
+
+/* Multifd XBZRLE compression */
+
+/**
+ * xbzrle_send_setup: setup send side
+ *
+ * The first channel creates the cache shared by all of them, sized by
+ * xbzrle-cache-size.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int xbzrle_send_setup(MultiFDSendParams *p, Error **errp)
+{
+    uint32_t page_count = MULTIFD_PACKET_SIZE / qemu_target_page_size();
+    size_t page_size = qemu_target_page_size();
+    struct xbzrle_data *x;
+
+    /* The channels are set up in order, the first one sets up the cache */
+    if (p->id == 0) {
+        xbzrle_cache = cache_init(migrate_xbzrle_cache_size() / page_size,
+                                  page_size, errp);
+        if (!xbzrle_cache) {
+            return -1;
+        }
+        xbzrle_stats_init();
+    }
+
+    x = g_malloc0(sizeof(struct xbzrle_data));
+    x->current_buf = g_malloc(page_size);
+    /* Headers, and no page is sent bigger than raw */
+    x->buf_len = page_count * (sizeof(uint32_t) + page_size);
+    x->buf = g_try_malloc(x->buf_len);
+    if (!x->buf) {
+        g_free(x->current_buf);
+        g_free(x);
+        error_setg(errp, "multifd %d: out of memory for xbzrle buffer",
+                   p->id);
+        return -1;
+    }
+    p->data = x;
+    return 0;
+}
+
+/**
+ * xbzrle_send_cleanup: cleanup send side
+ *
+ * Free the buffers of the channel, and the cache with the first one.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void xbzrle_send_cleanup(MultiFDSendParams *p, Error **errp)
+{
+    struct xbzrle_data *x = p->data;
+
+    if (p->id == 0 && xbzrle_cache) {
+        cache_fini(xbzrle_cache);
+        xbzrle_cache = NULL;
+    }
+    if (!x) {
+        return;
+    }
+    g_free(x->current_buf);
+    g_free(x->buf);
+    g_free(p->data);
+    p->data = NULL;
+}
+
+/**
+ * xbzrle_send_prepare: prepare date to be able to send
+ *
+ * Encode each page against its copy in the cache, or send it raw and
+ * cache it.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @used: number of pages used
+ */
+static int xbzrle_send_prepare(MultiFDSendParams *p, uint32_t used,
+                               Error **errp)
+{
+    struct xbzrle_data *x = p->data;
+    MultiFDPages_t *pages = p->pages;
+    RAMBlock *block = pages->block;
+    size_t page_size = qemu_target_page_size();
+    uint32_t *header = (uint32_t *)x->buf;
+    uint32_t out_size = used * sizeof(uint32_t);
+    /* The cache ages with the dirty bitmap syncs, like the main cache */
+    uint64_t age = ram_counters.dirty_sync_count;
+    uint32_t encoded = 0, unchanged = 0;
+    uint32_t i;
+
+    for (i = 0; i < used; i++) {
+        ram_addr_t offset = pages->offset[i];
+        uint64_t addr = block->offset + offset;
+        uint8_t *cached;
+        int len = -1;
+
+        /*
+         * The guest may write the page while we encode it, work on a
+         * copy so that the cache holds exactly what we send.
+         */
+        memcpy(x->current_buf, pages->iov[i].iov_base, page_size);
+
+        cached = cache_lookup_lock(xbzrle_cache, addr, age,
+                                   block->xbzrle_stats);
+        if (cached) {
+            len = xbzrle_encode_buffer(cached, x->current_buf, page_size,
+                                       x->buf + out_size, page_size);
+            if (len) {
+                memcpy(cached, x->current_buf, page_size);
+            }
+            cache_unlock(xbzrle_cache, addr);
+        } else {
+            /* We don't care if the page does not fit, it is sent raw */
+            cache_insert(xbzrle_cache, addr, x->current_buf, age,
+                         block->xbzrle_stats);
+        }
+
+        if (len < 0) {
+            header[i] = cpu_to_be32(MULTIFD_XBZRLE_RAW);
+            memcpy(x->buf + out_size, x->current_buf, page_size);
+            out_size += page_size;
+        } else {
+            header[i] = cpu_to_be32(len);
+            out_size += len;
+            encoded++;
+            unchanged += !len;
+        }
+    }
+
+    trace_multifd_xbzrle_send_prepare(p->id, used, encoded, unchanged,
+                                      out_size);
+    p->next_packet_size = out_size;
+    p->flags |= MULTIFD_FLAG_XBZRLE;
+
+    return 0;
+}
+
+/**
+ * xbzrle_send_write: do the actual write of the data
+ *
+ * Do the actual write of the encoded buffer.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @used: number of pages used
+ * @errp: pointer to an error
+ */
+static int xbzrle_send_write(MultiFDSendParams *p, uint32_t used, Error **errp)
+{
+    struct xbzrle_data *x = p->data;
+
+    return qio_channel_write_all(p->c, (void *)x->buf, p->next_packet_size,
+                                 errp);
+}
+
+/**
+ * xbzrle_recv_setup: setup receive side
+ *
+ * Create the receive buffer.  The destination needs no cache, the pages
+ * are decoded on top of the guest RAM.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @errp: pointer to an error
+ */
+static int xbzrle_recv_setup(MultiFDRecvParams *p, Error **errp)
+{
+    uint32_t page_count = MULTIFD_PACKET_SIZE / qemu_target_page_size();
+    struct xbzrle_data *x = g_malloc0(sizeof(struct xbzrle_data));
+
+    p->data = x;
+    x->buf_len = page_count * (sizeof(uint32_t) + qemu_target_page_size());
+    x->buf = g_try_malloc(x->buf_len);
+    if (!x->buf) {
+        error_setg(errp, "multifd %d: out of memory for xbzrle buffer",
+                   p->id);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ * xbzrle_recv_cleanup: cleanup receive side
+ *
+ * Free the receive buffer.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void xbzrle_recv_cleanup(MultiFDRecvParams *p)
+{
+    struct xbzrle_data *x = p->data;
+
+    if (!x) {
+        return;
+    }
+    g_free(x->buf);
+    g_free(p->data);
+    p->data = NULL;
+}
+
+/**
+ * xbzrle_recv_pages: read the data from the channel into actual pages
+ *
+ * Read the encoded buffer, and decode it into the actual pages.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @used: number of pages used
+ * @errp: pointer to an error
+ */
+static int xbzrle_recv_pages(MultiFDRecvParams *p, uint32_t used, Error **errp)
+{
+    struct xbzrle_data *x = p->data;
+    uint32_t in_size = p->next_packet_size;
+    uint32_t flags = p->flags & MULTIFD_FLAG_COMPRESSION_MASK;
+    size_t page_size = qemu_target_page_size();
+    uint32_t *header = (uint32_t *)x->buf;
+    uint32_t pos = used * sizeof(uint32_t);
+    int ret;
+    int i;
+
+    if (flags != MULTIFD_FLAG_XBZRLE) {
+        error_setg(errp, "multifd %d: flags received %x flags expected %x",
+                   p->id, flags, MULTIFD_FLAG_XBZRLE);
+        return -1;
+    }
+    if (in_size > x->buf_len || in_size < pos) {
+        error_setg(errp, "multifd %d: packet size received %u for %u pages",
+                   p->id, in_size, used);
+        return -1;
+    }
+    ret = qio_channel_read_all(p->c, (void *)x->buf, in_size, errp);
+    if (ret != 0) {
+        return ret;
+    }
+
+    for (i = 0; i < used; i++) {
+        uint32_t len = be32_to_cpu(header[i]);
+        uint8_t *host = p->pages->iov[i].iov_base;
+
+        if (len == MULTIFD_XBZRLE_RAW) {
+            len = page_size;
+            if (in_size - pos < len) {
+                break;
+            }
+            memcpy(host, x->buf + pos, len);
+        } else {
+            if (in_size - pos < len) {
+                break;
+            }
+            /* An empty encoding means that the page did not change */
+            if (len && xbzrle_decode_buffer(x->buf + pos, len, host,
+                                            page_size) == -1) {
+                error_setg(errp, "multifd %d: failed to decode page %d",
+                           p->id, i);
+                return -1;
+            }
+        }
+        pos += len;
+    }
+
+    if (i != used || pos != in_size) {
+        error_setg(errp, "multifd %d: packet size received %u size decoded %u",
+                   p->id, in_size, pos);
+        return -1;
+    }
+    return 0;
+}
+
+static MultiFDMethods multifd_xbzrle_ops = {
+    .send_setup = xbzrle_send_setup,
+    .send_cleanup = xbzrle_send_cleanup,
+    .send_prepare = xbzrle_send_prepare,
+    .send_write = xbzrle_send_write,
+    .recv_setup = xbzrle_recv_setup,
+    .recv_cleanup = xbzrle_recv_cleanup,
+    .recv_pages = xbzrle_recv_pages
+};
+
+static void multifd_xbzrle_register(void)
+{
+    multifd_register_ops(MULTIFD_COMPRESSION_XBZRLE, &multifd_xbzrle_ops);
+}
+
+migration_init(multifd_xbzrle_register);
@@ -22,6 +22,8 @@
 struct zlib_data {
     /* stream for compression */
     z_stream zs;
+    /* compression level of the stream */
+    int level;
     /* compressed buffer */
     uint8_t *zbuff;
     /* size of compressed buffer */
@@ -49,7 +51,8 @@ static int zlib_send_setup(MultiFDSendParams *p, Error **errp)
     zs->zalloc = Z_NULL;
     zs->zfree = Z_NULL;
     zs->opaque = Z_NULL;
-    if (deflateInit(zs, migrate_multifd_zlib_level()) != Z_OK) {
+    z->level = multifd_send_compression_level();
+    if (deflateInit(zs, z->level) != Z_OK) {
         g_free(z);
         error_setg(errp, "multifd %d: deflate init failed", p->id);
         return -1;
@@ -90,7 +93,8 @@ static void zlib_send_cleanup(MultiFDSendParams *p, Error **errp)
  * zlib_send_prepare: prepare date to be able to send
  *
  * Create a compressed buffer with all the pages that we are going to
- * send.
+ * send.  The compression level may have been changed by auto-tuning
+ * since the previous packet.
  *
  * Returns 0 for success or -1 for error
  *
@@ -102,10 +106,29 @@ static int zlib_send_prepare(MultiFDSendParams *p, uint32_t used, Error **errp)
     struct iovec *iov = p->pages->iov;
     struct zlib_data *z = p->data;
     z_stream *zs = &z->zs;
+    int level = multifd_send_compression_level();
     uint32_t out_size = 0;
     int ret;
     uint32_t i;
 
+    if (level != z->level) {
+        /*
+         * The previous packet ended with a sync flush, but deflateParams()
+         * may still emit an empty block; it goes at the start of the packet.
+         */
+        zs->avail_in = 0;
+        zs->avail_out = z->zbuff_len;
+        zs->next_out = z->zbuff;
+        ret = deflateParams(zs, level, Z_DEFAULT_STRATEGY);
+        if (ret != Z_OK) {
+            error_setg(errp, "multifd %d: deflateParams returned %d",
+                       p->id, ret);
+            return -1;
+        }
+        out_size = z->zbuff_len - zs->avail_out;
+        z->level = level;
+    }
+
     for (i = 0; i < used; i++) {
         uint32_t available = z->zbuff_len - out_size;
         int flush = Z_NO_FLUSH;
@@ -24,6 +24,8 @@ struct zstd_data {
     ZSTD_CStream *zcs;
     /* stream for decompression */
     ZSTD_DStream *zds;
+    /* compression level of the stream */
+    int level;
     /* buffers */
     ZSTD_inBuffer in;
     ZSTD_outBuffer out;
@@ -59,7 +61,8 @@ static int zstd_send_setup(MultiFDSendParams *p, Error **errp)
         return -1;
     }
 
-    res = ZSTD_initCStream(z->zcs, migrate_multifd_zstd_level());
+    z->level = multifd_send_compression_level();
+    res = ZSTD_initCStream(z->zcs, z->level);
     if (ZSTD_isError(res)) {
         ZSTD_freeCStream(z->zcs);
         g_free(z);
@@ -103,7 +106,8 @@ static void zstd_send_cleanup(MultiFDSendParams *p, Error **errp)
  * zstd_send_prepare: prepare date to be able to send
  *
  * Create a compressed buffer with all the pages that we are going to
- * send.
+ * send.  The compression level may have been changed by auto-tuning
+ * since the previous packet.
  *
  * Returns 0 for success or -1 for error
  *
@@ -114,9 +118,22 @@ static int zstd_send_prepare(MultiFDSendParams *p, uint32_t used, Error **errp)
 {
     struct iovec *iov = p->pages->iov;
     struct zstd_data *z = p->data;
+    int level = multifd_send_compression_level();
+    size_t res;
     int ret;
     uint32_t i;
 
+    if (level != z->level) {
+        /* The level is one of the parameters that can change mid-stream */
+        res = ZSTD_CCtx_setParameter(z->zcs, ZSTD_c_compressionLevel, level);
+        if (ZSTD_isError(res)) {
+            error_setg(errp, "multifd %d: setting level %d failed with %s",
+                       p->id, level, ZSTD_getErrorName(res));
+            return -1;
+        }
+        z->level = level;
+    }
+
     z->out.dst = z->zbuff;
     z->out.size = z->zbuff_len;
     z->out.pos = 0;
@@ -16,10 +16,13 @@
 #include "sysemu/sysemu.h"
 #include "exec/ramblock.h"
 #include "qemu/error-report.h"
+#include "qemu/cutils.h"
+#include "qemu/timer.h"
 #include "qapi/error.h"
 #include "ram.h"
 #include "migration.h"
 #include "socket.h"
+#include "file.h"
 #include "tls.h"
 #include "qemu-file.h"
 #include "trace.h"
@@ -91,7 +94,9 @@ static int nocomp_send_prepare(MultiFDSendParams *p, uint32_t used,
 /**
  * nocomp_send_write: do the actual write of the data
  *
- * For no compression we just have to write the data.
+ * For no compression we just have to write the data.  With zero-copy-send
+ * the kernel sends the guest pages without copying them, the completions
+ * are reaped by qio_channel_flush() at the next sync.
  *
  * Returns 0 for success or -1 for error
  *
@@ -101,7 +106,13 @@ static int nocomp_send_prepare(MultiFDSendParams *p, uint32_t used,
  */
 static int nocomp_send_write(MultiFDSendParams *p, uint32_t used, Error **errp)
 {
-    return qio_channel_writev_all(p->c, p->pages->iov, used, errp);
+    int flags = 0;
+
+    if (migrate_use_zero_copy_send()) {
+        flags |= QIO_CHANNEL_WRITE_FLAG_ZERO_COPY;
+    }
+    return qio_channel_writev_full_all(p->c, p->pages->iov, used,
+                                       NULL, 0, flags, errp);
 }
 
 /**
@@ -249,6 +260,7 @@ static MultiFDPages_t *multifd_pages_init(size_t size)
 static void multifd_pages_clear(MultiFDPages_t *pages)
 {
     pages->used = 0;
+    pages->zero_num = 0;
     pages->allocated = 0;
     pages->packet_num = 0;
     pages->block = NULL;
@@ -267,6 +279,7 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
     packet->flags = cpu_to_be32(p->flags);
     packet->pages_alloc = cpu_to_be32(p->pages->allocated);
     packet->pages_used = cpu_to_be32(p->pages->used);
+    packet->zero_pages = cpu_to_be32(p->pages->zero_num);
     packet->next_packet_size = cpu_to_be32(p->next_packet_size);
     packet->packet_num = cpu_to_be64(p->packet_num);
 
@@ -274,7 +287,7 @@ static void multifd_send_fill_packet(MultiFDSendParams *p)
         strncpy(packet->ramblock, p->pages->block->idstr, 256);
     }
 
-    for (i = 0; i < p->pages->used; i++) {
+    for (i = 0; i < p->pages->used + p->pages->zero_num; i++) {
         /* there are architectures where ram_addr_t is 32 bit */
         uint64_t temp = p->pages->offset[i];
 
@@ -328,17 +341,20 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
     }
 
     p->pages->used = be32_to_cpu(packet->pages_used);
-    if (p->pages->used > packet->pages_alloc) {
+    p->pages->zero_num = be32_to_cpu(packet->zero_pages);
+    if (p->pages->used > packet->pages_alloc ||
+        p->pages->zero_num > packet->pages_alloc - p->pages->used) {
         error_setg(errp, "multifd: received packet "
-                   "with %d pages and expected maximum pages are %d",
-                   p->pages->used, packet->pages_alloc) ;
+                   "with %d pages and %d zero pages and expected maximum "
+                   "pages are %d", p->pages->used, p->pages->zero_num,
+                   packet->pages_alloc) ;
         return -1;
     }
 
     p->next_packet_size = be32_to_cpu(packet->next_packet_size);
     p->packet_num = be64_to_cpu(packet->packet_num);
 
-    if (p->pages->used == 0) {
+    if (p->pages->used + p->pages->zero_num == 0) {
         return 0;
     }
 
@@ -351,7 +367,8 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
         return -1;
     }
 
-    for (i = 0; i < p->pages->used; i++) {
+    p->pages->block = block;
+    for (i = 0; i < p->pages->used + p->pages->zero_num; i++) {
         uint64_t offset = be64_to_cpu(packet->offset[i]);
 
         if (offset > (block->used_length - qemu_target_page_size())) {
@@ -360,13 +377,72 @@ static int multifd_recv_unfill_packet(MultiFDRecvParams *p, Error **errp)
                        offset, block->max_length);
             return -1;
         }
-        p->pages->iov[i].iov_base = block->host + offset;
-        p->pages->iov[i].iov_len = qemu_target_page_size();
+        p->pages->offset[i] = offset;
+        if (i < p->pages->used) {
+            p->pages->iov[i].iov_base = block->host + offset;
+            p->pages->iov[i].iov_len = qemu_target_page_size();
+        }
     }
 
     return 0;
 }
 
+/**
+ * multifd_send_zero_page_detect: split the pages of a packet
+ *
+ * Moves the zero pages to the end of @p->pages, so that only the
+ * first pages->used ones have to be sent; the rest are only described
+ * by their offset in the packet header.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void multifd_send_zero_page_detect(MultiFDSendParams *p)
+{
+    MultiFDPages_t *pages = p->pages;
+    size_t page_size = qemu_target_page_size();
+    int i = 0;
+    int j = pages->used - 1;
+
+    while (i <= j) {
+        ram_addr_t offset;
+        struct iovec iov;
+
+        if (!buffer_is_zero(pages->iov[i].iov_base, page_size)) {
+            i++;
+            continue;
+        }
+        offset = pages->offset[i];
+        multifd_xbzrle_cache_zero_page(pages->block, offset);
+        pages->offset[i] = pages->offset[j];
+        pages->offset[j] = offset;
+        iov = pages->iov[i];
+        pages->iov[i] = pages->iov[j];
+        pages->iov[j] = iov;
+        j--;
+    }
+    pages->zero_num = pages->used - i;
+    pages->used = i;
+}
+
+/**
+ * multifd_recv_zero_pages: clear the zero pages of a packet
+ *
+ * The pages are only written when they are not already zero, to
+ * avoid allocating memory for untouched guest pages.
+ *
+ * @p: Params for the channel that we are using
+ */
+static void multifd_recv_zero_pages(MultiFDRecvParams *p)
+{
+    MultiFDPages_t *pages = p->pages;
+    int i;
+
+    for (i = pages->used; i < pages->used + pages->zero_num; i++) {
+        ram_handle_compressed(pages->block->host + pages->offset[i], 0,
+                              qemu_target_page_size());
+    }
+}
+
 struct {
     MultiFDSendParams *params;
     /* array of pages to sent */
@@ -383,6 +459,13 @@ struct {
     int exiting;
     /* multifd ops */
     MultiFDMethods *ops;
+    /*
+     * Channels new packets are sent through, the first ones.  The
+     * others only get the sync packets.  Set by the migration thread.
+     */
+    int active_channels;
+    /* compression level the channels use, changed at runtime */
+    int compression_level;
 } *multifd_send_state;
 
 /*
@@ -403,9 +486,30 @@ struct {
  * false.
  */
 
+/*
+ * Zero pages found by the channel threads were accounted as normal
+ * pages when they were queued.  Fix the counters up once the channel
+ * has processed them.  Must be called with p->mutex held.
+ */
+static void multifd_send_account_zero_pages(QEMUFile *f, MultiFDSendParams *p)
+{
+    uint64_t zero_pages = p->zero_pages_pending;
+    uint64_t bytes = zero_pages * qemu_target_page_size();
+
+    if (!zero_pages) {
+        return;
+    }
+    p->zero_pages_pending = 0;
+    ram_counters.normal -= zero_pages;
+    ram_counters.duplicate += zero_pages;
+    ram_counters.multifd_bytes -= bytes;
+    ram_counters.transferred -= bytes;
+    qemu_file_update_transfer(f, -bytes);
+}
+
 static int multifd_send_pages(QEMUFile *f)
 {
-    int i;
+    int i, j, active;
     static int next_channel;
     MultiFDSendParams *p = NULL; /* make happy gcc */
     MultiFDPages_t *pages = multifd_send_state->pages;
@@ -415,37 +519,53 @@ static int multifd_send_pages(QEMUFile *f)
         return -1;
     }
 
-    qemu_sem_wait(&multifd_send_state->channels_ready);
-    /*
-     * next_channel can remain from a previous migration that was
-     * using more channels, so ensure it doesn't overflow if the
-     * limit is lower now.
-     */
-    next_channel %= migrate_multifd_channels();
-    for (i = next_channel;; i = (i + 1) % migrate_multifd_channels()) {
-        p = &multifd_send_state->params[i];
+    for (;;) {
+        qemu_sem_wait(&multifd_send_state->channels_ready);
+        /*
+         * next_channel can remain from a previous migration that was
+         * using more channels, or the active channels may have been
+         * reduced, so ensure it doesn't overflow if the limit is lower
+         * now.
+         */
+        active = qatomic_read(&multifd_send_state->active_channels);
+        next_channel %= active;
+        for (j = 0; j < active; j++) {
+            i = (next_channel + j) % active;
+            p = &multifd_send_state->params[i];
 
-        qemu_mutex_lock(&p->mutex);
-        if (p->quit) {
-            error_report("%s: channel %d has already quit!", __func__, i);
+            qemu_mutex_lock(&p->mutex);
+            if (p->quit) {
+                error_report("%s: channel %d has already quit!", __func__, i);
+                qemu_mutex_unlock(&p->mutex);
+                return -1;
+            }
+            if (!p->pending_job) {
+                p->pending_job++;
+                next_channel = (i + 1) % active;
+                break;
+            }
             qemu_mutex_unlock(&p->mutex);
-            return -1;
         }
-        if (!p->pending_job) {
-            p->pending_job++;
-            next_channel = (i + 1) % migrate_multifd_channels();
+        if (j < active) {
             break;
         }
-        qemu_mutex_unlock(&p->mutex);
+        /*
+         * The wakeup is stale: the channel that posted it was given a
+         * job already, or was parked since.  Every active channel posts
+         * again when it becomes idle, so just wait for the next one.
+         */
     }
     assert(!p->pages->used);
     assert(!p->pages->block);
+    multifd_send_account_zero_pages(f, p);
 
     p->packet_num = multifd_send_state->packet_num++;
     multifd_send_state->pages = p->pages;
     p->pages = pages;
-    transferred = ((uint64_t) pages->used) * qemu_target_page_size()
-                + p->packet_len;
+    transferred = ((uint64_t) pages->used) * qemu_target_page_size();
+    if (!migrate_use_mapped_ram()) {
+        transferred += p->packet_len;
+    }
     qemu_file_update_transfer(f, transferred);
     ram_counters.multifd_bytes += transferred;
     ram_counters.transferred += transferred;
@@ -542,7 +662,11 @@ void multifd_save_cleanup(void)
         MultiFDSendParams *p = &multifd_send_state->params[i];
         Error *local_err = NULL;
 
-        socket_send_channel_destroy(p->c);
+        if (migrate_use_mapped_ram()) {
+            file_send_channel_destroy(p->c);
+        } else {
+            socket_send_channel_destroy(p->c);
+        }
         p->c = NULL;
         qemu_mutex_destroy(&p->mutex);
         qemu_sem_destroy(&p->sem);
@@ -600,9 +724,11 @@ void multifd_send_sync_main(QEMUFile *f)
         p->packet_num = multifd_send_state->packet_num++;
         p->flags |= MULTIFD_FLAG_SYNC;
         p->pending_job++;
-        qemu_file_update_transfer(f, p->packet_len);
-        ram_counters.multifd_bytes += p->packet_len;
-        ram_counters.transferred += p->packet_len;
+        if (!migrate_use_mapped_ram()) {
+            qemu_file_update_transfer(f, p->packet_len);
+            ram_counters.multifd_bytes += p->packet_len;
+            ram_counters.transferred += p->packet_len;
+        }
         qemu_mutex_unlock(&p->mutex);
         qemu_sem_post(&p->sem);
     }
@@ -611,26 +737,187 @@ void multifd_send_sync_main(QEMUFile *f)
 
         trace_multifd_send_sync_main_wait(p->id);
         qemu_sem_wait(&p->sem_sync);
+
+        qemu_mutex_lock(&p->mutex);
+        multifd_send_account_zero_pages(f, p);
+        qemu_mutex_unlock(&p->mutex);
     }
     trace_multifd_send_sync_main(multifd_send_state->packet_num);
 }
 
+/**
+ * multifd_send_stats: get the totals of the send channels
+ *
+ * The counters only grow during a migration; the caller computes the
+ * difference between two calls.
+ *
+ * @stats: where to store the totals
+ */
+void multifd_send_stats(MultiFDSendStats *stats)
+{
+    int i;
+
+    memset(stats, 0, sizeof(*stats));
+    for (i = 0; i < migrate_multifd_channels(); i++) {
+        MultiFDSendParams *p = &multifd_send_state->params[i];
+        uint64_t prepare_time = stat64_get(&p->prepare_time);
+        uint64_t write_time = stat64_get(&p->write_time);
+        uint64_t bytes = stat64_get(&p->bytes);
+
+        trace_multifd_send_stats(p->id, prepare_time, write_time, bytes);
+        stats->prepare_time += prepare_time;
+        stats->write_time += write_time;
+        stats->bytes += bytes;
+    }
+}
+
+int multifd_send_active_channels(void)
+{
+    return qatomic_read(&multifd_send_state->active_channels);
+}
+
+/**
+ * multifd_send_set_active_channels: change the channels used for pages
+ *
+ * Only the first @channels channels get new pages, the others keep
+ * running but only send the sync packets.
+ *
+ * @channels: number of channels, between 1 and multifd-channels
+ */
+void multifd_send_set_active_channels(int channels)
+{
+    int i, old;
+
+    assert(channels > 0 && channels <= migrate_multifd_channels());
+    old = qatomic_xchg(&multifd_send_state->active_channels, channels);
+
+    /*
+     * The channels that were parked did not post channels_ready, do it
+     * for them.  If one is still busy with a sync, multifd_send_pages()
+     * waits for the post it makes once it is done.
+     */
+    for (i = old; i < channels; i++) {
+        qemu_sem_post(&multifd_send_state->channels_ready);
+    }
+}
+
+/* Compression level set by the migration parameters */
+static int multifd_compression_level(void)
+{
+    switch (migrate_multifd_compression()) {
+    case MULTIFD_COMPRESSION_ZLIB:
+        return migrate_multifd_zlib_level();
+    case MULTIFD_COMPRESSION_ZSTD:
+        return migrate_multifd_zstd_level();
+#ifdef CONFIG_LZ4
+    case MULTIFD_COMPRESSION_LZ4:
+        return migrate_multifd_lz4_level();
+#endif
+    default:
+        return 0;
+    }
+}
+
+/**
+ * multifd_send_compression_levels: get the levels of the method in use
+ *
+ * Returns false if the compression method has no level.  Level 0 of
+ * zlib and zstd, no compression and the default level, is left out.
+ *
+ * @min: lowest, fastest, level
+ * @max: highest level
+ */
+bool multifd_send_compression_levels(int *min, int *max)
+{
+    switch (migrate_multifd_compression()) {
+    case MULTIFD_COMPRESSION_ZLIB:
+        *min = 1;
+        *max = 9;
+        return true;
+    case MULTIFD_COMPRESSION_ZSTD:
+        *min = 1;
+        *max = 19;
+        return true;
+#ifdef CONFIG_LZ4
+    case MULTIFD_COMPRESSION_LZ4:
+        *min = 0;
+        *max = 12;
+        return true;
+#endif
+    default:
+        return false;
+    }
+}
+
+/* Used by the compression methods at the start of each packet */
+int multifd_send_compression_level(void)
+{
+    return qatomic_read(&multifd_send_state->compression_level);
+}
+
+void multifd_send_set_compression_level(int level)
+{
+    qatomic_set(&multifd_send_state->compression_level, level);
+}
+
+/**
+ * multifd_send_file_pages: write pages to their place in the file
+ *
+ * With mapped-ram there are no packets, every page is written at its
+ * offset in the region of its RAMBlock.  Contiguous pages are written
+ * with a single call.
+ *
+ * Returns 0 for success or -1 for error
+ *
+ * @p: Params for the channel that we are using
+ * @block: RAMBlock the pages belong to
+ * @used: number of pages used
+ * @errp: pointer to an error
+ */
+static int multifd_send_file_pages(MultiFDSendParams *p, RAMBlock *block,
+                                   uint32_t used, Error **errp)
+{
+    MultiFDPages_t *pages = p->pages;
+    size_t page_size = qemu_target_page_size();
+    uint32_t start = 0;
+    uint32_t i;
+
+    for (i = 1; i <= used; i++) {
+        if (i < used &&
+            pages->offset[i] == pages->offset[i - 1] + page_size) {
+            continue;
+        }
+        if (qio_channel_pwritev_all(p->c, &pages->iov[start], i - start,
+                                    block->pages_offset + pages->offset[start],
+                                    errp) < 0) {
+            return -1;
+        }
+        start = i;
+    }
+    return 0;
+}
+
 static void *multifd_send_thread(void *opaque)
 {
     MultiFDSendParams *p = opaque;
     Error *local_err = NULL;
     int ret = 0;
     uint32_t flags = 0;
+    bool mapped_ram = migrate_use_mapped_ram();
+    int64_t start;
 
     trace_multifd_send_thread_start(p->id);
     rcu_register_thread();
 
-    if (multifd_send_initial_packet(p, &local_err) < 0) {
-        ret = -1;
-        goto out;
+    /* The file has no room for packets, pages go straight to their place */
+    if (!mapped_ram) {
+        if (multifd_send_initial_packet(p, &local_err) < 0) {
+            ret = -1;
+            goto out;
+        }
+        /* initial packet */
+        p->num_packets = 1;
     }
-    /* initial packet */
-    p->num_packets = 1;
 
     while (true) {
         qemu_sem_wait(&p->sem);
@@ -641,50 +928,100 @@ static void *multifd_send_thread(void *opaque)
         qemu_mutex_lock(&p->mutex);
 
         if (p->pending_job) {
-            uint32_t used = p->pages->used;
+            RAMBlock *block = p->pages->block;
+            uint32_t used;
+            uint32_t zero_num;
             uint64_t packet_num = p->packet_num;
             flags = p->flags;
 
-            if (used) {
+            if (p->pages->used && migrate_use_multifd_zero_page()) {
+                multifd_send_zero_page_detect(p);
+            }
+            used = p->pages->used;
+            zero_num = p->pages->zero_num;
+
+            if (used && !mapped_ram) {
+                start = get_clock();
                 ret = multifd_send_state->ops->send_prepare(p, used,
                                                             &local_err);
                 if (ret != 0) {
                     qemu_mutex_unlock(&p->mutex);
                     break;
                 }
+                stat64_add(&p->prepare_time, get_clock() - start);
+            }
+            if (!mapped_ram) {
+                multifd_send_fill_packet(p);
             }
-            multifd_send_fill_packet(p);
             p->flags = 0;
             p->num_packets++;
             p->num_pages += used;
+            p->num_zero_pages += zero_num;
+            p->zero_pages_pending += zero_num;
             p->pages->used = 0;
+            p->pages->zero_num = 0;
             p->pages->block = NULL;
             qemu_mutex_unlock(&p->mutex);
 
-            trace_multifd_send(p->id, packet_num, used, flags,
+            trace_multifd_send(p->id, packet_num, used, zero_num, flags,
                                p->next_packet_size);
 
-            ret = qio_channel_write_all(p->c, (void *)p->packet,
-                                        p->packet_len, &local_err);
-            if (ret != 0) {
-                break;
-            }
-
-            if (used) {
-                ret = multifd_send_state->ops->send_write(p, used, &local_err);
+            start = get_clock();
+            if (mapped_ram) {
+                if (used) {
+                    ret = multifd_send_file_pages(p, block, used, &local_err);
+                    if (ret != 0) {
+                        break;
+                    }
+                    stat64_add(&p->bytes,
+                               (uint64_t)used * qemu_target_page_size());
+                }
+            } else {
+                ret = qio_channel_write_all(p->c, (void *)p->packet,
+                                            p->packet_len, &local_err);
                 if (ret != 0) {
                     break;
                 }
+
+                if (used) {
+                    ret = multifd_send_state->ops->send_write(p, used,
+                                                              &local_err);
+                    if (ret != 0) {
+                        break;
+                    }
+                }
+                stat64_add(&p->bytes, p->packet_len +
+                           (used ? p->next_packet_size : 0));
             }
+            stat64_add(&p->write_time, get_clock() - start);
 
             qemu_mutex_lock(&p->mutex);
             p->pending_job--;
             qemu_mutex_unlock(&p->mutex);
 
             if (flags & MULTIFD_FLAG_SYNC) {
+                /*
+                 * Pages sent with zero copy may still be read by the
+                 * kernel, make sure they are all out before the sync
+                 * completes.
+                 */
+                if (migrate_use_zero_copy_send()) {
+                    ret = qio_channel_flush(p->c, &local_err);
+                    if (ret < 0) {
+                        break;
+                    }
+                    trace_multifd_send_flush(p->id, ret);
+                    if (ret == 1) {
+                        p->num_zero_copy_missed++;
+                    }
+                    ret = 0;
+                }
                 qemu_sem_post(&p->sem_sync);
             }
-            qemu_sem_post(&multifd_send_state->channels_ready);
+            /* Parked channels only send the sync packets */
+            if (p->id < qatomic_read(&multifd_send_state->active_channels)) {
+                qemu_sem_post(&multifd_send_state->channels_ready);
+            }
         } else if (p->quit) {
             qemu_mutex_unlock(&p->mutex);
             break;
@@ -715,7 +1052,11 @@ out:
     qemu_mutex_unlock(&p->mutex);
 
     rcu_unregister_thread();
-    trace_multifd_send_thread_end(p->id, p->num_packets, p->num_pages);
+    trace_multifd_send_thread_end(p->id, p->num_packets, p->num_pages,
+                                  p->num_zero_pages);
+    if (p->num_zero_copy_missed) {
+        trace_multifd_send_zero_copy_missed(p->id, p->num_zero_copy_missed);
+    }
 
     return NULL;
 }
@@ -772,7 +1113,8 @@ static bool multifd_channel_connect(MultiFDSendParams *p,
         ioc, object_get_typename(OBJECT(ioc)), p->tls_hostname, error);
 
     if (!error) {
-        if (s->parameters.tls_creds &&
+        if (!migrate_use_mapped_ram() &&
+            s->parameters.tls_creds &&
             *s->parameters.tls_creds &&
             !object_dynamic_cast(OBJECT(ioc),
                                  TYPE_QIO_CHANNEL_TLS)) {
@@ -828,6 +1170,13 @@ static void multifd_new_send_channel_async(QIOTask *task, gpointer opaque)
     } else {
         p->c = QIO_CHANNEL(sioc);
         qio_channel_set_delay(p->c, false);
+        if (migrate_use_zero_copy_send() &&
+            !qio_channel_has_feature(p->c,
+                                     QIO_CHANNEL_FEATURE_WRITE_ZERO_COPY)) {
+            error_setg(&local_err, "multifd: zero-copy-send is not supported "
+                       "by this migration channel");
+            goto cleanup;
+        }
         p->running = true;
         if (multifd_channel_connect(p, sioc, local_err)) {
             goto cleanup;
@@ -857,6 +1206,8 @@ int multifd_save_setup(Error **errp)
     qemu_sem_init(&multifd_send_state->channels_ready, 0);
     qatomic_set(&multifd_send_state->exiting, 0);
     multifd_send_state->ops = multifd_ops[migrate_multifd_compression()];
+    multifd_send_state->active_channels = thread_count;
+    multifd_send_state->compression_level = multifd_compression_level();
 
     for (i = 0; i < thread_count; i++) {
         MultiFDSendParams *p = &multifd_send_state->params[i];
@@ -867,6 +1218,9 @@ int multifd_save_setup(Error **errp)
         p->quit = false;
         p->pending_job = 0;
         p->id = i;
+        stat64_init(&p->prepare_time, 0);
+        stat64_init(&p->write_time, 0);
+        stat64_init(&p->bytes, 0);
         p->pages = multifd_pages_init(page_count);
         p->packet_len = sizeof(MultiFDPacket_t)
                       + sizeof(uint64_t) * page_count;
@@ -875,7 +1229,11 @@ int multifd_save_setup(Error **errp)
         p->packet->version = cpu_to_be32(MULTIFD_VERSION);
         p->name = g_strdup_printf("multifdsend_%d", i);
         p->tls_hostname = g_strdup(s->hostname);
-        socket_send_channel_create(multifd_new_send_channel_async, p);
+        if (migrate_use_mapped_ram()) {
+            file_send_channel_create(multifd_new_send_channel_async, p);
+        } else {
+            socket_send_channel_create(multifd_new_send_channel_async, p);
+        }
     }
 
     for (i = 0; i < thread_count; i++) {
@@ -942,7 +1300,7 @@ int multifd_load_cleanup(Error **errp)
 {
     int i;
 
-    if (!migrate_use_multifd()) {
+    if (!migrate_use_multifd() || migrate_use_mapped_ram()) {
         return 0;
     }
     multifd_recv_terminate_threads(NULL);
@@ -988,7 +1346,7 @@ void multifd_recv_sync_main(void)
 {
     int i;
 
-    if (!migrate_use_multifd()) {
+    if (!migrate_use_multifd() || migrate_use_mapped_ram()) {
         return;
     }
     for (i = 0; i < migrate_multifd_channels(); i++) {
@@ -1022,6 +1380,7 @@ static void *multifd_recv_thread(void *opaque)
 
     while (true) {
         uint32_t used;
+        uint32_t zero_num;
         uint32_t flags;
 
         if (p->quit) {
@@ -1045,13 +1404,15 @@ static void *multifd_recv_thread(void *opaque)
         }
 
         used = p->pages->used;
+        zero_num = p->pages->zero_num;
         flags = p->flags;
         /* recv methods don't know how to handle the SYNC flag */
         p->flags &= ~MULTIFD_FLAG_SYNC;
-        trace_multifd_recv(p->id, p->packet_num, used, flags,
+        trace_multifd_recv(p->id, p->packet_num, used, zero_num, flags,
                            p->next_packet_size);
         p->num_packets++;
         p->num_pages += used;
+        p->num_zero_pages += zero_num;
         qemu_mutex_unlock(&p->mutex);
 
         if (used) {
@@ -1061,6 +1422,10 @@ static void *multifd_recv_thread(void *opaque)
             }
         }
 
+        if (zero_num) {
+            multifd_recv_zero_pages(p);
+        }
+
         if (flags & MULTIFD_FLAG_SYNC) {
             qemu_sem_post(&multifd_recv_state->sem_sync);
             qemu_sem_wait(&p->sem_sync);
@@ -1076,7 +1441,8 @@ static void *multifd_recv_thread(void *opaque)
     qemu_mutex_unlock(&p->mutex);
 
     rcu_unregister_thread();
-    trace_multifd_recv_thread_end(p->id, p->num_packets, p->num_pages);
+    trace_multifd_recv_thread_end(p->id, p->num_packets, p->num_pages,
+                                  p->num_zero_pages);
 
     return NULL;
 }
@@ -1087,7 +1453,11 @@ int multifd_load_setup(Error **errp)
     uint32_t page_count = MULTIFD_PACKET_SIZE / qemu_target_page_size();
     uint8_t i;
 
-    if (!migrate_use_multifd()) {
+    /*
+     * With mapped-ram, the pages are read in parallel from the file
+     * by ram_load() instead.
+     */
+    if (!migrate_use_multifd() || migrate_use_mapped_ram()) {
         return 0;
     }
     thread_count = migrate_multifd_channels();
@@ -1129,7 +1499,7 @@ bool multifd_recv_all_channels_created(void)
 {
     int thread_count = migrate_multifd_channels();
 
-    if (!migrate_use_multifd()) {
+    if (!migrate_use_multifd() || migrate_use_mapped_ram()) {
         return true;
     }
 
@@ -13,6 +13,8 @@
 #ifndef QEMU_MIGRATION_MULTIFD_H
 #define QEMU_MIGRATION_MULTIFD_H
 
+#include "qemu/stats64.h"
+
 int multifd_save_setup(Error **errp);
 void multifd_save_cleanup(void);
 int multifd_load_setup(Error **errp);
@@ -22,6 +24,21 @@ bool multifd_recv_new_channel(QIOChannel *ioc, Error **errp);
 void multifd_recv_sync_main(void);
 void multifd_send_sync_main(QEMUFile *f);
 int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset);
+void multifd_xbzrle_cache_zero_page(RAMBlock *block, ram_addr_t offset);
+
+/* Totals over all the send channels, see MultiFDSendParams */
+typedef struct {
+    uint64_t prepare_time;
+    uint64_t write_time;
+    uint64_t bytes;
+} MultiFDSendStats;
+
+void multifd_send_stats(MultiFDSendStats *stats);
+int multifd_send_active_channels(void);
+void multifd_send_set_active_channels(int channels);
+bool multifd_send_compression_levels(int *min, int *max);
+int multifd_send_compression_level(void);
+void multifd_send_set_compression_level(int level);
 
 /* Multifd Compression flags */
 #define MULTIFD_FLAG_SYNC (1 << 0)
@@ -32,6 +49,8 @@ int multifd_queue_page(QEMUFile *f, RAMBlock *block, ram_addr_t offset);
 #define MULTIFD_FLAG_NOCOMP (0 << 1)
 #define MULTIFD_FLAG_ZLIB (1 << 1)
 #define MULTIFD_FLAG_ZSTD (2 << 1)
+#define MULTIFD_FLAG_XBZRLE (3 << 1)
+#define MULTIFD_FLAG_LZ4 (4 << 1)
 
 /* This value needs to be a multiple of qemu_target_page_size() */
 #define MULTIFD_PACKET_SIZE (512 * 1024)
@@ -42,11 +61,15 @@ typedef struct {
     uint32_t flags;
     /* maximum number of allocated pages */
     uint32_t pages_alloc;
+    /* number of pages whose data follows the packet */
     uint32_t pages_used;
     /* size of the next packet that contains pages */
     uint32_t next_packet_size;
     uint64_t packet_num;
-    uint64_t unused[4];    /* Reserved for future use */
+    /* number of zero pages, their offsets follow the used ones */
+    uint32_t zero_pages;
+    uint32_t unused32[1];    /* Reserved for future use */
+    uint64_t unused64[3];    /* Reserved for future use */
     char ramblock[256];
     uint64_t offset[];
 } __attribute__((packed)) MultiFDPacket_t;
@@ -56,6 +79,8 @@ typedef struct {
     uint32_t used;
     /* number of allocated pages */
     uint32_t allocated;
+    /* number of zero pages, stored in offset after the used ones */
+    uint32_t zero_num;
     /* global number of generated multifd packets */
     uint64_t packet_num;
     /* offset of each page */
@@ -104,6 +129,18 @@ typedef struct {
     uint64_t num_packets;
     /* pages sent through this channel */
     uint64_t num_pages;
+    /* zero pages found by this channel */
+    uint64_t num_zero_pages;
+    /* zero pages not yet accounted by the migration thread */
+    uint64_t zero_pages_pending;
+    /* syncs where the kernel had to copy all zero-copy sends */
+    uint64_t num_zero_copy_missed;
+    /* time spent preparing the packets, mostly compressing, in ns */
+    Stat64 prepare_time;
+    /* time spent writing the packets to the channel, in ns */
+    Stat64 write_time;
+    /* bytes written to the channel */
+    Stat64 bytes;
     /* syncs main thread and channels */
     QemuSemaphore sem_sync;
     /* used for compression methods */
@@ -143,6 +180,8 @@ typedef struct {
     uint64_t num_packets;
     /* pages sent through this channel */
     uint64_t num_pages;
+    /* zero pages received through this channel */
+    uint64_t num_zero_pages;
     /* syncs main thread and channels */
     QemuSemaphore sem_sync;
     /* used for de-compression methods */
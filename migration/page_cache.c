@@ -1,6 +1,6 @@
 /*
  * Page cache for QEMU
- * The cache is base on a hash of the page address
+ * The cache is set associative, the set is a hash of the page address
  *
  * Copyright 2012 Red Hat, Inc. and/or its affiliates
  *
@@ -17,6 +17,7 @@
 #include "qapi/qmp/qerror.h"
 #include "qapi/error.h"
 #include "qemu/host-utils.h"
+#include "qemu/thread.h"
 #include "page_cache.h"
 
 #ifdef DEBUG_CACHE
@@ -30,40 +31,45 @@
 /* the page in cache will not be replaced in two cycles */
 #define CACHED_PAGE_LIFETIME 2
 
+/* number of pages that can share a set */
+#define CACHE_WAYS 8
+
+#define CACHE_ADDR_INVALID UINT64_MAX
+
 typedef struct CacheItem CacheItem;
 
 struct CacheItem {
     uint64_t it_addr;
     uint64_t it_age;
     uint8_t *it_data;
+    /* statistics of the page being cached, charged for its eviction */
+    PageCacheStats *it_stats;
 };
 
+/*
+ * The items of a set are page_cache[set * ways, (set + 1) * ways),
+ * protected by locks[set].
+ */
 struct PageCache {
     CacheItem *page_cache;
+    QemuSpin *locks;
     size_t page_size;
     size_t max_num_items;
-    size_t num_items;
+    size_t num_sets;
+    size_t ways;
 };
 
-PageCache *cache_init(int64_t new_size, size_t page_size, Error **errp)
+PageCache *cache_init(uint64_t num_pages, size_t page_size, Error **errp)
 {
     int64_t i;
-    size_t num_pages = new_size / page_size;
     PageCache *cache;
 
-    if (new_size < page_size) {
+    if (!num_pages) {
         error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "cache size",
                    "is smaller than one target page size");
         return NULL;
     }
 
-    /* round down to the nearest power of 2 */
-    if (!is_power_of_2(num_pages)) {
-        error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "cache size",
-                   "is not a power of two number of pages");
-        return NULL;
-    }
-
     /* We prefer not to abort if there is no memory */
     cache = g_try_malloc(sizeof(*cache));
     if (!cache) {
@@ -72,17 +78,22 @@ PageCache *cache_init(int64_t new_size, size_t page_size, Error **errp)
         return NULL;
     }
     cache->page_size = page_size;
-    cache->num_items = 0;
-    cache->max_num_items = num_pages;
+    cache->ways = MIN(num_pages, CACHE_WAYS);
+    cache->num_sets = num_pages / cache->ways;
+    cache->max_num_items = cache->num_sets * cache->ways;
 
-    DPRINTF("Setting cache buckets to %" PRId64 "\n", cache->max_num_items);
+    DPRINTF("Setting cache sets to %zu of %zu pages\n", cache->num_sets,
+            cache->ways);
 
     /* We prefer not to abort if there is no memory */
     cache->page_cache = g_try_malloc((cache->max_num_items) *
                                      sizeof(*cache->page_cache));
-    if (!cache->page_cache) {
+    cache->locks = g_try_malloc(cache->num_sets * sizeof(*cache->locks));
+    if (!cache->page_cache || !cache->locks) {
         error_setg(errp, QERR_INVALID_PARAMETER_VALUE, "cache size",
                    "Failed to allocate page cache");
+        g_free(cache->page_cache);
+        g_free(cache->locks);
         g_free(cache);
         return NULL;
     }
@@ -90,7 +101,11 @@ PageCache *cache_init(int64_t new_size, size_t page_size, Error **errp)
     for (i = 0; i < cache->max_num_items; i++) {
         cache->page_cache[i].it_data = NULL;
         cache->page_cache[i].it_age = 0;
-        cache->page_cache[i].it_addr = -1;
+        cache->page_cache[i].it_addr = CACHE_ADDR_INVALID;
+        cache->page_cache[i].it_stats = NULL;
+    }
+    for (i = 0; i < cache->num_sets; i++) {
+        qemu_spin_init(&cache->locks[i]);
     }
 
     return cache;
@@ -108,77 +123,188 @@ void cache_fini(PageCache *cache)
     }
 
     g_free(cache->page_cache);
+    g_free(cache->locks);
     cache->page_cache = NULL;
     g_free(cache);
 }
 
-static size_t cache_get_cache_pos(const PageCache *cache,
-                                  uint64_t address)
+static size_t cache_get_set(const PageCache *cache, uint64_t address)
+{
+    g_assert(cache->num_sets);
+    return (address / cache->page_size) % cache->num_sets;
+}
+
+static void cache_lock_set(PageCache *cache, uint64_t addr)
 {
-    g_assert(cache->max_num_items);
-    return (address / cache->page_size) & (cache->max_num_items - 1);
+    qemu_spin_lock(&cache->locks[cache_get_set(cache, addr)]);
 }
 
+/**
+ * cache_get_by_addr: find the item caching a page
+ *
+ * Returns the item or NULL if the page is not cached
+ *
+ * @cache pointer to the PageCache struct
+ * @addr: page addr
+ */
 static CacheItem *cache_get_by_addr(const PageCache *cache, uint64_t addr)
 {
-    size_t pos;
+    CacheItem *set;
+    size_t i;
 
     g_assert(cache);
     g_assert(cache->page_cache);
 
-    pos = cache_get_cache_pos(cache, addr);
+    set = &cache->page_cache[cache_get_set(cache, addr) * cache->ways];
+    for (i = 0; i < cache->ways; i++) {
+        if (set[i].it_addr == addr) {
+            return &set[i];
+        }
+    }
+    return NULL;
+}
+
+/**
+ * cache_get_victim: find the item to cache a new page into
+ *
+ * Returns the first free item of the set, or else its least recently
+ * used item, or NULL if all the items are fresh
+ *
+ * @cache pointer to the PageCache struct
+ * @addr: page addr
+ * @current_age: current bitmap generation
+ */
+static CacheItem *cache_get_victim(const PageCache *cache, uint64_t addr,
+                                   uint64_t current_age)
+{
+    CacheItem *set, *victim = NULL;
+    size_t i;
 
-    return &cache->page_cache[pos];
+    set = &cache->page_cache[cache_get_set(cache, addr) * cache->ways];
+    for (i = 0; i < cache->ways; i++) {
+        if (set[i].it_addr == CACHE_ADDR_INVALID) {
+            return &set[i];
+        }
+        if (!victim || set[i].it_age < victim->it_age) {
+            victim = &set[i];
+        }
+    }
+    if (victim->it_age + CACHED_PAGE_LIFETIME > current_age) {
+        /* the cache page is fresh, don't replace it */
+        return NULL;
+    }
+    return victim;
+}
+
+static CacheItem *cache_lookup(PageCache *cache, uint64_t addr,
+                               uint64_t current_age, PageCacheStats *stats)
+{
+    CacheItem *it = cache_get_by_addr(cache, addr);
+
+    if (!it) {
+        if (stats) {
+            stat64_add(&stats->misses, 1);
+        }
+        return NULL;
+    }
+    /* update the it_age when the cache hit */
+    it->it_age = current_age;
+    if (stats) {
+        stat64_add(&stats->hits, 1);
+    }
+    return it;
 }
 
 uint8_t *get_cached_data(const PageCache *cache, uint64_t addr)
 {
-    return cache_get_by_addr(cache, addr)->it_data;
+    CacheItem *it = cache_get_by_addr(cache, addr);
+
+    return it ? it->it_data : NULL;
 }
 
-bool cache_is_cached(const PageCache *cache, uint64_t addr,
-                     uint64_t current_age)
+bool cache_is_cached(PageCache *cache, uint64_t addr,
+                     uint64_t current_age, PageCacheStats *stats)
 {
-    CacheItem *it;
+    bool ret;
 
-    it = cache_get_by_addr(cache, addr);
+    cache_lock_set(cache, addr);
+    ret = cache_lookup(cache, addr, current_age, stats) != NULL;
+    cache_unlock(cache, addr);
+    return ret;
+}
+
+uint8_t *cache_lookup_lock(PageCache *cache, uint64_t addr,
+                           uint64_t current_age, PageCacheStats *stats)
+{
+    CacheItem *it;
 
-    if (it->it_addr == addr) {
-        /* update the it_age when the cache hit */
-        it->it_age = current_age;
-        return true;
+    cache_lock_set(cache, addr);
+    it = cache_lookup(cache, addr, current_age, stats);
+    if (!it) {
+        cache_unlock(cache, addr);
+        return NULL;
     }
-    return false;
+    return it->it_data;
 }
 
-int cache_insert(PageCache *cache, uint64_t addr, const uint8_t *pdata,
-                 uint64_t current_age)
+void cache_unlock(PageCache *cache, uint64_t addr)
 {
+    qemu_spin_unlock(&cache->locks[cache_get_set(cache, addr)]);
+}
 
+int cache_insert(PageCache *cache, uint64_t addr, const uint8_t *pdata,
+                 uint64_t current_age, PageCacheStats *stats)
+{
     CacheItem *it;
+    int ret = -1;
+
+    cache_lock_set(cache, addr);
 
     /* actual update of entry */
     it = cache_get_by_addr(cache, addr);
-
-    if (it->it_data && it->it_addr != addr &&
-        it->it_age + CACHED_PAGE_LIFETIME > current_age) {
-        /* the cache page is fresh, don't replace it */
-        return -1;
+    if (!it) {
+        it = cache_get_victim(cache, addr, current_age);
+        if (!it) {
+            goto out;
+        }
+        if (it->it_addr != CACHE_ADDR_INVALID && it->it_stats) {
+            stat64_add(&it->it_stats->evictions, 1);
+        }
     }
+
     /* allocate page */
     if (!it->it_data) {
         it->it_data = g_try_malloc(cache->page_size);
         if (!it->it_data) {
             DPRINTF("Error allocating page\n");
-            return -1;
+            it->it_addr = CACHE_ADDR_INVALID;
+            goto out;
         }
-        cache->num_items++;
     }
 
     memcpy(it->it_data, pdata, cache->page_size);
 
     it->it_age = current_age;
     it->it_addr = addr;
+    it->it_stats = stats;
+    ret = 0;
 
-    return 0;
+out:
+    cache_unlock(cache, addr);
+    return ret;
+}
+
+void cache_invalidate(PageCache *cache, uint64_t addr)
+{
+    CacheItem *it;
+
+    cache_lock_set(cache, addr);
+    it = cache_get_by_addr(cache, addr);
+    if (it) {
+        /* keep the data buffer for the next page cached in the set */
+        it->it_addr = CACHE_ADDR_INVALID;
+        it->it_age = 0;
+        it->it_stats = NULL;
+    }
+    cache_unlock(cache, addr);
 }
@@ -1,6 +1,6 @@
 /*
  * Page cache for QEMU
- * The cache is base on a hash of the page address
+ * The cache is set associative, the set is a hash of the page address
  *
  * Copyright 2012 Red Hat, Inc. and/or its affiliates
  *
@@ -15,20 +15,37 @@
 #ifndef PAGE_CACHE_H
 #define PAGE_CACHE_H
 
+#include "qemu/stats64.h"
+
 /* Page cache for storing guest pages */
 typedef struct PageCache PageCache;
 
+/*
+ * Statistics of a set of pages, usually a RAMBlock.  They are updated
+ * atomically and may be shared by several caches.
+ */
+typedef struct PageCacheStats {
+    Stat64 hits;
+    Stat64 misses;
+    /* pages of the set replaced by another page */
+    Stat64 evictions;
+} PageCacheStats;
+
 /**
  * cache_init: Initialize the page cache
  *
+ * Every page may be cached in any of the few slots of its set; when
+ * they are all used, the least recently used one is replaced.  The
+ * operations on the cache only lock the set of the page, so that the
+ * cache can be shared by several threads.
  *
  * Returns new allocated cache or NULL on error
  *
- * @cache_size: cache size in bytes
+ * @num_pages: cache size in pages
  * @page_size: cache page size
  * @errp: set *errp if the check failed, with reason
  */
-PageCache *cache_init(int64_t cache_size, size_t page_size, Error **errp);
+PageCache *cache_init(uint64_t num_pages, size_t page_size, Error **errp);
 /**
  * cache_fini: free all cache resources
  * @cache pointer to the PageCache struct
@@ -43,13 +60,17 @@ void cache_fini(PageCache *cache);
  * @cache pointer to the PageCache struct
  * @addr: page addr
  * @current_age: current bitmap generation
+ * @stats: statistics to account the hit or miss to, or NULL
  */
-bool cache_is_cached(const PageCache *cache, uint64_t addr,
-                     uint64_t current_age);
+bool cache_is_cached(PageCache *cache, uint64_t addr,
+                     uint64_t current_age, PageCacheStats *stats);
 
 /**
  * get_cached_data: Get the data cached for an addr
  *
+ * The set of the page is not locked, so the data is only stable if
+ * the caller is the only user of the cache.
+ *
  * Returns pointer to the data cached or NULL if not cached
  *
  * @cache pointer to the PageCache struct
@@ -57,6 +78,31 @@ bool cache_is_cached(const PageCache *cache, uint64_t addr,
  */
 uint8_t *get_cached_data(const PageCache *cache, uint64_t addr);
 
+/**
+ * cache_lookup_lock: Get the data cached for an addr and lock it
+ *
+ * On a hit the set of the page stays locked until cache_unlock(), so
+ * that the data can be read and updated in place.  The lock is a
+ * spinlock, do not sleep while holding it.
+ *
+ * Returns pointer to the data cached or NULL if not cached
+ *
+ * @cache pointer to the PageCache struct
+ * @addr: page addr
+ * @current_age: current bitmap generation
+ * @stats: statistics to account the hit or miss to, or NULL
+ */
+uint8_t *cache_lookup_lock(PageCache *cache, uint64_t addr,
+                           uint64_t current_age, PageCacheStats *stats);
+
+/**
+ * cache_unlock: unlock the data returned by cache_lookup_lock()
+ *
+ * @cache pointer to the PageCache struct
+ * @addr: page addr
+ */
+void cache_unlock(PageCache *cache, uint64_t addr);
+
 /**
  * cache_insert: insert the page into the cache. the page cache
  * will dup the data on insert. the previous value will be overwritten
@@ -67,8 +113,17 @@ uint8_t *get_cached_data(const PageCache *cache, uint64_t addr);
  * @addr: page address
  * @pdata: pointer to the page
  * @current_age: current bitmap generation
+ * @stats: statistics to account an eviction of the page to, or NULL
  */
 int cache_insert(PageCache *cache, uint64_t addr, const uint8_t *pdata,
-                 uint64_t current_age);
+                 uint64_t current_age, PageCacheStats *stats);
+
+/**
+ * cache_invalidate: drop a page from the cache
+ *
+ * @cache pointer to the PageCache struct
+ * @addr: page address
+ */
+void cache_invalidate(PageCache *cache, uint64_t addr);
 
 #endif
@@ -20,11 +20,14 @@
 #include "exec/target_page.h"
 #include "migration.h"
 #include "qemu-file.h"
+#include "qemu-file-channel.h"
 #include "savevm.h"
+#include "socket.h"
 #include "postcopy-ram.h"
 #include "ram.h"
 #include "qapi/error.h"
 #include "qemu/notify.h"
+#include "qemu/host-utils.h"
 #include "qemu/rcu.h"
 #include "sysemu/sysemu.h"
 #include "qemu/error-report.h"
@@ -48,6 +51,18 @@ struct PostcopyDiscardState {
     unsigned int nsentcmds;
 };
 
+typedef struct PostcopyFaultThread {
+    MigrationIncomingState *mis;
+    QemuThread thread;
+    /* Index in mis->fault_threads, thread 0 also serves shared memory */
+    int id;
+    /* To notify the thread to wake, e.g., when need to quit */
+    int event_fd;
+    /* Last page requested by this thread, to detect sequential faults */
+    RAMBlock *last_fault_rb;
+    ram_addr_t last_fault_offset;
+} PostcopyFaultThread;
+
 static NotifierWithReturnList postcopy_notifier_list;
 
 void postcopy_infrastructure_init(void)
@@ -75,6 +90,108 @@ int postcopy_notify(enum PostcopyNotifyReason reason, Error **errp)
                                             &pnd);
 }
 
+/*
+ * The preempt channel is opened next to the main channel when the
+ * migration starts.  During postcopy the source sends the pages requested
+ * by the destination on it, so that they do not queue behind the
+ * background pages of the main channel.
+ */
+int postcopy_preempt_setup(MigrationState *s, Error **errp)
+{
+    QIOChannel *ioc;
+
+    ioc = socket_send_channel_create_sync(errp);
+    if (!ioc) {
+        return -1;
+    }
+
+    qio_channel_set_name(ioc, "migration-postcopy-preempt");
+    qemu_mutex_lock(&s->qemu_file_lock);
+    s->postcopy_qemufile_src = qemu_fopen_channel_output(ioc);
+    qemu_mutex_unlock(&s->qemu_file_lock);
+    object_unref(OBJECT(ioc));
+
+    trace_postcopy_preempt_setup();
+    return 0;
+}
+
+void postcopy_preempt_close(MigrationState *s)
+{
+    QEMUFile *file;
+
+    qemu_mutex_lock(&s->qemu_file_lock);
+    file = s->postcopy_qemufile_src;
+    s->postcopy_qemufile_src = NULL;
+    qemu_mutex_unlock(&s->qemu_file_lock);
+
+    if (file) {
+        qemu_file_shutdown(file);
+        qemu_fclose(file);
+    }
+}
+
+static void *postcopy_preempt_thread(void *opaque)
+{
+    MigrationIncomingState *mis = opaque;
+    int ret;
+
+    trace_postcopy_preempt_thread_entry();
+    rcu_register_thread();
+
+    ret = ram_load_postcopy_preempt(mis->postcopy_qemufile_dst);
+    if (ret && !qatomic_read(&mis->preempt_thread_quit)) {
+        error_report("%s: postcopy preempt channel failed: %s",
+                     __func__, strerror(-ret));
+        /* Let the main channel go through the postcopy pause */
+        qemu_file_shutdown(mis->from_src_file);
+    }
+
+    rcu_unregister_thread();
+    trace_postcopy_preempt_thread_exit(ret);
+    return NULL;
+}
+
+/*
+ * The thread needs both the channel and the temporary page allocated by
+ * postcopy_ram_incoming_setup(), whichever comes last starts it.
+ */
+static void postcopy_preempt_thread_start(MigrationIncomingState *mis)
+{
+    if (!mis->postcopy_qemufile_dst || !mis->postcopy_preempt_tmp_page ||
+        mis->have_preempt_thread) {
+        return;
+    }
+
+    mis->preempt_thread_quit = false;
+    qemu_thread_create(&mis->preempt_thread, "postcopy/preempt",
+                       postcopy_preempt_thread, mis, QEMU_THREAD_JOINABLE);
+    mis->have_preempt_thread = true;
+}
+
+void postcopy_preempt_new_channel(MigrationIncomingState *mis, QEMUFile *file)
+{
+    trace_postcopy_preempt_new_channel();
+    mis->postcopy_qemufile_dst = file;
+    /* Read by its own thread, like the main channel during postcopy */
+    qemu_file_set_blocking(file, true);
+    postcopy_preempt_thread_start(mis);
+}
+
+void postcopy_preempt_thread_join(MigrationIncomingState *mis, bool abort)
+{
+    if (!mis->have_preempt_thread) {
+        return;
+    }
+
+    /* Otherwise the source ends the channel when postcopy completes */
+    if (abort) {
+        qatomic_set(&mis->preempt_thread_quit, true);
+        qemu_file_shutdown(mis->postcopy_qemufile_dst);
+    }
+    qemu_thread_join(&mis->preempt_thread);
+    mis->have_preempt_thread = false;
+}
+
 /* Postcopy needs to detect accesses to pages that haven't yet been copied
  * across, and efficiently map new pages in, the techniques for doing this
  * are target OS specific.
@@ -91,6 +208,18 @@ int postcopy_notify(enum PostcopyNotifyReason reason, Error **errp)
 #include <sys/eventfd.h>
 #include <linux/userfaultfd.h>
 
+/* Maximum number of page faults a fault thread handles at once */
+#define POSTCOPY_FAULT_BATCH 16
+
+/* Fault latency buckets, the last one counts faults of 2^23us (~8s) and more */
+#define POSTCOPY_FAULT_LATENCY_BUCKETS 24
+
+typedef struct PostcopyFaultRequest {
+    RAMBlock *rb;
+    /* Offset of the faulted host page in rb */
+    ram_addr_t offset;
+} PostcopyFaultRequest;
+
 typedef struct PostcopyBlocktimeContext {
     /* time when page fault initiated per vCPU */
     uint32_t *page_fault_vcpu_time;
@@ -105,6 +234,15 @@ typedef struct PostcopyBlocktimeContext {
     int smp_cpus_down;
     uint64_t start_time;
 
+    /* Latency of the faulted pages, see PostcopyFaultLatency */
+    QemuMutex fault_latency_lock;
+    /* Host page address -> time of the first fault on it, in us */
+    GHashTable *fault_latency_pending;
+    uint64_t fault_latency_count;
+    uint64_t fault_latency_total;
+    uint64_t fault_latency_max;
+    uint64_t fault_latency_buckets[POSTCOPY_FAULT_LATENCY_BUCKETS];
+
     /*
      * Handler for exit event, necessary for
      * releasing whole blocktime_ctx
@@ -117,6 +255,8 @@ static void destroy_blocktime_context(struct PostcopyBlocktimeContext *ctx)
     g_free(ctx->page_fault_vcpu_time);
     g_free(ctx->vcpu_addr);
     g_free(ctx->vcpu_blocktime);
+    g_hash_table_destroy(ctx->fault_latency_pending);
+    qemu_mutex_destroy(&ctx->fault_latency_lock);
     g_free(ctx);
 }
 
@@ -135,6 +275,10 @@ static struct PostcopyBlocktimeContext *blocktime_context_new(void)
     ctx->page_fault_vcpu_time = g_new0(uint32_t, smp_cpus);
     ctx->vcpu_addr = g_new0(uintptr_t, smp_cpus);
     ctx->vcpu_blocktime = g_new0(uint32_t, smp_cpus);
+    qemu_mutex_init(&ctx->fault_latency_lock);
+    ctx->fault_latency_pending = g_hash_table_new_full(g_direct_hash,
+                                                       g_direct_equal,
+                                                       NULL, g_free);
 
     ctx->exit_notifier.notify = migration_exit_cb;
     ctx->start_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
@@ -158,6 +302,27 @@ static uint32List *get_vcpu_blocktime_list(PostcopyBlocktimeContext *ctx)
     return list;
 }
 
+static PostcopyFaultLatency *get_fault_latency(PostcopyBlocktimeContext *ctx)
+{
+    PostcopyFaultLatency *latency = g_new0(PostcopyFaultLatency, 1);
+    uint64List *entry;
+    int i;
+
+    qemu_mutex_lock(&ctx->fault_latency_lock);
+    latency->count = ctx->fault_latency_count;
+    latency->total = ctx->fault_latency_total;
+    latency->max = ctx->fault_latency_max;
+    for (i = POSTCOPY_FAULT_LATENCY_BUCKETS - 1; i >= 0; i--) {
+        entry = g_new0(uint64List, 1);
+        entry->value = ctx->fault_latency_buckets[i];
+        entry->next = latency->buckets;
+        latency->buckets = entry;
+    }
+    qemu_mutex_unlock(&ctx->fault_latency_lock);
+
+    return latency;
+}
+
 /*
  * This function just populates MigrationInfo from postcopy's
  * blocktime context. It will not populate MigrationInfo,
@@ -178,6 +343,8 @@ void fill_destination_postcopy_migration_info(MigrationInfo *info)
     info->postcopy_blocktime = bc->total_blocktime;
     info->has_postcopy_vcpu_blocktime = true;
     info->postcopy_vcpu_blocktime = get_vcpu_blocktime_list(bc);
+    info->has_postcopy_fault_latency = true;
+    info->postcopy_fault_latency = get_fault_latency(bc);
 }
 
 static uint32_t get_postcopy_total_blocktime(void)
@@ -524,16 +691,23 @@ int postcopy_ram_incoming_init(MigrationIncomingState *mis)
  */
 int postcopy_ram_incoming_cleanup(MigrationIncomingState *mis)
 {
+    int i;
+
     trace_postcopy_ram_incoming_cleanup_entry();
 
+    postcopy_preempt_thread_join(mis,
+                                 mis->state == MIGRATION_STATUS_FAILED);
+
     if (mis->have_fault_thread) {
         Error *local_err = NULL;
 
-        /* Let the fault thread quit */
+        /* Let the fault threads quit */
         qatomic_set(&mis->fault_thread_quit, 1);
         postcopy_fault_thread_notify(mis);
         trace_postcopy_ram_incoming_cleanup_join();
-        qemu_thread_join(&mis->fault_thread);
+        for (i = 0; i < mis->fault_thread_count; i++) {
+            qemu_thread_join(&mis->fault_threads[i].thread);
+        }
 
         if (postcopy_notify(POSTCOPY_NOTIFY_INBOUND_END, &local_err)) {
             error_report_err(local_err);
@@ -546,7 +720,12 @@ int postcopy_ram_incoming_cleanup(MigrationIncomingState *mis)
 
         trace_postcopy_ram_incoming_cleanup_closeuf();
         close(mis->userfault_fd);
-        close(mis->userfault_event_fd);
+        for (i = 0; i < mis->fault_thread_count; i++) {
+            close(mis->fault_threads[i].event_fd);
+        }
+        g_free(mis->fault_threads);
+        mis->fault_threads = NULL;
+        mis->fault_thread_count = 0;
         mis->have_fault_thread = false;
     }
 
@@ -568,6 +747,10 @@ int postcopy_ram_incoming_cleanup(MigrationIncomingState *mis)
         munmap(mis->postcopy_tmp_zero_page, mis->largest_page_size);
         mis->postcopy_tmp_zero_page = NULL;
     }
+    if (mis->postcopy_preempt_tmp_page) {
+        munmap(mis->postcopy_preempt_tmp_page, mis->largest_page_size);
+        mis->postcopy_preempt_tmp_page = NULL;
+    }
     trace_postcopy_ram_incoming_cleanup_blocktime(
             get_postcopy_total_blocktime());
 
@@ -684,7 +867,7 @@ int postcopy_request_shared_page(struct PostCopyFD *pcfd, RAMBlock *rb,
                                         qemu_ram_get_idstr(rb), rb_offset);
         return postcopy_wake_shared(pcfd, client_addr, rb);
     }
-    migrate_send_rp_req_pages(mis, rb, aligned_rbo);
+    migrate_send_rp_req_pages(mis, rb, aligned_rbo, pagesize);
     return 0;
 }
 
@@ -709,6 +892,60 @@ static uint32_t get_low_time_offset(PostcopyBlocktimeContext *dc)
     return start_time_offset < 1 ? 1 : start_time_offset & UINT32_MAX;
 }
 
+/*
+ * Remember when the guest first faulted on a host page, so that
+ * mark_postcopy_blocktime_end() can account the latency of the fault.
+ *
+ * @host: faulted host page
+ * @rb: ramblock appropriate to host
+ */
+static void mark_postcopy_fault_latency_begin(void *host, RAMBlock *rb)
+{
+    MigrationIncomingState *mis = migration_incoming_get_current();
+    PostcopyBlocktimeContext *dc = mis->blocktime_ctx;
+    int64_t *start;
+
+    if (!dc) {
+        return;
+    }
+
+    qemu_mutex_lock(&dc->fault_latency_lock);
+    if (!g_hash_table_contains(dc->fault_latency_pending, host)) {
+        start = g_new(int64_t, 1);
+        *start = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+        g_hash_table_insert(dc->fault_latency_pending, host, start);
+    }
+    /* As in mark_postcopy_blocktime_begin, the page may be there already */
+    if (ramblock_recv_bitmap_test(rb, host)) {
+        g_hash_table_remove(dc->fault_latency_pending, host);
+    }
+    qemu_mutex_unlock(&dc->fault_latency_lock);
+}
+
+static void mark_postcopy_fault_latency_end(PostcopyBlocktimeContext *dc,
+                                            uintptr_t addr)
+{
+    int64_t *start;
+    uint64_t latency;
+    int bucket;
+
+    qemu_mutex_lock(&dc->fault_latency_lock);
+    start = g_hash_table_lookup(dc->fault_latency_pending, (void *)addr);
+    if (start) {
+        latency = MAX(qemu_clock_get_us(QEMU_CLOCK_REALTIME) - *start, 0);
+        bucket = latency < 2 ? 0 : 63 - clz64(latency);
+        bucket = MIN(bucket, POSTCOPY_FAULT_LATENCY_BUCKETS - 1);
+
+        dc->fault_latency_count++;
+        dc->fault_latency_total += latency;
+        dc->fault_latency_max = MAX(dc->fault_latency_max, latency);
+        dc->fault_latency_buckets[bucket]++;
+        g_hash_table_remove(dc->fault_latency_pending, (void *)addr);
+        trace_mark_postcopy_fault_latency_end(addr, latency);
+    }
+    qemu_mutex_unlock(&dc->fault_latency_lock);
+}
+
 /*
  * This function is being called when pagefault occurs. It
  * tracks down vCPU blocking time.
@@ -832,12 +1069,15 @@ static void mark_postcopy_blocktime_end(uintptr_t addr)
     }
     trace_mark_postcopy_blocktime_end(addr, dc, dc->total_blocktime,
                                       affected_cpu);
+
+    mark_postcopy_fault_latency_end(dc, addr);
 }
 
 static bool postcopy_pause_fault_thread(MigrationIncomingState *mis)
 {
     trace_postcopy_pause_fault_thread();
 
+    qatomic_inc(&mis->postcopy_fault_threads_paused);
     qemu_sem_wait(&mis->postcopy_pause_sem_fault);
 
     trace_postcopy_pause_fault_thread_continued();
@@ -845,33 +1085,183 @@ static bool postcopy_pause_fault_thread(MigrationIncomingState *mis)
     return true;
 }
 
+static int postcopy_fault_request_cmp(const void *a, const void *b)
+{
+    const PostcopyFaultRequest *r1 = a, *r2 = b;
+
+    if (r1->rb != r2->rb) {
+        return (uintptr_t)r1->rb < (uintptr_t)r2->rb ? -1 : 1;
+    }
+    if (r1->offset != r2->offset) {
+        return r1->offset < r2->offset ? -1 : 1;
+    }
+    return 0;
+}
+
+/*
+ * Request the host pages [offset, offset + len) of @rb faulted by the
+ * guest.  If the faults seen by this thread look sequential, also
+ * request the pages that follow, up to postcopy-prefetch-pages of them.
+ */
+static int postcopy_fault_thread_request(PostcopyFaultThread *ft,
+                                         RAMBlock *rb, ram_addr_t offset,
+                                         uint64_t len)
+{
+    MigrationIncomingState *mis = ft->mis;
+    size_t pagesize = qemu_ram_pagesize(rb);
+    uint32_t prefetch = migrate_postcopy_prefetch_pages();
+    uint64_t max_len = QEMU_ALIGN_DOWN(UINT32_MAX, pagesize);
+    uint64_t faulted = len;
+    int ret;
+
+    if (prefetch && (len > pagesize ||
+                     (rb == ft->last_fault_rb &&
+                      offset == ft->last_fault_offset + pagesize))) {
+        while (prefetch-- &&
+               offset + len + pagesize <= qemu_ram_get_used_length(rb) &&
+               len + pagesize <= max_len &&
+               !ramblock_recv_bitmap_test_byte_offset(rb, offset + len)) {
+            len += pagesize;
+        }
+    }
+    /*
+     * The prefetched pages don't fault, so the next fault of a sequential
+     * access is right after them.
+     */
+    ft->last_fault_rb = rb;
+    ft->last_fault_offset = offset + len - pagesize;
+
+    trace_postcopy_ram_fault_thread_request_range(ft->id,
+                                                  qemu_ram_get_idstr(rb),
+                                                  offset, faulted, len);
+retry:
+    /*
+     * Send the request to the source - we want to request whole host
+     * pages (which are >= TPS)
+     */
+    ret = migrate_send_rp_req_pages(mis, rb, offset, len);
+    if (ret) {
+        /* May be network failure, try to wait for recovery */
+        if (ret == -EIO && postcopy_pause_fault_thread(mis)) {
+            /* We got reconnected somehow, try to continue */
+            mis->last_rb = NULL;
+            goto retry;
+        }
+        /* This is a unavoidable fault */
+        error_report("%s: migrate_send_rp_req_pages() get %d",
+                     __func__, ret);
+    }
+    return ret;
+}
+
+/*
+ * Handle a batch of page faults read from the userfaultfd.  The faulted
+ * host pages are sorted, so that the pages faulted by several vCPUs are
+ * only requested once and contiguous pages of a RAMBlock are requested
+ * together.
+ */
+static int postcopy_fault_thread_handle(PostcopyFaultThread *ft,
+                                        struct uffd_msg *msgs, int nmsgs)
+{
+    PostcopyFaultRequest reqs[POSTCOPY_FAULT_BATCH];
+    RAMBlock *rb;
+    ram_addr_t rb_offset, start = 0;
+    uint64_t len = 0;
+    int i, nreqs = 0;
+
+    for (i = 0; i < nmsgs; i++) {
+        struct uffd_msg *msg = &msgs[i];
+
+        if (msg->event != UFFD_EVENT_PAGEFAULT) {
+            error_report("%s: Read unexpected event %ud from userfaultfd",
+                         __func__, msg->event);
+            continue; /* It's not a page fault, shouldn't happen */
+        }
+
+        rb = qemu_ram_block_from_host(
+                 (void *)(uintptr_t)msg->arg.pagefault.address,
+                 true, &rb_offset);
+        if (!rb) {
+            error_report("postcopy_ram_fault_thread: Fault outside guest: %"
+                         PRIx64, (uint64_t)msg->arg.pagefault.address);
+            return -1;
+        }
+
+        rb_offset &= ~(qemu_ram_pagesize(rb) - 1);
+        trace_postcopy_ram_fault_thread_request(msg->arg.pagefault.address,
+                                                qemu_ram_get_idstr(rb),
+                                                rb_offset,
+                                                msg->arg.pagefault.feat.ptid);
+        mark_postcopy_blocktime_begin(
+                (uintptr_t)(msg->arg.pagefault.address),
+                            msg->arg.pagefault.feat.ptid, rb);
+        mark_postcopy_fault_latency_begin(
+                qemu_ram_get_host_addr(rb) + rb_offset, rb);
+
+        reqs[nreqs].rb = rb;
+        reqs[nreqs].offset = rb_offset;
+        nreqs++;
+    }
+
+    qsort(reqs, nreqs, sizeof(reqs[0]), postcopy_fault_request_cmp);
+
+    rb = NULL;
+    for (i = 0; i < nreqs; i++) {
+        size_t pagesize = qemu_ram_pagesize(reqs[i].rb);
+
+        if (reqs[i].rb == rb && reqs[i].offset < start + len) {
+            /* Several vCPUs faulted on the same page */
+            continue;
+        }
+        if (reqs[i].rb == rb && reqs[i].offset == start + len &&
+            len + pagesize <= UINT32_MAX) {
+            len += pagesize;
+            continue;
+        }
+        if (rb && postcopy_fault_thread_request(ft, rb, start, len)) {
+            return -1;
+        }
+        rb = reqs[i].rb;
+        start = reqs[i].offset;
+        len = pagesize;
+    }
+
+    if (rb) {
+        return postcopy_fault_thread_request(ft, rb, start, len);
+    }
+    return 0;
+}
+
 /*
  * Handle faults detected by the USERFAULT markings
+ *
+ * All the fault threads read the same userfaultfd; the first one also
+ * serves the shared memory of external processes.
  */
 static void *postcopy_ram_fault_thread(void *opaque)
 {
-    MigrationIncomingState *mis = opaque;
+    PostcopyFaultThread *ft = opaque;
+    MigrationIncomingState *mis = ft->mis;
+    struct uffd_msg msgs[POSTCOPY_FAULT_BATCH];
     struct uffd_msg msg;
     int ret;
     size_t index;
-    RAMBlock *rb = NULL;
 
-    trace_postcopy_ram_fault_thread_entry();
+    trace_postcopy_ram_fault_thread_entry(ft->id);
     rcu_register_thread();
-    mis->last_rb = NULL; /* last RAMBlock we sent part of */
     qemu_sem_post(&mis->fault_thread_sem);
 
     struct pollfd *pfd;
-    size_t pfd_len = 2 + mis->postcopy_remote_fds->len;
+    size_t pfd_len = 2 + (ft->id ? 0 : mis->postcopy_remote_fds->len);
 
     pfd = g_new0(struct pollfd, pfd_len);
 
     pfd[0].fd = mis->userfault_fd;
     pfd[0].events = POLLIN;
-    pfd[1].fd = mis->userfault_event_fd;
+    pfd[1].fd = ft->event_fd;
     pfd[1].events = POLLIN; /* Waiting for eventfd to go positive */
     trace_postcopy_ram_fault_thread_fds_core(pfd[0].fd, pfd[1].fd);
-    for (index = 0; index < mis->postcopy_remote_fds->len; index++) {
+    for (index = 0; index < pfd_len - 2; index++) {
         struct PostCopyFD *pcfd = &g_array_index(mis->postcopy_remote_fds,
                                                  struct PostCopyFD, index);
         pfd[2 + index].fd = pcfd->fd;
@@ -881,7 +1271,6 @@ static void *postcopy_ram_fault_thread(void *opaque)
     }
 
     while (true) {
-        ram_addr_t rb_offset;
         int poll_result;
 
         /*
@@ -916,83 +1305,46 @@ static void *postcopy_ram_fault_thread(void *opaque)
             uint64_t tmp64 = 0;
 
             /* Consume the signal */
-            if (read(mis->userfault_event_fd, &tmp64, 8) != 8) {
+            if (read(ft->event_fd, &tmp64, 8) != 8) {
                 /* Nothing obviously nicer than posting this error. */
                 error_report("%s: read() failed", __func__);
             }
 
             if (qatomic_read(&mis->fault_thread_quit)) {
-                trace_postcopy_ram_fault_thread_quit();
+                trace_postcopy_ram_fault_thread_quit(ft->id);
                 break;
             }
         }
 
         if (pfd[0].revents) {
             poll_result--;
-            ret = read(mis->userfault_fd, &msg, sizeof(msg));
-            if (ret != sizeof(msg)) {
+            /* Several faults may be pending, take as many as we can */
+            ret = read(mis->userfault_fd, msgs, sizeof(msgs));
+            if (ret < 0) {
                 if (errno == EAGAIN) {
                     /*
                      * if a wake up happens on the other thread just after
-                     * the poll, there is nothing to read.
+                     * the poll, or another fault thread read the faults
+                     * first, there is nothing to read.
                      */
                     continue;
                 }
-                if (ret < 0) {
-                    error_report("%s: Failed to read full userfault "
-                                 "message: %s",
-                                 __func__, strerror(errno));
-                    break;
-                } else {
-                    error_report("%s: Read %d bytes from userfaultfd "
-                                 "expected %zd",
-                                 __func__, ret, sizeof(msg));
-                    break; /* Lost alignment, don't know what we'd read next */
-                }
+                error_report("%s: Failed to read full userfault "
+                             "message: %s",
+                             __func__, strerror(errno));
+                break;
             }
-            if (msg.event != UFFD_EVENT_PAGEFAULT) {
-                error_report("%s: Read unexpected event %ud from userfaultfd",
-                             __func__, msg.event);
-                continue; /* It's not a page fault, shouldn't happen */
+            if (ret % sizeof(msgs[0])) {
+                error_report("%s: Read %d bytes from userfaultfd "
+                             "expected a multiple of %zd",
+                             __func__, ret, sizeof(msgs[0]));
+                break; /* Lost alignment, don't know what we'd read next */
             }
 
-            rb = qemu_ram_block_from_host(
-                     (void *)(uintptr_t)msg.arg.pagefault.address,
-                     true, &rb_offset);
-            if (!rb) {
-                error_report("postcopy_ram_fault_thread: Fault outside guest: %"
-                             PRIx64, (uint64_t)msg.arg.pagefault.address);
+            if (postcopy_fault_thread_handle(ft, msgs,
+                                             ret / sizeof(msgs[0]))) {
                 break;
             }
-
-            rb_offset &= ~(qemu_ram_pagesize(rb) - 1);
-            trace_postcopy_ram_fault_thread_request(msg.arg.pagefault.address,
-                                                qemu_ram_get_idstr(rb),
-                                                rb_offset,
-                                                msg.arg.pagefault.feat.ptid);
-            mark_postcopy_blocktime_begin(
-                    (uintptr_t)(msg.arg.pagefault.address),
-                                msg.arg.pagefault.feat.ptid, rb);
-
-retry:
-            /*
-             * Send the request to the source - we want to request one
-             * of our host page sizes (which is >= TPS)
-             */
-            ret = migrate_send_rp_req_pages(mis, rb, rb_offset);
-            if (ret) {
-                /* May be network failure, try to wait for recovery */
-                if (ret == -EIO && postcopy_pause_fault_thread(mis)) {
-                    /* We got reconnected somehow, try to continue */
-                    mis->last_rb = NULL;
-                    goto retry;
-                } else {
-                    /* This is a unavoidable fault */
-                    error_report("%s: migrate_send_rp_req_pages() get %d",
-                                 __func__, ret);
-                    break;
-                }
-            }
         }
 
         /* Now handle any requests from external processes on shared memory */
@@ -1052,13 +1404,15 @@ retry:
         }
     }
     rcu_unregister_thread();
-    trace_postcopy_ram_fault_thread_exit();
+    trace_postcopy_ram_fault_thread_exit(ft->id);
     g_free(pfd);
     return NULL;
 }
 
 int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
 {
+    int i;
+
     /* Open the fd for the kernel to give us userfaults */
     mis->userfault_fd = syscall(__NR_userfaultfd, O_CLOEXEC | O_NONBLOCK);
     if (mis->userfault_fd == -1) {
@@ -1075,19 +1429,42 @@ int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
         return -1;
     }
 
-    /* Now an eventfd we use to tell the fault-thread to quit */
-    mis->userfault_event_fd = eventfd(0, EFD_CLOEXEC);
-    if (mis->userfault_event_fd == -1) {
-        error_report("%s: Opening userfault_event_fd: %s", __func__,
-                     strerror(errno));
-        close(mis->userfault_fd);
-        return -1;
+    mis->fault_thread_count = migrate_postcopy_fault_threads();
+    mis->fault_threads = g_new0(PostcopyFaultThread, mis->fault_thread_count);
+    for (i = 0; i < mis->fault_thread_count; i++) {
+        PostcopyFaultThread *ft = &mis->fault_threads[i];
+
+        ft->mis = mis;
+        ft->id = i;
+        /* Now an eventfd we use to tell the fault-thread to quit */
+        ft->event_fd = eventfd(0, EFD_CLOEXEC);
+        if (ft->event_fd == -1) {
+            error_report("%s: Opening userfault_event_fd: %s", __func__,
+                         strerror(errno));
+            while (i--) {
+                close(mis->fault_threads[i].event_fd);
+            }
+            g_free(mis->fault_threads);
+            mis->fault_threads = NULL;
+            mis->fault_thread_count = 0;
+            close(mis->userfault_fd);
+            return -1;
+        }
     }
 
+    mis->last_rb = NULL; /* last RAMBlock we sent part of */
     qemu_sem_init(&mis->fault_thread_sem, 0);
-    qemu_thread_create(&mis->fault_thread, "postcopy/fault",
-                       postcopy_ram_fault_thread, mis, QEMU_THREAD_JOINABLE);
-    qemu_sem_wait(&mis->fault_thread_sem);
+    for (i = 0; i < mis->fault_thread_count; i++) {
+        /* Thread names are limited to 15 characters */
+        char *name = i ? g_strdup_printf("postcopy/flt%d", i) :
+                         g_strdup("postcopy/fault");
+
+        qemu_thread_create(&mis->fault_threads[i].thread, name,
+                           postcopy_ram_fault_thread, &mis->fault_threads[i],
+                           QEMU_THREAD_JOINABLE);
+        qemu_sem_wait(&mis->fault_thread_sem);
+        g_free(name);
+    }
     qemu_sem_destroy(&mis->fault_thread_sem);
     mis->have_fault_thread = true;
 
@@ -1123,6 +1500,21 @@ int postcopy_ram_incoming_setup(MigrationIncomingState *mis)
     }
     memset(mis->postcopy_tmp_zero_page, '\0', mis->largest_page_size);
 
+    if (migrate_postcopy_preempt()) {
+        mis->postcopy_preempt_tmp_page = mmap(NULL, mis->largest_page_size,
+                                              PROT_READ | PROT_WRITE,
+                                              MAP_PRIVATE | MAP_ANONYMOUS,
+                                              -1, 0);
+        if (mis->postcopy_preempt_tmp_page == MAP_FAILED) {
+            int e = errno;
+            mis->postcopy_preempt_tmp_page = NULL;
+            error_report("%s: Failed to map postcopy_preempt_tmp_page %s",
+                         __func__, strerror(e));
+            return -e;
+        }
+        postcopy_preempt_thread_start(mis);
+    }
+
     trace_postcopy_ram_enable_notify();
 
     return 0;
@@ -1298,15 +1690,18 @@ int postcopy_wake_shared(struct PostCopyFD *pcfd,
 void postcopy_fault_thread_notify(MigrationIncomingState *mis)
 {
     uint64_t tmp64 = 1;
+    int i;
 
     /*
-     * Wakeup the fault_thread.  It's an eventfd that should currently
+     * Wakeup the fault threads.  Each has an eventfd that should currently
      * be at 0, we're going to increment it to 1
      */
-    if (write(mis->userfault_event_fd, &tmp64, 8) != 8) {
-        /* Not much we can do here, but may as well report it */
-        error_report("%s: incrementing failed: %s", __func__,
-                     strerror(errno));
+    for (i = 0; i < mis->fault_thread_count; i++) {
+        if (write(mis->fault_threads[i].event_fd, &tmp64, 8) != 8) {
+            /* Not much we can do here, but may as well report it */
+            error_report("%s: incrementing failed: %s", __func__,
+                         strerror(errno));
+        }
     }
 }
 
@@ -34,6 +34,20 @@ int postcopy_ram_incoming_init(MigrationIncomingState *mis);
  */
 int postcopy_ram_incoming_cleanup(MigrationIncomingState *mis);
 
+/*
+ * Postcopy preempt channel.  On the source, open it when the migration
+ * starts and close it when the migration ends or pauses.
+ */
+int postcopy_preempt_setup(MigrationState *s, Error **errp);
+void postcopy_preempt_close(MigrationState *s);
+/*
+ * On the destination, hand the incoming channel to the preempt thread;
+ * the thread is joined at the end of postcopy, or as soon as possible
+ * if @abort is set.
+ */
+void postcopy_preempt_new_channel(MigrationIncomingState *mis, QEMUFile *file);
+void postcopy_preempt_thread_join(MigrationIncomingState *mis, bool abort);
+
 /*
  * Userfault requires us to mark RAM as NOHUGEPAGE prior to discard
  * however leaving it until after precopy means that most of the precopy
@@ -160,6 +160,51 @@ static QEMUFile *channel_get_output_return_path(void *opaque)
     return qemu_fopen_channel_input(ioc);
 }
 
+static int channel_seek(void *opaque, int64_t pos, Error **errp)
+{
+    QIOChannel *ioc = QIO_CHANNEL(opaque);
+
+    if (qio_channel_io_seek(ioc, pos, SEEK_SET, errp) < 0) {
+        return -EIO;
+    }
+    return 0;
+}
+
+
+static ssize_t channel_pwritev_buffer(void *opaque,
+                                      struct iovec *iov,
+                                      int iovcnt,
+                                      int64_t pos,
+                                      Error **errp)
+{
+    QIOChannel *ioc = QIO_CHANNEL(opaque);
+
+    if (qio_channel_pwritev_all(ioc, iov, iovcnt, pos, errp) < 0) {
+        return -EIO;
+    }
+    return iov_size(iov, iovcnt);
+}
+
+
+static ssize_t channel_pread_buffer(void *opaque,
+                                    uint8_t *buf,
+                                    int64_t pos,
+                                    size_t size,
+                                    Error **errp)
+{
+    QIOChannel *ioc = QIO_CHANNEL(opaque);
+    struct iovec iov = {
+        .iov_base = buf,
+        .iov_len = size,
+    };
+
+    if (qio_channel_preadv_all(ioc, &iov, 1, pos, errp) < 0) {
+        return -EIO;
+    }
+    return size;
+}
+
+
 static const QEMUFileOps channel_input_ops = {
     .get_buffer = channel_get_buffer,
     .close = channel_close,
@@ -178,14 +223,42 @@ static const QEMUFileOps channel_output_ops = {
 };
 
 
+static const QEMUFileOps channel_seekable_input_ops = {
+    .get_buffer = channel_get_buffer,
+    .close = channel_close,
+    .shut_down = channel_shutdown,
+    .set_blocking = channel_set_blocking,
+    .get_return_path = channel_get_input_return_path,
+    .seek = channel_seek,
+    .pread_buffer = channel_pread_buffer,
+};
+
+
+static const QEMUFileOps channel_seekable_output_ops = {
+    .writev_buffer = channel_writev_buffer,
+    .close = channel_close,
+    .shut_down = channel_shutdown,
+    .set_blocking = channel_set_blocking,
+    .get_return_path = channel_get_output_return_path,
+    .seek = channel_seek,
+    .pwritev_buffer = channel_pwritev_buffer,
+};
+
+
 QEMUFile *qemu_fopen_channel_input(QIOChannel *ioc)
 {
     object_ref(OBJECT(ioc));
+    if (qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_SEEKABLE)) {
+        return qemu_fopen_ops(ioc, &channel_seekable_input_ops);
+    }
     return qemu_fopen_ops(ioc, &channel_input_ops);
 }
 
 QEMUFile *qemu_fopen_channel_output(QIOChannel *ioc)
 {
     object_ref(OBJECT(ioc));
+    if (qio_channel_has_feature(ioc, QIO_CHANNEL_FEATURE_SEEKABLE)) {
+        return qemu_fopen_ops(ioc, &channel_seekable_output_ops);
+    }
     return qemu_fopen_ops(ioc, &channel_output_ops);
 }
@@ -173,6 +173,96 @@ bool qemu_file_is_writable(QEMUFile *f)
     return f->ops->writev_buffer;
 }
 
+/*
+ * Files that support random access can be written and read at any
+ * position with qemu_put_buffer_at() and qemu_get_buffer_at().
+ */
+bool qemu_file_is_seekable(QEMUFile *f)
+{
+    return f->ops->seek;
+}
+
+/*
+ * Continue the stream at @pos.  Buffered output is written out
+ * first, buffered input is dropped.
+ */
+void qemu_set_offset(QEMUFile *f, int64_t pos)
+{
+    Error *local_error = NULL;
+    int ret;
+
+    if (qemu_file_is_writable(f)) {
+        qemu_fflush(f);
+    } else {
+        f->buf_index = 0;
+        f->buf_size = 0;
+    }
+
+    if (qemu_file_get_error(f)) {
+        return;
+    }
+
+    ret = f->ops->seek(f->opaque, pos, &local_error);
+    if (ret < 0) {
+        qemu_file_set_error_obj(f, ret, local_error);
+        return;
+    }
+    f->pos = pos;
+}
+
+/*
+ * Write @buf at @pos of a seekable file, bypassing the buffer and
+ * without moving the stream position.
+ *
+ * Returns the number of bytes written, 0 on error
+ */
+size_t qemu_put_buffer_at(QEMUFile *f, const uint8_t *buf, size_t buflen,
+                          int64_t pos)
+{
+    struct iovec iov = {
+        .iov_base = (void *)buf,
+        .iov_len = buflen,
+    };
+    Error *local_error = NULL;
+    ssize_t ret;
+
+    if (f->last_error) {
+        return 0;
+    }
+
+    ret = f->ops->pwritev_buffer(f->opaque, &iov, 1, pos, &local_error);
+    if (ret != buflen) {
+        qemu_file_set_error_obj(f, ret < 0 ? ret : -EIO, local_error);
+        return 0;
+    }
+    f->bytes_xfer += buflen;
+
+    return buflen;
+}
+
+/*
+ * Read @buflen bytes at @pos of a seekable file, bypassing the buffer
+ * and without moving the stream position.  The file state is not
+ * touched, so several threads can read from the same file at once.
+ *
+ * Returns 0 on success, -1 on error
+ */
+int qemu_get_buffer_at(QEMUFile *f, uint8_t *buf, size_t buflen,
+                       int64_t pos, Error **errp)
+{
+    ssize_t ret;
+
+    ret = f->ops->pread_buffer(f->opaque, buf, pos, buflen, errp);
+    if (ret < 0) {
+        return -1;
+    }
+    if (ret != buflen) {
+        error_setg(errp, "Short read at offset %" PRId64, pos);
+        return -1;
+    }
+    return 0;
+}
+
 static void qemu_iovec_release_ram(QEMUFile *f)
 {
     struct iovec iov;
@@ -657,6 +747,15 @@ int64_t qemu_ftell(QEMUFile *f)
     return f->pos;
 }
 
+/*
+ * Offset in the stream of the next byte read from @f, for files opened
+ * for reading
+ */
+int64_t qemu_ftell_input(QEMUFile *f)
+{
+    return f->pos - f->buf_size + f->buf_index;
+}
+
 int qemu_file_rate_limit(QEMUFile *f)
 {
     if (f->shutdown) {
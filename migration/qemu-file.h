@@ -103,6 +103,13 @@ typedef QEMUFile *(QEMURetPathFunc)(void *opaque);
 typedef int (QEMUFileShutdownFunc)(void *opaque, bool rd, bool wr,
                                    Error **errp);
 
+/*
+ * Move the position of the underlying transport to @pos, for files
+ * that support random access.
+ * Returns 0 on success, -err on error
+ */
+typedef int (QEMUFileSeekFunc)(void *opaque, int64_t pos, Error **errp);
+
 typedef struct QEMUFileOps {
     QEMUFileGetBufferFunc *get_buffer;
     QEMUFileCloseFunc *close;
@@ -110,6 +117,10 @@ typedef struct QEMUFileOps {
     QEMUFileWritevBufferFunc *writev_buffer;
     QEMURetPathFunc *get_return_path;
     QEMUFileShutdownFunc *shut_down;
+    /* Only for files that support random access */
+    QEMUFileSeekFunc *seek;
+    QEMUFileWritevBufferFunc *pwritev_buffer;
+    QEMUFileGetBufferFunc *pread_buffer;
 } QEMUFileOps;
 
 typedef struct QEMUFileHooks {
@@ -125,6 +136,7 @@ int qemu_get_fd(QEMUFile *f);
 int qemu_fclose(QEMUFile *f);
 int64_t qemu_ftell(QEMUFile *f);
 int64_t qemu_ftell_fast(QEMUFile *f);
+int64_t qemu_ftell_input(QEMUFile *f);
 /*
  * put_buffer without copying the buffer.
  * The buffer should be available till it is sent asynchronously.
@@ -133,6 +145,12 @@ void qemu_put_buffer_async(QEMUFile *f, const uint8_t *buf, size_t size,
                            bool may_free);
 bool qemu_file_mode_is_not_valid(const char *mode);
 bool qemu_file_is_writable(QEMUFile *f);
+bool qemu_file_is_seekable(QEMUFile *f);
+void qemu_set_offset(QEMUFile *f, int64_t pos);
+size_t qemu_put_buffer_at(QEMUFile *f, const uint8_t *buf, size_t buflen,
+                          int64_t pos);
+int qemu_get_buffer_at(QEMUFile *f, uint8_t *buf, size_t buflen,
+                       int64_t pos, Error **errp);
 
 #include "migration/qemu-file-types.h"
 
@@ -29,6 +29,7 @@
 #include "qemu/osdep.h"
 #include "cpu.h"
 #include "qemu/cutils.h"
+#include "qemu/units.h"
 #include "qemu/bitops.h"
 #include "qemu/bitmap.h"
 #include "qemu/main-loop.h"
@@ -53,6 +54,7 @@
 #include "block.h"
 #include "sysemu/sysemu.h"
 #include "sysemu/cpu-throttle.h"
+#include "sysemu/dirtylimit.h"
 #include "savevm.h"
 #include "qemu/iov.h"
 #include "multifd.h"
@@ -76,6 +78,17 @@
 /* 0x80 is reserved in migration.h start with 0x100 next */
 #define RAM_SAVE_FLAG_COMPRESS_PAGE    0x100
 
+/*
+ * mapped-ram: the region of each RAMBlock in the migration file starts
+ * with a bitmap of the pages present in the file, followed by the
+ * pages themselves at an aligned offset.
+ */
+#define MAPPED_RAM_HDR_VERSION 1
+#define MAPPED_RAM_HDR_SIZE (sizeof(uint32_t) + 3 * sizeof(uint64_t))
+#define MAPPED_RAM_FILE_OFFSET_ALIGNMENT 0x100000
+/* Don't split the restore of a block in chunks smaller than this */
+#define MAPPED_RAM_LOAD_MIN_CHUNK (64 * MiB)
+
 static inline bool is_zero_range(uint8_t *p, uint64_t size)
 {
     return buffer_is_zero(p, size);
@@ -144,7 +157,8 @@ int xbzrle_cache_resize(int64_t new_size, Error **errp)
     XBZRLE_cache_lock();
 
     if (XBZRLE.cache != NULL) {
-        new_cache = cache_init(new_size, TARGET_PAGE_SIZE, errp);
+        new_cache = cache_init(new_size / TARGET_PAGE_SIZE, TARGET_PAGE_SIZE,
+                               errp);
         if (!new_cache) {
             ret = -1;
             goto out;
@@ -158,6 +172,59 @@ out:
     return ret;
 }
 
+/**
+ * xbzrle_stats_init: reset the XBZRLE cache statistics of the RAMBlocks
+ *
+ * The statistics are allocated on first use and live as long as the
+ * RAMBlock, since pages of the block may stay in a cache after the
+ * migration.  Must be called before the caches are used by the
+ * migration thread or the multifd threads.
+ */
+void xbzrle_stats_init(void)
+{
+    RAMBlock *block;
+
+    RCU_READ_LOCK_GUARD();
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        if (!block->xbzrle_stats) {
+            block->xbzrle_stats = g_new(PageCacheStats, 1);
+        }
+        stat64_init(&block->xbzrle_stats->hits, 0);
+        stat64_init(&block->xbzrle_stats->misses, 0);
+        stat64_init(&block->xbzrle_stats->evictions, 0);
+    }
+}
+
+/**
+ * xbzrle_block_stats: get the XBZRLE cache statistics of the RAMBlocks
+ *
+ * Returns the list of the statistics, or NULL if the caches were never
+ * used
+ */
+XBZRLECacheBlockStatsList *xbzrle_block_stats(void)
+{
+    XBZRLECacheBlockStatsList *head = NULL, **tail = &head, *entry;
+    RAMBlock *block;
+
+    RCU_READ_LOCK_GUARD();
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        PageCacheStats *stats = block->xbzrle_stats;
+
+        if (!stats) {
+            continue;
+        }
+        entry = g_new0(XBZRLECacheBlockStatsList, 1);
+        entry->value = g_new0(XBZRLECacheBlockStats, 1);
+        entry->value->id_str = g_strdup(block->idstr);
+        entry->value->hits = stat64_get(&stats->hits);
+        entry->value->misses = stat64_get(&stats->misses);
+        entry->value->evictions = stat64_get(&stats->evictions);
+        *tail = entry;
+        tail = &entry->next;
+    }
+    return head;
+}
+
 bool ramblock_is_ignored(RAMBlock *block)
 {
     return !qemu_ram_is_migratable(block) ||
@@ -401,6 +468,8 @@ struct PageSearchStatus {
     unsigned long page;
     /* Set once we wrap around */
     bool         complete_round;
+    /* The page was requested by the destination */
+    bool         postcopy_requested;
 };
 typedef struct PageSearchStatus PageSearchStatus;
 
@@ -643,10 +712,34 @@ static void mig_throttle_guest_down(uint64_t bytes_dirty_period,
     }
 }
 
+/**
+ * migration_dirty_limit_guest: limit the dirty page rate of each vCPU
+ *
+ * Used instead of mig_throttle_guest_down() with the dirty-limit
+ * capability: only the vCPUs that dirty memory faster than
+ * vcpu-dirty-limit are slowed down, the others keep running at full
+ * speed.  Must be called with the BQL held.
+ */
+static void migration_dirty_limit_guest(void)
+{
+    MigrationState *s = migrate_get_current();
+
+    /* Leave alone the limits set by the user with set-vcpu-dirty-limit */
+    if (!s->dirty_limit_set && dirtylimit_in_service()) {
+        return;
+    }
+
+    dirtylimit_set_period(migrate_vcpu_dirty_limit_period());
+    dirtylimit_set_all(migrate_vcpu_dirty_limit());
+    s->dirty_limit_set = true;
+    trace_migration_dirty_limit_guest(migrate_vcpu_dirty_limit());
+}
+
 /**
  * xbzrle_cache_zero_page: insert a zero page in the XBZRLE cache
  *
  * @rs: current RAM state
+ * @block: block that contains the page
  * @current_addr: address for the zero page
  *
  * Update the xbzrle cache to reflect a page that's been sent as all 0.
@@ -655,7 +748,8 @@ static void mig_throttle_guest_down(uint64_t bytes_dirty_period,
  * As a bonus, if the page wasn't in the cache it gets added so that
  * when a small write is made into the 0'd page it gets XBZRLE sent.
  */
-static void xbzrle_cache_zero_page(RAMState *rs, ram_addr_t current_addr)
+static void xbzrle_cache_zero_page(RAMState *rs, RAMBlock *block,
+                                   ram_addr_t current_addr)
 {
     if (rs->ram_bulk_stage || !migrate_use_xbzrle()) {
         return;
@@ -664,7 +758,7 @@ static void xbzrle_cache_zero_page(RAMState *rs, ram_addr_t current_addr)
     /* We don't care if this fails to allocate a new cache page
      * as long as it updated an old one */
     cache_insert(XBZRLE.cache, current_addr, XBZRLE.zero_target_page,
-                 ram_counters.dirty_sync_count);
+                 ram_counters.dirty_sync_count, block->xbzrle_stats);
 }
 
 #define ENCODING_FLAG_XBZRLE 0x1
@@ -691,11 +785,12 @@ static int save_xbzrle_page(RAMState *rs, uint8_t **current_data,
     uint8_t *prev_cached_page;
 
     if (!cache_is_cached(XBZRLE.cache, current_addr,
-                         ram_counters.dirty_sync_count)) {
+                         ram_counters.dirty_sync_count, block->xbzrle_stats)) {
         xbzrle_counters.cache_miss++;
         if (!last_stage) {
             if (cache_insert(XBZRLE.cache, current_addr, *current_data,
-                             ram_counters.dirty_sync_count) == -1) {
+                             ram_counters.dirty_sync_count,
+                             block->xbzrle_stats) == -1) {
                 return -1;
             } else {
                 /* update *current_data when the page has been
@@ -858,6 +953,202 @@ static void ramblock_sync_dirty_bitmap(RAMState *rs, RAMBlock *rb)
     rs->num_dirty_pages_period += new_dirty_pages;
 }
 
+/*
+ * Size of the pieces the dirty bitmap sync is split into when it runs
+ * on several threads, so that a single huge RAMBlock is shared too.
+ * It is a multiple of BITS_PER_LONG pages: chunks then take the word
+ * aligned path of cpu_physical_memory_sync_dirty_bitmap(), which only
+ * touches its own words of the destination bitmap.
+ */
+#define DIRTY_SYNC_CHUNK_PAGES  (256 * 1024)
+
+typedef struct {
+    RAMBlock *block;
+    ram_addr_t start;
+    ram_addr_t length;
+} DirtySyncChunk;
+
+typedef struct {
+    QemuThread thread;
+    /* posted to start a sync, or to quit */
+    QemuSemaphore sem;
+    bool quit;
+    uint64_t new_dirty_pages;
+} DirtySyncParams;
+
+/*
+ * The dirty-sync threads are created by ram_save_setup() and live until
+ * ram_save_cleanup(), the migration thread wakes them up for each sync
+ * and works on the chunks with them.
+ */
+static struct {
+    DirtySyncParams *params;
+    int nthreads;
+    GArray *chunks;
+    /* index of the next chunk to sync, shared and updated atomically */
+    unsigned int next;
+    QemuSemaphore done_sem;
+} dirty_sync;
+
+/* Called with RCU critical section */
+static uint64_t dirty_sync_chunks(void)
+{
+    uint64_t new_dirty_pages = 0;
+    unsigned int i;
+
+    while ((i = qatomic_fetch_inc(&dirty_sync.next)) <
+           dirty_sync.chunks->len) {
+        DirtySyncChunk *c = &g_array_index(dirty_sync.chunks,
+                                           DirtySyncChunk, i);
+
+        new_dirty_pages +=
+            cpu_physical_memory_sync_dirty_bitmap(c->block, c->start,
+                                                  c->length);
+    }
+    return new_dirty_pages;
+}
+
+static void *dirty_sync_thread(void *opaque)
+{
+    DirtySyncParams *p = opaque;
+
+    rcu_register_thread();
+    while (true) {
+        qemu_sem_wait(&p->sem);
+        if (qatomic_read(&p->quit)) {
+            break;
+        }
+        WITH_RCU_READ_LOCK_GUARD() {
+            p->new_dirty_pages = dirty_sync_chunks();
+        }
+        qemu_sem_post(&dirty_sync.done_sem);
+    }
+    rcu_unregister_thread();
+
+    return NULL;
+}
+
+static void dirty_sync_threads_cleanup(void)
+{
+    int i;
+
+    if (!dirty_sync.params) {
+        return;
+    }
+    for (i = 0; i < dirty_sync.nthreads; i++) {
+        DirtySyncParams *p = &dirty_sync.params[i];
+
+        qatomic_set(&p->quit, true);
+        qemu_sem_post(&p->sem);
+        qemu_thread_join(&p->thread);
+        qemu_sem_destroy(&p->sem);
+    }
+    qemu_sem_destroy(&dirty_sync.done_sem);
+    g_free(dirty_sync.params);
+    dirty_sync.params = NULL;
+    dirty_sync.nthreads = 0;
+}
+
+static void dirty_sync_threads_setup(void)
+{
+    int i;
+
+    /* The migration thread is one of the dirty-sync-threads */
+    dirty_sync.nthreads = migrate_dirty_sync_threads() - 1;
+    if (dirty_sync.nthreads <= 0) {
+        dirty_sync.nthreads = 0;
+        return;
+    }
+
+    qemu_sem_init(&dirty_sync.done_sem, 0);
+    dirty_sync.params = g_new0(DirtySyncParams, dirty_sync.nthreads);
+    for (i = 0; i < dirty_sync.nthreads; i++) {
+        DirtySyncParams *p = &dirty_sync.params[i];
+
+        qemu_sem_init(&p->sem, 0);
+        qemu_thread_create(&p->thread, "dirty-sync", dirty_sync_thread, p,
+                           QEMU_THREAD_JOINABLE);
+    }
+}
+
+/**
+ * ram_sync_dirty_bitmaps: merge the dirty log into the migration bitmaps
+ *
+ * With more than one dirty-sync-threads the blocks are cut in chunks
+ * that the threads take in turn; this thread works on them as well.
+ * Ranges that cannot be synced concurrently (unaligned blocks and
+ * tails, blocks without a clear_bmap) are done here beforehand.
+ *
+ * Called with RCU critical section and bitmap_mutex held
+ *
+ * @rs: current RAM state
+ */
+static void ram_sync_dirty_bitmaps(RAMState *rs)
+{
+    const ram_addr_t align = (ram_addr_t)BITS_PER_LONG << TARGET_PAGE_BITS;
+    const ram_addr_t chunk_size =
+        (ram_addr_t)DIRTY_SYNC_CHUNK_PAGES << TARGET_PAGE_BITS;
+    uint64_t new_dirty_pages = 0;
+    RAMBlock *block;
+    int nthreads;
+    int i;
+
+    /* No dirty-sync threads on the destination, e.g. for COLO */
+    if (!dirty_sync.nthreads) {
+        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+            ramblock_sync_dirty_bitmap(rs, block);
+        }
+        return;
+    }
+
+    dirty_sync.chunks = g_array_new(false, false, sizeof(DirtySyncChunk));
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        ram_addr_t aligned = 0;
+        ram_addr_t start;
+
+        if (block->clear_bmap && QEMU_IS_ALIGNED(block->offset, align)) {
+            aligned = QEMU_ALIGN_DOWN(block->used_length, align);
+        }
+        for (start = 0; start < aligned; start += chunk_size) {
+            DirtySyncChunk c = {
+                .block = block,
+                .start = start,
+                .length = MIN(chunk_size, aligned - start),
+            };
+
+            g_array_append_val(dirty_sync.chunks, c);
+        }
+        if (aligned < block->used_length) {
+            new_dirty_pages +=
+                cpu_physical_memory_sync_dirty_bitmap(block, aligned,
+                                                      block->used_length -
+                                                      aligned);
+        }
+    }
+
+    /* Only wake up as many threads as there are chunks to share */
+    nthreads = MIN(dirty_sync.nthreads + 1, dirty_sync.chunks->len);
+    trace_ram_sync_dirty_bitmaps(dirty_sync.chunks->len, nthreads);
+    dirty_sync.next = 0;
+    for (i = 0; i < nthreads - 1; i++) {
+        qemu_sem_post(&dirty_sync.params[i].sem);
+    }
+    /* We are already inside a RCU critical section */
+    new_dirty_pages += dirty_sync_chunks();
+
+    for (i = 0; i < nthreads - 1; i++) {
+        qemu_sem_wait(&dirty_sync.done_sem);
+    }
+    for (i = 0; i < nthreads - 1; i++) {
+        new_dirty_pages += dirty_sync.params[i].new_dirty_pages;
+    }
+    g_array_free(dirty_sync.chunks, true);
+    dirty_sync.chunks = NULL;
+
+    rs->migration_dirty_pages += new_dirty_pages;
+    rs->num_dirty_pages_period += new_dirty_pages;
+}
+
 /**
  * ram_pagesize_summary: calculate all the pagesizes of a VM
  *
@@ -949,7 +1240,8 @@ static void migration_trigger_throttle(RAMState *rs)
     /* During block migration the auto-converge logic incorrectly detects
      * that ram migration makes no progress. Avoid this by disabling the
      * throttling logic during the bulk phase of block migration. */
-    if (migrate_auto_converge() && !blk_mig_bulk_active()) {
+    if ((migrate_auto_converge() || migrate_dirty_limit()) &&
+        !blk_mig_bulk_active()) {
         /* The following detection logic can be refined later. For now:
            Check to see if the ratio between dirtied bytes and the approx.
            amount of bytes that just got transferred since the last time
@@ -960,15 +1252,19 @@ static void migration_trigger_throttle(RAMState *rs)
             (++rs->dirty_rate_high_cnt >= 2)) {
             trace_migration_throttle();
             rs->dirty_rate_high_cnt = 0;
-            mig_throttle_guest_down(bytes_dirty_period,
-                                    bytes_dirty_threshold);
+            if (migrate_dirty_limit()) {
+                migration_dirty_limit_guest();
+            } else {
+                mig_throttle_guest_down(bytes_dirty_period,
+                                        bytes_dirty_threshold);
+            }
         }
     }
 }
 
 static void migration_bitmap_sync(RAMState *rs)
 {
-    RAMBlock *block;
+    int64_t start_us, log_sync_us, sync_us;
     int64_t end_time;
 
     ram_counters.dirty_sync_count++;
@@ -978,19 +1274,24 @@ static void migration_bitmap_sync(RAMState *rs)
     }
 
     trace_migration_bitmap_sync_start();
+    start_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
     memory_global_dirty_log_sync();
+    log_sync_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
 
     qemu_mutex_lock(&rs->bitmap_mutex);
     WITH_RCU_READ_LOCK_GUARD() {
-        RAMBLOCK_FOREACH_NOT_IGNORED(block) {
-            ramblock_sync_dirty_bitmap(rs, block);
-        }
+        ram_sync_dirty_bitmaps(rs);
         ram_counters.remaining = ram_bytes_remaining();
     }
     qemu_mutex_unlock(&rs->bitmap_mutex);
 
     memory_global_after_dirty_log_sync();
-    trace_migration_bitmap_sync_end(rs->num_dirty_pages_period);
+    sync_us = qemu_clock_get_us(QEMU_CLOCK_REALTIME);
+    ram_counters.last_dirty_sync_time = sync_us - start_us;
+    ram_counters.dirty_sync_time += sync_us - start_us;
+    trace_migration_bitmap_sync_end(rs->num_dirty_pages_period,
+                                    log_sync_us - start_us,
+                                    sync_us - log_sync_us);
 
     end_time = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
 
@@ -1068,7 +1369,22 @@ static int save_zero_page_to_file(RAMState *rs, QEMUFile *file,
  */
 static int save_zero_page(RAMState *rs, RAMBlock *block, ram_addr_t offset)
 {
-    int len = save_zero_page_to_file(rs, rs->f, block, offset);
+    int len;
+
+    /*
+     * A zero page is not written to a mapped-ram file, it is just
+     * marked as absent so that the destination leaves it alone.
+     */
+    if (migrate_use_mapped_ram()) {
+        if (!is_zero_range(block->host + offset, TARGET_PAGE_SIZE)) {
+            return -1;
+        }
+        clear_bit(offset >> TARGET_PAGE_BITS, block->file_bmap);
+        ram_counters.duplicate++;
+        return 1;
+    }
+
+    len = save_zero_page_to_file(rs, rs->f, block, offset);
 
     if (len) {
         ram_counters.duplicate++;
@@ -1139,6 +1455,15 @@ static bool control_save_page(RAMState *rs, RAMBlock *block, ram_addr_t offset,
 static int save_normal_page(RAMState *rs, RAMBlock *block, ram_addr_t offset,
                             uint8_t *buf, bool async)
 {
+    if (migrate_use_mapped_ram()) {
+        qemu_put_buffer_at(rs->f, buf, TARGET_PAGE_SIZE,
+                           block->pages_offset + offset);
+        set_bit(offset >> TARGET_PAGE_BITS, block->file_bmap);
+        ram_counters.transferred += TARGET_PAGE_SIZE;
+        ram_counters.normal++;
+        return 1;
+    }
+
     ram_counters.transferred += save_page_header(rs, rs->f, block,
                                                  offset | RAM_SAVE_FLAG_PAGE);
     if (async) {
@@ -1207,6 +1532,9 @@ static int ram_save_multifd_page(RAMState *rs, RAMBlock *block,
     if (multifd_queue_page(rs->f, block, offset) < 0) {
         return -1;
     }
+    if (migrate_use_mapped_ram()) {
+        set_bit(offset >> TARGET_PAGE_BITS, block->file_bmap);
+    }
     ram_counters.normal++;
 
     return 1;
@@ -1493,6 +1821,7 @@ static bool get_queued_page(RAMState *rs, PageSearchStatus *pss)
          * really rare.
          */
         pss->complete_round = false;
+        pss->postcopy_requested = true;
     }
 
     return !!block;
@@ -1651,6 +1980,7 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss,
 {
     RAMBlock *block = pss->block;
     ram_addr_t offset = ((ram_addr_t)pss->page) << TARGET_PAGE_BITS;
+    bool use_multifd;
     int res;
 
     if (control_save_page(rs, block, offset, &res)) {
@@ -1661,34 +1991,56 @@ static int ram_save_target_page(RAMState *rs, PageSearchStatus *pss,
         return 1;
     }
 
-    res = save_zero_page(rs, block, offset);
-    if (res > 0) {
-        /* Must let xbzrle know, otherwise a previous (now 0'd) cached
-         * page would be stale
-         */
-        if (!save_page_use_compression(rs)) {
-            XBZRLE_cache_lock();
-            xbzrle_cache_zero_page(rs, block->offset + offset);
-            XBZRLE_cache_unlock();
-        }
-        ram_release_pages(block->idstr, offset, res);
-        return res;
-    }
-
     /*
      * Do not use multifd for:
      * 1. Compression as the first page in the new block should be posted out
      *    before sending the compressed page
      * 2. In postcopy as one whole host page should be placed
      */
-    if (!save_page_use_compression(rs) && migrate_use_multifd()
-        && !migration_in_postcopy()) {
+    use_multifd = !save_page_use_compression(rs) && migrate_use_multifd()
+                  && !migration_in_postcopy();
+
+    /* The multifd channels look for zero pages themselves if asked to */
+    if (!use_multifd || !migrate_use_multifd_zero_page()) {
+        res = save_zero_page(rs, block, offset);
+        if (res > 0) {
+            /* Must let xbzrle know, otherwise a previous (now 0'd) cached
+             * page would be stale
+             */
+            if (!save_page_use_compression(rs)) {
+                XBZRLE_cache_lock();
+                xbzrle_cache_zero_page(rs, block, block->offset + offset);
+                XBZRLE_cache_unlock();
+            }
+            if (use_multifd) {
+                multifd_xbzrle_cache_zero_page(block, offset);
+            }
+            ram_release_pages(block->idstr, offset, res);
+            return res;
+        }
+    }
+
+    if (use_multifd) {
         return ram_save_multifd_page(rs, block, offset);
     }
 
     return ram_save_page(rs, pss, last_stage);
 }
 
+/*
+ * Returns the channel to send the pages requested by the destination on,
+ * or NULL if they share the main channel.
+ */
+static QEMUFile *postcopy_preempt_channel(void)
+{
+    if (!migrate_postcopy_preempt() || !migration_in_postcopy()) {
+        return NULL;
+    }
+
+    /* Only changed by the migration thread, like rs->f */
+    return migrate_get_current()->postcopy_qemufile_src;
+}
+
 /**
  * ram_save_host_page: save a whole host page
  *
@@ -1733,8 +2085,13 @@ static int ram_save_host_page(RAMState *rs, PageSearchStatus *pss,
 
         pages += tmppages;
         pss->page++;
-        /* Allow rate limiting to happen in the middle of huge pages */
-        migration_rate_limit();
+        /*
+         * Allow rate limiting to happen in the middle of huge pages, the
+         * preempt channel is not rate limited
+         */
+        if (!pss->postcopy_requested || !postcopy_preempt_channel()) {
+            migration_rate_limit();
+        }
     } while ((pss->page & (pagesize_bits - 1)) &&
              offset_in_ramblock(pss->block,
                                 ((ram_addr_t)pss->page) << TARGET_PAGE_BITS));
@@ -1744,6 +2101,47 @@ static int ram_save_host_page(RAMState *rs, PageSearchStatus *pss,
     return pages;
 }
 
+/**
+ * postcopy_preempt_save_host_page: send a requested host page on the
+ * preempt channel
+ *
+ * Returns the number of pages written or negative on error
+ *
+ * The page is followed by RAM_SAVE_FLAG_EOS and flushed right away, so
+ * the destination can place it without waiting for the main channel.
+ *
+ * @rs: current RAM state
+ * @pss: data about the page we want to send
+ * @f: the preempt channel
+ * @last_stage: if we are at the completion stage
+ */
+static int postcopy_preempt_save_host_page(RAMState *rs, PageSearchStatus *pss,
+                                           QEMUFile *f, bool last_stage)
+{
+    QEMUFile *main_f = rs->f;
+    RAMBlock *main_block = rs->last_sent_block;
+    int pages, ret;
+
+    trace_postcopy_preempt_send_host_page(pss->block->idstr, pss->page);
+
+    /* The destination tracks the last block of each channel separately */
+    rs->f = f;
+    rs->last_sent_block = NULL;
+    pages = ram_save_host_page(rs, pss, last_stage);
+    rs->f = main_f;
+    rs->last_sent_block = main_block;
+
+    /* An empty burst would end the channel */
+    if (pages > 0) {
+        qemu_put_be64(f, RAM_SAVE_FLAG_EOS);
+        qemu_fflush(f);
+        ram_counters.transferred += 8;
+    }
+
+    ret = qemu_file_get_error(f);
+    return ret < 0 ? ret : pages;
+}
+
 /**
  * ram_find_and_save_block: finds a dirty page and sends it to f
  *
@@ -1779,7 +2177,10 @@ static int ram_find_and_save_block(RAMState *rs, bool last_stage)
     }
 
     do {
+        QEMUFile *preempt;
+
         again = true;
+        pss.postcopy_requested = false;
         found = get_queued_page(rs, &pss);
 
         if (!found) {
@@ -1788,7 +2189,14 @@ static int ram_find_and_save_block(RAMState *rs, bool last_stage)
         }
 
         if (found) {
-            pages = ram_save_host_page(rs, &pss, last_stage);
+            preempt = pss.postcopy_requested ? postcopy_preempt_channel()
+                                             : NULL;
+            if (preempt) {
+                pages = postcopy_preempt_save_host_page(rs, &pss, preempt,
+                                                        last_stage);
+            } else {
+                pages = ram_save_host_page(rs, &pss, last_stage);
+            }
         }
     } while (!pages && again);
 
@@ -1881,17 +2289,20 @@ static void ram_save_cleanup(void *opaque)
     /* caller have hold iothread lock or is in a bh, so there is
      * no writing race against the migration bitmap
      */
-    memory_global_dirty_log_stop();
+    memory_global_dirty_log_stop(GLOBAL_DIRTY_MIGRATION);
 
     RAMBLOCK_FOREACH_NOT_IGNORED(block) {
         g_free(block->clear_bmap);
         block->clear_bmap = NULL;
         g_free(block->bmap);
         block->bmap = NULL;
+        g_free(block->file_bmap);
+        block->file_bmap = NULL;
     }
 
     xbzrle_cleanup();
     compress_threads_save_cleanup();
+    dirty_sync_threads_cleanup();
     ram_state_cleanup(rsp);
 }
 
@@ -2233,7 +2644,7 @@ static int xbzrle_init(void)
         goto err_out;
     }
 
-    XBZRLE.cache = cache_init(migrate_xbzrle_cache_size(),
+    XBZRLE.cache = cache_init(migrate_xbzrle_cache_size() / TARGET_PAGE_SIZE,
                               TARGET_PAGE_SIZE, &local_err);
     if (!XBZRLE.cache) {
         error_report_err(local_err);
@@ -2252,6 +2663,8 @@ static int xbzrle_init(void)
         goto free_encoded_buf;
     }
 
+    xbzrle_stats_init();
+
     /* We are all good */
     XBZRLE_cache_unlock();
     return 0;
@@ -2341,7 +2754,7 @@ static void ram_init_bitmaps(RAMState *rs)
 
     WITH_RCU_READ_LOCK_GUARD() {
         ram_list_init_bitmaps();
-        memory_global_dirty_log_start();
+        memory_global_dirty_log_start(GLOBAL_DIRTY_MIGRATION);
         migration_bitmap_sync_precopy(rs);
     }
     qemu_mutex_unlock_ramlist();
@@ -2453,6 +2866,56 @@ void qemu_guest_free_page_hint(void *addr, size_t len)
  * granularity of these critical sections.
  */
 
+/**
+ * mapped_ram_setup_ramblock: reserve the region of a block in the file
+ *
+ * The header goes in the stream, and the stream then continues after
+ * the end of the region.
+ *
+ * @f: QEMUFile where to send the data
+ * @block: RAMBlock to set up
+ */
+static void mapped_ram_setup_ramblock(QEMUFile *f, RAMBlock *block)
+{
+    size_t num_pages = block->used_length >> TARGET_PAGE_BITS;
+    size_t bitmap_size = BITS_TO_LONGS(num_pages) * sizeof(unsigned long);
+
+    block->file_bmap = bitmap_new(num_pages);
+    block->bitmap_offset = qemu_ftell(f) + MAPPED_RAM_HDR_SIZE;
+    block->pages_offset = ROUND_UP(block->bitmap_offset + bitmap_size,
+                                   MAPPED_RAM_FILE_OFFSET_ALIGNMENT);
+
+    qemu_put_be32(f, MAPPED_RAM_HDR_VERSION);
+    qemu_put_be64(f, TARGET_PAGE_SIZE);
+    qemu_put_be64(f, block->bitmap_offset);
+    qemu_put_be64(f, block->pages_offset);
+
+    qemu_set_offset(f, block->pages_offset + block->used_length);
+}
+
+/**
+ * mapped_ram_write_bitmaps: write the page bitmaps in the file
+ *
+ * Called once all the pages are in the file.
+ *
+ * @f: QEMUFile where to send the data
+ */
+static void mapped_ram_write_bitmaps(QEMUFile *f)
+{
+    RAMBlock *block;
+
+    RAMBLOCK_FOREACH_NOT_IGNORED(block) {
+        size_t num_pages = block->used_length >> TARGET_PAGE_BITS;
+        size_t bitmap_size = BITS_TO_LONGS(num_pages) * sizeof(unsigned long);
+        unsigned long *le_bitmap = bitmap_new(num_pages);
+
+        bitmap_to_le(le_bitmap, block->file_bmap, num_pages);
+        qemu_put_buffer_at(f, (uint8_t *)le_bitmap, bitmap_size,
+                           block->bitmap_offset);
+        g_free(le_bitmap);
+    }
+}
+
 /**
  * ram_save_setup: Setup RAM for migration
  *
@@ -2466,13 +2929,20 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
     RAMState **rsp = opaque;
     RAMBlock *block;
 
+    if (migrate_use_mapped_ram() && !qemu_file_is_seekable(f)) {
+        error_report("mapped-ram migration needs a seekable file");
+        return -1;
+    }
+
     if (compress_threads_save_setup()) {
         return -1;
     }
+    dirty_sync_threads_setup();
 
     /* migration has already setup the bitmap, reuse it. */
     if (!migration_in_colo_state()) {
         if (ram_init_all(rsp) != 0) {
+            dirty_sync_threads_cleanup();
             compress_threads_save_cleanup();
             return -1;
         }
@@ -2493,6 +2963,9 @@ static int ram_save_setup(QEMUFile *f, void *opaque)
             if (migrate_ignore_shared()) {
                 qemu_put_be64(f, block->mr->addr);
             }
+            if (migrate_use_mapped_ram() && !ramblock_is_ignored(block)) {
+                mapped_ram_setup_ramblock(f, block);
+            }
         }
     }
 
@@ -2658,9 +3131,22 @@ static int ram_save_complete(QEMUFile *f, void *opaque)
     }
 
     if (ret >= 0) {
+        QEMUFile *preempt = postcopy_preempt_channel();
+
         multifd_send_sync_main(rs->f);
+        if (migrate_use_mapped_ram()) {
+            WITH_RCU_READ_LOCK_GUARD() {
+                mapped_ram_write_bitmaps(f);
+            }
+        }
         qemu_put_be64(f, RAM_SAVE_FLAG_EOS);
         qemu_fflush(f);
+
+        if (preempt) {
+            /* An empty burst tells the preempt thread to quit */
+            qemu_put_be64(preempt, RAM_SAVE_FLAG_EOS);
+            qemu_fflush(preempt);
+        }
     }
 
     return ret;
@@ -2738,10 +3224,13 @@ static int load_xbzrle(QEMUFile *f, ram_addr_t addr, void *host)
  *
  * @f: QEMUFile where to read the data from
  * @flags: Page flags (mostly to see if it's a continuation of previous block)
+ * @channel: the channel the page comes from
  */
-static inline RAMBlock *ram_block_from_stream(QEMUFile *f, int flags)
+static inline RAMBlock *ram_block_from_stream(QEMUFile *f, int flags,
+                                              int channel)
 {
-    static RAMBlock *block = NULL;
+    MigrationIncomingState *mis = migration_incoming_get_current();
+    RAMBlock *block = mis->last_recv_block[channel];
     char id[256];
     uint8_t len;
 
@@ -2768,6 +3257,7 @@ static inline RAMBlock *ram_block_from_stream(QEMUFile *f, int flags)
         return NULL;
     }
 
+    mis->last_recv_block[channel] = block;
     return block;
 }
 
@@ -3071,7 +3561,7 @@ void colo_incoming_start_dirty_log(void)
             /* Discard this dirty bitmap record */
             bitmap_zero(block->bmap, block->max_length >> TARGET_PAGE_BITS);
         }
-        memory_global_dirty_log_start();
+        memory_global_dirty_log_start(GLOBAL_DIRTY_MIGRATION);
     }
     ram_state->migration_dirty_pages = 0;
     qemu_mutex_unlock_ramlist();
@@ -3083,7 +3573,7 @@ void colo_release_ram_cache(void)
 {
     RAMBlock *block;
 
-    memory_global_dirty_log_stop();
+    memory_global_dirty_log_stop(GLOBAL_DIRTY_MIGRATION);
     RAMBLOCK_FOREACH_NOT_IGNORED(block) {
         g_free(block->bmap);
         block->bmap = NULL;
@@ -3160,19 +3650,21 @@ int ram_postcopy_incoming_init(MigrationIncomingState *mis)
  *
  * Returns 0 for success or -errno in case of error
  *
- * Called in postcopy mode by ram_load().
+ * Called in postcopy mode by ram_load() and ram_load_postcopy_preempt().
  * rcu_read_lock is taken prior to this being called.
  *
  * @f: QEMUFile where to send the data
+ * @channel: RAM_CHANNEL_POSTCOPY if @f is the preempt channel
  */
-static int ram_load_postcopy(QEMUFile *f)
+static int ram_load_postcopy(QEMUFile *f, int channel)
 {
     int flags = 0, ret = 0;
     bool place_needed = false;
     bool matches_target_page_size = false;
     MigrationIncomingState *mis = migration_incoming_get_current();
     /* Temporary page that is later 'placed' */
-    void *postcopy_host_page = mis->postcopy_tmp_page;
+    void *postcopy_host_page = channel == RAM_CHANNEL_POSTCOPY ?
+        mis->postcopy_preempt_tmp_page : mis->postcopy_tmp_page;
     void *this_host = NULL;
     bool all_zero = true;
     int target_pages = 0;
@@ -3203,7 +3695,7 @@ static int ram_load_postcopy(QEMUFile *f)
         trace_ram_load_postcopy_loop((uint64_t)addr, flags);
         if (flags & (RAM_SAVE_FLAG_ZERO | RAM_SAVE_FLAG_PAGE |
                      RAM_SAVE_FLAG_COMPRESS_PAGE)) {
-            block = ram_block_from_stream(f, flags);
+            block = ram_block_from_stream(f, flags, channel);
 
             host = host_from_ram_block_offset(block, addr);
             if (!host) {
@@ -3295,7 +3787,9 @@ static int ram_load_postcopy(QEMUFile *f)
 
         case RAM_SAVE_FLAG_EOS:
             /* normal exit */
-            multifd_recv_sync_main();
+            if (channel == RAM_CHANNEL_PRECOPY) {
+                multifd_recv_sync_main();
+            }
             break;
         default:
             error_report("Unknown combination of migration flags: %#x"
@@ -3336,6 +3830,43 @@ static int ram_load_postcopy(QEMUFile *f)
     return ret;
 }
 
+/**
+ * ram_load_postcopy_preempt: load the pages sent on the preempt channel
+ *
+ * Returns 0 once the source has ended the channel, or -errno in case of
+ * error
+ *
+ * Each requested host page comes in its own burst ending with
+ * RAM_SAVE_FLAG_EOS; an empty burst ends the channel.  The RCU read lock
+ * is only held while a burst is loaded, not while waiting for the next
+ * one.
+ *
+ * @f: the preempt channel
+ */
+int ram_load_postcopy_preempt(QEMUFile *f)
+{
+    uint8_t *buf;
+    int ret = 0;
+
+    while (!ret) {
+        if (qemu_peek_buffer(f, &buf, sizeof(uint64_t), 0) !=
+            sizeof(uint64_t)) {
+            ret = qemu_file_get_error(f);
+            return ret ? ret : -EIO;
+        }
+        if (ldq_be_p(buf) == RAM_SAVE_FLAG_EOS) {
+            qemu_file_skip(f, sizeof(uint64_t));
+            break;
+        }
+
+        WITH_RCU_READ_LOCK_GUARD() {
+            ret = ram_load_postcopy(f, RAM_CHANNEL_POSTCOPY);
+        }
+    }
+
+    return ret;
+}
+
 static bool postcopy_is_advised(void)
 {
     PostcopyState ps = postcopy_state_get();
@@ -3390,6 +3921,145 @@ void colo_flush_ram_cache(void)
     trace_colo_flush_ram_cache_end();
 }
 
+typedef struct {
+    QEMUFile *f;
+    RAMBlock *block;
+    unsigned long *bitmap;
+    /* range of pages handled by this thread */
+    unsigned long start;
+    unsigned long end;
+    QemuThread thread;
+    Error *err;
+} MappedRamLoadParams;
+
+static void *mapped_ram_load_thread(void *opaque)
+{
+    MappedRamLoadParams *p = opaque;
+    unsigned long set, clear;
+
+    set = find_next_bit(p->bitmap, p->end, p->start);
+    while (set < p->end) {
+        ram_addr_t offset = (ram_addr_t)set << TARGET_PAGE_BITS;
+        size_t size;
+
+        clear = find_next_zero_bit(p->bitmap, p->end, set);
+        size = (clear - set) << TARGET_PAGE_BITS;
+        if (qemu_get_buffer_at(p->f, p->block->host + offset, size,
+                               p->block->pages_offset + offset,
+                               &p->err) < 0) {
+            break;
+        }
+        set = find_next_bit(p->bitmap, p->end, clear);
+    }
+
+    return NULL;
+}
+
+/**
+ * mapped_ram_load_ramblock: read the pages of a block from the file
+ *
+ * Returns 0 for success or -errno in case of error
+ *
+ * The pages present in the file are read with positioned reads, split
+ * across the multifd channel count when multifd is enabled.  Pages
+ * that are not in the file were zero on the source.
+ *
+ * @f: QEMUFile where to receive the data
+ * @block: RAMBlock to load
+ * @length: length of the block on the source
+ */
+static int mapped_ram_load_ramblock(QEMUFile *f, RAMBlock *block,
+                                    ram_addr_t length)
+{
+    size_t num_pages = length >> TARGET_PAGE_BITS;
+    size_t bitmap_size = BITS_TO_LONGS(num_pages) * sizeof(unsigned long);
+    g_autofree unsigned long *le_bitmap = bitmap_new(num_pages);
+    g_autofree unsigned long *bitmap = bitmap_new(num_pages);
+    g_autofree MappedRamLoadParams *params = NULL;
+    Error *local_err = NULL;
+    uint32_t version;
+    uint64_t page_size;
+    int nthreads = 1;
+    int ret = 0;
+    int i;
+
+    version = qemu_get_be32(f);
+    page_size = qemu_get_be64(f);
+    block->bitmap_offset = qemu_get_be64(f);
+    block->pages_offset = qemu_get_be64(f);
+
+    if (version != MAPPED_RAM_HDR_VERSION) {
+        error_report("Unsupported mapped-ram header version %" PRIu32
+                     " for block %s", version, block->idstr);
+        return -EINVAL;
+    }
+    if (page_size != TARGET_PAGE_SIZE) {
+        error_report("Mismatched page size %" PRIu64 " != %" PRIu64
+                     " in mapped-ram block %s", page_size,
+                     (uint64_t)TARGET_PAGE_SIZE, block->idstr);
+        return -EINVAL;
+    }
+    if (!qemu_file_is_seekable(f)) {
+        error_report("mapped-ram migration needs a seekable file");
+        return -EINVAL;
+    }
+
+    if (qemu_get_buffer_at(f, (uint8_t *)le_bitmap, bitmap_size,
+                           block->bitmap_offset, &local_err) < 0) {
+        error_report_err(local_err);
+        return -EIO;
+    }
+    bitmap_from_le(bitmap, le_bitmap, num_pages);
+
+    if (migrate_use_multifd()) {
+        nthreads = MIN(migrate_multifd_channels(),
+                       DIV_ROUND_UP(length, MAPPED_RAM_LOAD_MIN_CHUNK));
+    }
+    params = g_new0(MappedRamLoadParams, nthreads);
+
+    for (i = 0; i < nthreads; i++) {
+        MappedRamLoadParams *p = &params[i];
+
+        p->f = f;
+        p->block = block;
+        p->bitmap = bitmap;
+        p->start = num_pages * i / nthreads;
+        p->end = num_pages * (i + 1) / nthreads;
+        if (i == 0) {
+            continue;
+        }
+        qemu_thread_create(&p->thread, "mapped-ram-load",
+                           mapped_ram_load_thread, p, QEMU_THREAD_JOINABLE);
+    }
+    /* The first range is read by this thread */
+    mapped_ram_load_thread(&params[0]);
+
+    for (i = 0; i < nthreads; i++) {
+        MappedRamLoadParams *p = &params[i];
+
+        if (i) {
+            qemu_thread_join(&p->thread);
+        }
+        if (p->err) {
+            if (!ret) {
+                error_report_err(p->err);
+            } else {
+                error_free(p->err);
+            }
+            ret = -EIO;
+        }
+    }
+    trace_ram_load_mapped_ramblock(block->idstr, num_pages,
+                                   bitmap_count_one(bitmap, num_pages),
+                                   nthreads);
+
+    qemu_set_offset(f, block->pages_offset + length);
+    if (!ret) {
+        ret = qemu_file_get_error(f);
+    }
+    return ret;
+}
+
 /**
  * ram_load_precopy: load pages in precopy case
  *
@@ -3440,7 +4110,8 @@ static int ram_load_precopy(QEMUFile *f)
 
         if (flags & (RAM_SAVE_FLAG_ZERO | RAM_SAVE_FLAG_PAGE |
                      RAM_SAVE_FLAG_COMPRESS_PAGE | RAM_SAVE_FLAG_XBZRLE)) {
-            RAMBlock *block = ram_block_from_stream(f, flags);
+            RAMBlock *block = ram_block_from_stream(f, flags,
+                                                    RAM_CHANNEL_PRECOPY);
 
             host = host_from_ram_block_offset(block, addr);
             /*
@@ -3529,6 +4200,10 @@ static int ram_load_precopy(QEMUFile *f)
                             ret = -EINVAL;
                         }
                     }
+                    if (!ret && migrate_use_mapped_ram() &&
+                        !ramblock_is_ignored(block)) {
+                        ret = mapped_ram_load_ramblock(f, block, length);
+                    }
                     ram_control_load_hook(f, RAM_CONTROL_BLOCK_REG,
                                           block->idstr);
                 } else {
@@ -3617,7 +4292,7 @@ static int ram_load(QEMUFile *f, void *opaque, int version_id)
      */
     WITH_RCU_READ_LOCK_GUARD() {
         if (postcopy_running) {
-            ret = ram_load_postcopy(f);
+            ret = ram_load_postcopy(f, RAM_CHANNEL_PRECOPY);
         } else {
             ret = ram_load_precopy(f);
         }
@@ -51,6 +51,7 @@
 #include "trace.h"
 #include "qemu/iov.h"
 #include "qemu/main-loop.h"
+#include "qemu/rcu.h"
 #include "block/snapshot.h"
 #include "qemu/cutils.h"
 #include "io/channel-buffer.h"
@@ -85,6 +86,8 @@ enum qemu_vm_cmd {
     MIG_CMD_ENABLE_COLO,       /* Enable COLO */
     MIG_CMD_POSTCOPY_RESUME,   /* resume postcopy on dest */
     MIG_CMD_RECV_BITMAP,       /* Request for recved bitmap on dst */
+    MIG_CMD_DEVICE_STATE,      /* A device section that can be loaded
+                                  concurrently with the stream */
     MIG_CMD_MAX
 };
 
@@ -104,6 +107,7 @@ static struct mig_cmd_args {
     [MIG_CMD_POSTCOPY_RESUME]  = { .len =  0, .name = "POSTCOPY_RESUME" },
     [MIG_CMD_PACKAGED]         = { .len =  4, .name = "PACKAGED" },
     [MIG_CMD_RECV_BITMAP]      = { .len = -1, .name = "RECV_BITMAP" },
+    [MIG_CMD_DEVICE_STATE]     = { .len =  4, .name = "DEVICE_STATE" },
     [MIG_CMD_MAX]              = { .len = -1, .name = "MAX" },
 };
 
@@ -230,6 +234,17 @@ typedef struct CompatEntry {
     int instance_id;
 } CompatEntry;
 
+typedef struct SectionStats {
+    /* the section was saved, or loaded, by the last migration */
+    bool valid;
+    /* by one of the device-state-threads */
+    bool parallel;
+    /* time spent in microseconds */
+    int64_t time;
+    /* size of the section in the stream */
+    uint64_t bytes;
+} SectionStats;
+
 typedef struct SaveStateEntry {
     QTAILQ_ENTRY(SaveStateEntry) entry;
     char idstr[256];
@@ -246,6 +261,8 @@ typedef struct SaveStateEntry {
     void *opaque;
     CompatEntry *compat;
     int is_ram;
+    SectionStats save_stats;
+    SectionStats load_stats;
 } SaveStateEntry;
 
 typedef struct SaveState {
@@ -948,6 +965,165 @@ static void save_section_footer(QEMUFile *f, SaveStateEntry *se)
     }
 }
 
+/*
+ * The sections whose vmsd is declared independent can be saved and loaded
+ * by worker threads, concurrently with the rest of the stream.  Each of
+ * them is saved into its own buffer and sent, in the usual order, in a
+ * MIG_CMD_DEVICE_STATE command that gives its length, so that the
+ * destination can hand it over to a worker without parsing it.
+ */
+typedef struct DeviceStateJob {
+    /* section being saved, unknown until loaded on the destination */
+    SaveStateEntry *se;
+    /* buffer holding the section, and the file on top of it */
+    QIOChannelBuffer *bioc;
+    QEMUFile *f;
+    /* description of the section, only when saving */
+    QJSON *vmdesc;
+    int ret;
+    bool done;
+    QSIMPLEQ_ENTRY(DeviceStateJob) next;
+} DeviceStateJob;
+
+typedef struct DeviceStateWorkers {
+    QemuThread *threads;
+    int num_threads;
+    /* save or load the section of a job */
+    int (*run)(DeviceStateJob *job);
+    /* protects the following fields and done in the jobs */
+    QemuMutex lock;
+    /* signalled when a job is queued or the threads must quit */
+    QemuCond job_cond;
+    /* signalled when a job is done */
+    QemuCond done_cond;
+    /* jobs that are not started yet */
+    QSIMPLEQ_HEAD(, DeviceStateJob) queue;
+    /* all the jobs, in the stream order */
+    GPtrArray *jobs;
+    bool quit;
+} DeviceStateWorkers;
+
+static void device_state_job_free(gpointer opaque)
+{
+    DeviceStateJob *job = opaque;
+
+    if (job->f) {
+        qemu_fclose(job->f);
+    }
+    if (job->vmdesc) {
+        qjson_destroy(job->vmdesc);
+    }
+    g_free(job);
+}
+
+static void *device_state_thread(void *opaque)
+{
+    DeviceStateWorkers *w = opaque;
+    DeviceStateJob *job;
+    int ret;
+
+    rcu_register_thread();
+    qemu_mutex_lock(&w->lock);
+    while (true) {
+        job = QSIMPLEQ_FIRST(&w->queue);
+        if (!job) {
+            if (w->quit) {
+                break;
+            }
+            qemu_cond_wait(&w->job_cond, &w->lock);
+            continue;
+        }
+        QSIMPLEQ_REMOVE_HEAD(&w->queue, next);
+        qemu_mutex_unlock(&w->lock);
+
+        ret = w->run(job);
+
+        qemu_mutex_lock(&w->lock);
+        job->ret = ret;
+        job->done = true;
+        qemu_cond_broadcast(&w->done_cond);
+    }
+    qemu_mutex_unlock(&w->lock);
+    rcu_unregister_thread();
+    return NULL;
+}
+
+static DeviceStateWorkers *device_state_workers_new(int num_threads,
+                                                    int (*run)(DeviceStateJob *),
+                                                    const char *name)
+{
+    DeviceStateWorkers *w = g_new0(DeviceStateWorkers, 1);
+    int i;
+
+    w->num_threads = num_threads;
+    w->run = run;
+    qemu_mutex_init(&w->lock);
+    qemu_cond_init(&w->job_cond);
+    qemu_cond_init(&w->done_cond);
+    QSIMPLEQ_INIT(&w->queue);
+    w->jobs = g_ptr_array_new_with_free_func(device_state_job_free);
+    w->threads = g_new0(QemuThread, num_threads);
+    for (i = 0; i < num_threads; i++) {
+        qemu_thread_create(&w->threads[i], name, device_state_thread, w,
+                           QEMU_THREAD_JOINABLE);
+    }
+    return w;
+}
+
+static void device_state_workers_queue(DeviceStateWorkers *w,
+                                       DeviceStateJob *job)
+{
+    qemu_mutex_lock(&w->lock);
+    g_ptr_array_add(w->jobs, job);
+    QSIMPLEQ_INSERT_TAIL(&w->queue, job, next);
+    qemu_cond_signal(&w->job_cond);
+    qemu_mutex_unlock(&w->lock);
+}
+
+/* Returns the result of the job once it is done */
+static int device_state_job_wait(DeviceStateWorkers *w, DeviceStateJob *job)
+{
+    qemu_mutex_lock(&w->lock);
+    while (!job->done) {
+        qemu_cond_wait(&w->done_cond, &w->lock);
+    }
+    qemu_mutex_unlock(&w->lock);
+    return job->ret;
+}
+
+/*
+ * Wait for all the jobs, stop the threads and free everything
+ *
+ * Returns the first error of the jobs, in the stream order, or 0
+ */
+static int device_state_workers_finish(DeviceStateWorkers *w)
+{
+    int ret = 0;
+    guint i;
+
+    qemu_mutex_lock(&w->lock);
+    w->quit = true;
+    qemu_cond_broadcast(&w->job_cond);
+    qemu_mutex_unlock(&w->lock);
+
+    for (i = 0; i < w->num_threads; i++) {
+        qemu_thread_join(&w->threads[i]);
+    }
+    for (i = 0; i < w->jobs->len && !ret; i++) {
+        DeviceStateJob *job = g_ptr_array_index(w->jobs, i);
+
+        ret = job->ret;
+    }
+
+    g_ptr_array_free(w->jobs, true);
+    qemu_cond_destroy(&w->done_cond);
+    qemu_cond_destroy(&w->job_cond);
+    qemu_mutex_destroy(&w->lock);
+    g_free(w->threads);
+    g_free(w);
+    return ret;
+}
+
 /**
  * qemu_savevm_command_send: Send a 'QEMU_VM_COMMAND' type element with the
  *                           command and associated data.
@@ -1162,6 +1338,9 @@ void qemu_savevm_state_setup(QEMUFile *f)
     int ret;
 
     trace_savevm_state_setup();
+    QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        se->save_stats.valid = false;
+    }
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
         if (!se->ops || !se->ops->save_setup) {
             continue;
@@ -1322,6 +1501,7 @@ static
 int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
 {
     SaveStateEntry *se;
+    int64_t start, start_pos;
     int ret;
 
     QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
@@ -1338,6 +1518,8 @@ int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
             }
         }
         trace_savevm_section_start(se->idstr, se->section_id);
+        start = get_clock();
+        start_pos = qemu_ftell_fast(f);
 
         save_section_header(f, se, QEMU_VM_SECTION_END);
 
@@ -1348,21 +1530,128 @@ int qemu_savevm_state_complete_precopy_iterable(QEMUFile *f, bool in_postcopy)
             qemu_file_set_error(f, ret);
             return -1;
         }
+
+        se->save_stats.time = (get_clock() - start) / SCALE_US;
+        se->save_stats.bytes = qemu_ftell_fast(f) - start_pos;
+        se->save_stats.parallel = false;
+        se->save_stats.valid = true;
     }
 
     return 0;
 }
 
+/* Save the section of @job into its buffer, on a device-state thread */
+static int device_state_save_job(DeviceStateJob *job)
+{
+    SaveStateEntry *se = job->se;
+    int64_t start = get_clock();
+    int ret;
+
+    trace_savevm_section_start(se->idstr, se->section_id);
+
+    json_prop_str(job->vmdesc, "name", se->idstr);
+    json_prop_int(job->vmdesc, "instance_id", se->instance_id);
+
+    save_section_header(job->f, se, QEMU_VM_SECTION_FULL);
+    ret = vmstate_save(job->f, se, job->vmdesc);
+    if (ret) {
+        return ret;
+    }
+    trace_savevm_section_end(se->idstr, se->section_id, 0);
+    save_section_footer(job->f, se);
+    qemu_fflush(job->f);
+    qjson_finish(job->vmdesc);
+
+    se->save_stats.time = (get_clock() - start) / SCALE_US;
+    se->save_stats.bytes = job->bioc->usage;
+    se->save_stats.parallel = true;
+    se->save_stats.valid = true;
+    return qemu_file_get_error(job->f);
+}
+
+static bool device_state_independent(SaveStateEntry *se)
+{
+    return se->vmsd && se->vmsd->independent;
+}
+
+/*
+ * Start saving the sections that are independent, they are sent in
+ * order by device_state_send()
+ */
+static DeviceStateWorkers *device_state_save_start(void)
+{
+    DeviceStateWorkers *w;
+    SaveStateEntry *se;
+
+    w = device_state_workers_new(migrate_device_state_threads(),
+                                 device_state_save_job, "mig/save_state");
+    QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        DeviceStateJob *job;
+
+        if (!device_state_independent(se) ||
+            !vmstate_save_needed(se->vmsd, se->opaque)) {
+            continue;
+        }
+
+        job = g_new0(DeviceStateJob, 1);
+        job->se = se;
+        job->bioc = qio_channel_buffer_new(4096);
+        qio_channel_set_name(QIO_CHANNEL(job->bioc),
+                             "migration-device-state-buffer");
+        job->f = qemu_fopen_channel_output(QIO_CHANNEL(job->bioc));
+        object_unref(OBJECT(job->bioc));
+        job->vmdesc = qjson_new();
+        device_state_workers_queue(w, job);
+    }
+    return w;
+}
+
+/* Wait for the section of @job to be saved, and send it */
+static int device_state_send(QEMUFile *f, DeviceStateWorkers *w,
+                             DeviceStateJob *job, QJSON *vmdesc)
+{
+    size_t len;
+    uint32_t tmp;
+    int ret;
+
+    ret = device_state_job_wait(w, job);
+    if (ret) {
+        return ret;
+    }
+
+    len = job->bioc->usage;
+    if (len > MAX_VM_CMD_PACKAGED_SIZE) {
+        error_report("%s: Unreasonably large device state for '%s': %zu",
+                     __func__, job->se->idstr, len);
+        return -EINVAL;
+    }
+
+    trace_savevm_send_device_state(job->se->idstr, len);
+    tmp = cpu_to_be32(len);
+    qemu_savevm_command_send(f, MIG_CMD_DEVICE_STATE, 4, (uint8_t *)&tmp);
+    qemu_put_buffer(f, job->bioc->data, len);
+    json_prop_qjson(vmdesc, NULL, job->vmdesc);
+    return 0;
+}
+
 static
 int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
                                                     bool in_postcopy,
                                                     bool inactivate_disks)
 {
     g_autoptr(QJSON) vmdesc = NULL;
+    DeviceStateWorkers *workers = NULL;
+    DeviceStateJob *job;
+    guint next_job = 0;
     int vmdesc_len;
     SaveStateEntry *se;
+    int64_t start, start_pos;
     int ret;
 
+    if (migrate_device_state_threads()) {
+        workers = device_state_save_start();
+    }
+
     vmdesc = qjson_new();
     json_prop_int(vmdesc, "page_size", qemu_target_page_size());
     json_start_array(vmdesc, "devices");
@@ -1371,12 +1660,28 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
         if ((!se->ops || !se->ops->save_state) && !se->vmsd) {
             continue;
         }
+
+        job = NULL;
+        if (workers && next_job < workers->jobs->len) {
+            job = g_ptr_array_index(workers->jobs, next_job);
+        }
+        if (job && job->se == se) {
+            next_job++;
+            ret = device_state_send(f, workers, job, vmdesc);
+            if (ret) {
+                goto fail;
+            }
+            continue;
+        }
+
         if (se->vmsd && !vmstate_save_needed(se->vmsd, se->opaque)) {
             trace_savevm_section_skip(se->idstr, se->section_id);
             continue;
         }
 
         trace_savevm_section_start(se->idstr, se->section_id);
+        start = get_clock();
+        start_pos = qemu_ftell_fast(f);
 
         json_start_object(vmdesc, NULL);
         json_prop_str(vmdesc, "name", se->idstr);
@@ -1385,13 +1690,25 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
         save_section_header(f, se, QEMU_VM_SECTION_FULL);
         ret = vmstate_save(f, se, vmdesc);
         if (ret) {
-            qemu_file_set_error(f, ret);
-            return ret;
+            goto fail;
         }
         trace_savevm_section_end(se->idstr, se->section_id, 0);
         save_section_footer(f, se);
 
         json_end_object(vmdesc);
+
+        se->save_stats.time = (get_clock() - start) / SCALE_US;
+        se->save_stats.bytes = qemu_ftell_fast(f) - start_pos;
+        se->save_stats.parallel = false;
+        se->save_stats.valid = true;
+    }
+
+    if (workers) {
+        ret = device_state_workers_finish(workers);
+        workers = NULL;
+        if (ret) {
+            goto fail;
+        }
     }
 
     if (inactivate_disks) {
@@ -1421,6 +1738,13 @@ int qemu_savevm_state_complete_precopy_non_iterable(QEMUFile *f,
     }
 
     return 0;
+
+fail:
+    if (workers) {
+        device_state_workers_finish(workers);
+    }
+    qemu_file_set_error(f, ret);
+    return ret;
 }
 
 int qemu_savevm_state_complete_precopy(QEMUFile *f, bool iterable_only,
@@ -1958,8 +2282,11 @@ static void loadvm_postcopy_handle_run_bh(void *opaque)
     /* TODO we should move all of this lot into postcopy_ram.c or a shared code
      * in migration.c
      */
+    migration_phase_begin(mis->phases, MIGRATION_PHASE_SYNC, 0);
     cpu_synchronize_all_post_init();
+    migration_phase_end(mis->phases, MIGRATION_PHASE_SYNC, 0);
 
+    migration_phase_begin(mis->phases, MIGRATION_PHASE_RESUME, 0);
     qemu_announce_self(&mis->announce_timer, migrate_announce_params());
 
     /* Make sure all file formats flush their mutable metadata.
@@ -1984,6 +2311,7 @@ static void loadvm_postcopy_handle_run_bh(void *opaque)
         /* leave it paused and let management decide when to start the CPU */
         runstate_set(RUN_STATE_PAUSED);
     }
+    migration_phase_end(mis->phases, MIGRATION_PHASE_RESUME, 0);
 
     qemu_bh_delete(mis->bh);
 }
@@ -1992,6 +2320,7 @@ static void loadvm_postcopy_handle_run_bh(void *opaque)
 static int loadvm_postcopy_handle_run(MigrationIncomingState *mis)
 {
     PostcopyState ps = postcopy_state_get();
+    int ret;
 
     trace_loadvm_postcopy_handle_run();
     if (ps != POSTCOPY_INCOMING_LISTENING) {
@@ -1999,6 +2328,14 @@ static int loadvm_postcopy_handle_run(MigrationIncomingState *mis)
         return -1;
     }
 
+    /* The devices must be loaded before the guest runs */
+    ret = qemu_loadvm_device_state_wait();
+    if (ret < 0) {
+        return ret;
+    }
+    migration_phase_end(mis->phases, MIGRATION_PHASE_COMPLETE,
+                        qemu_ftell_input(mis->from_src_file));
+
     postcopy_state_set(POSTCOPY_INCOMING_RUNNING);
     mis->bh = qemu_bh_new(loadvm_postcopy_handle_run_bh, mis);
     qemu_bh_schedule(mis->bh);
@@ -2013,6 +2350,8 @@ static int loadvm_postcopy_handle_run(MigrationIncomingState *mis)
 
 static int loadvm_postcopy_handle_resume(MigrationIncomingState *mis)
 {
+    int i, paused;
+
     if (mis->state != MIGRATION_STATUS_POSTCOPY_RECOVER) {
         error_report("%s: illegal resume received", __func__);
         /* Don't fail the load, only for this. */
@@ -2026,7 +2365,14 @@ static int loadvm_postcopy_handle_resume(MigrationIncomingState *mis)
      */
     migrate_set_state(&mis->state, MIGRATION_STATUS_POSTCOPY_RECOVER,
                       MIGRATION_STATUS_POSTCOPY_ACTIVE);
-    qemu_sem_post(&mis->postcopy_pause_sem_fault);
+    /*
+     * Only wake up the fault threads that paused: a spare post would let
+     * the next pause go through without waiting for the recovery.
+     */
+    paused = qatomic_xchg(&mis->postcopy_fault_threads_paused, 0);
+    for (i = 0; i < paused; i++) {
+        qemu_sem_post(&mis->postcopy_pause_sem_fault);
+    }
 
     trace_loadvm_postcopy_handle_resume();
 
@@ -2052,6 +2398,9 @@ static int loadvm_handle_cmd_packaged(MigrationIncomingState *mis)
     size_t length;
     QIOChannelBuffer *bioc;
 
+    /* The package holds the device state sent once the source stopped */
+    migration_phase_begin(mis->phases, MIGRATION_PHASE_COMPLETE,
+                          qemu_ftell_input(mis->from_src_file));
     length = qemu_get_be32(mis->from_src_file);
     trace_loadvm_handle_cmd_packaged(length);
 
@@ -2140,6 +2489,8 @@ static int loadvm_process_enable_colo(MigrationIncomingState *mis)
     return ret;
 }
 
+static int loadvm_handle_device_state(QEMUFile *f);
+
 /*
  * Process an incoming 'QEMU_VM_COMMAND'
  * 0           just a normal return
@@ -2222,6 +2573,9 @@ static int loadvm_process_command(QEMUFile *f)
 
     case MIG_CMD_ENABLE_COLO:
         return loadvm_process_enable_colo(mis);
+
+    case MIG_CMD_DEVICE_STATE:
+        return loadvm_handle_device_state(f);
     }
 
     return 0;
@@ -2271,11 +2625,14 @@ static bool check_section_footer(QEMUFile *f, SaveStateEntry *se)
 }
 
 static int
-qemu_loadvm_section_start_full(QEMUFile *f, MigrationIncomingState *mis)
+qemu_loadvm_section_start_full(QEMUFile *f, MigrationIncomingState *mis,
+                               bool parallel)
 {
     uint32_t instance_id, version_id, section_id;
     SaveStateEntry *se;
     char idstr[256];
+    int64_t start = get_clock();
+    int64_t start_pos = qemu_ftell_input(f);
     int ret;
 
     /* Read section start */
@@ -2331,15 +2688,125 @@ qemu_loadvm_section_start_full(QEMUFile *f, MigrationIncomingState *mis)
     if (!check_section_footer(f, se)) {
         return -EINVAL;
     }
+    se->load_stats.time = (get_clock() - start) / SCALE_US;
+    se->load_stats.bytes = qemu_ftell_input(f) - start_pos;
+    se->load_stats.parallel = parallel;
+    se->load_stats.valid = true;
 
     return 0;
 }
 
+/*
+ * Workers loading the MIG_CMD_DEVICE_STATE sections, started with the
+ * first one and stopped by qemu_loadvm_device_state_wait()
+ */
+static DeviceStateWorkers *device_state_loaders;
+
+/* Load the section of @job from its buffer */
+static int device_state_load(DeviceStateJob *job, bool parallel)
+{
+    MigrationIncomingState *mis = migration_incoming_get_current();
+    uint8_t section_type;
+    int ret;
+
+    section_type = qemu_get_byte(job->f);
+    if (section_type != QEMU_VM_SECTION_FULL) {
+        error_report("Unexpected section type %d in device state",
+                     section_type);
+        return -EINVAL;
+    }
+    ret = qemu_loadvm_section_start_full(job->f, mis, parallel);
+    trace_loadvm_device_state_loaded(ret);
+    return ret;
+}
+
+/* Load the section of @job, on a device-state thread */
+static int device_state_load_job(DeviceStateJob *job)
+{
+    return device_state_load(job, true);
+}
+
+/*
+ * Process an incoming 'QEMU_VM_COMMAND'
+ * MIG_CMD_DEVICE_STATE
+ *
+ * The section is read into a buffer and loaded by one of the
+ * device-state-threads, or right away if there are none.
+ *
+ * Returns: Negative values on error
+ */
+static int loadvm_handle_device_state(QEMUFile *f)
+{
+    DeviceStateJob *job;
+    size_t length;
+    int ret;
+
+    length = qemu_get_be32(f);
+    trace_loadvm_handle_device_state(length);
+
+    if (length > MAX_VM_CMD_PACKAGED_SIZE) {
+        error_report("Unreasonably large device state: %zu", length);
+        return -1;
+    }
+
+    job = g_new0(DeviceStateJob, 1);
+    job->bioc = qio_channel_buffer_new(length);
+    qio_channel_set_name(QIO_CHANNEL(job->bioc),
+                         "migration-device-state-buffer");
+    ret = qemu_get_buffer(f, job->bioc->data, length);
+    if (ret != length) {
+        object_unref(OBJECT(job->bioc));
+        g_free(job);
+        error_report("CMD_DEVICE_STATE: Buffer receive fail ret=%d "
+                     "length=%zu", ret, length);
+        return (ret < 0) ? ret : -EAGAIN;
+    }
+    job->bioc->usage += length;
+    job->f = qemu_fopen_channel_input(QIO_CHANNEL(job->bioc));
+    object_unref(OBJECT(job->bioc));
+
+    if (!migrate_device_state_threads()) {
+        ret = device_state_load(job, false);
+        device_state_job_free(job);
+        return ret;
+    }
+
+    if (!device_state_loaders) {
+        device_state_loaders =
+            device_state_workers_new(migrate_device_state_threads(),
+                                     device_state_load_job,
+                                     "mig/load_state");
+    }
+    device_state_workers_queue(device_state_loaders, job);
+    return 0;
+}
+
+/*
+ * Wait for the device state sections being loaded by the
+ * device-state-threads
+ *
+ * Returns: the first error of the sections, or 0
+ */
+int qemu_loadvm_device_state_wait(void)
+{
+    int ret;
+
+    if (!device_state_loaders) {
+        return 0;
+    }
+    ret = device_state_workers_finish(device_state_loaders);
+    device_state_loaders = NULL;
+    return ret;
+}
+
 static int
-qemu_loadvm_section_part_end(QEMUFile *f, MigrationIncomingState *mis)
+qemu_loadvm_section_part_end(QEMUFile *f, MigrationIncomingState *mis,
+                             uint8_t section_type)
 {
     uint32_t section_id;
     SaveStateEntry *se;
+    int64_t start = get_clock();
+    int64_t start_pos = qemu_ftell_input(f);
     int ret;
 
     section_id = qemu_get_be32(f);
@@ -2372,6 +2839,14 @@ qemu_loadvm_section_part_end(QEMUFile *f, MigrationIncomingState *mis)
         return -EINVAL;
     }
 
+    /* Only the last part is loaded while the guest is stopped */
+    if (section_type == QEMU_VM_SECTION_END) {
+        se->load_stats.time = (get_clock() - start) / SCALE_US;
+        se->load_stats.bytes = qemu_ftell_input(f) - start_pos;
+        se->load_stats.parallel = false;
+        se->load_stats.valid = true;
+    }
+
     return 0;
 }
 
@@ -2460,6 +2935,12 @@ static bool postcopy_pause_incoming(MigrationIncomingState *mis)
     /* Clear the triggered bit to allow one recovery */
     mis->postcopy_recover_triggered = false;
 
+    /*
+     * The preempt thread may use the main channel, stop it first.  The
+     * recovered migration sends every page on the main channel.
+     */
+    postcopy_preempt_thread_join(mis, true);
+
     assert(mis->from_src_file);
     qemu_file_shutdown(mis->from_src_file);
     qemu_fclose(mis->from_src_file);
@@ -2493,6 +2974,7 @@ static bool postcopy_pause_incoming(MigrationIncomingState *mis)
 int qemu_loadvm_state_main(QEMUFile *f, MigrationIncomingState *mis)
 {
     uint8_t section_type;
+    int wait_ret;
     int ret = 0;
 
 retry:
@@ -2508,14 +2990,22 @@ retry:
         switch (section_type) {
         case QEMU_VM_SECTION_START:
         case QEMU_VM_SECTION_FULL:
-            ret = qemu_loadvm_section_start_full(f, mis);
+            if (section_type == QEMU_VM_SECTION_FULL) {
+                migration_phase_begin(mis->phases, MIGRATION_PHASE_COMPLETE,
+                                      qemu_ftell_input(f) - 1);
+            }
+            ret = qemu_loadvm_section_start_full(f, mis, false);
             if (ret < 0) {
                 goto out;
             }
             break;
         case QEMU_VM_SECTION_PART:
         case QEMU_VM_SECTION_END:
-            ret = qemu_loadvm_section_part_end(f, mis);
+            if (section_type == QEMU_VM_SECTION_END) {
+                migration_phase_begin(mis->phases, MIGRATION_PHASE_COMPLETE,
+                                      qemu_ftell_input(f) - 1);
+            }
+            ret = qemu_loadvm_section_part_end(f, mis, section_type);
             if (ret < 0) {
                 goto out;
             }
@@ -2538,6 +3028,11 @@ retry:
     }
 
 out:
+    /* The sections must be loaded before anything looks at the devices */
+    wait_ret = qemu_loadvm_device_state_wait();
+    if (wait_ret < 0 && ret >= 0) {
+        ret = wait_ret;
+    }
     if (ret < 0) {
         qemu_file_set_error(f, ret);
 
@@ -2565,10 +3060,40 @@ out:
     return ret;
 }
 
+/*
+ * Time spent saving, or loading with @load, each device section by the
+ * last migration, in the stream order
+ */
+MigrationSectionStatsList *qemu_savevm_section_stats(bool load)
+{
+    MigrationSectionStatsList *head = NULL, **tail = &head;
+    SaveStateEntry *se;
+
+    QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        SectionStats *stats = load ? &se->load_stats : &se->save_stats;
+        MigrationSectionStatsList *elem;
+
+        if (!stats->valid) {
+            continue;
+        }
+        elem = g_new0(MigrationSectionStatsList, 1);
+        elem->value = g_new0(MigrationSectionStats, 1);
+        elem->value->id_str = g_strdup(se->idstr);
+        elem->value->instance_id = se->instance_id;
+        elem->value->parallel = stats->parallel;
+        elem->value->time = stats->time;
+        elem->value->bytes = stats->bytes;
+        *tail = elem;
+        tail = &elem->next;
+    }
+    return head;
+}
+
 int qemu_loadvm_state(QEMUFile *f)
 {
     MigrationIncomingState *mis = migration_incoming_get_current();
     Error *local_err = NULL;
+    SaveStateEntry *se;
     int ret;
 
     if (qemu_savevm_state_blocked(&local_err)) {
@@ -2576,6 +3101,11 @@ int qemu_loadvm_state(QEMUFile *f)
         return -EINVAL;
     }
 
+    QTAILQ_FOREACH(se, &savevm_state.handlers, entry) {
+        se->load_stats.valid = false;
+    }
+    memset(mis->phases, 0, sizeof(mis->phases));
+
     ret = qemu_loadvm_state_header(f);
     if (ret) {
         return ret;
@@ -2591,6 +3121,8 @@ int qemu_loadvm_state(QEMUFile *f)
     qemu_event_set(&mis->main_thread_load_event);
 
     trace_qemu_loadvm_state_post_main(ret);
+    migration_phase_end(mis->phases, MIGRATION_PHASE_COMPLETE,
+                        qemu_ftell_input(f));
 
     if (mis->have_listen_thread) {
         /* Listen thread still going, can't clean up yet */
@@ -2637,7 +3169,9 @@ int qemu_loadvm_state(QEMUFile *f)
     }
 
     qemu_loadvm_state_cleanup();
+    migration_phase_begin(mis->phases, MIGRATION_PHASE_SYNC, 0);
     cpu_synchronize_all_post_init();
+    migration_phase_end(mis->phases, MIGRATION_PHASE_SYNC, 0);
 
     return ret;
 }
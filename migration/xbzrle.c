@@ -12,6 +12,7 @@
  */
 #include "qemu/osdep.h"
 #include "qemu/cutils.h"
+#include "qemu/host-utils.h"
 #include "xbzrle.h"
 
 /*
@@ -24,8 +25,8 @@
 
   length = uleb128 encoded integer
  */
-int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
-                         uint8_t *dst, int dlen)
+static int xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf,
+                                    int slen, uint8_t *dst, int dlen)
 {
     uint32_t zrun_len = 0, nzrun_len = 0;
     int d = 0, i = 0;
@@ -126,6 +127,251 @@ int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
     return d;
 }
 
+#if defined(CONFIG_AVX512F_OPT) || defined(CONFIG_AVX2_OPT)
+/*
+ * The vectorized encoders find the end of each run with wide compares and
+ * then share the run emission below, so they produce exactly the same
+ * output as xbzrle_encode_buffer_int.
+ *
+ * @find_run_end returns the index of the first byte at or after @i that
+ * differs between the buffers (@zrun) or is the same in both (!@zrun),
+ * or @slen if there is none.
+ */
+typedef int (*XBZRLEFindRunEnd)(uint8_t *old_buf, uint8_t *new_buf,
+                                int i, int slen, bool zrun);
+
+static inline QEMU_ALWAYS_INLINE int
+xbzrle_encode_runs(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                   uint8_t *dst, int dlen, XBZRLEFindRunEnd find_run_end)
+{
+    uint32_t zrun_len, nzrun_len;
+    int d = 0, i = 0, end;
+
+    while (i < slen) {
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+
+        end = find_run_end(old_buf, new_buf, i, slen, true);
+        zrun_len = end - i;
+        i = end;
+
+        /* buffer unchanged */
+        if (zrun_len == slen) {
+            return 0;
+        }
+
+        /* skip last zero run */
+        if (i == slen) {
+            return d;
+        }
+
+        d += uleb128_encode_small(dst + d, zrun_len);
+
+        /* overflow */
+        if (d + 2 > dlen) {
+            return -1;
+        }
+
+        end = find_run_end(old_buf, new_buf, i, slen, false);
+        nzrun_len = end - i;
+
+        d += uleb128_encode_small(dst + d, nzrun_len);
+        /* overflow */
+        if (d + nzrun_len > dlen) {
+            return -1;
+        }
+        memcpy(dst + d, new_buf + i, nzrun_len);
+        d += nzrun_len;
+        i = end;
+    }
+
+    return d;
+}
+#endif
+
+#ifdef CONFIG_AVX2_OPT
+#pragma GCC push_options
+#pragma GCC target("avx2")
+#include <immintrin.h>
+
+static int find_run_end_avx2(uint8_t *old_buf, uint8_t *new_buf,
+                             int i, int slen, bool zrun)
+{
+    /* 32 bytes at a time, the compare mask gives the run end directly */
+    while (i + 32 <= slen) {
+        __m256i o = _mm256_loadu_si256((__m256i *)(old_buf + i));
+        __m256i n = _mm256_loadu_si256((__m256i *)(new_buf + i));
+        uint32_t eq = _mm256_movemask_epi8(_mm256_cmpeq_epi8(o, n));
+        uint32_t stop = zrun ? ~eq : eq;
+
+        if (stop) {
+            return i + ctz32(stop);
+        }
+        i += 32;
+    }
+
+    while (i < slen && (old_buf[i] == new_buf[i]) == zrun) {
+        i++;
+    }
+    return i;
+}
+
+static int xbzrle_encode_buffer_avx2(uint8_t *old_buf, uint8_t *new_buf,
+                                     int slen, uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_runs(old_buf, new_buf, slen, dst, dlen,
+                              find_run_end_avx2);
+}
+#pragma GCC pop_options
+#endif /* CONFIG_AVX2_OPT */
+
+#ifdef CONFIG_AVX512F_OPT
+#pragma GCC push_options
+#pragma GCC target("avx512f")
+#include <immintrin.h>
+
+static int find_run_end_avx512(uint8_t *old_buf, uint8_t *new_buf,
+                               int i, int slen, bool zrun)
+{
+    const __m512i ones = _mm512_set1_epi32(0x01010101);
+    const __m512i highs = _mm512_set1_epi32((int)0x80808080);
+
+    /*
+     * AVX512F has no byte compares: find the first 32-bit lane that
+     * ends the run, 64 bytes at a time, and finish byte by byte.
+     */
+    while (i + 64 <= slen) {
+        __m512i x = _mm512_xor_si512(_mm512_loadu_si512(old_buf + i),
+                                     _mm512_loadu_si512(new_buf + i));
+        __mmask16 stop;
+
+        if (zrun) {
+            /* Lanes with a changed byte */
+            stop = _mm512_test_epi32_mask(x, x);
+        } else {
+            /* Lanes with an unchanged byte, like the mask trick above */
+            __m512i t = _mm512_andnot_si512(x, _mm512_sub_epi32(x, ones));
+            stop = _mm512_test_epi32_mask(t, highs);
+        }
+        if (stop) {
+            i += ctz32(stop) * 4;
+            break;
+        }
+        i += 64;
+    }
+
+    while (i < slen && (old_buf[i] == new_buf[i]) == zrun) {
+        i++;
+    }
+    return i;
+}
+
+static int xbzrle_encode_buffer_avx512(uint8_t *old_buf, uint8_t *new_buf,
+                                       int slen, uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_runs(old_buf, new_buf, slen, dst, dlen,
+                              find_run_end_avx512);
+}
+#pragma GCC pop_options
+#endif /* CONFIG_AVX512F_OPT */
+
+/* Note that for test_xbzrle_encode_next_accel, the most preferred
+ * ISA must have the least significant bit.
+ */
+#define CACHE_AVX512F 1
+#define CACHE_AVX2    2
+
+typedef int (*XBZRLEEncodeFn)(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                              uint8_t *dst, int dlen);
+
+static unsigned cpuid_cache;
+static XBZRLEEncodeFn encode_accel = xbzrle_encode_buffer_int;
+static const char *encode_accel_name = "int";
+
+static void init_accel(unsigned cache)
+{
+    XBZRLEEncodeFn fn = xbzrle_encode_buffer_int;
+    const char *name = "int";
+
+#ifdef CONFIG_AVX2_OPT
+    if (cache & CACHE_AVX2) {
+        fn = xbzrle_encode_buffer_avx2;
+        name = "avx2";
+    }
+#endif
+#ifdef CONFIG_AVX512F_OPT
+    if (cache & CACHE_AVX512F) {
+        fn = xbzrle_encode_buffer_avx512;
+        name = "avx512f";
+    }
+#endif
+    encode_accel = fn;
+    encode_accel_name = name;
+}
+
+#if defined(CONFIG_AVX512F_OPT) || defined(CONFIG_AVX2_OPT)
+#include "qemu/cpuid.h"
+
+static void __attribute__((constructor)) init_cpuid_cache(void)
+{
+    int max = __get_cpuid_max(0, NULL);
+    int a, b, c, d;
+    unsigned cache = 0;
+
+    if (max >= 1) {
+        __cpuid(1, a, b, c, d);
+
+        /* We must check that AVX is not just available, but usable.  */
+        if ((c & bit_OSXSAVE) && (c & bit_AVX) && max >= 7) {
+            int bv;
+            __asm("xgetbv" : "=a"(bv), "=d"(d) : "c"(0));
+            __cpuid_count(7, 0, a, b, c, d);
+            if ((bv & 0x6) == 0x6 && (b & bit_AVX2)) {
+                cache |= CACHE_AVX2;
+            }
+            /* See util/bufferiszero.c for the XCR0 bits */
+            if ((bv & 0xe6) == 0xe6 && (b & bit_AVX512F)) {
+                cache |= CACHE_AVX512F;
+            }
+        }
+    }
+    cpuid_cache = cache;
+    init_accel(cache);
+}
+#endif /* CONFIG_AVX512F_OPT || CONFIG_AVX2_OPT */
+
+bool test_xbzrle_encode_next_accel(void)
+{
+    /* If no bits set, we just tested xbzrle_encode_buffer_int, and there
+       are no more acceleration options to test.  */
+    if (cpuid_cache == 0) {
+        return false;
+    }
+    /* Disable the accelerator we used before and select a new one.  */
+    cpuid_cache &= cpuid_cache - 1;
+    init_accel(cpuid_cache);
+    return true;
+}
+
+int test_xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf,
+                                  int slen, uint8_t *dst, int dlen)
+{
+    return xbzrle_encode_buffer_int(old_buf, new_buf, slen, dst, dlen);
+}
+
+const char *xbzrle_encode_accel(void)
+{
+    return encode_accel_name;
+}
+
+int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
+                         uint8_t *dst, int dlen)
+{
+    return encode_accel(old_buf, new_buf, slen, dst, dlen);
+}
+
 int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen)
 {
     int i = 0, d = 0;
@@ -14,8 +14,19 @@
 #ifndef QEMU_MIGRATION_XBZRLE_H
 #define QEMU_MIGRATION_XBZRLE_H
 
+/*
+ * Encode the changes from @old_buf to @new_buf with the fastest encoder
+ * supported by the host; all the encoders produce the same output.
+ */
 int xbzrle_encode_buffer(uint8_t *old_buf, uint8_t *new_buf, int slen,
                          uint8_t *dst, int dlen);
+/* Name of the encoder used by xbzrle_encode_buffer */
+const char *xbzrle_encode_accel(void);
+/* For tests: switch to the next slower encoder, false if there is none */
+bool test_xbzrle_encode_next_accel(void);
+/* For tests: encode with the portable encoder, whatever the host supports */
+int test_xbzrle_encode_buffer_int(uint8_t *old_buf, uint8_t *new_buf,
+                                  int slen, uint8_t *dst, int dlen);
 
 int xbzrle_decode_buffer(uint8_t *src, int slen, uint8_t *dst, int dlen);
 #endif
@@ -274,6 +274,9 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->ram->multifd_bytes >> 10);
         monitor_printf(mon, "pages-per-second: %" PRIu64 "\n",
                        info->ram->pages_per_second);
+        monitor_printf(mon, "dirty sync time: %" PRIu64 " us (last %"
+                       PRIu64 " us)\n", info->ram->dirty_sync_time,
+                       info->ram->last_dirty_sync_time);
 
         if (info->ram->dirty_pages_rate) {
             monitor_printf(mon, "dirty pages rate: %" PRIu64 " pages\n",
@@ -309,6 +312,16 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->xbzrle_cache->encoding_rate);
         monitor_printf(mon, "xbzrle overflow: %" PRIu64 "\n",
                        info->xbzrle_cache->overflow);
+        if (info->xbzrle_cache->has_blocks) {
+            XBZRLECacheBlockStatsList *item;
+
+            for (item = info->xbzrle_cache->blocks; item; item = item->next) {
+                monitor_printf(mon, "xbzrle cache %s: hits %" PRIu64
+                               " misses %" PRIu64 " evictions %" PRIu64 "\n",
+                               item->value->id_str, item->value->hits,
+                               item->value->misses, item->value->evictions);
+            }
+        }
     }
 
     if (info->has_compression) {
@@ -324,6 +337,13 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
                        info->compression->compression_rate);
     }
 
+    if (info->has_multifd_active_channels) {
+        monitor_printf(mon, "multifd active channels: %" PRId64 "\n",
+                       info->multifd_active_channels);
+        monitor_printf(mon, "multifd compression level: %" PRId64 "\n",
+                       info->multifd_compression_level);
+    }
+
     if (info->has_cpu_throttle_percentage) {
         monitor_printf(mon, "cpu throttle percentage: %" PRIu64 "\n",
                        info->cpu_throttle_percentage);
@@ -345,6 +365,24 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
         g_free(str);
         visit_free(v);
     }
+
+    if (info->has_postcopy_fault_latency) {
+        PostcopyFaultLatency *latency = info->postcopy_fault_latency;
+        Visitor *v;
+        char *str;
+
+        monitor_printf(mon, "postcopy faults: %" PRIu64 "\n", latency->count);
+        monitor_printf(mon, "postcopy fault latency (avg/max): %" PRIu64
+                       " us / %" PRIu64 " us\n",
+                       latency->count ? latency->total / latency->count : 0,
+                       latency->max);
+        v = string_output_visitor_new(false, &str);
+        visit_type_uint64List(v, NULL, &latency->buckets, &error_abort);
+        visit_complete(v, &str);
+        monitor_printf(mon, "postcopy fault latency histogram: %s\n", str);
+        g_free(str);
+        visit_free(v);
+    }
     if (info->has_socket_address) {
         SocketAddressList *addr;
 
@@ -357,6 +395,32 @@ void hmp_info_migrate(Monitor *mon, const QDict *qdict)
         }
         monitor_printf(mon, "]\n");
     }
+    if (info->has_sections) {
+        MigrationSectionStatsList *sec;
+
+        monitor_printf(mon, "device sections: [\n");
+
+        for (sec = info->sections; sec; sec = sec->next) {
+            monitor_printf(mon, "\t%s/%u: %" PRId64 " us %" PRIu64
+                           " bytes%s\n",
+                           sec->value->id_str, sec->value->instance_id,
+                           sec->value->time, sec->value->bytes,
+                           sec->value->parallel ? " (parallel)" : "");
+        }
+        monitor_printf(mon, "]\n");
+    }
+    if (info->has_phases) {
+        MigrationPhaseStatsList *phase;
+
+        monitor_printf(mon, "downtime phases: [\n");
+
+        for (phase = info->phases; phase; phase = phase->next) {
+            monitor_printf(mon, "\t%s: %" PRId64 " us %" PRIu64 " bytes\n",
+                           MigrationPhase_str(phase->value->phase),
+                           phase->value->time, phase->value->bytes);
+        }
+        monitor_printf(mon, "]\n");
+    }
     qapi_free_MigrationInfo(info);
 }
 
@@ -462,6 +526,31 @@ void hmp_info_migrate_parameters(Monitor *mon, const QDict *qdict)
         monitor_printf(mon, "%s: %s\n",
             MigrationParameter_str(MIGRATION_PARAMETER_MULTIFD_COMPRESSION),
             MultiFDCompression_str(params->multifd_compression));
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_DIRTY_SYNC_THREADS),
+            params->dirty_sync_threads);
+        monitor_printf(mon, "%s: %" PRIu64 " MB/s\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_VCPU_DIRTY_LIMIT),
+            params->vcpu_dirty_limit);
+        monitor_printf(mon, "%s: %" PRIu64 " ms\n",
+            MigrationParameter_str(
+                MIGRATION_PARAMETER_X_VCPU_DIRTY_LIMIT_PERIOD),
+            params->x_vcpu_dirty_limit_period);
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_POSTCOPY_FAULT_THREADS),
+            params->postcopy_fault_threads);
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_POSTCOPY_PREFETCH_PAGES),
+            params->postcopy_prefetch_pages);
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_DEVICE_STATE_THREADS),
+            params->device_state_threads);
+        monitor_printf(mon, "%s: %u\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_MULTIFD_LZ4_LEVEL),
+            params->multifd_lz4_level);
+        monitor_printf(mon, "%s: %u%%\n",
+            MigrationParameter_str(MIGRATION_PARAMETER_MULTIFD_LZ4_MIN_SAVING),
+            params->multifd_lz4_min_saving);
         monitor_printf(mon, "%s: %" PRIu64 " bytes\n",
             MigrationParameter_str(MIGRATION_PARAMETER_XBZRLE_CACHE_SIZE),
             params->xbzrle_cache_size);
@@ -1381,6 +1470,38 @@ void hmp_migrate_set_parameter(Monitor *mon, const QDict *qdict)
         p->has_multifd_zstd_level = true;
         visit_type_int(v, param, &p->multifd_zstd_level, &err);
         break;
+    case MIGRATION_PARAMETER_MULTIFD_LZ4_LEVEL:
+        p->has_multifd_lz4_level = true;
+        visit_type_int(v, param, &p->multifd_lz4_level, &err);
+        break;
+    case MIGRATION_PARAMETER_MULTIFD_LZ4_MIN_SAVING:
+        p->has_multifd_lz4_min_saving = true;
+        visit_type_int(v, param, &p->multifd_lz4_min_saving, &err);
+        break;
+    case MIGRATION_PARAMETER_DIRTY_SYNC_THREADS:
+        p->has_dirty_sync_threads = true;
+        visit_type_int(v, param, &p->dirty_sync_threads, &err);
+        break;
+    case MIGRATION_PARAMETER_VCPU_DIRTY_LIMIT:
+        p->has_vcpu_dirty_limit = true;
+        visit_type_uint64(v, param, &p->vcpu_dirty_limit, &err);
+        break;
+    case MIGRATION_PARAMETER_X_VCPU_DIRTY_LIMIT_PERIOD:
+        p->has_x_vcpu_dirty_limit_period = true;
+        visit_type_uint64(v, param, &p->x_vcpu_dirty_limit_period, &err);
+        break;
+    case MIGRATION_PARAMETER_POSTCOPY_FAULT_THREADS:
+        p->has_postcopy_fault_threads = true;
+        visit_type_int(v, param, &p->postcopy_fault_threads, &err);
+        break;
+    case MIGRATION_PARAMETER_POSTCOPY_PREFETCH_PAGES:
+        p->has_postcopy_prefetch_pages = true;
+        visit_type_int(v, param, &p->postcopy_prefetch_pages, &err);
+        break;
+    case MIGRATION_PARAMETER_DEVICE_STATE_THREADS:
+        p->has_device_state_threads = true;
+        visit_type_int(v, param, &p->device_state_threads, &err);
+        break;
     case MIGRATION_PARAMETER_XBZRLE_CACHE_SIZE:
         p->has_xbzrle_cache_size = true;
         if (!visit_type_size(v, param, &cache_size, &err)) {
@@ -0,0 +1,669 @@
+/*
+ * AF_XDP network backend
+ *
+ * Copyright (c) 2020 The QEMU Project Developers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+/*
+ * Each netdev queue owns an XSK socket bound to one NIC queue.  All the
+ * sockets of a netdev share a single UMEM, which is cut into one slice
+ * of frames per queue: a queue only ever hands its own frames to its
+ * fill and TX rings, so the rings need no locking between queues and
+ * each queue can be serviced by a different iothread.
+ */
+
+#include "qemu/osdep.h"
+#include <bpf/libbpf.h>
+#include <bpf/xsk.h>
+#include <linux/if_link.h>
+#include <linux/if_xdp.h>
+#include <net/if.h>
+
+#include "net/net.h"
+#include "clients.h"
+#include "block/aio.h"
+#include "qapi/error.h"
+#include "qemu/error-report.h"
+#include "qemu/iov.h"
+#include "qemu/main-loop.h"
+
+#define AF_XDP_FRAME_SIZE      XSK_UMEM__DEFAULT_FRAME_SIZE
+#define AF_XDP_RING_SIZE       XSK_RING_CONS__DEFAULT_NUM_DESCS
+/* Enough frames to keep both the fill and the TX ring full */
+#define AF_XDP_QUEUE_FRAMES    (2 * AF_XDP_RING_SIZE)
+#define AF_XDP_BATCH_SIZE      64
+
+/* The UMEM and the XDP program, shared by all queues of a netdev */
+typedef struct AFXDPUmem {
+    struct xsk_umem *umem;
+    /* Fill and completion rings created with the UMEM, used by queue 0 */
+    struct xsk_ring_prod fq;
+    struct xsk_ring_cons cq;
+    void *buffer;
+    size_t size;
+    unsigned int refcnt;
+    int ifindex;
+    uint32_t xdp_flags;
+    /* The XDP program loaded by this netdev, 0 if it reused another one */
+    uint32_t xdp_prog_id;
+} AFXDPUmem;
+
+typedef struct AFXDPState {
+    NetClientState       nc;
+    AFXDPUmem            *umem;
+    struct xsk_socket    *xsk;
+    struct xsk_ring_cons rx;
+    struct xsk_ring_prod tx;
+    struct xsk_ring_cons *cq;
+    struct xsk_ring_prod *fq;
+    struct xsk_ring_cons cq_ring;
+    struct xsk_ring_prod fq_ring;
+    int                  fd;
+    uint32_t             nic_queue;
+    bool                 read_poll;
+    bool                 write_poll;
+    bool                 busy_poll;
+    uint32_t             outstanding_tx;
+    /* Frames of this queue's slice that the kernel doesn't own */
+    uint64_t             *pool;
+    uint32_t             n_pool;
+    AioContext           *ctx;        /* NULL when serviced by the main loop */
+} AFXDPState;
+
+static void af_xdp_send(void *opaque);
+static void af_xdp_writable(void *opaque);
+static bool af_xdp_poll_cb(void *opaque);
+
+static void af_xdp_update_fd_handler(AFXDPState *s)
+{
+    IOHandler *fd_read = s->read_poll ? af_xdp_send : NULL;
+    IOHandler *fd_write = s->write_poll ? af_xdp_writable : NULL;
+
+    if (s->ctx) {
+        aio_set_fd_handler(s->ctx, s->fd, false, fd_read, fd_write,
+                           fd_read || fd_write ? af_xdp_poll_cb : NULL, s);
+    } else {
+        qemu_set_fd_handler(s->fd, fd_read, fd_write, s);
+    }
+}
+
+static void af_xdp_read_poll(AFXDPState *s, bool enable)
+{
+    if (s->read_poll != enable) {
+        s->read_poll = enable;
+        af_xdp_update_fd_handler(s);
+    }
+}
+
+static void af_xdp_write_poll(AFXDPState *s, bool enable)
+{
+    if (s->write_poll != enable) {
+        s->write_poll = enable;
+        af_xdp_update_fd_handler(s);
+    }
+}
+
+static void af_xdp_poll(NetClientState *nc, bool enable)
+{
+    AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+
+    if (s->read_poll != enable || s->write_poll != enable) {
+        s->read_poll = enable;
+        s->write_poll = enable;
+        af_xdp_update_fd_handler(s);
+    }
+}
+
+/* Acquire the context servicing @s, false if it moved meanwhile */
+static bool af_xdp_lock(AFXDPState *s, AioContext *ctx)
+{
+    if (ctx) {
+        aio_context_acquire(ctx);
+        if (s->ctx != ctx) {
+            aio_context_release(ctx);
+            return false;
+        }
+    }
+    return true;
+}
+
+static void af_xdp_unlock(AioContext *ctx)
+{
+    if (ctx) {
+        aio_context_release(ctx);
+    }
+}
+
+/* Kick the kernel, needed when it asks for it or to drive busy polling */
+static void af_xdp_kick_tx(AFXDPState *s)
+{
+    if (s->busy_poll || xsk_ring_prod__needs_wakeup(&s->tx)) {
+        sendto(s->fd, NULL, 0, MSG_DONTWAIT, NULL, 0);
+    }
+}
+
+static void af_xdp_kick_rx(AFXDPState *s)
+{
+    if (s->busy_poll || xsk_ring_prod__needs_wakeup(s->fq)) {
+        recvfrom(s->fd, NULL, 0, MSG_DONTWAIT, NULL, NULL);
+    }
+}
+
+static void af_xdp_fq_refill(AFXDPState *s)
+{
+    uint32_t i, n, idx = 0;
+
+    n = MIN(s->n_pool, xsk_prod_nb_free(s->fq, AF_XDP_RING_SIZE));
+    if (!n || xsk_ring_prod__reserve(s->fq, n, &idx) != n) {
+        return;
+    }
+    for (i = 0; i < n; i++) {
+        *xsk_ring_prod__fill_addr(s->fq, idx + i) = s->pool[--s->n_pool];
+    }
+    xsk_ring_prod__submit(s->fq, n);
+    af_xdp_kick_rx(s);
+}
+
+/* Take back the frames of completed transmissions */
+static uint32_t af_xdp_complete_tx(AFXDPState *s)
+{
+    uint32_t i, n, idx = 0;
+
+    if (!s->outstanding_tx) {
+        return 0;
+    }
+    n = xsk_ring_cons__peek(s->cq, AF_XDP_RING_SIZE, &idx);
+    for (i = 0; i < n; i++) {
+        s->pool[s->n_pool++] = *xsk_ring_cons__comp_addr(s->cq, idx + i);
+    }
+    xsk_ring_cons__release(s->cq, n);
+    s->outstanding_tx -= n;
+    return n;
+}
+
+/*
+ * Queue a batch of packets on the TX ring, copying them into frames of
+ * our slice.  Returns the number queued, 0 if the ring or the pool is
+ * exhausted.
+ */
+static int af_xdp_tx_batch(AFXDPState *s, const NetBatchPacket *pkts,
+                           int count)
+{
+    uint32_t i, n, valid = 0, idx = 0;
+
+    af_xdp_complete_tx(s);
+
+    /* Packets larger than a frame can't be sent, they are dropped */
+    n = MIN(count, AF_XDP_BATCH_SIZE);
+    for (i = 0; i < n; i++) {
+        if (iov_size(pkts[i].iov, pkts[i].iovcnt) <= AF_XDP_FRAME_SIZE) {
+            if (valid == s->n_pool) {
+                break;
+            }
+            valid++;
+        }
+    }
+    n = i;
+    if (!n ||
+        (valid && xsk_ring_prod__reserve(&s->tx, valid, &idx) != valid)) {
+        af_xdp_kick_tx(s);
+        af_xdp_write_poll(s, true);
+        return 0;
+    }
+
+    for (i = 0; i < n; i++) {
+        struct xdp_desc *desc;
+        uint64_t addr;
+
+        if (iov_size(pkts[i].iov, pkts[i].iovcnt) > AF_XDP_FRAME_SIZE) {
+            continue;
+        }
+        desc = xsk_ring_prod__tx_desc(&s->tx, idx++);
+        addr = s->pool[--s->n_pool];
+        desc->addr = addr;
+        desc->len = iov_to_buf(pkts[i].iov, pkts[i].iovcnt, 0,
+                               xsk_umem__get_data(s->umem->buffer, addr),
+                               AF_XDP_FRAME_SIZE);
+    }
+    if (valid) {
+        xsk_ring_prod__submit(&s->tx, valid);
+        s->outstanding_tx += valid;
+        af_xdp_kick_tx(s);
+    }
+
+    return n;
+}
+
+static int af_xdp_receive_batch(NetClientState *nc,
+                                const NetBatchPacket *pkts, int count)
+{
+    AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+    int done = 0, ret;
+
+    while (done < count) {
+        ret = af_xdp_tx_batch(s, pkts + done, count - done);
+        if (!ret) {
+            break;
+        }
+        done += ret;
+    }
+    return done;
+}
+
+static ssize_t af_xdp_receive_iov(NetClientState *nc,
+                                  const struct iovec *iov, int iovcnt)
+{
+    AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+    NetBatchPacket pkt = { .iov = iov, .iovcnt = iovcnt };
+
+    if (!af_xdp_tx_batch(s, &pkt, 1)) {
+        return 0;
+    }
+    return iov_size(iov, iovcnt);
+}
+
+static ssize_t af_xdp_receive(NetClientState *nc,
+                              const uint8_t *buf, size_t size)
+{
+    struct iovec iov = {
+        .iov_base = (void *)buf,
+        .iov_len = size,
+    };
+
+    return af_xdp_receive_iov(nc, &iov, 1);
+}
+
+static void af_xdp_send_completed(NetClientState *nc, ssize_t len)
+{
+    AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+
+    af_xdp_read_poll(s, true);
+}
+
+/* Pass the packets on the RX ring to the peer, returns how many */
+static uint32_t af_xdp_rx_batch(AFXDPState *s)
+{
+    uint32_t i, n, idx = 0;
+    bool stop = false;
+
+    n = xsk_ring_cons__peek(&s->rx, AF_XDP_BATCH_SIZE, &idx);
+    if (!n) {
+        af_xdp_kick_rx(s);
+        return 0;
+    }
+
+    /* Whatever the peer can't take now is queued, so deliver everything */
+    for (i = 0; i < n; i++) {
+        const struct xdp_desc *desc = xsk_ring_cons__rx_desc(&s->rx, idx + i);
+        uint64_t addr = desc->addr;
+
+        if (qemu_send_packet_async(&s->nc,
+                                   xsk_umem__get_data(s->umem->buffer,
+                                                      desc->addr),
+                                   desc->len, af_xdp_send_completed) == 0) {
+            stop = true;
+        }
+        s->pool[s->n_pool++] = addr - addr % AF_XDP_FRAME_SIZE;
+    }
+    xsk_ring_cons__release(&s->rx, n);
+    af_xdp_fq_refill(s);
+
+    if (stop) {
+        af_xdp_read_poll(s, false);
+    }
+    return n;
+}
+
+static void af_xdp_send(void *opaque)
+{
+    AFXDPState *s = opaque;
+    AioContext *ctx = s->ctx;
+
+    if (!af_xdp_lock(s, ctx)) {
+        return;
+    }
+    while (s->read_poll && af_xdp_rx_batch(s) == AF_XDP_BATCH_SIZE) {
+        /* keep going while the ring had a full batch */
+    }
+    af_xdp_unlock(ctx);
+}
+
+static void af_xdp_writable(void *opaque)
+{
+    AFXDPState *s = opaque;
+    AioContext *ctx = s->ctx;
+
+    if (!af_xdp_lock(s, ctx)) {
+        return;
+    }
+    af_xdp_complete_tx(s);
+    af_xdp_write_poll(s, false);
+    qemu_flush_queued_packets(&s->nc);
+    af_xdp_unlock(ctx);
+}
+
+/*
+ * Busy polling from the iothread: service both rings without waiting for
+ * the fd to become ready.  With busy-poll-budget the kicks also make the
+ * kernel poll the NIC queue from this thread.
+ */
+static bool af_xdp_poll_cb(void *opaque)
+{
+    AFXDPState *s = opaque;
+    AioContext *ctx = s->ctx;
+    bool progress = false;
+
+    if (!af_xdp_lock(s, ctx)) {
+        return false;
+    }
+    if (s->write_poll && af_xdp_complete_tx(s)) {
+        af_xdp_write_poll(s, false);
+        qemu_flush_queued_packets(&s->nc);
+        progress = true;
+    }
+    if (s->read_poll && af_xdp_rx_batch(s)) {
+        progress = true;
+    }
+    af_xdp_unlock(ctx);
+
+    return progress;
+}
+
+static void af_xdp_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+
+    if (s->ctx == ctx) {
+        return;
+    }
+
+    /* Detach from the current context before attaching to the new one */
+    if (s->ctx) {
+        aio_set_fd_handler(s->ctx, s->fd, false, NULL, NULL, NULL, NULL);
+    } else {
+        qemu_set_fd_handler(s->fd, NULL, NULL, NULL);
+    }
+    s->ctx = ctx;
+    af_xdp_update_fd_handler(s);
+}
+
+static void af_xdp_umem_unref(AFXDPUmem *umem)
+{
+    if (--umem->refcnt) {
+        return;
+    }
+    if (umem->umem) {
+        xsk_umem__delete(umem->umem);
+    }
+    if (umem->xdp_prog_id) {
+        uint32_t prog_id = 0;
+
+        /* Leave it alone if somebody replaced it in the meantime */
+        if (!bpf_get_link_xdp_id(umem->ifindex, &prog_id, umem->xdp_flags) &&
+            prog_id == umem->xdp_prog_id) {
+            bpf_set_link_xdp_fd(umem->ifindex, -1, umem->xdp_flags);
+        }
+    }
+    qemu_vfree(umem->buffer);
+    g_free(umem);
+}
+
+static void af_xdp_cleanup(NetClientState *nc)
+{
+    AFXDPState *s = DO_UPCAST(AFXDPState, nc, nc);
+    AioContext *ctx = s->ctx;
+
+    if (ctx) {
+        aio_context_acquire(ctx);
+    }
+
+    qemu_purge_queued_packets(nc);
+
+    if (s->xsk) {
+        af_xdp_poll(nc, false);
+        xsk_socket__delete(s->xsk);
+        s->xsk = NULL;
+    }
+    s->ctx = NULL;
+
+    if (ctx) {
+        aio_context_release(ctx);
+    }
+
+    g_free(s->pool);
+    s->pool = NULL;
+    af_xdp_umem_unref(s->umem);
+}
+
+static NetClientInfo net_af_xdp_info = {
+    .type = NET_CLIENT_DRIVER_AF_XDP,
+    .size = sizeof(AFXDPState),
+    .receive = af_xdp_receive,
+    .receive_iov = af_xdp_receive_iov,
+    .receive_batch = af_xdp_receive_batch,
+    .poll = af_xdp_poll,
+    .cleanup = af_xdp_cleanup,
+    .set_aio_context = af_xdp_set_aio_context,
+};
+
+static int af_xdp_socket_create(AFXDPState *s, const char *ifname,
+                                uint32_t xdp_flags, uint16_t bind_flags,
+                                Error **errp)
+{
+    struct xsk_socket_config cfg = {
+        .rx_size = AF_XDP_RING_SIZE,
+        .tx_size = AF_XDP_RING_SIZE,
+        .xdp_flags = xdp_flags,
+        .bind_flags = bind_flags | XDP_USE_NEED_WAKEUP,
+    };
+    int ret;
+
+    ret = xsk_socket__create_shared(&s->xsk, ifname, s->nic_queue,
+                                    s->umem->umem, &s->rx, &s->tx,
+                                    s->fq, s->cq, &cfg);
+    if (ret) {
+        error_setg_errno(errp, -ret,
+                         "failed to create AF_XDP socket on %s queue %u",
+                         ifname, s->nic_queue);
+        return -1;
+    }
+    s->fd = xsk_socket__fd(s->xsk);
+    return 0;
+}
+
+static int af_xdp_set_busy_poll(AFXDPState *s, int64_t budget, Error **errp)
+{
+#ifdef SO_PREFER_BUSY_POLL
+    int value = 1;
+
+    if (setsockopt(s->fd, SOL_SOCKET, SO_PREFER_BUSY_POLL,
+                   &value, sizeof(value)) < 0) {
+        goto fail;
+    }
+    value = 20; /* usecs */
+    if (setsockopt(s->fd, SOL_SOCKET, SO_BUSY_POLL,
+                   &value, sizeof(value)) < 0) {
+        goto fail;
+    }
+    value = budget;
+    if (setsockopt(s->fd, SOL_SOCKET, SO_BUSY_POLL_BUDGET,
+                   &value, sizeof(value)) < 0) {
+        goto fail;
+    }
+    s->busy_poll = true;
+    return 0;
+
+fail:
+    error_setg_errno(errp, errno, "failed to enable busy polling");
+    return -1;
+#else
+    error_setg(errp, "busy polling is not supported by this host");
+    return -1;
+#endif
+}
+
+/* The exported init function
+ *
+ * ... -netdev af-xdp,ifname="..."
+ */
+int net_init_af_xdp(const Netdev *netdev,
+                    const char *name, NetClientState *peer, Error **errp)
+{
+    const NetdevAFXDPOptions *opts = &netdev->u.af_xdp;
+    struct xsk_umem_config umem_cfg = {
+        .fill_size = AF_XDP_RING_SIZE,
+        .comp_size = AF_XDP_RING_SIZE,
+        .frame_size = AF_XDP_FRAME_SIZE,
+        .frame_headroom = 0,
+    };
+    AFXDPState **states;
+    AFXDPUmem *umem;
+    uint16_t bind_flags = opts->has_force_copy && opts->force_copy ?
+                          XDP_COPY : 0;
+    int64_t queues = opts->has_queues ? opts->queues : 1;
+    int64_t start_queue = opts->has_start_queue ? opts->start_queue : 0;
+    uint32_t xdp_flags, prog_id = 0;
+    int64_t i;
+    int ret;
+
+    if (queues < 1 || queues > MAX_QUEUE_NUM) {
+        error_setg(errp, "invalid number of queues (%" PRId64 ") for '%s'",
+                   queues, opts->ifname);
+        return -1;
+    }
+    if (start_queue < 0 || start_queue + queues > UINT32_MAX) {
+        error_setg(errp, "invalid start-queue (%" PRId64 ")", start_queue);
+        return -1;
+    }
+    if (opts->has_busy_poll_budget &&
+        (opts->busy_poll_budget < 0 || opts->busy_poll_budget > INT_MAX)) {
+        error_setg(errp, "invalid busy-poll-budget (%" PRId64 ")",
+                   opts->busy_poll_budget);
+        return -1;
+    }
+
+    umem = g_new0(AFXDPUmem, 1);
+    umem->ifindex = if_nametoindex(opts->ifname);
+    if (!umem->ifindex) {
+        error_setg_errno(errp, errno, "failed to get ifindex for '%s'",
+                         opts->ifname);
+        g_free(umem);
+        return -1;
+    }
+    umem->size = queues * AF_XDP_QUEUE_FRAMES * AF_XDP_FRAME_SIZE;
+    umem->buffer = qemu_try_memalign(qemu_real_host_page_size, umem->size);
+    if (!umem->buffer) {
+        error_setg(errp, "failed to allocate %zu bytes of UMEM", umem->size);
+        g_free(umem);
+        return -1;
+    }
+
+    states = g_new0(AFXDPState *, queues);
+    for (i = 0; i < queues; i++) {
+        NetClientState *nc;
+        AFXDPState *s;
+        uint32_t j;
+
+        nc = qemu_new_net_client(&net_af_xdp_info, peer, "af-xdp", name);
+        s = DO_UPCAST(AFXDPState, nc, nc);
+        s->umem = umem;
+        s->fd = -1;
+        s->nic_queue = start_queue + i;
+        s->fq = i ? &s->fq_ring : &umem->fq;
+        s->cq = i ? &s->cq_ring : &umem->cq;
+        umem->refcnt++;
+
+        /* This queue's slice of the UMEM */
+        s->pool = g_new(uint64_t, AF_XDP_QUEUE_FRAMES);
+        for (j = 0; j < AF_XDP_QUEUE_FRAMES; j++) {
+            s->pool[j] = ((uint64_t)i * AF_XDP_QUEUE_FRAMES + j) *
+                         AF_XDP_FRAME_SIZE;
+        }
+        s->n_pool = AF_XDP_QUEUE_FRAMES;
+
+        snprintf(nc->info_str, sizeof(nc->info_str),
+                 "af-xdp: ifname=%s queue=%u", opts->ifname, s->nic_queue);
+        states[i] = s;
+    }
+
+    /* The first queue uses the fill and completion rings of the UMEM */
+    ret = xsk_umem__create(&umem->umem, umem->buffer, umem->size,
+                           &umem->fq, &umem->cq, &umem_cfg);
+    if (ret) {
+        error_setg_errno(errp, -ret, "failed to create UMEM for '%s'",
+                         opts->ifname);
+        goto err;
+    }
+
+    /*
+     * libbpf only loads its XDP program if the interface has none, and
+     * otherwise uses the one that is there.  Only detach the program on
+     * cleanup if it is ours.
+     */
+    ret = bpf_get_link_xdp_id(umem->ifindex, &prog_id, 0);
+    if (ret) {
+        error_setg_errno(errp, -ret, "failed to query XDP program of '%s'",
+                         opts->ifname);
+        goto err;
+    }
+
+    if (opts->has_mode) {
+        xdp_flags = opts->mode == AFXDP_MODE_NATIVE ?
+                    XDP_FLAGS_DRV_MODE : XDP_FLAGS_SKB_MODE;
+    } else {
+        xdp_flags = XDP_FLAGS_DRV_MODE;
+    }
+
+    for (i = 0; i < queues; i++) {
+        AFXDPState *s = states[i];
+        Error *err = NULL;
+
+        ret = af_xdp_socket_create(s, opts->ifname,
+                                   xdp_flags | XDP_FLAGS_UPDATE_IF_NOEXIST,
+                                   bind_flags, &err);
+        if (ret && !i && !opts->has_mode) {
+            /* No native XDP in the driver, fall back to generic XDP */
+            warn_report_err(err);
+            err = NULL;
+            xdp_flags = XDP_FLAGS_SKB_MODE;
+            ret = af_xdp_socket_create(s, opts->ifname,
+                                       xdp_flags | XDP_FLAGS_UPDATE_IF_NOEXIST,
+                                       bind_flags, &err);
+        }
+        if (ret) {
+            error_propagate(errp, err);
+            goto err;
+        }
+        if (!i && !prog_id) {
+            /* The program was loaded along with the first socket */
+            umem->xdp_flags = xdp_flags;
+            ret = bpf_get_link_xdp_id(umem->ifindex, &umem->xdp_prog_id,
+                                      xdp_flags);
+            if (ret) {
+                error_setg_errno(errp, -ret,
+                                 "failed to query XDP program of '%s'",
+                                 opts->ifname);
+                goto err;
+            }
+        }
+
+        if (opts->has_busy_poll_budget && opts->busy_poll_budget &&
+            af_xdp_set_busy_poll(s, opts->busy_poll_budget, errp) < 0) {
+            goto err;
+        }
+
+        af_xdp_fq_refill(s);
+        af_xdp_read_poll(s, true);
+    }
+
+    g_free(states);
+    return 0;
+
+err:
+    qemu_del_net_client(&states[0]->nc);
+    g_free(states);
+    return -1;
+}
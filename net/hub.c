@@ -76,6 +76,25 @@ static ssize_t net_hub_receive_iov(NetHub *hub, NetHubPort *source_port,
     return len;
 }
 
+static int net_hub_receive_batch(NetHub *hub, NetHubPort *source_port,
+                                 const NetBatchPacket *pkts, int count)
+{
+    NetHubPort *port;
+    int i, sent;
+
+    QLIST_FOREACH(port, &hub->ports, next) {
+        if (port == source_port) {
+            continue;
+        }
+
+        sent = qemu_sendv_packet_batch(&port->nc, pkts, count);
+        for (i = sent; i < count; i++) {
+            qemu_sendv_packet(&port->nc, pkts[i].iov, pkts[i].iovcnt);
+        }
+    }
+    return count;
+}
+
 static NetHub *net_hub_new(int id)
 {
     NetHub *hub;
@@ -125,6 +144,14 @@ static ssize_t net_hub_port_receive_iov(NetClientState *nc,
     return net_hub_receive_iov(port->hub, port, iov, iovcnt);
 }
 
+static int net_hub_port_receive_batch(NetClientState *nc,
+                                      const NetBatchPacket *pkts, int count)
+{
+    NetHubPort *port = DO_UPCAST(NetHubPort, nc, nc);
+
+    return net_hub_receive_batch(port->hub, port, pkts, count);
+}
+
 static void net_hub_port_cleanup(NetClientState *nc)
 {
     NetHubPort *port = DO_UPCAST(NetHubPort, nc, nc);
@@ -138,6 +165,7 @@ static NetClientInfo net_hub_port_info = {
     .can_receive = net_hub_port_can_receive,
     .receive = net_hub_port_receive,
     .receive_iov = net_hub_port_receive_iov,
+    .receive_batch = net_hub_port_receive_batch,
     .cleanup = net_hub_port_cleanup,
 };
 
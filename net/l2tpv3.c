@@ -69,6 +69,14 @@ typedef struct NetL2TPV3State {
     uint8_t *header_buf;
     struct iovec *vec;
 
+    /*
+     * batched xmit - one header per message, each message gets its
+     * iovecs from vec
+     */
+
+    uint8_t *batch_header_buf;
+    struct mmsghdr *batch_msgvec;
+
     /*
      * these are used for receive - try to "eat" up to 32 packets at a time
      */
@@ -213,6 +221,18 @@ static void l2tpv3_form_header(NetL2TPV3State *s)
     }
 }
 
+/*
+ * Give back the counter values of @count headers that were formed for
+ * packets that could not be sent: they are formed again when the peer
+ * retries, and the sequence must not have a hole for them.
+ */
+static void l2tpv3_unform_headers(NetL2TPV3State *s, int count)
+{
+    if (s->has_counter && !s->pin_counter) {
+        s->counter -= count;
+    }
+}
+
 static ssize_t net_l2tpv3_receive_dgram_iov(NetClientState *nc,
                     const struct iovec *iov,
                     int iovcnt)
@@ -254,6 +274,7 @@ static ssize_t net_l2tpv3_receive_dgram_iov(NetClientState *nc,
         /* signal upper layer that socket buffer is full */
         ret = -errno;
         if (ret == -EAGAIN || ret == -ENOBUFS) {
+            l2tpv3_unform_headers(s, 1);
             l2tpv3_write_poll(s, true);
             ret = 0;
         }
@@ -299,6 +320,7 @@ static ssize_t net_l2tpv3_receive_dgram(NetClientState *nc,
         ret = -errno;
         if (ret == -EAGAIN || ret == -ENOBUFS) {
             /* signal upper layer that socket buffer is full */
+            l2tpv3_unform_headers(s, 1);
             l2tpv3_write_poll(s, true);
             ret = 0;
         }
@@ -306,6 +328,77 @@ static ssize_t net_l2tpv3_receive_dgram(NetClientState *nc,
     return ret;
 }
 
+static int net_l2tpv3_receive_batch(NetClientState *nc,
+                                    const NetBatchPacket *pkts, int count)
+{
+    NetL2TPV3State *s = DO_UPCAST(NetL2TPV3State, nc, nc);
+    int done = 0;
+
+    while (done < count) {
+        struct iovec *vec = s->vec;
+        int msgcnt = 0, iovused = 0;
+        int ret, i;
+
+        /* Fill as many messages as the header and iovec arrays allow */
+        while (done + msgcnt < count && msgcnt < MAX_L2TPV3_MSGCNT) {
+            const NetBatchPacket *pkt = &pkts[done + msgcnt];
+            struct mmsghdr *msg = &s->batch_msgvec[msgcnt];
+            uint8_t *header = s->batch_header_buf + msgcnt * s->header_size;
+
+            if (pkt->iovcnt > MAX_L2TPV3_IOVCNT - 1) {
+                if (!msgcnt) {
+                    /* let the per-packet path report it */
+                    return done;
+                }
+                break;
+            }
+            if (iovused + pkt->iovcnt + 1 > MAX_L2TPV3_IOVCNT) {
+                break;
+            }
+
+            l2tpv3_form_header(s);
+            memcpy(header, s->header_buf, s->offset);
+            vec[iovused].iov_base = header;
+            vec[iovused].iov_len = s->offset;
+            memcpy(vec + iovused + 1, pkt->iov,
+                   pkt->iovcnt * sizeof(struct iovec));
+
+            msg->msg_hdr.msg_name = s->dgram_dst;
+            msg->msg_hdr.msg_namelen = s->dst_size;
+            msg->msg_hdr.msg_iov = vec + iovused;
+            msg->msg_hdr.msg_iovlen = pkt->iovcnt + 1;
+            msg->msg_hdr.msg_control = NULL;
+            msg->msg_hdr.msg_controllen = 0;
+            msg->msg_hdr.msg_flags = 0;
+            msg->msg_len = 0;
+
+            iovused += pkt->iovcnt + 1;
+            msgcnt++;
+        }
+
+        for (i = 0; i < msgcnt; ) {
+            ret = sendmmsg(s->fd, s->batch_msgvec + i, msgcnt - i, 0);
+            if (ret > 0) {
+                i += ret;
+                continue;
+            }
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ret < 0 && (errno == EAGAIN || errno == ENOBUFS)) {
+                /* signal upper layer that socket buffer is full */
+                l2tpv3_unform_headers(s, msgcnt - i);
+                l2tpv3_write_poll(s, true);
+                return done + i;
+            }
+            /* the message at i is lost, same as a failed sendmsg() */
+            i++;
+        }
+        done += msgcnt;
+    }
+    return done;
+}
+
 static int l2tpv3_verify_header(NetL2TPV3State *s, uint8_t *buf)
 {
 
@@ -512,6 +605,8 @@ static void net_l2tpv3_cleanup(NetClientState *nc)
     destroy_vector(s->msgvec, MAX_L2TPV3_MSGCNT, IOVSIZE);
     g_free(s->vec);
     g_free(s->header_buf);
+    g_free(s->batch_msgvec);
+    g_free(s->batch_header_buf);
     g_free(s->dgram_dst);
 }
 
@@ -520,6 +615,7 @@ static NetClientInfo net_l2tpv3_info = {
     .size = sizeof(NetL2TPV3State),
     .receive = net_l2tpv3_receive_dgram,
     .receive_iov = net_l2tpv3_receive_dgram_iov,
+    .receive_batch = net_l2tpv3_receive_batch,
     .poll = l2tpv3_poll,
     .cleanup = net_l2tpv3_cleanup,
 };
@@ -718,6 +814,8 @@ int net_init_l2tpv3(const Netdev *netdev,
     s->msgvec = build_l2tpv3_vector(s, MAX_L2TPV3_MSGCNT);
     s->vec = g_new(struct iovec, MAX_L2TPV3_IOVCNT);
     s->header_buf = g_malloc(s->header_size);
+    s->batch_msgvec = g_new0(struct mmsghdr, MAX_L2TPV3_MSGCNT);
+    s->batch_header_buf = g_malloc(s->header_size * MAX_L2TPV3_MSGCNT);
 
     qemu_set_nonblock(fd);
 
@@ -523,6 +523,21 @@ int qemu_set_vnet_be(NetClientState *nc, bool is_be)
 #endif
 }
 
+/*
+ * Move the backend's I/O handlers to @ctx, or back to the main loop if
+ * @ctx is NULL.  Once moved, the backend's receive path is only called
+ * with @ctx held.
+ */
+int qemu_net_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    if (!nc || !nc->info->set_aio_context) {
+        return -ENOSYS;
+    }
+
+    nc->info->set_aio_context(nc, ctx);
+    return 0;
+}
+
 int qemu_can_send_packet(NetClientState *sender)
 {
     int vm_running = runstate_is_running();
@@ -784,6 +799,43 @@ qemu_sendv_packet(NetClientState *nc, const struct iovec *iov, int iovcnt)
     return qemu_sendv_packet_async(nc, iov, iovcnt, NULL);
 }
 
+/*
+ * Hand a batch of packets to the peer's receive_batch in one call.  This
+ * only happens when nothing has to see the packets one by one: no
+ * filters, nothing queued, and a peer ready to receive.  Returns how
+ * many packets were consumed.  The caller sends the rest with
+ * qemu_sendv_packet_async(), which takes care of queueing.
+ */
+int qemu_sendv_packet_batch(NetClientState *sender,
+                            const NetBatchPacket *pkts, int count)
+{
+    NetClientState *peer = sender->peer;
+    int i;
+
+    if (sender->link_down || !peer) {
+        return count;
+    }
+
+    if (!peer->info->receive_batch || peer->link_down ||
+        !QTAILQ_EMPTY(&sender->filters) || !QTAILQ_EMPTY(&peer->filters) ||
+        !qemu_net_queue_idle(peer->incoming_queue) ||
+        !qemu_can_send_packet(sender)) {
+        return 0;
+    }
+
+    /* Oversized packets are dropped by qemu_sendv_packet_async() */
+    for (i = 0; i < count; i++) {
+        if (iov_size(pkts[i].iov, pkts[i].iovcnt) > NET_BUFSIZE) {
+            break;
+        }
+    }
+    if (!i) {
+        return 0;
+    }
+
+    return peer->info->receive_batch(peer, pkts, i);
+}
+
 NetClientState *qemu_find_netdev(const char *id)
 {
     NetClientState *nc;
@@ -959,6 +1011,9 @@ static int (* const net_client_init_fun[NET_CLIENT_DRIVER__MAX])(
 #ifdef CONFIG_NETMAP
         [NET_CLIENT_DRIVER_NETMAP]    = net_init_netmap,
 #endif
+#ifdef CONFIG_AF_XDP
+        [NET_CLIENT_DRIVER_AF_XDP]    = net_init_af_xdp,
+#endif
 #ifdef CONFIG_NET_BRIDGE
         [NET_CLIENT_DRIVER_BRIDGE]    = net_init_bridge,
 #endif
@@ -1047,6 +1102,9 @@ static void show_netdevs(void)
 #ifdef CONFIG_NETMAP
         "netmap",
 #endif
+#ifdef CONFIG_AF_XDP
+        "af-xdp",
+#endif
 #ifdef CONFIG_POSIX
         "vhost-user",
 #endif
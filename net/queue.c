@@ -248,6 +248,12 @@ void qemu_net_queue_purge(NetQueue *queue, NetClientState *from)
     }
 }
 
+/* Nothing queued or being delivered, so packets may bypass @queue */
+bool qemu_net_queue_idle(NetQueue *queue)
+{
+    return !queue->delivering && QTAILQ_EMPTY(&queue->packets);
+}
+
 bool qemu_net_queue_flush(NetQueue *queue)
 {
     if (queue->delivering)
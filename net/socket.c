@@ -33,6 +33,24 @@
 #include "qemu/sockets.h"
 #include "qemu/iov.h"
 #include "qemu/main-loop.h"
+#ifdef CONFIG_SENDMMSG
+#include <netinet/udp.h>
+
+/* Packets handed to one sendmmsg() call, and datagrams per recvmmsg() */
+#define NET_SOCKET_TX_BATCH 64
+#define NET_SOCKET_RX_BATCH 8
+
+#ifdef UDP_SEGMENT
+/* Kernel limits for one UDP_SEGMENT send */
+#define NET_SOCKET_GSO_MAX_SEGS 64
+#define NET_SOCKET_GSO_MAX_SIZE 65507
+#endif
+
+typedef union NetSocketCmsg {
+    char buf[CMSG_SPACE(sizeof(uint16_t))];
+    struct cmsghdr align;
+} NetSocketCmsg;
+#endif
 
 typedef struct NetSocketState {
     NetClientState nc;
@@ -44,6 +62,14 @@ typedef struct NetSocketState {
     IOHandler *send_fn;           /* differs between SOCK_STREAM/SOCK_DGRAM */
     bool read_poll;               /* waiting to receive data? */
     bool write_poll;              /* waiting to transmit data? */
+#ifdef CONFIG_SENDMMSG
+    bool udp_gso;                 /* try UDP_SEGMENT for equal sized runs */
+    struct mmsghdr *msgvec;       /* batched xmit/recv (only SOCK_DGRAM) */
+    NetSocketCmsg *cmsgs;
+    struct iovec *batch_iov;
+    int batch_iov_len;
+    uint8_t *rx_bufs;
+#endif
 } NetSocketState;
 
 static void net_socket_accept(void *opaque);
@@ -193,11 +219,184 @@ static void net_socket_send(void *opaque)
     }
 }
 
+#ifdef CONFIG_SENDMMSG
+static int net_socket_receive_batch_dgram(NetClientState *nc,
+                                          const NetBatchPacket *pkts,
+                                          int count)
+{
+    NetSocketState *s = DO_UPCAST(NetSocketState, nc, nc);
+    int done = 0;
+
+    while (done < count) {
+        int msgpkts[NET_SOCKET_TX_BATCH];
+        int npkts = MIN(count - done, NET_SOCKET_TX_BATCH);
+        int msgcnt = 0, iovused = 0, sent = 0, niov = 0;
+        int i, ret;
+
+        for (i = 0; i < npkts; i++) {
+            niov += pkts[done + i].iovcnt;
+        }
+        if (niov > s->batch_iov_len) {
+            s->batch_iov = g_renew(struct iovec, s->batch_iov, niov);
+            s->batch_iov_len = niov;
+        }
+
+        for (i = 0; i < npkts; msgcnt++) {
+            struct mmsghdr *msg = &s->msgvec[msgcnt];
+            const NetBatchPacket *pkt = &pkts[done + i];
+            size_t seg = iov_size(pkt->iov, pkt->iovcnt);
+            int segs = 1;
+
+            msg->msg_hdr.msg_iov = s->batch_iov + iovused;
+            msg->msg_hdr.msg_iovlen = pkt->iovcnt;
+            memcpy(s->batch_iov + iovused, pkt->iov,
+                   pkt->iovcnt * sizeof(struct iovec));
+            iovused += pkt->iovcnt;
+            i++;
+
+#ifdef UDP_SEGMENT
+            /*
+             * Coalesce a run of equally sized packets into one send, the
+             * kernel cuts it back into datagrams of @seg bytes.  Only the
+             * last one may be shorter.
+             */
+            if (s->udp_gso && seg) {
+                size_t total = seg;
+
+                while (i < npkts && segs < NET_SOCKET_GSO_MAX_SEGS) {
+                    const NetBatchPacket *next = &pkts[done + i];
+                    size_t len = iov_size(next->iov, next->iovcnt);
+
+                    if (!len || len > seg ||
+                        total + len > NET_SOCKET_GSO_MAX_SIZE ||
+                        msg->msg_hdr.msg_iovlen + next->iovcnt > IOV_MAX) {
+                        break;
+                    }
+                    memcpy(s->batch_iov + iovused, next->iov,
+                           next->iovcnt * sizeof(struct iovec));
+                    iovused += next->iovcnt;
+                    msg->msg_hdr.msg_iovlen += next->iovcnt;
+                    total += len;
+                    segs++;
+                    i++;
+                    if (len < seg) {
+                        break;
+                    }
+                }
+            }
+#endif
+
+            if (s->dgram_dst.sin_family != AF_UNIX) {
+                msg->msg_hdr.msg_name = &s->dgram_dst;
+                msg->msg_hdr.msg_namelen = sizeof(s->dgram_dst);
+            } else {
+                msg->msg_hdr.msg_name = NULL;
+                msg->msg_hdr.msg_namelen = 0;
+            }
+            msg->msg_hdr.msg_control = NULL;
+            msg->msg_hdr.msg_controllen = 0;
+            msg->msg_hdr.msg_flags = 0;
+            msg->msg_len = 0;
+#ifdef UDP_SEGMENT
+            if (segs > 1) {
+                struct cmsghdr *cm;
+
+                msg->msg_hdr.msg_control = s->cmsgs[msgcnt].buf;
+                msg->msg_hdr.msg_controllen = sizeof(s->cmsgs[msgcnt].buf);
+                cm = CMSG_FIRSTHDR(&msg->msg_hdr);
+                cm->cmsg_level = SOL_UDP;
+                cm->cmsg_type = UDP_SEGMENT;
+                cm->cmsg_len = CMSG_LEN(sizeof(uint16_t));
+                *(uint16_t *)CMSG_DATA(cm) = seg;
+            }
+#endif
+            msgpkts[msgcnt] = segs;
+        }
+
+        for (i = 0; i < msgcnt; ) {
+            ret = sendmmsg(s->fd, s->msgvec + i, msgcnt - i, 0);
+            if (ret > 0) {
+                while (ret--) {
+                    sent += msgpkts[i++];
+                }
+                continue;
+            }
+            if (ret < 0 && errno == EINTR) {
+                continue;
+            }
+            if (ret < 0 && errno == EAGAIN) {
+                net_socket_write_poll(s, true);
+                return done + sent;
+            }
+            if (ret < 0 && msgpkts[i] > 1 &&
+                (errno == EIO || errno == EINVAL ||
+                 errno == ENOPROTOOPT || errno == EOPNOTSUPP)) {
+                /* no GSO here (or not for this MTU), send one by one */
+                s->udp_gso = false;
+                return done + sent;
+            }
+            /* the datagram is lost, same as a failed sendto() */
+            sent += msgpkts[i++];
+        }
+        done += sent;
+    }
+    return done;
+}
+
+static void net_socket_send_dgram_batch(NetSocketState *s)
+{
+    bool stop = false;
+    int i, ret;
+
+    for (i = 0; i < NET_SOCKET_RX_BATCH; i++) {
+        struct mmsghdr *msg = &s->msgvec[i];
+
+        s->batch_iov[i].iov_base = s->rx_bufs + i * NET_BUFSIZE;
+        s->batch_iov[i].iov_len = NET_BUFSIZE;
+        memset(msg, 0, sizeof(*msg));
+        msg->msg_hdr.msg_iov = &s->batch_iov[i];
+        msg->msg_hdr.msg_iovlen = 1;
+    }
+
+    do {
+        ret = recvmmsg(s->fd, s->msgvec, NET_SOCKET_RX_BATCH, 0, NULL);
+    } while (ret == -1 && errno == EINTR);
+    if (ret < 0) {
+        return;
+    }
+    if (ret == 0 || s->msgvec[0].msg_len == 0) {
+        /* end of connection */
+        net_socket_read_poll(s, false);
+        net_socket_write_poll(s, false);
+        return;
+    }
+
+    /* Whatever the peer can't take now is queued, so deliver everything */
+    for (i = 0; i < ret; i++) {
+        if (qemu_send_packet_async(&s->nc, s->rx_bufs + i * NET_BUFSIZE,
+                                   s->msgvec[i].msg_len,
+                                   net_socket_send_completed) == 0) {
+            stop = true;
+        }
+    }
+    if (stop) {
+        net_socket_read_poll(s, false);
+    }
+}
+#endif
+
 static void net_socket_send_dgram(void *opaque)
 {
     NetSocketState *s = opaque;
     int size;
 
+#ifdef CONFIG_SENDMMSG
+    if (s->rx_bufs) {
+        net_socket_send_dgram_batch(s);
+        return;
+    }
+#endif
+
     size = qemu_recv(s->fd, s->rs.buf, sizeof(s->rs.buf), 0);
     if (size < 0)
         return;
@@ -320,12 +519,21 @@ static void net_socket_cleanup(NetClientState *nc)
         closesocket(s->listen_fd);
         s->listen_fd = -1;
     }
+#ifdef CONFIG_SENDMMSG
+    g_free(s->msgvec);
+    g_free(s->cmsgs);
+    g_free(s->batch_iov);
+    g_free(s->rx_bufs);
+#endif
 }
 
 static NetClientInfo net_dgram_socket_info = {
     .type = NET_CLIENT_DRIVER_SOCKET,
     .size = sizeof(NetSocketState),
     .receive = net_socket_receive_dgram,
+#ifdef CONFIG_SENDMMSG
+    .receive_batch = net_socket_receive_batch_dgram,
+#endif
     .cleanup = net_socket_cleanup,
 };
 
@@ -382,6 +590,14 @@ static NetSocketState *net_socket_fd_init_dgram(NetClientState *peer,
     s->fd = fd;
     s->listen_fd = -1;
     s->send_fn = net_socket_send_dgram;
+#ifdef CONFIG_SENDMMSG
+    s->msgvec = g_new0(struct mmsghdr, NET_SOCKET_TX_BATCH);
+    s->cmsgs = g_new0(NetSocketCmsg, NET_SOCKET_TX_BATCH);
+    s->batch_iov_len = NET_SOCKET_TX_BATCH;
+    s->batch_iov = g_new(struct iovec, s->batch_iov_len);
+    s->rx_bufs = g_malloc(NET_SOCKET_RX_BATCH * NET_BUFSIZE);
+    s->udp_gso = sa_type != SOCKET_ADDRESS_TYPE_UNIX;
+#endif
     net_socket_rs_init(&s->rs, net_socket_rs_finalize, false);
     net_socket_read_poll(s, true);
 
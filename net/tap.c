@@ -42,6 +42,7 @@
 #include "qemu/error-report.h"
 #include "qemu/main-loop.h"
 #include "qemu/sockets.h"
+#include "block/aio.h"
 
 #include "net/tap.h"
 
@@ -61,6 +62,7 @@ typedef struct TAPState {
     VHostNetState *vhost_net;
     unsigned host_vnet_hdr_len;
     Notifier exit;
+    AioContext *ctx;        /* NULL when serviced by the main loop */
 } TAPState;
 
 static void launch_script(const char *setup_script, const char *ifname,
@@ -71,10 +73,14 @@ static void tap_writable(void *opaque);
 
 static void tap_update_fd_handler(TAPState *s)
 {
-    qemu_set_fd_handler(s->fd,
-                        s->read_poll && s->enabled ? tap_send : NULL,
-                        s->write_poll && s->enabled ? tap_writable : NULL,
-                        s);
+    IOHandler *fd_read = s->read_poll && s->enabled ? tap_send : NULL;
+    IOHandler *fd_write = s->write_poll && s->enabled ? tap_writable : NULL;
+
+    if (s->ctx) {
+        aio_set_fd_handler(s->ctx, s->fd, false, fd_read, fd_write, NULL, s);
+    } else {
+        qemu_set_fd_handler(s->fd, fd_read, fd_write, s);
+    }
 }
 
 static void tap_read_poll(TAPState *s, bool enable)
@@ -92,10 +98,24 @@ static void tap_write_poll(TAPState *s, bool enable)
 static void tap_writable(void *opaque)
 {
     TAPState *s = opaque;
+    AioContext *ctx = s->ctx;
+
+    if (ctx) {
+        aio_context_acquire(ctx);
+        if (s->ctx != ctx) {
+            /* Moved to another context while we were waiting for the lock */
+            aio_context_release(ctx);
+            return;
+        }
+    }
 
     tap_write_poll(s, false);
 
     qemu_flush_queued_packets(&s->nc);
+
+    if (ctx) {
+        aio_context_release(ctx);
+    }
 }
 
 static ssize_t tap_write_packet(TAPState *s, const struct iovec *iov, int iovcnt)
@@ -184,9 +204,19 @@ static void tap_send_completed(NetClientState *nc, ssize_t len)
 static void tap_send(void *opaque)
 {
     TAPState *s = opaque;
+    AioContext *ctx = s->ctx;
     int size;
     int packets = 0;
 
+    if (ctx) {
+        aio_context_acquire(ctx);
+        if (s->ctx != ctx) {
+            /* Moved to another context while we were waiting for the lock */
+            aio_context_release(ctx);
+            return;
+        }
+    }
+
     while (true) {
         uint8_t *buf = s->buf;
 
@@ -219,6 +249,10 @@ static void tap_send(void *opaque)
             break;
         }
     }
+
+    if (ctx) {
+        aio_context_release(ctx);
+    }
 }
 
 static bool tap_has_ufo(NetClientState *nc)
@@ -312,6 +346,11 @@ static void tap_exit_notify(Notifier *notifier, void *data)
 static void tap_cleanup(NetClientState *nc)
 {
     TAPState *s = DO_UPCAST(TAPState, nc, nc);
+    AioContext *ctx = s->ctx;
+
+    if (ctx) {
+        aio_context_acquire(ctx);
+    }
 
     if (s->vhost_net) {
         vhost_net_cleanup(s->vhost_net);
@@ -328,6 +367,11 @@ static void tap_cleanup(NetClientState *nc)
     tap_write_poll(s, false);
     close(s->fd);
     s->fd = -1;
+    s->ctx = NULL;
+
+    if (ctx) {
+        aio_context_release(ctx);
+    }
 }
 
 static void tap_poll(NetClientState *nc, bool enable)
@@ -337,6 +381,26 @@ static void tap_poll(NetClientState *nc, bool enable)
     tap_write_poll(s, enable);
 }
 
+static void tap_set_aio_context(NetClientState *nc, AioContext *ctx)
+{
+    TAPState *s = DO_UPCAST(TAPState, nc, nc);
+
+    assert(!s->vhost_net || !ctx);
+
+    if (s->ctx == ctx) {
+        return;
+    }
+
+    /* Detach from the current context before attaching to the new one */
+    if (s->ctx) {
+        aio_set_fd_handler(s->ctx, s->fd, false, NULL, NULL, NULL, NULL);
+    } else {
+        qemu_set_fd_handler(s->fd, NULL, NULL, NULL);
+    }
+    s->ctx = ctx;
+    tap_update_fd_handler(s);
+}
+
 int tap_get_fd(NetClientState *nc)
 {
     TAPState *s = DO_UPCAST(TAPState, nc, nc);
@@ -354,6 +418,7 @@ static NetClientInfo net_tap_info = {
     .receive_iov = tap_receive_iov,
     .poll = tap_poll,
     .cleanup = tap_cleanup,
+    .set_aio_context = tap_set_aio_context,
     .has_ufo = tap_has_ufo,
     .has_vnet_hdr = tap_has_vnet_hdr,
     .has_vnet_hdr_len = tap_has_vnet_hdr_len,
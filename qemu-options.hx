@@ -123,6 +123,7 @@ DEF("accel", HAS_ARG, QEMU_OPTION_accel,
     "                igd-passthru=on|off (enable Xen integrated Intel graphics passthrough, default=off)\n"
     "                kernel-irqchip=on|off|split controls accelerated irqchip support (default=on)\n"
     "                kvm-shadow-mem=size of KVM shadow MMU in bytes\n"
+    "                dirty-ring-size=n (KVM dirty ring GFN count, default 0)\n"
     "                tb-size=n (TCG translation block cache size)\n"
     "                thread=single|multi (enable multi-threaded TCG)\n", QEMU_ARCH_ALL)
 SRST
@@ -148,6 +149,16 @@ SRST
     ``kvm-shadow-mem=size``
         Defines the size of the KVM shadow MMU.
 
+    ``dirty-ring-size=n``
+        When KVM accelerator is used, it controls the size of the per-vCPU
+        dirty page ring buffer (number of entries for each vCPU). It should
+        be a value that is power of two, and it should be 1024 or bigger (but
+        still less than the maximum value that the kernel supports).  4096
+        could be a good initial value if you have no idea which is the best.
+        Set this value to 0 to disable the feature.  By default, this feature
+        is disabled (dirty-ring-size=0).  When enabled, KVM will instead
+        record dirty pages in a bitmap.
+
     ``tb-size=n``
         Controls the size (in MiB) of the TCG translation block cache.
 
@@ -2467,6 +2478,13 @@ DEF("netdev", HAS_ARG, QEMU_OPTION_netdev,
     "                VALE port (created on the fly) called 'name' ('nmname' is name of the \n"
     "                netmap device, defaults to '/dev/netmap')\n"
 #endif
+#ifdef CONFIG_AF_XDP
+    "-netdev af-xdp,id=str,ifname=name[,mode=native|skb][,force-copy=on|off]\n"
+    "         [,queues=n][,start-queue=m][,busy-poll-budget=b]\n"
+    "                attach to the host network interface 'name' with AF_XDP sockets\n"
+    "                on its queues 'm' to 'm'+'n'-1 ('mode' selects native or generic\n"
+    "                XDP; 'b' enables socket busy polling with that budget)\n"
+#endif
 #ifdef CONFIG_POSIX
     "-netdev vhost-user,id=str,chardev=dev[,vhostforce=on|off]\n"
     "                configure a vhost-user network, backed by a chardev 'dev'\n"
@@ -2953,6 +2971,28 @@ SRST
              -netdev type=vhost-user,id=net0,chardev=chr0 \
              -device virtio-net-pci,netdev=net0
 
+``-netdev af-xdp,id=id,ifname=name[,mode=native|skb][,force-copy=on|off][,queues=n][,start-queue=m][,busy-poll-budget=b]``
+    Connect to the host network interface ``name`` using AF_XDP
+    sockets. One socket is bound to each of the NIC queues ``m`` to
+    ``m+n-1`` and all of them share a single UMEM. The netdev gets
+    ``n`` queues, so a multiqueue virtio-net device can map each guest
+    queue pair to a NIC queue. The NIC must steer the traffic meant for
+    the guest to those queues, for example with ``ethtool -N``.
+
+    ``mode`` selects driver (native) or generic (skb) XDP; by default
+    native is tried first. Zero-copy is used when the driver supports
+    it, unless ``force-copy=on``. With ``busy-poll-budget`` the sockets
+    are busy polled, which pairs well with virtio-net ``iothreads``
+    whose ``poll-max-ns`` is non-zero.
+
+    Example (testing against a veth pair):
+
+    ::
+
+        ip link add veth0 type veth peer name veth1
+        qemu-system-x86_64 -netdev af-xdp,id=n0,ifname=veth0,mode=skb \
+                           -device virtio-net-pci,netdev=n0
+
 ``-netdev vhost-vdpa,vhostdev=/path/to/dev``
     Establish a vhost-vdpa netdev.
 
@@ -4104,6 +4144,8 @@ DEF("incoming", HAS_ARG, QEMU_OPTION_incoming, \
     "-incoming exec:cmdline\n" \
     "                accept incoming migration on given file descriptor\n" \
     "                or from given external command\n" \
+    "-incoming file:filename\n" \
+    "                accept incoming migration from a given file\n" \
     "-incoming defer\n" \
     "                wait for the URI to be specified via migrate_incoming\n",
     QEMU_ARCH_ALL)
@@ -4123,6 +4165,10 @@ SRST
     Accept incoming migration as an output from specified external
     command.
 
+``-incoming file:filename``
+    Accept incoming migration from a file previously written with
+    ``migrate file:filename``.
+
 ``-incoming defer``
     Wait for the URI to be specified via migrate\_incoming. The monitor
     can be used to change settings (such as migration parameters) prior
@@ -0,0 +1,169 @@
+#!/usr/bin/env python3
+#
+# Migration downtime analyzer
+#
+# Saves the downtime breakdown of a completed migration, as returned by
+# query-migrate on either side, and compares two of them to find what
+# got slower.
+#
+# This work is licensed under the terms of the GNU GPL, version 2 or later.
+# See the COPYING file in the top-level directory.
+
+import argparse
+import json
+import os
+import sys
+
+sys.path.append(os.path.join(os.path.dirname(__file__), '..', 'python'))
+
+
+def load_info(filename):
+    with open(filename) as f:
+        info = json.load(f)
+    # Accept a raw QMP reply as well
+    if 'return' in info:
+        info = info['return']
+    if info.get('status') != 'completed':
+        raise Exception("%s: migration is not completed (status %s)" %
+                        (filename, info.get('status')))
+    return info
+
+
+def phases(info):
+    return dict((p['phase'], p) for p in info.get('phases', []))
+
+
+def sections(info):
+    return dict(("%s/%d" % (s['id-str'], s['instance-id']), s)
+                for s in info.get('sections', []))
+
+
+def dump(args):
+    from qemu.qmp import QEMUMonitorProtocol
+
+    qmp = QEMUMonitorProtocol(args.socket)
+    qmp.connect()
+    info = qmp.command('query-migrate')
+    qmp.close()
+
+    if info.get('status') != 'completed':
+        print("migration is not completed (status %s)" % info.get('status'),
+              file=sys.stderr)
+        return 1
+    out = open(args.output, 'w') if args.output else sys.stdout
+    json.dump(info, out, indent=2)
+    out.write('\n')
+    return 0
+
+
+def show(args):
+    info = load_info(args.file)
+
+    if 'downtime' in info:
+        print("downtime: %d ms" % info['downtime'])
+    print("phases:")
+    for name, p in phases(info).items():
+        print("  %-10s %10d us %12d bytes" % (name, p['time'], p['bytes']))
+
+    secs = sorted(sections(info).items(), key=lambda s: -s[1]['time'])
+    if args.top:
+        secs = secs[:args.top]
+    print("sections:")
+    for name, s in secs:
+        print("  %-40s %10d us %12d bytes%s" %
+              (name, s['time'], s['bytes'],
+               " (parallel)" if s['parallel'] else ""))
+    return 0
+
+
+def regressed(old, new, args):
+    if new - old < args.min_time:
+        return False
+    return new > old * (100 + args.threshold) / 100
+
+
+def compare_entries(kind, base, new, args):
+    found = 0
+
+    for name, n in new.items():
+        b = base.get(name)
+        if b is None:
+            if n['time'] >= args.min_time:
+                print("%s %s: new, %d us %d bytes" %
+                      (kind, name, n['time'], n['bytes']))
+                found += 1
+            continue
+        if regressed(b['time'], n['time'], args):
+            print("%s %s: time %d -> %d us (%+d)" %
+                  (kind, name, b['time'], n['time'], n['time'] - b['time']))
+            found += 1
+        if n['bytes'] > b['bytes'] * (100 + args.threshold) / 100 and \
+           n['bytes'] - b['bytes'] >= args.min_bytes:
+            print("%s %s: size %d -> %d bytes (%+d)" %
+                  (kind, name, b['bytes'], n['bytes'],
+                   n['bytes'] - b['bytes']))
+            found += 1
+        if b.get('parallel') and not n.get('parallel'):
+            print("%s %s: not parallel anymore" % (kind, name))
+            found += 1
+    return found
+
+
+def compare(args):
+    base = load_info(args.base)
+    new = load_info(args.new)
+    found = 0
+
+    if 'downtime' in base and 'downtime' in new and \
+       regressed(base['downtime'] * 1000, new['downtime'] * 1000, args):
+        print("downtime: %d -> %d ms" % (base['downtime'], new['downtime']))
+        found += 1
+    found += compare_entries("phase", phases(base), phases(new), args)
+    found += compare_entries("section", sections(base), sections(new), args)
+
+    if not found:
+        print("no regression")
+    return 1 if found else 0
+
+
+def main():
+    parser = argparse.ArgumentParser()
+    sub = parser.add_subparsers(dest='command')
+    sub.required = True
+
+    p = sub.add_parser('dump', help='save the downtime breakdown of the '
+                       'last migration of a QEMU instance')
+    p.add_argument('socket', help='QMP socket path, or host:port')
+    p.add_argument('-o', '--output', help='output file, default stdout')
+    p.set_defaults(func=dump)
+
+    p = sub.add_parser('show', help='print a saved breakdown')
+    p.add_argument('file')
+    p.add_argument('--top', type=int, default=0,
+                   help='only print the slowest sections')
+    p.set_defaults(func=show)
+
+    p = sub.add_parser('compare', help='print what got slower or bigger '
+                       'between two saved breakdowns, exit with 1 if '
+                       'anything did')
+    p.add_argument('base')
+    p.add_argument('new')
+    p.add_argument('--threshold', type=int, default=20,
+                   help='growth to report, in percent (default 20)')
+    p.add_argument('--min-time', type=int, default=100,
+                   help='ignore time changes smaller than this, '
+                   'in us (default 100)')
+    p.add_argument('--min-bytes', type=int, default=4096,
+                   help='ignore size changes smaller than this '
+                   '(default 4096)')
+    p.set_defaults(func=compare)
+
+    args = parser.parse_args()
+    if args.command == 'dump' and ':' in args.socket:
+        host, port = args.socket.rsplit(':', 1)
+        args.socket = (host, int(port))
+    return args.func(args)
+
+
+if __name__ == '__main__':
+    sys.exit(main())
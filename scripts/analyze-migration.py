@@ -487,8 +487,11 @@ class MigrationDump(object):
     QEMU_VM_SUBSECTION    = 0x05
     QEMU_VM_VMDESCRIPTION = 0x06
     QEMU_VM_CONFIGURATION = 0x07
+    QEMU_VM_COMMAND       = 0x08
     QEMU_VM_SECTION_FOOTER= 0x7e
 
+    MIG_CMD_DEVICE_STATE  = 0x0b
+
     def __init__(self, filename):
         self.section_classes = { ( 'ram', 0 ) : [ RamSection, None ],
                                  ( 'spapr/htab', 0) : ( HTABSection, None ) }
@@ -547,6 +550,14 @@ class MigrationDump(object):
                 read_section_id = file.read32()
                 if read_section_id != section_id:
                     raise Exception("Mismatched section footer: %x vs %x" % (read_section_id, section_id))
+            elif section_type == self.QEMU_VM_COMMAND:
+                cmd = file.read16()
+                cmd_len = file.read16()
+                if cmd != self.MIG_CMD_DEVICE_STATE or cmd_len != 4:
+                    raise Exception("Unsupported command: 0x%x" % cmd)
+                # The length of the device section that follows, which is
+                # an ordinary full section
+                file.read32()
             else:
                 raise Exception("Unknown section type: %d" % section_type)
         file.close()
@@ -0,0 +1,304 @@
+/*
+ * Dirty page rate limit of virtual CPUs
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "qapi/qapi-commands-migration.h"
+#include "qemu/main-loop.h"
+#include "qemu/timer.h"
+#include "qemu/units.h"
+#include "exec/memory.h"
+#include "exec/target_page.h"
+#include "hw/core/cpu.h"
+#include "hw/boards.h"
+#include "sysemu/cpus.h"
+#include "sysemu/kvm.h"
+#include "sysemu/dirtylimit.h"
+#include "trace.h"
+
+#define DIRTYLIMIT_PCT_MAX 99
+#define DIRTYLIMIT_TIMESLICE_NS 10000000
+#define DIRTYLIMIT_PERIOD_MS_DEFAULT 1000
+
+typedef struct VcpuDirtyLimitState {
+    /* Dirty page rate limit in MB/s, 0 if the vCPU is not limited */
+    uint64_t quota;
+    /* Dirty page rate measured during the last period, in MB/s */
+    uint64_t current;
+    /* CPUState::dirty_pages at the start of the period */
+    uint64_t last_pages;
+    /* Percentage of time the vCPU is put to sleep */
+    int throttle_pct;
+    /* A sleep is queued on the vCPU */
+    int sleep_scheduled;
+} VcpuDirtyLimitState;
+
+/* Indexed by cpu_index, all protected by the BQL */
+static VcpuDirtyLimitState *vcpu_dirty_limit;
+static unsigned int dirtylimit_nvcpu;
+static bool dirtylimit_logging;
+static uint64_t dirtylimit_period_ms = DIRTYLIMIT_PERIOD_MS_DEFAULT;
+static int64_t dirtylimit_last_calc_ms;
+static QEMUTimer *dirtylimit_calc_timer;
+static QEMUTimer *dirtylimit_throttle_timer;
+
+static void dirtylimit_vcpu_sleep(CPUState *cpu, run_on_cpu_data opaque)
+{
+    VcpuDirtyLimitState *v = &vcpu_dirty_limit[cpu->cpu_index];
+    int64_t sleeptime_ns, endtime_ns;
+    double pct;
+
+    if (!v->throttle_pct) {
+        goto out;
+    }
+
+    pct = (double)v->throttle_pct / 100;
+    /* Add 1ns to fix double's rounding error (like 0.9999999...) */
+    sleeptime_ns = (int64_t)(pct / (1 - pct) * DIRTYLIMIT_TIMESLICE_NS + 1);
+    endtime_ns = qemu_clock_get_ns(QEMU_CLOCK_REALTIME) + sleeptime_ns;
+    while (sleeptime_ns > 0 && !cpu->stop) {
+        if (sleeptime_ns > SCALE_MS) {
+            qemu_cond_timedwait_iothread(cpu->halt_cond,
+                                         sleeptime_ns / SCALE_MS);
+        } else {
+            qemu_mutex_unlock_iothread();
+            g_usleep(sleeptime_ns / SCALE_US);
+            qemu_mutex_lock_iothread();
+        }
+        sleeptime_ns = endtime_ns - qemu_clock_get_ns(QEMU_CLOCK_REALTIME);
+    }
+
+out:
+    qatomic_set(&v->sleep_scheduled, 0);
+}
+
+static void dirtylimit_throttle_tick(void *opaque)
+{
+    CPUState *cpu;
+    int max_pct = 0;
+
+    CPU_FOREACH(cpu) {
+        VcpuDirtyLimitState *v = &vcpu_dirty_limit[cpu->cpu_index];
+
+        if (!v->throttle_pct) {
+            continue;
+        }
+        max_pct = MAX(max_pct, v->throttle_pct);
+        if (!qatomic_xchg(&v->sleep_scheduled, 1)) {
+            async_run_on_cpu(cpu, dirtylimit_vcpu_sleep, RUN_ON_CPU_NULL);
+        }
+    }
+
+    /* Rearmed by dirtylimit_calc_tick() when a vCPU needs throttling */
+    if (!max_pct) {
+        return;
+    }
+    timer_mod(dirtylimit_throttle_timer,
+              qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL_RT) +
+              DIRTYLIMIT_TIMESLICE_NS * 100 / (100 - max_pct));
+}
+
+/*
+ * The measured rate includes the time the vCPU spent asleep: scale it
+ * back to the rate of the vCPU while it runs, then pick the share of
+ * sleep that brings it down to the quota.
+ */
+static void dirtylimit_adjust(VcpuDirtyLimitState *v)
+{
+    uint64_t running_rate;
+    int pct = 0;
+
+    if (v->quota) {
+        running_rate = v->current * 100 / (100 - v->throttle_pct);
+        if (running_rate > v->quota) {
+            pct = 100 - v->quota * 100 / running_rate;
+        }
+    }
+    v->throttle_pct = MIN(pct, DIRTYLIMIT_PCT_MAX);
+}
+
+static void dirtylimit_calc_tick(void *opaque)
+{
+    int64_t now = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+    int64_t elapsed = now - dirtylimit_last_calc_ms;
+    bool throttled = false;
+    CPUState *cpu;
+
+    /* Harvest the rings so that the counters are up to date */
+    kvm_dirty_ring_reap_all();
+
+    CPU_FOREACH(cpu) {
+        VcpuDirtyLimitState *v = &vcpu_dirty_limit[cpu->cpu_index];
+        uint64_t pages = cpu->dirty_pages - v->last_pages;
+
+        v->last_pages = cpu->dirty_pages;
+        v->current = elapsed > 0 ?
+            pages * qemu_target_page_size() * 1000 / elapsed / MiB : 0;
+        dirtylimit_adjust(v);
+        throttled |= v->throttle_pct != 0;
+        trace_dirtylimit_calc(cpu->cpu_index, v->quota, v->current,
+                              v->throttle_pct);
+    }
+    dirtylimit_last_calc_ms = now;
+
+    if (throttled && !timer_pending(dirtylimit_throttle_timer)) {
+        timer_mod(dirtylimit_throttle_timer,
+                  qemu_clock_get_ns(QEMU_CLOCK_VIRTUAL_RT) +
+                  DIRTYLIMIT_TIMESLICE_NS);
+    }
+    timer_mod(dirtylimit_calc_timer, now + dirtylimit_period_ms);
+}
+
+static void dirtylimit_state_init(void)
+{
+    CPUState *cpu;
+
+    if (vcpu_dirty_limit) {
+        return;
+    }
+
+    vcpu_dirty_limit = g_new0(VcpuDirtyLimitState,
+                              current_machine->smp.max_cpus);
+    dirtylimit_calc_timer = timer_new_ms(QEMU_CLOCK_REALTIME,
+                                         dirtylimit_calc_tick, NULL);
+    dirtylimit_throttle_timer = timer_new_ns(QEMU_CLOCK_VIRTUAL_RT,
+                                             dirtylimit_throttle_tick, NULL);
+    CPU_FOREACH(cpu) {
+        vcpu_dirty_limit[cpu->cpu_index].last_pages = cpu->dirty_pages;
+    }
+}
+
+static void dirtylimit_update(VcpuDirtyLimitState *v, uint64_t quota)
+{
+    if (!v->quota && quota) {
+        dirtylimit_nvcpu++;
+    } else if (v->quota && !quota) {
+        dirtylimit_nvcpu--;
+        v->throttle_pct = 0;
+    }
+    v->quota = quota;
+}
+
+/*
+ * KVM only fills the dirty rings of memory slots that have
+ * KVM_MEM_LOG_DIRTY_PAGES, so keep the global dirty log on for as long
+ * as a vCPU is limited, whether or not migration is running.
+ */
+static void dirtylimit_start_stop(void)
+{
+    if (dirtylimit_nvcpu) {
+        if (!dirtylimit_logging) {
+            memory_global_dirty_log_start(GLOBAL_DIRTY_LIMIT);
+            dirtylimit_logging = true;
+        }
+        if (!timer_pending(dirtylimit_calc_timer)) {
+            dirtylimit_last_calc_ms = qemu_clock_get_ms(QEMU_CLOCK_REALTIME);
+            timer_mod(dirtylimit_calc_timer,
+                      dirtylimit_last_calc_ms + dirtylimit_period_ms);
+        }
+    } else {
+        timer_del(dirtylimit_calc_timer);
+        timer_del(dirtylimit_throttle_timer);
+        if (dirtylimit_logging) {
+            memory_global_dirty_log_stop(GLOBAL_DIRTY_LIMIT);
+            dirtylimit_logging = false;
+        }
+    }
+}
+
+void dirtylimit_set_vcpu(int cpu_index, uint64_t quota)
+{
+    dirtylimit_state_init();
+    trace_dirtylimit_set_vcpu(cpu_index, quota);
+    dirtylimit_update(&vcpu_dirty_limit[cpu_index], quota);
+    dirtylimit_start_stop();
+}
+
+void dirtylimit_set_all(uint64_t quota)
+{
+    CPUState *cpu;
+
+    dirtylimit_state_init();
+    CPU_FOREACH(cpu) {
+        trace_dirtylimit_set_vcpu(cpu->cpu_index, quota);
+        dirtylimit_update(&vcpu_dirty_limit[cpu->cpu_index], quota);
+    }
+    dirtylimit_start_stop();
+}
+
+void dirtylimit_set_period(uint64_t period_ms)
+{
+    dirtylimit_period_ms = period_ms;
+}
+
+bool dirtylimit_in_service(void)
+{
+    return dirtylimit_nvcpu != 0;
+}
+
+static bool dirtylimit_check(bool has_cpu_index, int64_t cpu_index,
+                             Error **errp)
+{
+    if (!kvm_dirty_ring_enabled()) {
+        error_setg(errp, "dirty page limit requires KVM with accelerator"
+                   " property 'dirty-ring-size' set");
+        return false;
+    }
+    if (has_cpu_index &&
+        (cpu_index < 0 || cpu_index >= current_machine->smp.max_cpus ||
+         !qemu_get_cpu(cpu_index))) {
+        error_setg(errp, "incorrect cpu index specified");
+        return false;
+    }
+    return true;
+}
+
+void qmp_set_vcpu_dirty_limit(bool has_cpu_index, int64_t cpu_index,
+                              uint64_t dirty_rate, Error **errp)
+{
+    if (!dirtylimit_check(has_cpu_index, cpu_index, errp)) {
+        return;
+    }
+
+    if (has_cpu_index) {
+        dirtylimit_set_vcpu(cpu_index, dirty_rate);
+    } else {
+        dirtylimit_set_all(dirty_rate);
+    }
+}
+
+void qmp_cancel_vcpu_dirty_limit(bool has_cpu_index, int64_t cpu_index,
+                                 Error **errp)
+{
+    qmp_set_vcpu_dirty_limit(has_cpu_index, cpu_index, 0, errp);
+}
+
+DirtyLimitInfoList *qmp_query_vcpu_dirty_limit(Error **errp)
+{
+    DirtyLimitInfoList *head = NULL, **tail = &head;
+    CPUState *cpu;
+
+    if (!dirtylimit_check(false, 0, errp)) {
+        return NULL;
+    }
+
+    dirtylimit_state_init();
+    CPU_FOREACH(cpu) {
+        VcpuDirtyLimitState *v = &vcpu_dirty_limit[cpu->cpu_index];
+        DirtyLimitInfoList *entry = g_new0(DirtyLimitInfoList, 1);
+
+        entry->value = g_new0(DirtyLimitInfo, 1);
+        entry->value->cpu_index = cpu->cpu_index;
+        entry->value->limit_rate = v->quota;
+        entry->value->current_rate = v->current;
+        entry->value->throttle_percentage = v->throttle_pct;
+        *tail = entry;
+        tail = &entry->next;
+    }
+
+    return head;
+}
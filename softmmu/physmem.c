@@ -2114,6 +2114,7 @@ static void reclaim_ramblock(RAMBlock *block)
     } else {
         qemu_anon_ram_free(block->host, block->max_length);
     }
+    g_free(block->xbzrle_stats);
     g_free(block);
 }
 
@@ -0,0 +1,150 @@
+/*
+ * XBZRLE encoder speed benchmark
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ * The pages are read from the file named by the XBZRLE_BENCH_PAGES
+ * environment variable if it is set: a sequence of pairs of 4096 bytes
+ * pages, the old version of a page followed by the new one, as recorded
+ * from a migrating guest.  Otherwise the pairs are generated, with a
+ * given number of bytes changed in each page.
+ */
+#include "qemu/osdep.h"
+#include "qemu/units.h"
+#include "../migration/xbzrle.h"
+
+#define PAGE_SIZE 4096
+#define NUM_PAGES 1024
+
+typedef struct XBZRLEBenchPages {
+    const char *name;
+    uint8_t *data;
+    size_t num_pages;
+} XBZRLEBenchPages;
+
+static uint8_t *bench_old_page(const XBZRLEBenchPages *pages, size_t i)
+{
+    return pages->data + 2 * i * PAGE_SIZE;
+}
+
+static uint8_t *bench_new_page(const XBZRLEBenchPages *pages, size_t i)
+{
+    return pages->data + (2 * i + 1) * PAGE_SIZE;
+}
+
+static XBZRLEBenchPages *bench_pages_generate(int changed)
+{
+    XBZRLEBenchPages *pages = g_new0(XBZRLEBenchPages, 1);
+    size_t i;
+    int j;
+
+    pages->name = g_strdup_printf("changed-%d", changed);
+    pages->num_pages = NUM_PAGES;
+    pages->data = g_malloc(2 * NUM_PAGES * PAGE_SIZE);
+
+    for (i = 0; i < pages->num_pages; i++) {
+        uint8_t *old = bench_old_page(pages, i);
+        uint8_t *new = bench_new_page(pages, i);
+
+        for (j = 0; j < PAGE_SIZE; j++) {
+            old[j] = g_test_rand_int();
+        }
+        memcpy(new, old, PAGE_SIZE);
+        for (j = 0; j < changed; j++) {
+            new[g_test_rand_int_range(0, PAGE_SIZE)] ^=
+                g_test_rand_int_range(1, 256);
+        }
+    }
+    return pages;
+}
+
+static XBZRLEBenchPages *bench_pages_load(const char *filename)
+{
+    XBZRLEBenchPages *pages;
+    GError *err = NULL;
+    gchar *data;
+    gsize len;
+
+    if (!g_file_get_contents(filename, &data, &len, &err)) {
+        g_printerr("%s\n", err->message);
+        g_error_free(err);
+        exit(1);
+    }
+    if (len < 2 * PAGE_SIZE) {
+        g_printerr("%s: no page pair found\n", filename);
+        exit(1);
+    }
+
+    pages = g_new0(XBZRLEBenchPages, 1);
+    pages->name = g_strdup("recorded");
+    pages->num_pages = len / (2 * PAGE_SIZE);
+    pages->data = (uint8_t *)data;
+    return pages;
+}
+
+static void bench_encode(const XBZRLEBenchPages *pages, uint8_t *buffer)
+{
+    const size_t total = 1 * GiB;
+    size_t done = 0, encoded = 0;
+    size_t i;
+    int rc;
+
+    g_test_timer_start();
+    while (done < total) {
+        for (i = 0; i < pages->num_pages; i++) {
+            rc = xbzrle_encode_buffer(bench_old_page(pages, i),
+                                      bench_new_page(pages, i),
+                                      PAGE_SIZE, buffer, PAGE_SIZE);
+            encoded += rc < 0 ? PAGE_SIZE : rc;
+        }
+        done += pages->num_pages * PAGE_SIZE;
+    }
+    g_test_timer_elapsed();
+
+    g_test_message("xbzrle(%s): %s %.2f MB/sec ratio %.3f",
+                   xbzrle_encode_accel(), pages->name,
+                   done / MiB / g_test_timer_last(),
+                   (double)encoded / done);
+}
+
+/*
+ * Selecting the next encoder cannot be undone, so all the page sets
+ * are run by a single test, starting from the best encoder.
+ */
+static void test_encode_speed(const void *opaque)
+{
+    GPtrArray *sets = (GPtrArray *)opaque;
+    uint8_t *buffer = g_malloc(PAGE_SIZE);
+    guint i;
+
+    do {
+        for (i = 0; i < sets->len; i++) {
+            bench_encode(g_ptr_array_index(sets, i), buffer);
+        }
+    } while (test_xbzrle_encode_next_accel());
+
+    g_free(buffer);
+}
+
+int main(int argc, char **argv)
+{
+    static const int changed[] = { 0, 1, 16, 256, 2048 };
+    const char *filename = g_getenv("XBZRLE_BENCH_PAGES");
+    GPtrArray *sets = g_ptr_array_new();
+    int i;
+
+    g_test_init(&argc, &argv, NULL);
+
+    if (filename) {
+        g_ptr_array_add(sets, bench_pages_load(filename));
+    } else {
+        for (i = 0; i < ARRAY_SIZE(changed); i++) {
+            g_ptr_array_add(sets, bench_pages_generate(changed[i]));
+        }
+    }
+    g_test_add_data_func("/xbzrle/benchmark/encode", sets,
+                         test_encode_speed);
+
+    return g_test_run();
+}
@@ -0,0 +1,277 @@
+/*
+ * QTest testcase for the AF_XDP network backend
+ *
+ * Copyright (c) 2020 The QEMU Project Developers
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ */
+
+#include "qemu/osdep.h"
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+#include <net/if.h>
+#include "libqos/libqtest.h"
+
+/*
+ * The tests need CAP_NET_ADMIN to create a veth pair and attach XDP
+ * programs to it, and are skipped without it.
+ */
+#define VETH_NAME "qxdp%d"
+#define VETH_PEER "qxdpp%d"
+
+/* Local experimental ethertype, so that the test frames stand out */
+#define TEST_ETH_P   0x88b5
+#define TEST_TIMEOUT 5
+
+static bool GCC_FMT_ATTR(1, 2) run_ip(const char *fmt, ...)
+{
+    g_autofree char *args = NULL;
+    g_autofree char *cmd = NULL;
+    int status;
+    va_list ap;
+
+    va_start(ap, fmt);
+    args = g_strdup_vprintf(fmt, ap);
+    va_end(ap);
+
+    cmd = g_strdup_printf("ip %s", args);
+    if (!g_spawn_command_line_sync(cmd, NULL, NULL, &status, NULL)) {
+        return false;
+    }
+    return g_spawn_check_exit_status(status, NULL);
+}
+
+static char *veth_create(int queues)
+{
+    char *name = g_strdup_printf(VETH_NAME, getpid());
+    g_autofree char *peer = g_strdup_printf(VETH_PEER, getpid());
+
+    if (!run_ip("link add %s numrxqueues %d numtxqueues %d type veth "
+                "peer name %s numrxqueues %d numtxqueues %d",
+                name, queues, queues, peer, queues, queues)) {
+        g_free(name);
+        return NULL;
+    }
+    run_ip("link set %s up", peer);
+    run_ip("link set %s up", name);
+    return name;
+}
+
+static void veth_destroy(char *name)
+{
+    run_ip("link del %s", name);
+    g_free(name);
+}
+
+/* Whether a generic XDP program is attached to @ifname */
+static bool xdp_attached(const char *ifname)
+{
+    g_autofree char *cmd = g_strdup_printf("ip -d link show dev %s", ifname);
+    g_autofree char *out = NULL;
+    int status;
+
+    g_assert(g_spawn_command_line_sync(cmd, &out, NULL, &status, NULL));
+    g_assert(g_spawn_check_exit_status(status, NULL));
+    return strstr(out, "xdpgeneric") != NULL;
+}
+
+static QTestState *af_xdp_start(const char *ifname, int start_queue)
+{
+    return qtest_initf("-M none -netdev af-xdp,id=n0,ifname=%s,mode=skb,"
+                       "start-queue=%d", ifname, start_queue);
+}
+
+/* The netdev that loaded the program detaches it */
+static void test_detach(void)
+{
+    char *ifname = veth_create(1);
+    QTestState *qts;
+
+    if (!ifname) {
+        g_test_skip("cannot create a veth pair");
+        return;
+    }
+
+    g_assert_false(xdp_attached(ifname));
+    qts = af_xdp_start(ifname, 0);
+    g_assert_true(xdp_attached(ifname));
+    qtest_quit(qts);
+    g_assert_false(xdp_attached(ifname));
+
+    veth_destroy(ifname);
+}
+
+/* A netdev that reused the program of another one leaves it attached */
+static void test_shared_program(void)
+{
+    char *ifname = veth_create(2);
+    QTestState *owner, *user;
+
+    if (!ifname) {
+        g_test_skip("cannot create a veth pair");
+        return;
+    }
+
+    owner = af_xdp_start(ifname, 0);
+    user = af_xdp_start(ifname, 1);
+    g_assert_true(xdp_attached(ifname));
+
+    qtest_quit(user);
+    g_assert_true(xdp_attached(ifname));
+
+    qtest_quit(owner);
+    g_assert_false(xdp_attached(ifname));
+
+    veth_destroy(ifname);
+}
+
+static void set_timeout(int fd)
+{
+    struct timeval tv = { .tv_sec = TEST_TIMEOUT };
+
+    g_assert_cmpint(setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO,
+                               &tv, sizeof(tv)), ==, 0);
+}
+
+/* A packet socket that sends and receives the test frames on @ifname */
+static int packet_open(const char *ifname)
+{
+    struct sockaddr_ll sll = {
+        .sll_family = AF_PACKET,
+        .sll_protocol = htons(TEST_ETH_P),
+        .sll_ifindex = if_nametoindex(ifname),
+    };
+    int fd;
+
+    g_assert_cmpint(sll.sll_ifindex, !=, 0);
+    fd = socket(AF_PACKET, SOCK_RAW, htons(TEST_ETH_P));
+    g_assert_cmpint(fd, >=, 0);
+    g_assert_cmpint(bind(fd, (struct sockaddr *)&sll, sizeof(sll)), ==, 0);
+    set_timeout(fd);
+    return fd;
+}
+
+static void frame_build(uint8_t *frame, size_t size, const char *payload)
+{
+    static const uint8_t src[] = { 0x52, 0x54, 0x00, 0x12, 0x34, 0x56 };
+    uint16_t proto = htons(TEST_ETH_P);
+
+    g_assert_cmpuint(size, >, 14 + strlen(payload));
+    memset(frame, 0, size);
+    memset(frame, 0xff, 6);
+    memcpy(frame + 6, src, sizeof(src));
+    memcpy(frame + 12, &proto, sizeof(proto));
+    strcpy((char *)frame + 14, payload);
+}
+
+static bool frame_match(const uint8_t *frame, size_t len, const char *payload)
+{
+    uint16_t proto;
+
+    if (len < 14 + strlen(payload) + 1) {
+        return false;
+    }
+    memcpy(&proto, frame + 12, sizeof(proto));
+    return ntohs(proto) == TEST_ETH_P &&
+           !strcmp((const char *)frame + 14, payload);
+}
+
+/* The socket netdev frames packets with their length in network order */
+static void stream_send(int fd, const uint8_t *frame, size_t len)
+{
+    uint32_t size = htonl(len);
+
+    g_assert_cmpint(send(fd, &size, sizeof(size), 0), ==, sizeof(size));
+    g_assert_cmpint(send(fd, frame, len, 0), ==, len);
+}
+
+/* Receives frames from the socket netdev until one carries @payload */
+static void stream_expect(int fd, const char *payload)
+{
+    uint8_t frame[ETH_FRAME_LEN];
+    uint32_t size;
+
+    for (;;) {
+        g_assert_cmpint(recv(fd, &size, sizeof(size), MSG_WAITALL), ==,
+                        sizeof(size));
+        size = ntohl(size);
+        g_assert_cmpuint(size, <=, sizeof(frame));
+        g_assert_cmpint(recv(fd, frame, size, MSG_WAITALL), ==, size);
+        if (frame_match(frame, size, payload)) {
+            return;
+        }
+    }
+}
+
+/* Receives frames from a packet socket until one carries @payload */
+static void packet_expect(int fd, const char *payload)
+{
+    uint8_t frame[ETH_FRAME_LEN];
+    ssize_t len;
+
+    for (;;) {
+        len = recv(fd, frame, sizeof(frame), 0);
+        g_assert_cmpint(len, >, 0);
+        if (frame_match(frame, len, payload)) {
+            return;
+        }
+    }
+}
+
+/*
+ * Frames go both ways between the veth peer and a socket netdev that
+ * is connected to the AF_XDP netdev through a hub.
+ */
+static void test_traffic(void)
+{
+    char *ifname = veth_create(1);
+    g_autofree char *peer = g_strdup_printf(VETH_PEER, getpid());
+    uint8_t frame[ETH_ZLEN];
+    QTestState *qts;
+    int sv[2];
+    int pfd;
+
+    if (!ifname) {
+        g_test_skip("cannot create a veth pair");
+        return;
+    }
+
+    g_assert_cmpint(socketpair(PF_UNIX, SOCK_STREAM, 0, sv), ==, 0);
+    set_timeout(sv[0]);
+    pfd = packet_open(peer);
+
+    qts = qtest_initf("-M none "
+                      "-netdev af-xdp,id=n0,ifname=%s,mode=skb "
+                      "-netdev socket,id=s0,fd=%d "
+                      "-netdev hubport,id=h0,hubid=0,netdev=n0 "
+                      "-netdev hubport,id=h1,hubid=0,netdev=s0",
+                      ifname, sv[1]);
+
+    /* From the netdev out of the interface */
+    frame_build(frame, sizeof(frame), "af-xdp tx");
+    stream_send(sv[0], frame, sizeof(frame));
+    packet_expect(pfd, "af-xdp tx");
+
+    /* From the wire into the netdev */
+    frame_build(frame, sizeof(frame), "af-xdp rx");
+    g_assert_cmpint(send(pfd, frame, sizeof(frame), 0), ==, sizeof(frame));
+    stream_expect(sv[0], "af-xdp rx");
+
+    qtest_quit(qts);
+    close(pfd);
+    close(sv[0]);
+    close(sv[1]);
+    veth_destroy(ifname);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+
+    qtest_add_func("/netdev/af-xdp/detach", test_detach);
+    qtest_add_func("/netdev/af-xdp/shared-program", test_shared_program);
+    qtest_add_func("/netdev/af-xdp/traffic", test_traffic);
+
+    return g_test_run();
+}
@@ -363,6 +363,20 @@ uint32_t qvirtqueue_add_indirect(QTestState *qts, QVirtQueue *vq,
 
 void qvirtqueue_kick(QTestState *qts, QVirtioDevice *d, QVirtQueue *vq,
                      uint32_t free_head)
+{
+    qvirtqueue_kick_batch(qts, d, vq, &free_head, 1);
+}
+
+/*
+ * qvirtqueue_kick_batch:
+ * @free_heads: The heads of the descriptor chains to make available
+ * @n: The number of entries in @free_heads
+ *
+ * Makes all chains available before notifying the device, so that the
+ * device sees them in a single handler pass.
+ */
+void qvirtqueue_kick_batch(QTestState *qts, QVirtioDevice *d, QVirtQueue *vq,
+                           const uint32_t *free_heads, int n)
 {
     /* vq->avail->idx */
     uint16_t idx = qvirtio_readw(d, qts, vq->avail + 2);
@@ -370,20 +384,25 @@ void qvirtqueue_kick(QTestState *qts, QVirtioDevice *d, QVirtQueue *vq,
     uint16_t flags;
     /* vq->used->avail_event */
     uint16_t avail_event;
+    int i;
 
-    /* vq->avail->ring[idx % vq->size] */
-    qvirtio_writew(d, qts, vq->avail + 4 + (2 * (idx % vq->size)), free_head);
+    for (i = 0; i < n; i++) {
+        /* vq->avail->ring[(idx + i) % vq->size] */
+        qvirtio_writew(d, qts,
+                       vq->avail + 4 + (2 * ((uint16_t)(idx + i) % vq->size)),
+                       free_heads[i]);
+    }
     /* vq->avail->idx */
-    qvirtio_writew(d, qts, vq->avail + 2, idx + 1);
+    qvirtio_writew(d, qts, vq->avail + 2, idx + n);
 
     /* Must read after idx is updated */
     flags = qvirtio_readw(d, qts, vq->avail);
     avail_event = qvirtio_readw(d, qts, vq->used + 4 +
                                 sizeof(struct vring_used_elem) * vq->size);
 
-    /* < 1 because we add elements to avail queue one by one */
+    /* Notify if avail_event is within the entries just added */
     if ((flags & VRING_USED_F_NO_NOTIFY) == 0 &&
-                            (!vq->event || (uint16_t)(idx-avail_event) < 1)) {
+        (!vq->event || (uint16_t)(idx + n - avail_event - 1) < n)) {
         d->bus->virtqueue_kick(d, vq);
     }
 }
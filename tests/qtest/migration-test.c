@@ -15,6 +15,7 @@
 #include "libqos/libqtest.h"
 #include "qapi/error.h"
 #include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
 #include "qemu/module.h"
 #include "qemu/option.h"
 #include "qemu/range.h"
@@ -42,6 +43,11 @@ static bool uffd_feature_thread_id;
 #include <sys/vfs.h>
 #endif
 
+#if defined(__linux__) && defined(HOST_X86_64)
+#include <sys/ioctl.h>
+#include <linux/kvm.h>
+#endif
+
 #if defined(__linux__) && defined(__NR_userfaultfd) && defined(CONFIG_EVENTFD)
 #include <sys/eventfd.h>
 #include <sys/ioctl.h>
@@ -182,6 +188,17 @@ static int64_t read_ram_property_int(QTestState *who, const char *property)
     return result;
 }
 
+static bool kvm_enabled(QTestState *who)
+{
+    QDict *rsp;
+    bool enabled;
+
+    rsp = wait_command(who, "{ 'execute': 'query-kvm' }");
+    enabled = qdict_get_bool(rsp, "enabled");
+    qobject_unref(rsp);
+    return enabled;
+}
+
 static int64_t read_migrate_property_int(QTestState *who, const char *property)
 {
     QDict *rsp_return;
@@ -204,6 +221,7 @@ static void read_blocktime(QTestState *who)
 
     rsp_return = migrate_query(who);
     g_assert(qdict_haskey(rsp_return, "postcopy-blocktime"));
+    g_assert(qdict_haskey(rsp_return, "postcopy-fault-latency"));
     qobject_unref(rsp_return);
 }
 
@@ -470,6 +488,10 @@ typedef struct {
     bool only_target;
     char *opts_source;
     char *opts_target;
+    /* send the pages requested in postcopy on their own channel */
+    bool postcopy_preempt;
+    /* enable the KVM dirty ring, if KVM is used */
+    bool use_dirty_ring;
 } MigrateStart;
 
 static MigrateStart *migrate_start_new(void)
@@ -500,6 +522,7 @@ static int test_migrate_start(QTestState **from, QTestState **to,
     const char *arch = qtest_get_arch();
     const char *machine_opts = NULL;
     const char *memory_size;
+    const char *accel;
     int ret = 0;
 
     if (args->use_shmem) {
@@ -574,11 +597,18 @@ static int test_migrate_start(QTestState **from, QTestState **to,
         shmem_opts = g_strdup("");
     }
 
-    cmd_source = g_strdup_printf("-accel kvm -accel tcg%s%s "
+    if (args->use_dirty_ring) {
+        accel = "-accel kvm,dirty-ring-size=4096 -accel tcg";
+    } else {
+        accel = "-accel kvm -accel tcg";
+    }
+
+    cmd_source = g_strdup_printf("%s%s%s "
                                  "-name source,debug-threads=on "
                                  "-m %s "
                                  "-serial file:%s/src_serial "
                                  "%s %s %s %s",
+                                 accel,
                                  machine_opts ? " -machine " : "",
                                  machine_opts ? machine_opts : "",
                                  memory_size, tmpfs,
@@ -590,12 +620,13 @@ static int test_migrate_start(QTestState **from, QTestState **to,
     }
     g_free(cmd_source);
 
-    cmd_target = g_strdup_printf("-accel kvm -accel tcg%s%s "
+    cmd_target = g_strdup_printf("%s%s%s "
                                  "-name target,debug-threads=on "
                                  "-m %s "
                                  "-serial file:%s/dest_serial "
                                  "-incoming %s "
                                  "%s %s %s %s",
+                                 accel,
                                  machine_opts ? " -machine " : "",
                                  machine_opts ? machine_opts : "",
                                  memory_size, tmpfs, uri,
@@ -650,6 +681,7 @@ static void test_migrate_end(QTestState *from, QTestState *to, bool test_dest)
 
     cleanup("bootsect");
     cleanup("migsocket");
+    cleanup("migfile");
     cleanup("src_serial");
     cleanup("dest_serial");
 }
@@ -706,6 +738,7 @@ static int migrate_postcopy_prepare(QTestState **from_ptr,
                                     MigrateStart *args)
 {
     char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
+    bool postcopy_preempt = args->postcopy_preempt;
     QTestState *from, *to;
 
     if (test_migrate_start(&from, &to, uri, args)) {
@@ -716,6 +749,11 @@ static int migrate_postcopy_prepare(QTestState **from_ptr,
     migrate_set_capability(to, "postcopy-ram", true);
     migrate_set_capability(to, "postcopy-blocktime", true);
 
+    if (postcopy_preempt) {
+        migrate_set_capability(from, "postcopy-preempt", true);
+        migrate_set_capability(to, "postcopy-preempt", true);
+    }
+
     /* We want to pick a speed slow enough that the test completes
      * quickly, but that it doesn't complete precopy even on a slow
      * machine, so also set the downtime.
@@ -763,6 +801,35 @@ static void test_postcopy(void)
     migrate_postcopy_complete(from, to);
 }
 
+static void test_postcopy_preempt(void)
+{
+    MigrateStart *args = migrate_start_new();
+    QTestState *from, *to;
+
+    args->postcopy_preempt = true;
+
+    if (migrate_postcopy_prepare(&from, &to, args)) {
+        return;
+    }
+    migrate_postcopy_start(from, to);
+    migrate_postcopy_complete(from, to);
+}
+
+static void test_postcopy_fault_threads(void)
+{
+    MigrateStart *args = migrate_start_new();
+    QTestState *from, *to;
+
+    if (migrate_postcopy_prepare(&from, &to, args)) {
+        return;
+    }
+    /* Read by the destination when postcopy starts */
+    migrate_set_parameter_int(to, "postcopy-fault-threads", 4);
+    migrate_set_parameter_int(to, "postcopy-prefetch-pages", 16);
+    migrate_postcopy_start(from, to);
+    migrate_postcopy_complete(from, to);
+}
+
 static void test_postcopy_recovery(void)
 {
     MigrateStart *args = migrate_start_new();
@@ -841,16 +908,75 @@ static void test_baddest(void)
     test_migrate_end(from, to, false);
 }
 
-static void test_precopy_unix(void)
+/*
+ * Check the downtime breakdown reported by query-migrate once the
+ * migration has completed; with device-state-threads, port92 on x86 is
+ * saved and loaded by the threads.
+ */
+static void check_downtime_breakdown(QTestState *who, bool parallel)
+{
+    const char *arch = qtest_get_arch();
+    bool x86 = !strcmp(arch, "i386") || !strcmp(arch, "x86_64");
+    bool found_parallel = false;
+    bool found_complete = false;
+    uint64_t bytes = 0;
+    QDict *rsp_return;
+    QListEntry *e;
+    QList *list;
+
+    rsp_return = migrate_query(who);
+    g_assert_cmpstr(qdict_get_str(rsp_return, "status"), ==, "completed");
+    list = qdict_get_qlist(rsp_return, "sections");
+    g_assert(list && !qlist_empty(list));
+
+    QLIST_FOREACH_ENTRY(list, e) {
+        QDict *sec = qobject_to(QDict, qlist_entry_obj(e));
+        const char *id = qdict_get_str(sec, "id-str");
+
+        g_assert_cmpint(qdict_get_int(sec, "time"), >=, 0);
+        bytes += qdict_get_int(sec, "bytes");
+        if (qdict_get_bool(sec, "parallel")) {
+            g_assert(g_str_has_suffix(id, "port92"));
+            found_parallel = true;
+        }
+    }
+    g_assert(found_parallel == (parallel && x86));
+    g_assert_cmpint(bytes, >, 0);
+
+    list = qdict_get_qlist(rsp_return, "phases");
+    g_assert(list && !qlist_empty(list));
+    QLIST_FOREACH_ENTRY(list, e) {
+        QDict *phase = qobject_to(QDict, qlist_entry_obj(e));
+
+        g_assert_cmpint(qdict_get_int(phase, "time"), >=, 0);
+        if (!strcmp(qdict_get_str(phase, "phase"), "complete")) {
+            g_assert_cmpint(qdict_get_int(phase, "bytes"), >, 0);
+            found_complete = true;
+        }
+    }
+    g_assert(found_complete);
+    qobject_unref(rsp_return);
+}
+
+static void do_test_precopy_unix(int dirty_sync_threads,
+                                 int device_state_threads,
+                                 bool dirty_ring)
 {
     char *uri = g_strdup_printf("unix:%s/migsocket", tmpfs);
     MigrateStart *args = migrate_start_new();
     QTestState *from, *to;
 
+    args->use_dirty_ring = dirty_ring;
     if (test_migrate_start(&from, &to, uri, args)) {
         return;
     }
 
+    if (dirty_ring) {
+        /* Make sure the pages really come from the rings, not TCG */
+        g_assert_true(kvm_enabled(from));
+        g_assert_true(kvm_enabled(to));
+    }
+
     /* We want to pick a speed slow enough that the test completes
      * quickly, but that it doesn't complete precopy even on a slow
      * machine, so also set the downtime.
@@ -859,6 +985,11 @@ static void test_precopy_unix(void)
     migrate_set_parameter_int(from, "downtime-limit", 1);
     /* 1GB/s */
     migrate_set_parameter_int(from, "max-bandwidth", 1000000000);
+    migrate_set_parameter_int(from, "dirty-sync-threads", dirty_sync_threads);
+    migrate_set_parameter_int(from, "device-state-threads",
+                              device_state_threads);
+    migrate_set_parameter_int(to, "device-state-threads",
+                              device_state_threads);
 
     /* Wait for the first serial output from the source */
     wait_for_serial("src_serial");
@@ -878,6 +1009,102 @@ static void test_precopy_unix(void)
     wait_for_serial("dest_serial");
     wait_for_migration_complete(from);
 
+    g_assert_cmpint(read_ram_property_int(from, "dirty-sync-time"), >=,
+                    read_ram_property_int(from, "last-dirty-sync-time"));
+
+    check_downtime_breakdown(from, device_state_threads);
+    wait_for_migration_complete(to);
+    check_downtime_breakdown(to, device_state_threads);
+
+    test_migrate_end(from, to, true);
+    g_free(uri);
+}
+
+static void test_precopy_unix(void)
+{
+    do_test_precopy_unix(1, 0, false);
+}
+
+static bool kvm_dirty_ring_supported(void)
+{
+#if defined(__linux__) && defined(HOST_X86_64)
+    int ret, kvm_fd = open("/dev/kvm", O_RDWR);
+
+    if (kvm_fd < 0) {
+        return false;
+    }
+    ret = ioctl(kvm_fd, KVM_CHECK_EXTENSION, KVM_CAP_DIRTY_LOG_RING);
+    close(kvm_fd);
+
+    /* The test asks for 4096 entries per vCPU */
+    return ret >= 4096;
+#else
+    return false;
+#endif
+}
+
+static void test_precopy_unix_dirty_ring(void)
+{
+    if (!kvm_dirty_ring_supported()) {
+        g_test_skip("KVM dirty ring not available");
+        return;
+    }
+    do_test_precopy_unix(1, 0, true);
+}
+
+static void test_precopy_unix_dirty_sync_threads(void)
+{
+    do_test_precopy_unix(4, 0, false);
+}
+
+static void test_precopy_unix_device_state_threads(void)
+{
+    do_test_precopy_unix(1, 2, false);
+}
+
+static void test_precopy_file_mapped_ram(void)
+{
+    char *uri = g_strdup_printf("file:%s/migfile", tmpfs);
+    MigrateStart *args = migrate_start_new();
+    QTestState *from, *to;
+    QDict *rsp;
+
+    /* The file only exists once the source is done */
+    if (test_migrate_start(&from, &to, "defer", args)) {
+        return;
+    }
+
+    /* There is nobody on the other side, so let it converge right away */
+    migrate_set_parameter_int(from, "downtime-limit", CONVERGE_DOWNTIME);
+    /* 1GB/s */
+    migrate_set_parameter_int(from, "max-bandwidth", 1000000000);
+
+    migrate_set_parameter_int(from, "multifd-channels", 4);
+    migrate_set_parameter_int(to, "multifd-channels", 4);
+
+    migrate_set_capability(from, "multifd", "true");
+    migrate_set_capability(to, "multifd", "true");
+    migrate_set_capability(from, "mapped-ram", "true");
+    migrate_set_capability(to, "mapped-ram", "true");
+
+    /* Wait for the first serial output from the source */
+    wait_for_serial("src_serial");
+
+    migrate_qmp(from, uri, "{}");
+
+    if (!got_stop) {
+        qtest_qmp_eventwait(from, "STOP");
+    }
+    wait_for_migration_complete(from);
+
+    rsp = wait_command(to, "{ 'execute': 'migrate-incoming',"
+                           "  'arguments': { 'uri': %s }}", uri);
+    qobject_unref(rsp);
+
+    qtest_qmp_eventwait(to, "RESUME");
+
+    wait_for_serial("dest_serial");
+
     test_migrate_end(from, to, true);
     g_free(uri);
 }
@@ -1262,7 +1489,100 @@ static void test_migrate_auto_converge(void)
     test_migrate_end(from, to, true);
 }
 
-static void test_multifd_tcp(const char *method)
+static QDict *query_vcpu_dirty_limit(QTestState *who)
+{
+    QDict *rsp;
+    QList *list;
+    QDict *info;
+
+    /* wait_command() only handles commands that return an object */
+    rsp = qtest_qmp(who, "{ 'execute': 'query-vcpu-dirty-limit' }");
+    g_assert(!qdict_haskey(rsp, "error"));
+    list = qdict_get_qlist(rsp, "return");
+    g_assert(list && !qlist_empty(list));
+    /* The first vCPU is the one running the test code */
+    info = qobject_to(QDict, qlist_peek(list));
+    qobject_ref(info);
+    qobject_unref(rsp);
+    return info;
+}
+
+/*
+ * The dirty rings are only filled while the global dirty log is on:
+ * check that setting a limit starts it even though no migration runs.
+ */
+static void test_vcpu_dirty_limit(void)
+{
+    MigrateStart *args = migrate_start_new();
+    QTestState *from, *to;
+    QDict *rsp, *info;
+    int64_t current = 0;
+    int i;
+
+    args->use_dirty_ring = true;
+    if (test_migrate_start(&from, &to, "defer", args)) {
+        return;
+    }
+
+    rsp = qtest_qmp(from, "{ 'execute': 'query-vcpu-dirty-limit' }");
+    if (qdict_haskey(rsp, "error")) {
+        qobject_unref(rsp);
+        g_test_skip("dirty page limit requires KVM with the dirty ring");
+        test_migrate_end(from, to, false);
+        return;
+    }
+    qobject_unref(rsp);
+
+    /* Wait for the first serial output from the source */
+    wait_for_serial("src_serial");
+
+    rsp = wait_command(from, "{ 'execute': 'set-vcpu-dirty-limit',"
+                             "  'arguments': { 'dirty-rate': 1 }}");
+    qobject_unref(rsp);
+
+    /* The rates are measured every second, give it a few periods */
+    for (i = 0; i < 100 && !current; i++) {
+        g_usleep(100 * 1000);
+        info = query_vcpu_dirty_limit(from);
+        g_assert_cmpint(qdict_get_int(info, "limit-rate"), ==, 1);
+        current = qdict_get_int(info, "current-rate");
+        qobject_unref(info);
+    }
+    g_assert_cmpint(current, >, 0);
+
+    rsp = wait_command(from, "{ 'execute': 'cancel-vcpu-dirty-limit' }");
+    qobject_unref(rsp);
+    info = query_vcpu_dirty_limit(from);
+    g_assert_cmpint(qdict_get_int(info, "limit-rate"), ==, 0);
+    g_assert_cmpint(qdict_get_int(info, "throttle-percentage"), ==, 0);
+    qobject_unref(info);
+
+    test_migrate_end(from, to, false);
+}
+
+/*
+ * With the bandwidth limited, the channels mostly wait for pages, so
+ * autotune must park some of them.  A decision takes two periods of one
+ * second, give it ten times that.
+ */
+static void wait_for_autotune_channels(QTestState *who, int channels)
+{
+    int64_t active = 0;
+    int i;
+
+    for (i = 0; i < 200; i++) {
+        active = read_migrate_property_int(who, "multifd-active-channels");
+        if (active && active != channels) {
+            break;
+        }
+        g_usleep(100 * 1000);
+    }
+    g_assert_cmpint(active, >, 0);
+    g_assert_cmpint(active, <, channels);
+}
+
+static void test_multifd_tcp(const char *method, bool zero_page,
+                             bool autotune)
 {
     MigrateStart *args = migrate_start_new();
     QTestState *from, *to;
@@ -1280,8 +1600,13 @@ static void test_multifd_tcp(const char *method)
      */
     /* 1 ms should make it not converge*/
     migrate_set_parameter_int(from, "downtime-limit", 1);
-    /* 1GB/s */
-    migrate_set_parameter_int(from, "max-bandwidth", 1000000000);
+    if (autotune) {
+        /* 10MB/s, until the channels have been tuned */
+        migrate_set_parameter_int(from, "max-bandwidth", 10000000);
+    } else {
+        /* 1GB/s */
+        migrate_set_parameter_int(from, "max-bandwidth", 1000000000);
+    }
 
     migrate_set_parameter_int(from, "multifd-channels", 16);
     migrate_set_parameter_int(to, "multifd-channels", 16);
@@ -1292,6 +1617,14 @@ static void test_multifd_tcp(const char *method)
     migrate_set_capability(from, "multifd", "true");
     migrate_set_capability(to, "multifd", "true");
 
+    if (zero_page) {
+        migrate_set_capability(from, "multifd-zero-page", "true");
+        migrate_set_capability(to, "multifd-zero-page", "true");
+    }
+    if (autotune) {
+        migrate_set_capability(from, "multifd-autotune", "true");
+    }
+
     /* Start incoming migration from the 1st socket */
     rsp = wait_command(to, "{ 'execute': 'migrate-incoming',"
                            "  'arguments': { 'uri': 'tcp:127.0.0.1:0' }}");
@@ -1304,6 +1637,11 @@ static void test_multifd_tcp(const char *method)
 
     migrate_qmp(from, uri, "{}");
 
+    if (autotune) {
+        wait_for_autotune_channels(from, 16);
+        migrate_set_parameter_int(from, "max-bandwidth", 1000000000);
+    }
+
     wait_for_migration_pass(from);
 
     migrate_set_parameter_int(from, "downtime-limit", CONVERGE_DOWNTIME);
@@ -1321,18 +1659,40 @@ static void test_multifd_tcp(const char *method)
 
 static void test_multifd_tcp_none(void)
 {
-    test_multifd_tcp("none");
+    test_multifd_tcp("none", false, false);
+}
+
+static void test_multifd_tcp_zero_page(void)
+{
+    test_multifd_tcp("none", true, false);
 }
 
 static void test_multifd_tcp_zlib(void)
 {
-    test_multifd_tcp("zlib");
+    test_multifd_tcp("zlib", false, false);
+}
+
+static void test_multifd_tcp_zlib_autotune(void)
+{
+    test_multifd_tcp("zlib", false, true);
+}
+
+static void test_multifd_tcp_xbzrle(void)
+{
+    test_multifd_tcp("xbzrle", true, false);
 }
 
 #ifdef CONFIG_ZSTD
 static void test_multifd_tcp_zstd(void)
 {
-    test_multifd_tcp("zstd");
+    test_multifd_tcp("zstd", false, false);
+}
+#endif
+
+#ifdef CONFIG_LZ4
+static void test_multifd_tcp_lz4(void)
+{
+    test_multifd_tcp("lz4", false, false);
 }
 #endif
 
@@ -1482,9 +1842,20 @@ int main(int argc, char **argv)
 
     qtest_add_func("/migration/postcopy/unix", test_postcopy);
     qtest_add_func("/migration/postcopy/recovery", test_postcopy_recovery);
+    qtest_add_func("/migration/postcopy/preempt", test_postcopy_preempt);
+    qtest_add_func("/migration/postcopy/fault-threads",
+                   test_postcopy_fault_threads);
     qtest_add_func("/migration/deprecated", test_deprecated);
     qtest_add_func("/migration/bad_dest", test_baddest);
     qtest_add_func("/migration/precopy/unix", test_precopy_unix);
+    qtest_add_func("/migration/precopy/unix/dirty-sync-threads",
+                   test_precopy_unix_dirty_sync_threads);
+    qtest_add_func("/migration/precopy/unix/device-state-threads",
+                   test_precopy_unix_device_state_threads);
+    qtest_add_func("/migration/precopy/unix/dirty-ring",
+                   test_precopy_unix_dirty_ring);
+    qtest_add_func("/migration/precopy/file/mapped-ram",
+                   test_precopy_file_mapped_ram);
     qtest_add_func("/migration/precopy/tcp", test_precopy_tcp);
     /* qtest_add_func("/migration/ignore_shared", test_ignore_shared); */
     qtest_add_func("/migration/xbzrle/unix", test_xbzrle_unix);
@@ -1497,12 +1868,21 @@ int main(int argc, char **argv)
                    test_validate_uuid_dst_not_set);
 
     qtest_add_func("/migration/auto_converge", test_migrate_auto_converge);
+    qtest_add_func("/migration/vcpu_dirty_limit", test_vcpu_dirty_limit);
     qtest_add_func("/migration/multifd/tcp/none", test_multifd_tcp_none);
+    qtest_add_func("/migration/multifd/tcp/zero-page",
+                   test_multifd_tcp_zero_page);
     qtest_add_func("/migration/multifd/tcp/cancel", test_multifd_tcp_cancel);
     qtest_add_func("/migration/multifd/tcp/zlib", test_multifd_tcp_zlib);
+    qtest_add_func("/migration/multifd/tcp/zlib/autotune",
+                   test_multifd_tcp_zlib_autotune);
+    qtest_add_func("/migration/multifd/tcp/xbzrle", test_multifd_tcp_xbzrle);
 #ifdef CONFIG_ZSTD
     qtest_add_func("/migration/multifd/tcp/zstd", test_multifd_tcp_zstd);
 #endif
+#ifdef CONFIG_LZ4
+    qtest_add_func("/migration/multifd/tcp/lz4", test_multifd_tcp_lz4);
+#endif
 
     ret = g_test_run();
 
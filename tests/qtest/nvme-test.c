@@ -8,12 +8,18 @@
  */
 
 #include "qemu/osdep.h"
+#include "qemu/bswap.h"
 #include "qemu/module.h"
 #include "qemu/units.h"
+#include "block/nvme.h"
 #include "libqos/libqtest.h"
 #include "libqos/qgraph.h"
 #include "libqos/pci.h"
 
+#define NVME_TEST_QSIZE         8
+#define NVME_TEST_PAGE_SIZE     4096
+#define NVME_TEST_TIMEOUT_US    (30 * 1000 * 1000)
+
 typedef struct QNvme QNvme;
 
 struct QNvme {
@@ -44,6 +50,204 @@ static void *nvme_create(void *pci_bus, QGuestAllocator *alloc, void *addr)
     return &nvme->obj;
 }
 
+/*
+ * A minimal host driver: the admin queue pair and one I/O queue pair, both
+ * polled, plus the shadow doorbell buffers once they have been configured.
+ */
+typedef struct NvmeTestQueue {
+    uint16_t qid;
+    uint64_t sq;
+    uint64_t cq;
+    uint16_t sq_tail;
+    uint16_t cq_head;
+    bool phase;
+} NvmeTestQueue;
+
+typedef struct NvmeTest {
+    QPCIDevice *pdev;
+    QTestState *qts;
+    QGuestAllocator *alloc;
+    QPCIBar bar;
+    NvmeTestQueue admin;
+    NvmeTestQueue io;
+    uint64_t dbs;
+    uint64_t eis;
+} NvmeTest;
+
+static void nvmetest_queue_init(NvmeTest *t, NvmeTestQueue *q, uint16_t qid)
+{
+    q->qid = qid;
+    q->sq = guest_alloc(t->alloc, NVME_TEST_QSIZE * sizeof(NvmeCmd));
+    q->cq = guest_alloc(t->alloc, NVME_TEST_QSIZE * sizeof(NvmeCqe));
+    qtest_memset(t->qts, q->cq, 0, NVME_TEST_QSIZE * sizeof(NvmeCqe));
+    q->sq_tail = 0;
+    q->cq_head = 0;
+    q->phase = true;
+}
+
+static void nvmetest_write_le32(NvmeTest *t, uint64_t addr, uint32_t val)
+{
+    val = cpu_to_le32(val);
+    qtest_memwrite(t->qts, addr, &val, sizeof(val));
+}
+
+static uint32_t nvmetest_read_le32(NvmeTest *t, uint64_t addr)
+{
+    uint32_t val;
+
+    qtest_memread(t->qts, addr, &val, sizeof(val));
+    return le32_to_cpu(val);
+}
+
+/* Waits for the device to store @val at @addr */
+static void nvmetest_wait_le32(NvmeTest *t, uint64_t addr, uint32_t val)
+{
+    gint64 start_time = g_get_monotonic_time();
+
+    while (nvmetest_read_le32(t, addr) != val) {
+        qtest_clock_step(t->qts, 100);
+        g_assert(g_get_monotonic_time() - start_time <= NVME_TEST_TIMEOUT_US);
+    }
+}
+
+static void nvmetest_start(NvmeTest *t, QNvme *nvme, QGuestAllocator *alloc)
+{
+    gint64 start_time = g_get_monotonic_time();
+    uint32_t cc;
+
+    t->pdev = &nvme->dev;
+    t->qts = t->pdev->bus->qts;
+    t->alloc = alloc;
+    t->dbs = t->eis = 0;
+
+    qpci_device_enable(t->pdev);
+    t->bar = qpci_iomap(t->pdev, 0, NULL);
+
+    nvmetest_queue_init(t, &t->admin, 0);
+    qpci_io_writel(t->pdev, t->bar, offsetof(NvmeBar, aqa),
+                   (NVME_TEST_QSIZE - 1) << 16 | (NVME_TEST_QSIZE - 1));
+    qpci_io_writel(t->pdev, t->bar, offsetof(NvmeBar, asq), t->admin.sq);
+    qpci_io_writel(t->pdev, t->bar, offsetof(NvmeBar, asq) + 4,
+                   t->admin.sq >> 32);
+    qpci_io_writel(t->pdev, t->bar, offsetof(NvmeBar, acq), t->admin.cq);
+    qpci_io_writel(t->pdev, t->bar, offsetof(NvmeBar, acq) + 4,
+                   t->admin.cq >> 32);
+
+    cc = 1 << CC_EN_SHIFT | 6 << CC_IOSQES_SHIFT | 4 << CC_IOCQES_SHIFT;
+    qpci_io_writel(t->pdev, t->bar, offsetof(NvmeBar, cc), cc);
+    while (!NVME_CSTS_RDY(qpci_io_readl(t->pdev, t->bar,
+                                        offsetof(NvmeBar, csts)))) {
+        g_assert(g_get_monotonic_time() - start_time <= NVME_TEST_TIMEOUT_US);
+    }
+    g_assert_false(NVME_CSTS_FAILED & qpci_io_readl(t->pdev, t->bar,
+                                                    offsetof(NvmeBar, csts)));
+}
+
+/* Copies @cmd to the tail of the submission queue without ringing */
+static void nvmetest_queue_cmd(NvmeTest *t, NvmeTestQueue *q, NvmeCmd *cmd)
+{
+    cmd->cid = cpu_to_le16(q->sq_tail);
+    qtest_memwrite(t->qts, q->sq + q->sq_tail * sizeof(NvmeCmd),
+                   cmd, sizeof(*cmd));
+    q->sq_tail = (q->sq_tail + 1) % NVME_TEST_QSIZE;
+}
+
+static void nvmetest_ring_sq(NvmeTest *t, NvmeTestQueue *q, uint16_t tail)
+{
+    qpci_io_writel(t->pdev, t->bar, 0x1000 + (q->qid << 3), tail);
+}
+
+/*
+ * Waits for the next completion and returns its status.  The new head is
+ * written to the shadow doorbell if there is one, else to the register.
+ */
+static uint16_t nvmetest_wait_cqe(NvmeTest *t, NvmeTestQueue *q)
+{
+    gint64 start_time = g_get_monotonic_time();
+    uint64_t addr = q->cq + q->cq_head * sizeof(NvmeCqe);
+    NvmeCqe cqe;
+
+    for (;;) {
+        qtest_memread(t->qts, addr, &cqe, sizeof(cqe));
+        if ((le16_to_cpu(cqe.status) & 1) == q->phase) {
+            break;
+        }
+        qtest_clock_step(t->qts, 100);
+        g_assert(g_get_monotonic_time() - start_time <= NVME_TEST_TIMEOUT_US);
+    }
+
+    q->cq_head = (q->cq_head + 1) % NVME_TEST_QSIZE;
+    if (!q->cq_head) {
+        q->phase = !q->phase;
+    }
+
+    if (q->qid && t->dbs) {
+        nvmetest_write_le32(t, t->dbs + (q->qid << 3) + 4, q->cq_head);
+    } else {
+        qpci_io_writel(t->pdev, t->bar, 0x1000 + (q->qid << 3) + 4,
+                       q->cq_head);
+    }
+
+    return le16_to_cpu(cqe.status) >> 1;
+}
+
+static uint16_t nvmetest_admin(NvmeTest *t, NvmeCmd *cmd)
+{
+    nvmetest_queue_cmd(t, &t->admin, cmd);
+    nvmetest_ring_sq(t, &t->admin, t->admin.sq_tail);
+    return nvmetest_wait_cqe(t, &t->admin);
+}
+
+static uint16_t nvmetest_identify(NvmeTest *t, uint8_t cns, uint32_t nsid,
+                                  uint64_t buf)
+{
+    NvmeCmd cmd = {
+        .opcode = NVME_ADM_CMD_IDENTIFY,
+        .nsid = cpu_to_le32(nsid),
+        .dptr.prp1 = cpu_to_le64(buf),
+        .cdw10 = cpu_to_le32(cns),
+    };
+
+    return nvmetest_admin(t, &cmd);
+}
+
+static void nvmetest_create_io_queues(NvmeTest *t)
+{
+    NvmeCmd cmd = {
+        .opcode = NVME_ADM_CMD_CREATE_CQ,
+        .cdw10 = cpu_to_le32((NVME_TEST_QSIZE - 1) << 16 | 1),
+        .cdw11 = cpu_to_le32(NVME_Q_PC),
+    };
+
+    nvmetest_queue_init(t, &t->io, 1);
+
+    cmd.dptr.prp1 = cpu_to_le64(t->io.cq);
+    g_assert_cmphex(nvmetest_admin(t, &cmd), ==, NVME_SUCCESS);
+
+    cmd = (NvmeCmd) {
+        .opcode = NVME_ADM_CMD_CREATE_SQ,
+        .dptr.prp1 = cpu_to_le64(t->io.sq),
+        .cdw10 = cpu_to_le32((NVME_TEST_QSIZE - 1) << 16 | 1),
+        .cdw11 = cpu_to_le32(1 << 16 | NVME_Q_PC),
+    };
+    g_assert_cmphex(nvmetest_admin(t, &cmd), ==, NVME_SUCCESS);
+}
+
+/* A one block read or write of @buf on the I/O queue, not yet rung */
+static void nvmetest_queue_rw(NvmeTest *t, uint8_t opcode, uint32_t nsid,
+                              uint64_t slba, uint64_t buf)
+{
+    NvmeCmd cmd = {
+        .opcode = opcode,
+        .nsid = cpu_to_le32(nsid),
+        .dptr.prp1 = cpu_to_le64(buf),
+        .cdw10 = cpu_to_le32(slba),
+        .cdw11 = cpu_to_le32(slba >> 32),
+    };
+
+    nvmetest_queue_cmd(t, &t->io, &cmd);
+}
+
 /* This used to cause a NULL pointer dereference.  */
 static void nvmetest_oob_cmb_test(void *obj, void *data, QGuestAllocator *alloc)
 {
@@ -66,6 +270,152 @@ static void nvmetest_oob_cmb_test(void *obj, void *data, QGuestAllocator *alloc)
     g_assert_cmpint(qpci_io_readl(pdev, bar, cmb_bar_size - 1), !=, 0x44332211);
 }
 
+/*
+ * Once the Doorbell Buffer Config command has set up shadow doorbells, the
+ * I/O queues take their SQ tail and CQ head from them and publish what they
+ * have seen as event indexes.
+ */
+static void nvmetest_dbbuf_test(void *obj, void *data, QGuestAllocator *alloc)
+{
+    QNvme *nvme = obj;
+    NvmeTest t;
+    NvmeCmd cmd = {
+        .opcode = NVME_ADM_CMD_DBBUF_CONFIG,
+    };
+    uint64_t buf;
+    uint16_t oacs;
+    int i;
+
+    nvmetest_start(&t, nvme, alloc);
+
+    buf = guest_alloc(alloc, NVME_TEST_PAGE_SIZE);
+    g_assert_cmphex(nvmetest_identify(&t, NVME_ID_CNS_CTRL, 0, buf), ==,
+                    NVME_SUCCESS);
+    qtest_memread(t.qts, buf + offsetof(NvmeIdCtrl, oacs), &oacs,
+                  sizeof(oacs));
+    g_assert_cmphex(le16_to_cpu(oacs) & NVME_OACS_DBBUF, ==, NVME_OACS_DBBUF);
+
+    t.dbs = guest_alloc(alloc, NVME_TEST_PAGE_SIZE);
+    t.eis = guest_alloc(alloc, NVME_TEST_PAGE_SIZE);
+    qtest_memset(t.qts, t.dbs, 0, NVME_TEST_PAGE_SIZE);
+    qtest_memset(t.qts, t.eis, 0, NVME_TEST_PAGE_SIZE);
+
+    /* The buffers must be page aligned */
+    cmd.dptr.prp1 = cpu_to_le64(t.dbs + 8);
+    cmd.dptr.prp2 = cpu_to_le64(t.eis);
+    g_assert_cmphex(nvmetest_admin(&t, &cmd), ==,
+                    NVME_INVALID_FIELD | NVME_DNR);
+
+    cmd.dptr.prp1 = cpu_to_le64(t.dbs);
+    g_assert_cmphex(nvmetest_admin(&t, &cmd), ==, NVME_SUCCESS);
+
+    nvmetest_create_io_queues(&t);
+
+    /*
+     * Queue two writes, but only put the first one in the doorbell register.
+     * The controller must take the tail from the shadow doorbell.
+     */
+    nvmetest_queue_rw(&t, NVME_CMD_WRITE, 1, 0, buf);
+    nvmetest_queue_rw(&t, NVME_CMD_WRITE, 1, 1, buf);
+    nvmetest_write_le32(&t, t.dbs + 8, t.io.sq_tail);
+    nvmetest_ring_sq(&t, &t.io, 1);
+    for (i = 0; i < 2; i++) {
+        g_assert_cmphex(nvmetest_wait_cqe(&t, &t.io), ==, NVME_SUCCESS);
+    }
+    nvmetest_wait_le32(&t, t.eis + 8, 2);
+
+    /*
+     * The CQ head of the two completions was only written to the shadow
+     * doorbell; the controller picks it up when posting the next one.
+     */
+    nvmetest_queue_rw(&t, NVME_CMD_READ, 1, 0, buf);
+    nvmetest_write_le32(&t, t.dbs + 8, t.io.sq_tail);
+    nvmetest_ring_sq(&t, &t.io, t.io.sq_tail);
+    g_assert_cmphex(nvmetest_wait_cqe(&t, &t.io), ==, NVME_SUCCESS);
+    nvmetest_wait_le32(&t, t.eis + 8, 3);
+    nvmetest_wait_le32(&t, t.eis + 12, 2);
+
+    guest_free(alloc, buf);
+}
+
+static void *nvmetest_namespaces_setup(GString *cmd_line, void *arg)
+{
+    g_string_append(cmd_line,
+                    " -drive id=drv1,if=none,file=null-co://,"
+                    "file.size=4M,file.read-zeroes=on,format=raw"
+                    " -drive id=drv2,if=none,file=null-co://,"
+                    "file.read-zeroes=on,format=raw"
+                    " -device nvme-ns,bus=nvme0,drive=drv1,nsid=4"
+                    " -device nvme-ns,bus=nvme0,drive=drv2 ");
+    return arg;
+}
+
+/*
+ * The controller's drive is namespace 1, drv1 has id 4 and drv2 takes the
+ * lowest free id, 2.  Ids 3 and 5 up to 256 are inactive.
+ */
+static void nvmetest_namespaces_test(void *obj, void *data,
+                                     QGuestAllocator *alloc)
+{
+    QNvme *nvme = obj;
+    NvmeTest t;
+    uint64_t buf;
+    uint64_t nsze;
+    uint32_t list[4];
+    uint32_t nn;
+
+    nvmetest_start(&t, nvme, alloc);
+
+    buf = guest_alloc(alloc, NVME_TEST_PAGE_SIZE);
+    g_assert_cmphex(nvmetest_identify(&t, NVME_ID_CNS_CTRL, 0, buf), ==,
+                    NVME_SUCCESS);
+    qtest_memread(t.qts, buf + offsetof(NvmeIdCtrl, nn), &nn, sizeof(nn));
+    g_assert_cmpuint(le32_to_cpu(nn), ==, 256);
+
+    g_assert_cmphex(nvmetest_identify(&t, NVME_ID_CNS_NS_ACTIVE_LIST, 0, buf),
+                    ==, NVME_SUCCESS);
+    qtest_memread(t.qts, buf, list, sizeof(list));
+    g_assert_cmpuint(le32_to_cpu(list[0]), ==, 1);
+    g_assert_cmpuint(le32_to_cpu(list[1]), ==, 2);
+    g_assert_cmpuint(le32_to_cpu(list[2]), ==, 4);
+    g_assert_cmpuint(le32_to_cpu(list[3]), ==, 0);
+
+    g_assert_cmphex(nvmetest_identify(&t, NVME_ID_CNS_NS_ACTIVE_LIST, 2, buf),
+                    ==, NVME_SUCCESS);
+    qtest_memread(t.qts, buf, list, sizeof(list));
+    g_assert_cmpuint(le32_to_cpu(list[0]), ==, 4);
+    g_assert_cmpuint(le32_to_cpu(list[1]), ==, 0);
+
+    g_assert_cmphex(nvmetest_identify(&t, NVME_ID_CNS_NS, 4, buf), ==,
+                    NVME_SUCCESS);
+    qtest_memread(t.qts, buf + offsetof(NvmeIdNs, nsze), &nsze, sizeof(nsze));
+    g_assert_cmpuint(le64_to_cpu(nsze), ==, 4 * MiB / 512);
+
+    /* An inactive id reports a zero filled structure */
+    qtest_memset(t.qts, buf, 0xff, NVME_TEST_PAGE_SIZE);
+    g_assert_cmphex(nvmetest_identify(&t, NVME_ID_CNS_NS, 3, buf), ==,
+                    NVME_SUCCESS);
+    qtest_memread(t.qts, buf + offsetof(NvmeIdNs, nsze), &nsze, sizeof(nsze));
+    g_assert_cmpuint(nsze, ==, 0);
+
+    g_assert_cmphex(nvmetest_identify(&t, NVME_ID_CNS_NS, 257, buf), ==,
+                    NVME_INVALID_NSID | NVME_DNR);
+
+    /* I/O goes to active namespaces only */
+    nvmetest_create_io_queues(&t);
+
+    nvmetest_queue_rw(&t, NVME_CMD_READ, 4, 0, buf);
+    nvmetest_ring_sq(&t, &t.io, t.io.sq_tail);
+    g_assert_cmphex(nvmetest_wait_cqe(&t, &t.io), ==, NVME_SUCCESS);
+
+    nvmetest_queue_rw(&t, NVME_CMD_READ, 3, 0, buf);
+    nvmetest_ring_sq(&t, &t.io, t.io.sq_tail);
+    g_assert_cmphex(nvmetest_wait_cqe(&t, &t.io), ==,
+                    NVME_INVALID_FIELD | NVME_DNR);
+
+    guest_free(alloc, buf);
+}
+
 static void nvme_register_nodes(void)
 {
     QOSGraphEdgeOptions opts = {
@@ -83,6 +433,17 @@ static void nvme_register_nodes(void)
     qos_add_test("oob-cmb-access", "nvme", nvmetest_oob_cmb_test, &(QOSGraphTestOptions) {
         .edge.extra_device_opts = "cmb_size_mb=2"
     });
+    qos_add_test("dbbuf", "nvme", nvmetest_dbbuf_test, NULL);
+    qos_add_test("dbbuf-iothread", "nvme", nvmetest_dbbuf_test,
+                 &(QOSGraphTestOptions) {
+        .edge.before_cmd_line = "-object iothread,id=thread0",
+        .edge.extra_device_opts = "iothread=thread0",
+    });
+    qos_add_test("namespaces", "nvme", nvmetest_namespaces_test,
+                 &(QOSGraphTestOptions) {
+        .before = nvmetest_namespaces_setup,
+        .edge.extra_device_opts = "id=nvme0",
+    });
 }
 
 libqos_init(nvme_register_nodes);
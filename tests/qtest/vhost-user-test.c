@@ -13,6 +13,7 @@
 #include "libqtest-single.h"
 #include "qapi/error.h"
 #include "qapi/qmp/qdict.h"
+#include "qapi/qmp/qlist.h"
 #include "qemu/config-file.h"
 #include "qemu/option.h"
 #include "qemu/range.h"
@@ -915,6 +916,30 @@ static void test_vhost_user_started(void *obj, void *arg, QGuestAllocator *alloc
     wait_for_rings_started(s, 2);
 }
 
+/*
+ * query-vhost-iotlb returns a list.  The device is started but has no
+ * vIOMMU to translate through, so it must not be listed.
+ */
+static void test_vhost_iotlb_query(void *obj, void *arg,
+                                   QGuestAllocator *alloc)
+{
+    TestServer *s = arg;
+    QDict *rsp;
+    QList *list;
+
+    if (!wait_for_fds(s)) {
+        return;
+    }
+    wait_for_rings_started(s, 2);
+
+    rsp = qmp("{ 'execute': 'query-vhost-iotlb' }");
+    g_assert(!qdict_haskey(rsp, "error"));
+    list = qdict_get_qlist(rsp, "return");
+    g_assert_nonnull(list);
+    g_assert(qlist_empty(list));
+    qobject_unref(rsp);
+}
+
 static void *vhost_user_test_setup_multiqueue(GString *cmd_line, void *arg)
 {
     TestServer *s = vhost_user_test_setup(cmd_line, arg);
@@ -995,6 +1020,10 @@ static void register_vhost_user_test(void)
                  "virtio-net",
                  test_migrate, &opts);
 
+    qos_add_test("vhost-user/iotlb-query",
+                 "virtio-net",
+                 test_vhost_iotlb_query, &opts);
+
     /* keeps failing on build-system since Aug 15 2017 */
     if (getenv("QTEST_VHOST_USER_FIXME")) {
         opts.before = vhost_user_test_setup_reconnect;
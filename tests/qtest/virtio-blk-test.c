@@ -12,6 +12,7 @@
 #include "libqtest-single.h"
 #include "qemu/bswap.h"
 #include "qemu/module.h"
+#include "qapi/qmp/qdict.h"
 #include "standard-headers/linux/virtio_blk.h"
 #include "standard-headers/linux/virtio_pci.h"
 #include "libqos/qgraph.h"
@@ -24,6 +25,18 @@
 #define QVIRTIO_BLK_TIMEOUT_US  (30 * 1000 * 1000)
 #define PCI_SLOT_HP             0x06
 
+/*
+ * More than two batches of virtqueue_pop_batch(), and more segments than
+ * a pooled VirtQueueElement has room for.
+ */
+#define BATCH_REQS              33
+
+/* Four zones on the zoned null-co backend */
+#define ZONED_IMAGE_SIZE        (16 * 1024 * 1024)
+#define ZONED_ZONE_SIZE         (4 * 1024 * 1024)
+#define ZONED_NR_ZONES          (ZONED_IMAGE_SIZE / ZONED_ZONE_SIZE)
+#define ZONED_ZONE_SECTORS      (ZONED_ZONE_SIZE / 512)
+
 typedef struct QVirtioBlkReq {
     uint32_t type;
     uint32_t ioprio;
@@ -91,8 +104,13 @@ static uint64_t virtio_blk_request(QGuestAllocator *alloc, QVirtioDevice *d,
     switch (req->type) {
     case VIRTIO_BLK_T_IN:
     case VIRTIO_BLK_T_OUT:
+    case VIRTIO_BLK_T_ZONE_APPEND:
         g_assert_cmpuint(data_size % 512, ==, 0);
         break;
+    case VIRTIO_BLK_T_ZONE_REPORT:
+        g_assert_cmpuint(data_size %
+                         sizeof(struct virtio_blk_zone_descriptor), ==, 0);
+        break;
     case VIRTIO_BLK_T_DISCARD:
     case VIRTIO_BLK_T_WRITE_ZEROES:
         g_assert_cmpuint(data_size %
@@ -113,6 +131,61 @@ static uint64_t virtio_blk_request(QGuestAllocator *alloc, QVirtioDevice *d,
     return addr;
 }
 
+/*
+ * Adds a request built by virtio_blk_request() as a header, @data_segs data
+ * descriptors of equal size and a status descriptor.  Returns the head.
+ */
+static uint32_t virtio_blk_add_request(QTestState *qts, QVirtQueue *vq,
+                                       uint64_t req_addr, uint64_t data_size,
+                                       int data_segs, bool is_read)
+{
+    uint64_t seg_size = data_size / data_segs;
+    uint32_t free_head;
+    int i;
+
+    free_head = qvirtqueue_add(qts, vq, req_addr, 16, false, true);
+    for (i = 0; i < data_segs; i++) {
+        qvirtqueue_add(qts, vq, req_addr + 16 + i * seg_size, seg_size,
+                       is_read, true);
+    }
+    qvirtqueue_add(qts, vq, req_addr + 16 + data_size, 1, true, false);
+
+    return free_head;
+}
+
+/*
+ * Waits until all of @heads have been used, in any order.  Unlike
+ * qvirtio_wait_used_elem() this does not rely on the ISR, which is only
+ * raised once for completions that arrive together.
+ */
+static void virtio_blk_wait_used_elems(QTestState *qts, QVirtQueue *vq,
+                                       const uint32_t *heads, int n)
+{
+    gint64 start_time = g_get_monotonic_time();
+    g_autofree bool *used = g_new0(bool, n);
+    uint32_t desc_idx;
+    int i, done = 0;
+
+    while (done < n) {
+        qtest_clock_step(qts, 100);
+
+        while (qvirtqueue_get_buf(qts, vq, &desc_idx, NULL)) {
+            for (i = 0; i < n; i++) {
+                if (heads[i] == desc_idx) {
+                    break;
+                }
+            }
+            g_assert_cmpint(i, <, n);
+            g_assert_false(used[i]);
+            used[i] = true;
+            done++;
+        }
+
+        g_assert(g_get_monotonic_time() - start_time <=
+                 QVIRTIO_BLK_TIMEOUT_US);
+    }
+}
+
 /* Returns the request virtqueue so the caller can perform further tests */
 static QVirtQueue *test_basic(QVirtioDevice *dev, QGuestAllocator *alloc)
 {
@@ -433,6 +506,92 @@ static void indirect(void *obj, void *u_data, QGuestAllocator *t_alloc)
     qvirtqueue_cleanup(dev->bus, vq, t_alloc);
 }
 
+/*
+ * Queue more requests than the device takes off the ring in one batch,
+ * and a request whose chain is longer than what fits a pooled element.
+ */
+static void batch(void *obj, void *u_data, QGuestAllocator *t_alloc)
+{
+    QVirtioBlk *blk_if = obj;
+    QVirtioDevice *dev = blk_if->vdev;
+    QVirtioBlkReq req;
+    QVirtQueue *vq;
+    uint64_t req_addr[BATCH_REQS];
+    uint32_t heads[BATCH_REQS];
+    uint64_t features;
+    uint8_t status;
+    char *data;
+    char *expected;
+    int i;
+    QTestState *qts = global_qtest;
+
+    features = qvirtio_get_features(dev);
+    features = features & ~(QVIRTIO_F_BAD_FEATURE |
+                            (1u << VIRTIO_RING_F_INDIRECT_DESC) |
+                            (1u << VIRTIO_RING_F_EVENT_IDX) |
+                            (1u << VIRTIO_BLK_F_SCSI));
+    qvirtio_set_features(dev, features);
+
+    vq = qvirtqueue_setup(dev, t_alloc, 0);
+    qvirtio_set_driver_ok(dev);
+
+    /* Write requests, made available with a single notification */
+    for (i = 0; i < BATCH_REQS; i++) {
+        req.type = VIRTIO_BLK_T_OUT;
+        req.ioprio = 1;
+        req.sector = i;
+        req.data = g_malloc0(512);
+        sprintf(req.data, "TEST%d", i);
+
+        req_addr[i] = virtio_blk_request(t_alloc, dev, &req, 512);
+
+        g_free(req.data);
+
+        heads[i] = virtio_blk_add_request(qts, vq, req_addr[i], 512, 1,
+                                          false);
+    }
+    qvirtqueue_kick_batch(qts, dev, vq, heads, BATCH_REQS);
+
+    virtio_blk_wait_used_elems(qts, vq, heads, BATCH_REQS);
+    for (i = 0; i < BATCH_REQS; i++) {
+        status = readb(req_addr[i] + 528);
+        g_assert_cmpint(status, ==, 0);
+        guest_free(t_alloc, req_addr[i]);
+    }
+
+    /* Read them back with one data descriptor per sector */
+    req.type = VIRTIO_BLK_T_IN;
+    req.ioprio = 1;
+    req.sector = 0;
+    req.data = g_malloc0(BATCH_REQS * 512);
+
+    req_addr[0] = virtio_blk_request(t_alloc, dev, &req, BATCH_REQS * 512);
+
+    g_free(req.data);
+
+    heads[0] = virtio_blk_add_request(qts, vq, req_addr[0], BATCH_REQS * 512,
+                                      BATCH_REQS, true);
+    qvirtqueue_kick(qts, dev, vq, heads[0]);
+
+    virtio_blk_wait_used_elems(qts, vq, heads, 1);
+    status = readb(req_addr[0] + 16 + BATCH_REQS * 512);
+    g_assert_cmpint(status, ==, 0);
+
+    data = g_malloc0(BATCH_REQS * 512);
+    expected = g_malloc0(512);
+    memread(req_addr[0] + 16, data, BATCH_REQS * 512);
+    for (i = 0; i < BATCH_REQS; i++) {
+        memset(expected, 0, 512);
+        sprintf(expected, "TEST%d", i);
+        g_assert_cmpmem(data + i * 512, 512, expected, 512);
+    }
+    g_free(expected);
+    g_free(data);
+
+    guest_free(t_alloc, req_addr[0]);
+    qvirtqueue_cleanup(dev->bus, vq, t_alloc);
+}
+
 static void config(void *obj, void *data, QGuestAllocator *t_alloc)
 {
     QVirtioBlk *blk_if = obj;
@@ -695,6 +854,378 @@ static void idx(void *obj, void *u_data, QGuestAllocator *t_alloc)
     qvirtqueue_cleanup(dev->bus, vq, t_alloc);
 }
 
+#define MERGE_WINDOW_PATH "/machine/peripheral/drv0/virtio-backend"
+
+static uint64_t merge_window_counter(const char *name)
+{
+    QDict *rsp;
+    uint64_t value;
+
+    rsp = qmp("{ 'execute': 'qom-get',"
+              "  'arguments': { 'path': %s, 'property': %s } }",
+              MERGE_WINDOW_PATH, name);
+    g_assert(qdict_haskey(rsp, "return"));
+    value = qdict_get_int(rsp, "return");
+    qobject_unref(rsp);
+    return value;
+}
+
+static void merge_window_writes(QGuestAllocator *t_alloc,
+                                QVirtioDevice *dev, QVirtQueue *vq,
+                                const uint64_t *sectors, int n)
+{
+    QVirtioBlkReq req;
+    uint64_t req_addr[8];
+    uint32_t heads[8];
+    uint8_t status;
+    QTestState *qts = global_qtest;
+    int i;
+
+    g_assert(n <= ARRAY_SIZE(heads) && n % 4 == 0);
+
+    /* Four per notification, each batch within the window of the last */
+    for (i = 0; i < n; i++) {
+        req.type = VIRTIO_BLK_T_OUT;
+        req.ioprio = 1;
+        req.sector = sectors[i];
+        req.data = g_malloc0(512);
+        sprintf(req.data, "TEST%" PRIu64, sectors[i]);
+
+        req_addr[i] = virtio_blk_request(t_alloc, dev, &req, 512);
+
+        g_free(req.data);
+
+        heads[i] = virtio_blk_add_request(qts, vq, req_addr[i], 512, 1,
+                                          false);
+        if (i % 4 == 3) {
+            qvirtqueue_kick_batch(qts, dev, vq, &heads[i - 3], 4);
+        }
+    }
+
+    virtio_blk_wait_used_elems(qts, vq, heads, n);
+    for (i = 0; i < n; i++) {
+        status = readb(req_addr[i] + 528);
+        g_assert_cmpint(status, ==, 0);
+        guest_free(t_alloc, req_addr[i]);
+    }
+}
+
+/*
+ * Adjacent writes are merged, also across handler passes held by the
+ * merge window; scattered ones are not.  Everything completes once the
+ * window expires, with the right data on disk.
+ */
+static void merge_window(void *obj, void *u_data, QGuestAllocator *t_alloc)
+{
+    static const uint64_t sequential[] = { 0, 1, 2, 3, 4, 5, 6, 7 };
+    static const uint64_t scattered[] = { 100, 300, 500, 700 };
+    QVirtioBlkPCI *blk = obj;
+    QVirtioDevice *dev = &blk->pci_vdev.vdev;
+    QVirtioBlkReq req;
+    QVirtQueue *vq;
+    uint64_t req_addr[1];
+    uint32_t heads[1];
+    uint64_t features;
+    uint64_t merged, unmerged;
+    uint8_t status;
+    char *data;
+    char *expected;
+    int i;
+    QTestState *qts = global_qtest;
+
+    features = qvirtio_get_features(dev);
+    features = features & ~(QVIRTIO_F_BAD_FEATURE |
+                            (1u << VIRTIO_RING_F_INDIRECT_DESC) |
+                            (1u << VIRTIO_RING_F_EVENT_IDX) |
+                            (1u << VIRTIO_BLK_F_SCSI));
+    qvirtio_set_features(dev, features);
+
+    vq = qvirtqueue_setup(dev, t_alloc, 0);
+    qvirtio_set_driver_ok(dev);
+
+    merged = merge_window_counter("merged-requests");
+    merge_window_writes(t_alloc, dev, vq, sequential, ARRAY_SIZE(sequential));
+    g_assert_cmpuint(merge_window_counter("merged-requests"), >, merged);
+
+    merged = merge_window_counter("merged-requests");
+    unmerged = merge_window_counter("unmerged-requests");
+
+    merge_window_writes(t_alloc, dev, vq, scattered, ARRAY_SIZE(scattered));
+    g_assert_cmpuint(merge_window_counter("merged-requests"), ==, merged);
+    g_assert_cmpuint(merge_window_counter("unmerged-requests"), ==,
+                     unmerged + ARRAY_SIZE(scattered));
+
+    /* Read request */
+    req.type = VIRTIO_BLK_T_IN;
+    req.ioprio = 1;
+    req.sector = 0;
+    req.data = g_malloc0(8 * 512);
+
+    req_addr[0] = virtio_blk_request(t_alloc, dev, &req, 8 * 512);
+
+    g_free(req.data);
+
+    heads[0] = virtio_blk_add_request(qts, vq, req_addr[0], 8 * 512, 1, true);
+    qvirtqueue_kick(qts, dev, vq, heads[0]);
+
+    virtio_blk_wait_used_elems(qts, vq, heads, 1);
+    status = readb(req_addr[0] + 16 + 8 * 512);
+    g_assert_cmpint(status, ==, 0);
+
+    data = g_malloc0(8 * 512);
+    expected = g_malloc0(512);
+    memread(req_addr[0] + 16, data, 8 * 512);
+    for (i = 0; i < 8; i++) {
+        memset(expected, 0, 512);
+        sprintf(expected, "TEST%d", i);
+        g_assert_cmpmem(data + i * 512, 512, expected, 512);
+    }
+    g_free(expected);
+    g_free(data);
+
+    guest_free(t_alloc, req_addr[0]);
+    qvirtqueue_cleanup(dev->bus, vq, t_alloc);
+}
+
+static uint64_t zoned_fix_u64(QVirtioDevice *d, uint64_t val)
+{
+    return qvirtio_is_big_endian(d) != host_is_big_endian ? bswap64(val) : val;
+}
+
+/* Sends a zone management command for the zone at @sector */
+static uint8_t zoned_mgmt(QVirtioDevice *dev, QGuestAllocator *alloc,
+                          QVirtQueue *vq, uint32_t type, uint64_t sector)
+{
+    QVirtioBlkReq req;
+    uint64_t req_addr;
+    uint32_t free_head;
+    uint8_t status;
+    QTestState *qts = global_qtest;
+
+    req.type = type;
+    req.ioprio = 1;
+    req.sector = sector;
+    req.data = NULL;
+
+    req_addr = virtio_blk_request(alloc, dev, &req, 0);
+
+    free_head = qvirtqueue_add(qts, vq, req_addr, 16, false, true);
+    qvirtqueue_add(qts, vq, req_addr + 16, 1, true, false);
+    qvirtqueue_kick(qts, dev, vq, free_head);
+
+    qvirtio_wait_used_elem(qts, dev, vq, free_head, NULL,
+                           QVIRTIO_BLK_TIMEOUT_US);
+    status = readb(req_addr + 16);
+
+    guest_free(alloc, req_addr);
+    return status;
+}
+
+/*
+ * Reports up to @nr zones starting with the one at @sector into @zones.
+ * Returns the number of zones reported.
+ */
+static uint64_t zoned_report(QVirtioDevice *dev, QGuestAllocator *alloc,
+                             QVirtQueue *vq, uint64_t sector, int nr,
+                             struct virtio_blk_zone_descriptor *zones)
+{
+    struct virtio_blk_zone_report hdr;
+    QVirtioBlkReq req;
+    uint64_t req_addr;
+    uint64_t data_size = sizeof(hdr) + nr * sizeof(*zones);
+    uint64_t nr_zones;
+    uint32_t free_head;
+    uint8_t status;
+    int i;
+    QTestState *qts = global_qtest;
+
+    req.type = VIRTIO_BLK_T_ZONE_REPORT;
+    req.ioprio = 1;
+    req.sector = sector;
+    req.data = g_malloc0(data_size);
+
+    req_addr = virtio_blk_request(alloc, dev, &req, data_size);
+
+    g_free(req.data);
+
+    free_head = virtio_blk_add_request(qts, vq, req_addr, data_size, 1, true);
+    qvirtqueue_kick(qts, dev, vq, free_head);
+
+    qvirtio_wait_used_elem(qts, dev, vq, free_head, NULL,
+                           QVIRTIO_BLK_TIMEOUT_US);
+    status = readb(req_addr + 16 + data_size);
+    g_assert_cmpint(status, ==, VIRTIO_BLK_S_OK);
+
+    memread(req_addr + 16, &hdr, sizeof(hdr));
+    nr_zones = zoned_fix_u64(dev, hdr.nr_zones);
+    g_assert_cmpuint(nr_zones, <=, nr);
+
+    memread(req_addr + 16 + sizeof(hdr), zones, nr_zones * sizeof(*zones));
+    for (i = 0; i < nr_zones; i++) {
+        zones[i].z_cap = zoned_fix_u64(dev, zones[i].z_cap);
+        zones[i].z_start = zoned_fix_u64(dev, zones[i].z_start);
+        zones[i].z_wp = zoned_fix_u64(dev, zones[i].z_wp);
+    }
+
+    guest_free(alloc, req_addr);
+    return nr_zones;
+}
+
+/*
+ * Appends @nr_sectors to the zone at @sector.  On success, *@append_sector
+ * is where the data was written.
+ */
+static uint8_t zoned_append(QVirtioDevice *dev, QGuestAllocator *alloc,
+                            QVirtQueue *vq, uint64_t sector, int nr_sectors,
+                            uint64_t *append_sector)
+{
+    QVirtioBlkReq req;
+    uint64_t req_addr, sector_addr;
+    uint64_t data_size = nr_sectors * 512;
+    uint32_t free_head;
+    uint8_t status;
+    QTestState *qts = global_qtest;
+
+    req.type = VIRTIO_BLK_T_ZONE_APPEND;
+    req.ioprio = 1;
+    req.sector = sector;
+    req.data = g_malloc0(data_size);
+    strcpy(req.data, "TEST");
+
+    req_addr = virtio_blk_request(alloc, dev, &req, data_size);
+    sector_addr = guest_alloc(alloc, sizeof(*append_sector));
+
+    g_free(req.data);
+
+    /* The appended sector comes back before the status */
+    free_head = qvirtqueue_add(qts, vq, req_addr, 16, false, true);
+    qvirtqueue_add(qts, vq, req_addr + 16, data_size, false, true);
+    qvirtqueue_add(qts, vq, sector_addr, sizeof(*append_sector), true, true);
+    qvirtqueue_add(qts, vq, req_addr + 16 + data_size, 1, true, false);
+    qvirtqueue_kick(qts, dev, vq, free_head);
+
+    qvirtio_wait_used_elem(qts, dev, vq, free_head, NULL,
+                           QVIRTIO_BLK_TIMEOUT_US);
+    status = readb(req_addr + 16 + data_size);
+    if (status == VIRTIO_BLK_S_OK) {
+        memread(sector_addr, append_sector, sizeof(*append_sector));
+        *append_sector = zoned_fix_u64(dev, *append_sector);
+    }
+
+    guest_free(alloc, sector_addr);
+    guest_free(alloc, req_addr);
+    return status;
+}
+
+static void zoned_check_zone(QVirtioDevice *dev, QGuestAllocator *alloc,
+                             QVirtQueue *vq, int idx, uint64_t wp,
+                             uint8_t state)
+{
+    struct virtio_blk_zone_descriptor zone;
+
+    g_assert_cmpuint(zoned_report(dev, alloc, vq,
+                                  idx * ZONED_ZONE_SECTORS, 1, &zone), ==, 1);
+    g_assert_cmpuint(zone.z_start, ==, idx * ZONED_ZONE_SECTORS);
+    g_assert_cmpuint(zone.z_wp, ==, wp);
+    g_assert_cmpint(zone.z_state, ==, state);
+}
+
+/*
+ * Zone report, append and management against a host-managed device,
+ * including the errors for commands that do not address a valid zone.
+ */
+static void zoned(void *obj, void *data, QGuestAllocator *t_alloc)
+{
+    QVirtioBlk *blk_if = obj;
+    QVirtioDevice *dev = blk_if->vdev;
+    struct virtio_blk_zone_descriptor zones[ZONED_NR_ZONES + 1];
+    uint64_t zone1 = ZONED_ZONE_SECTORS;
+    uint64_t features;
+    uint64_t append_sector;
+    uint64_t nr_zones;
+    QVirtQueue *vq;
+    int i;
+
+    features = qvirtio_get_features(dev);
+    g_assert(features & (1u << VIRTIO_BLK_F_ZONED));
+    features = features & ~(QVIRTIO_F_BAD_FEATURE |
+                            (1u << VIRTIO_RING_F_INDIRECT_DESC) |
+                            (1u << VIRTIO_RING_F_EVENT_IDX) |
+                            (1u << VIRTIO_BLK_F_SCSI));
+    qvirtio_set_features(dev, features);
+
+    g_assert_cmpint(qvirtio_config_readq(dev, 0), ==, ZONED_IMAGE_SIZE / 512);
+    g_assert_cmpint(qvirtio_config_readl(dev,
+                        offsetof(struct virtio_blk_config, zoned.zone_sectors)),
+                    ==, ZONED_ZONE_SECTORS);
+    g_assert_cmpint(qvirtio_config_readb(dev,
+                        offsetof(struct virtio_blk_config, zoned.model)),
+                    ==, VIRTIO_BLK_Z_HM);
+
+    vq = qvirtqueue_setup(dev, t_alloc, 0);
+    qvirtio_set_driver_ok(dev);
+
+    /* Report more zones than there are: only the existing ones come back */
+    nr_zones = zoned_report(dev, t_alloc, vq, 0, ARRAY_SIZE(zones), zones);
+    g_assert_cmpuint(nr_zones, ==, ZONED_NR_ZONES);
+    for (i = 0; i < nr_zones; i++) {
+        g_assert_cmpuint(zones[i].z_start, ==, i * ZONED_ZONE_SECTORS);
+        g_assert_cmpuint(zones[i].z_cap, ==, ZONED_ZONE_SECTORS);
+        g_assert_cmpuint(zones[i].z_wp, ==, zones[i].z_start);
+        g_assert_cmpint(zones[i].z_type, ==, VIRTIO_BLK_ZT_SWR);
+        g_assert_cmpint(zones[i].z_state, ==, VIRTIO_BLK_ZS_EMPTY);
+    }
+
+    /* Appends land at the write pointer and move it */
+    g_assert_cmpint(zoned_append(dev, t_alloc, vq, zone1, 2, &append_sector),
+                    ==, VIRTIO_BLK_S_OK);
+    g_assert_cmpuint(append_sector, ==, zone1);
+    g_assert_cmpint(zoned_append(dev, t_alloc, vq, zone1, 1, &append_sector),
+                    ==, VIRTIO_BLK_S_OK);
+    g_assert_cmpuint(append_sector, ==, zone1 + 2);
+    zoned_check_zone(dev, t_alloc, vq, 1, zone1 + 3, VIRTIO_BLK_ZS_IOPEN);
+
+    /* Management ops */
+    g_assert_cmpint(zoned_mgmt(dev, t_alloc, vq, VIRTIO_BLK_T_ZONE_CLOSE,
+                               zone1), ==, VIRTIO_BLK_S_OK);
+    zoned_check_zone(dev, t_alloc, vq, 1, zone1 + 3, VIRTIO_BLK_ZS_CLOSED);
+
+    g_assert_cmpint(zoned_mgmt(dev, t_alloc, vq, VIRTIO_BLK_T_ZONE_RESET,
+                               zone1), ==, VIRTIO_BLK_S_OK);
+    zoned_check_zone(dev, t_alloc, vq, 1, zone1, VIRTIO_BLK_ZS_EMPTY);
+
+    g_assert_cmpint(zoned_mgmt(dev, t_alloc, vq, VIRTIO_BLK_T_ZONE_OPEN,
+                               2 * ZONED_ZONE_SECTORS), ==, VIRTIO_BLK_S_OK);
+    zoned_check_zone(dev, t_alloc, vq, 2, 2 * ZONED_ZONE_SECTORS,
+                     VIRTIO_BLK_ZS_EOPEN);
+
+    g_assert_cmpint(zoned_mgmt(dev, t_alloc, vq, VIRTIO_BLK_T_ZONE_FINISH,
+                               3 * ZONED_ZONE_SECTORS), ==, VIRTIO_BLK_S_OK);
+    zoned_check_zone(dev, t_alloc, vq, 3, 4 * ZONED_ZONE_SECTORS,
+                     VIRTIO_BLK_ZS_FULL);
+
+    /* Invalid zones: past the end, not the start of a zone, or full */
+    g_assert_cmpint(zoned_mgmt(dev, t_alloc, vq, VIRTIO_BLK_T_ZONE_OPEN,
+                               ZONED_NR_ZONES * ZONED_ZONE_SECTORS),
+                    ==, VIRTIO_BLK_S_ZONE_INVALID_CMD);
+    g_assert_cmpint(zoned_mgmt(dev, t_alloc, vq, VIRTIO_BLK_T_ZONE_RESET,
+                               zone1 + 1), ==, VIRTIO_BLK_S_ZONE_INVALID_CMD);
+    g_assert_cmpint(zoned_append(dev, t_alloc, vq, 3 * ZONED_ZONE_SECTORS, 1,
+                                 &append_sector),
+                    ==, VIRTIO_BLK_S_ZONE_INVALID_CMD);
+
+    g_assert_cmpint(zoned_mgmt(dev, t_alloc, vq, VIRTIO_BLK_T_ZONE_RESET_ALL,
+                               0), ==, VIRTIO_BLK_S_OK);
+    nr_zones = zoned_report(dev, t_alloc, vq, 0, ARRAY_SIZE(zones), zones);
+    g_assert_cmpuint(nr_zones, ==, ZONED_NR_ZONES);
+    for (i = 0; i < nr_zones; i++) {
+        g_assert_cmpuint(zones[i].z_wp, ==, zones[i].z_start);
+        g_assert_cmpint(zones[i].z_state, ==, VIRTIO_BLK_ZS_EMPTY);
+    }
+
+    qvirtqueue_cleanup(dev->bus, vq, t_alloc);
+}
+
 static void pci_hotplug(void *obj, void *data, QGuestAllocator *t_alloc)
 {
     QVirtioPCIDevice *dev1 = obj;
@@ -780,15 +1311,30 @@ static void *virtio_blk_test_setup(GString *cmd_line, void *arg)
     return arg;
 }
 
+static void *virtio_blk_zoned_test_setup(GString *cmd_line, void *arg)
+{
+    g_string_append_printf(cmd_line,
+                           " -drive if=none,id=drive0,file=null-co://,"
+                           "file.size=%d,file.zone-size=%d,"
+                           "file.read-zeroes=on,format=raw ",
+                           ZONED_IMAGE_SIZE, ZONED_ZONE_SIZE);
+
+    return arg;
+}
+
 static void register_virtio_blk_test(void)
 {
     QOSGraphTestOptions opts = {
         .before = virtio_blk_test_setup,
     };
+    QOSGraphTestOptions zoned_opts = {
+        .before = virtio_blk_zoned_test_setup,
+    };
 
     qos_add_test("indirect", "virtio-blk", indirect, &opts);
     qos_add_test("config", "virtio-blk", config, &opts);
     qos_add_test("basic", "virtio-blk", basic, &opts);
+    qos_add_test("batch", "virtio-blk", batch, &opts);
     qos_add_test("resize", "virtio-blk", resize, &opts);
 
     /* tests just for virtio-blk-pci */
@@ -797,6 +1343,11 @@ static void register_virtio_blk_test(void)
     qos_add_test("nxvirtq", "virtio-blk-pci",
                       test_nonexistent_virtqueue, &opts);
     qos_add_test("hotplug", "virtio-blk-pci", pci_hotplug, &opts);
+
+    opts.edge.extra_device_opts = "merge-window-us=10000";
+    qos_add_test("merge-window", "virtio-blk-pci", merge_window, &opts);
+
+    qos_add_test("zoned", "virtio-blk", zoned, &zoned_opts);
 }
 
 libqos_init(register_virtio_blk_test);
@@ -10,6 +10,7 @@
 #include "qemu/osdep.h"
 #include "qemu-common.h"
 #include "libqtest-single.h"
+#include "qemu/cutils.h"
 #include "qemu/iov.h"
 #include "qemu/module.h"
 #include "qapi/qmp/qdict.h"
@@ -17,6 +18,12 @@
 #include "libqos/qgraph.h"
 #include "libqos/virtio-net.h"
 
+#ifdef CONFIG_LINUX
+#include <net/if.h>
+#include <linux/if_packet.h>
+#include <linux/if_tun.h>
+#endif
+
 #ifndef ETH_P_RARP
 #define ETH_P_RARP 0x8035
 #endif
@@ -307,12 +314,366 @@ static void large_tx(void *obj, void *data, QGuestAllocator *t_alloc)
     guest_free(t_alloc, req_addr);
 }
 
+#ifndef _WIN32
+/* The device keeps its iothreads alive until it goes away */
+static void iothreads_object_del(void *obj, void *data,
+                                 QGuestAllocator *t_alloc)
+{
+    QVirtioNetPCI *net_pci = obj;
+    QVirtioNet *net_if = &net_pci->net;
+    QTestState *qts = net_pci->pci_vdev.pdev->bus->qts;
+    int *sv = data;
+
+    qtest_qmp_assert_success(qts, "{'execute': 'object-del',"
+                                  " 'arguments': {'id': 'thread0'}}");
+
+    /* Link changes take the lock of every iothread */
+    qtest_qmp_assert_success(qts, "{'execute': 'set_link',"
+                                  " 'arguments': {'name': 'hs0',"
+                                  "               'up': false}}");
+    qtest_qmp_assert_success(qts, "{'execute': 'set_link',"
+                                  " 'arguments': {'name': 'hs0',"
+                                  "               'up': true}}");
+
+    rx_test(net_if->vdev, t_alloc, net_if->queues[0], sv[0]);
+    tx_test(net_if->vdev, t_alloc, net_if->queues[1], sv[0]);
+}
+
+static void *virtio_net_test_setup_iothreads(GString *cmd_line, void *arg)
+{
+    g_string_append(cmd_line, " -object iothread,id=thread0 ");
+    return virtio_net_test_setup(cmd_line, arg);
+}
+#endif
+
+#ifndef _WIN32
+#define TX_BATCH_PKTS 16
+#define TX_BATCH_LEN 52
+
+static void udp_test_cleanup(void *sock)
+{
+    int *fd = sock;
+
+    close(*fd);
+    qos_invalidate_command_line();
+    g_free(fd);
+}
+
+/* The netdev sends its datagrams to a socket the test reads from */
+static void *virtio_net_test_setup_udp(GString *cmd_line, void *arg)
+{
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    socklen_t addrlen = sizeof(addr);
+    int *fd = g_new(int, 1);
+    int ret;
+
+    *fd = socket(PF_INET, SOCK_DGRAM, 0);
+    g_assert_cmpint(*fd, !=, -1);
+    ret = bind(*fd, (struct sockaddr *)&addr, sizeof(addr));
+    g_assert_cmpint(ret, ==, 0);
+    ret = getsockname(*fd, (struct sockaddr *)&addr, &addrlen);
+    g_assert_cmpint(ret, ==, 0);
+
+    g_string_append_printf(cmd_line, " -netdev socket,id=hs0,"
+                           "udp=127.0.0.1:%d,localaddr=127.0.0.1:0 ",
+                           ntohs(addr.sin_port));
+
+    g_test_queue_destroy(udp_test_cleanup, fd);
+    return fd;
+}
+
+static int tx_batch_fill(char *pkt, int i)
+{
+    int len = i == TX_BATCH_PKTS - 1 ? TX_BATCH_LEN / 2 : TX_BATCH_LEN;
+
+    memset(pkt, 'a' + i, len);
+    snprintf(pkt, len, "TX-BATCH %02d", i);
+    return len;
+}
+
+/*
+ * All packets of one kick leave as a single batch.  The last one is
+ * shorter, so it ends the run of equally sized packets that a UDP_SEGMENT
+ * send can cover.
+ */
+static void tx_batch(void *obj, void *data, QGuestAllocator *t_alloc)
+{
+    QVirtioNet *dev = obj;
+    QVirtQueue *vq = dev->queues[1];
+    QTestState *qts = global_qtest;
+    uint64_t req_addr[TX_BATCH_PKTS];
+    uint32_t heads[TX_BATCH_PKTS];
+    char hdr[VNET_HDR_SIZE] = { 0 };
+    char buf[TX_BATCH_LEN + 1];
+    char pkt[TX_BATCH_LEN];
+    gint64 start_time;
+    uint32_t desc_idx;
+    int *fd = data;
+    int i, len, done;
+
+    for (i = 0; i < TX_BATCH_PKTS; i++) {
+        len = tx_batch_fill(pkt, i);
+
+        req_addr[i] = guest_alloc(t_alloc, VNET_HDR_SIZE + len);
+        memwrite(req_addr[i], hdr, VNET_HDR_SIZE);
+        memwrite(req_addr[i] + VNET_HDR_SIZE, pkt, len);
+        heads[i] = qvirtqueue_add(qts, vq, req_addr[i], VNET_HDR_SIZE + len,
+                                  false, false);
+    }
+    qvirtqueue_kick_batch(qts, dev->vdev, vq, heads, TX_BATCH_PKTS);
+
+    start_time = g_get_monotonic_time();
+    for (done = 0; done < TX_BATCH_PKTS; ) {
+        while (qvirtqueue_get_buf(qts, vq, &desc_idx, NULL)) {
+            g_assert_cmpint(desc_idx, ==, heads[done]);
+            done++;
+        }
+        g_assert(g_get_monotonic_time() - start_time <=
+                 QVIRTIO_NET_TIMEOUT_US);
+    }
+
+    /* One datagram per packet, in order, with the vnet header stripped */
+    for (i = 0; i < TX_BATCH_PKTS; i++) {
+        len = tx_batch_fill(pkt, i);
+
+        g_assert_cmpint(qemu_recv(*fd, buf, sizeof(buf), 0), ==, len);
+        g_assert(memcmp(buf, pkt, len) == 0);
+        guest_free(t_alloc, req_addr[i]);
+    }
+    g_assert_cmpint(qemu_recv(*fd, buf, sizeof(buf), MSG_DONTWAIT), ==, -1);
+}
+#endif
+
 static void *virtio_net_test_setup_nosocket(GString *cmd_line, void *arg)
 {
     g_string_append(cmd_line, " -netdev hubport,hubid=0,id=hs0 ");
     return arg;
 }
 
+#ifdef CONFIG_LINUX
+#define RSS_TAP_NAME "qrss%d"
+#define RSS_MARKER "RSS-STEER"
+#define RSS_RX_BUFS 16
+
+typedef struct RSSTap {
+    char *ifname;
+    int fds[2];
+} RSSTap;
+
+static int rss_tap_open_queue(const char *ifname)
+{
+    struct ifreq ifr = {
+        .ifr_flags = IFF_TAP | IFF_NO_PI | IFF_MULTI_QUEUE,
+    };
+    int fd;
+
+    fd = open("/dev/net/tun", O_RDWR);
+    if (fd < 0) {
+        return -1;
+    }
+    pstrcpy(ifr.ifr_name, IFNAMSIZ, ifname);
+    if (ioctl(fd, TUNSETIFF, &ifr) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+static void rss_tap_cleanup(void *opaque)
+{
+    RSSTap *tap = opaque;
+
+    qos_invalidate_command_line();
+    close(tap->fds[0]);
+    close(tap->fds[1]);
+    g_free(tap->ifname);
+    g_free(tap);
+}
+
+/*
+ * A two queue tap device that the test creates itself, so that it can
+ * detach queues behind QEMU's back.  Without CAP_NET_ADMIN there is no
+ * tap, QEMU gets a dummy backend and the test is skipped.
+ */
+static void *virtio_net_test_setup_rss(GString *cmd_line, void *arg)
+{
+    RSSTap *tap = g_new0(RSSTap, 1);
+
+    g_string_append(cmd_line, " -object iothread,id=thread0 ");
+
+    tap->ifname = g_strdup_printf(RSS_TAP_NAME, getpid());
+    tap->fds[0] = rss_tap_open_queue(tap->ifname);
+    tap->fds[1] = tap->fds[0] < 0 ? -1 : rss_tap_open_queue(tap->ifname);
+    if (tap->fds[1] < 0) {
+        if (tap->fds[0] >= 0) {
+            close(tap->fds[0]);
+        }
+        g_free(tap->ifname);
+        g_free(tap);
+        return virtio_net_test_setup_nosocket(cmd_line, NULL);
+    }
+
+    g_string_append_printf(cmd_line,
+                           " -netdev tap,id=hs0,fds=%d:%d,vhost=off ",
+                           tap->fds[0], tap->fds[1]);
+    g_test_queue_destroy(rss_tap_cleanup, tap);
+    return tap;
+}
+
+/* Sends @count copies of the same IPv4/UDP frame out of the tap device */
+static bool rss_tap_send(const char *ifname, int count)
+{
+    uint8_t frame[14 + 20 + 8 + sizeof(RSS_MARKER)] = {
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff,         /* destination */
+        0x52, 0x54, 0x00, 0xaa, 0xbb, 0xcc,         /* source */
+        0x08, 0x00,                                 /* IPv4 */
+        0x45, 0x00, 0x00, 20 + 8 + sizeof(RSS_MARKER),
+        0x00, 0x00, 0x00, 0x00, 0x40, 0x11, 0x00, 0x00,
+        10, 0, 0, 1,
+        10, 0, 0, 2,
+        0x30, 0x39, 0x00, 0x35,                     /* UDP ports */
+        0x00, 8 + sizeof(RSS_MARKER), 0x00, 0x00,
+    };
+    struct sockaddr_ll sll = {
+        .sll_family = AF_PACKET,
+        .sll_ifindex = if_nametoindex(ifname),
+        .sll_halen = ETH_ALEN,
+    };
+    struct ifreq ifr = { };
+    int s, i;
+
+    memcpy(frame + 14 + 20 + 8, RSS_MARKER, sizeof(RSS_MARKER));
+
+    s = socket(AF_INET, SOCK_DGRAM, 0);
+    g_assert_cmpint(s, >=, 0);
+    pstrcpy(ifr.ifr_name, IFNAMSIZ, ifname);
+    g_assert_cmpint(ioctl(s, SIOCGIFFLAGS, &ifr), ==, 0);
+    ifr.ifr_flags |= IFF_UP;
+    g_assert_cmpint(ioctl(s, SIOCSIFFLAGS, &ifr), ==, 0);
+    close(s);
+
+    s = socket(AF_PACKET, SOCK_RAW, 0);
+    if (s < 0) {
+        return false;
+    }
+    for (i = 0; i < count; i++) {
+        g_assert_cmpint(sendto(s, frame, sizeof(frame), 0,
+                               (struct sockaddr *)&sll, sizeof(sll)),
+                        ==, sizeof(frame));
+    }
+    close(s);
+    return true;
+}
+
+/*
+ * RSS sends every packet to the second queue pair, which is serviced by an
+ * iothread.  The second tap queue is detached, so the packets all arrive
+ * on the first tap queue in the main loop and have to be steered.  They
+ * are sent before the guest posts receive buffers, so they are also held
+ * until the ring is refilled.
+ */
+static void rss_steering(void *obj, void *data, QGuestAllocator *t_alloc)
+{
+    QVirtioNetPCI *net_pci = obj;
+    QVirtioNet *net_if = &net_pci->net;
+    QVirtioDevice *dev = net_if->vdev;
+    QVirtQueue *rx = net_if->queues[2];
+    QVirtQueue *ctrl = net_if->queues[net_if->n_queues - 1];
+    QTestState *qts = global_qtest;
+    RSSTap *tap = data;
+    struct QEMU_PACKED {
+        struct virtio_net_ctrl_hdr hdr;
+        uint32_t hash_types;
+        uint16_t indirection_table_mask;
+        uint16_t unclassified_queue;
+        uint16_t indirection_table[1];
+        uint16_t max_tx_vq;
+        uint8_t hash_key_length;
+        uint8_t hash_key[40];
+    } rss = {
+        .hdr.class = VIRTIO_NET_CTRL_MQ,
+        .hdr.cmd = VIRTIO_NET_CTRL_MQ_RSS_CONFIG,
+        .hash_types = cpu_to_le32(VIRTIO_NET_RSS_HASH_TYPE_IPv4),
+        .indirection_table = { cpu_to_le16(1) },
+        .unclassified_queue = cpu_to_le16(1),
+        .max_tx_vq = cpu_to_le16(2),
+        .hash_key_length = 40,
+    };
+    struct ifreq ifr = {
+        .ifr_flags = IFF_DETACH_QUEUE,
+    };
+    uint64_t req_addr;
+    uint64_t bufs[RSS_RX_BUFS];
+    uint32_t heads[RSS_RX_BUFS];
+    uint32_t free_head, desc_idx;
+    gint64 start_time;
+    char buffer[sizeof(RSS_MARKER)];
+    int i, found = 0;
+
+    if (!tap) {
+        g_test_skip("cannot create a multiqueue tap device");
+        return;
+    }
+    g_assert_cmphex(qvirtio_get_features(dev) & (1ull << VIRTIO_NET_F_RSS),
+                    !=, 0);
+
+    memset(rss.hash_key, 0x6d, sizeof(rss.hash_key));
+    req_addr = guest_alloc(t_alloc, sizeof(rss) + 1);
+    memwrite(req_addr, &rss, sizeof(rss));
+    writeb(req_addr + sizeof(rss), 0xff);
+
+    free_head = qvirtqueue_add(qts, ctrl, req_addr, sizeof(rss), false, true);
+    qvirtqueue_add(qts, ctrl, req_addr + sizeof(rss), 1, true, false);
+    qvirtqueue_kick(qts, dev, ctrl, free_head);
+    qvirtio_wait_used_elem(qts, dev, ctrl, free_head, NULL,
+                           QVIRTIO_NET_TIMEOUT_US);
+    g_assert_cmpint(readb(req_addr + sizeof(rss)), ==, VIRTIO_NET_OK);
+    guest_free(t_alloc, req_addr);
+
+    g_assert_cmpint(ioctl(tap->fds[1], TUNSETQUEUE, &ifr), ==, 0);
+    if (!rss_tap_send(tap->ifname, 2)) {
+        g_test_skip("cannot send packets on the tap device");
+        return;
+    }
+
+    for (i = 0; i < RSS_RX_BUFS; i++) {
+        bufs[i] = guest_alloc(t_alloc, 2048);
+        heads[i] = qvirtqueue_add(qts, rx, bufs[i], 2048, true, false);
+    }
+    qvirtqueue_kick_batch(qts, dev, rx, heads, RSS_RX_BUFS);
+
+    /* The host may send packets of its own, look for ours among them */
+    start_time = g_get_monotonic_time();
+    while (found < 2) {
+        qtest_clock_step(qts, 100);
+
+        while (found < 2 && qvirtqueue_get_buf(qts, rx, &desc_idx, NULL)) {
+            for (i = 0; i < RSS_RX_BUFS; i++) {
+                if (heads[i] == desc_idx) {
+                    break;
+                }
+            }
+            g_assert_cmpint(i, <, RSS_RX_BUFS);
+            memread(bufs[i] + VNET_HDR_SIZE + 14 + 20 + 8, buffer,
+                    sizeof(buffer));
+            if (!memcmp(buffer, RSS_MARKER, sizeof(RSS_MARKER))) {
+                found++;
+            }
+        }
+
+        g_assert(g_get_monotonic_time() - start_time <=
+                 QVIRTIO_NET_TIMEOUT_US);
+    }
+
+    for (i = 0; i < RSS_RX_BUFS; i++) {
+        guest_free(t_alloc, bufs[i]);
+    }
+}
+#endif
+
 static void register_virtio_net_test(void)
 {
     QOSGraphTestOptions opts = {
@@ -326,6 +687,27 @@ static void register_virtio_net_test(void)
 #endif
     qos_add_test("announce-self", "virtio-net", announce_self, &opts);
 
+#ifndef _WIN32
+    opts.before = virtio_net_test_setup_iothreads;
+    opts.edge.extra_device_opts = "len-iothreads=1,iothreads[0]=thread0";
+    qos_add_test("iothreads-object-del", "virtio-net-pci",
+                 iothreads_object_del, &opts);
+    opts.edge.extra_device_opts = NULL;
+#endif
+
+#ifndef _WIN32
+    opts.before = virtio_net_test_setup_udp;
+    qos_add_test("tx-batch", "virtio-net", tx_batch, &opts);
+#endif
+
+#ifdef CONFIG_LINUX
+    opts.before = virtio_net_test_setup_rss;
+    opts.edge.extra_device_opts = "disable-legacy=on,mq=on,rss=on,"
+                                  "len-iothreads=1,iothreads[0]=thread0";
+    qos_add_test("rss-steering", "virtio-net-pci", rss_steering, &opts);
+    opts.edge.extra_device_opts = NULL;
+#endif
+
     /* These tests do not need a loopback backend.  */
     opts.before = virtio_net_test_setup_nosocket;
     opts.arg = (gpointer)UINT_MAX;
@@ -59,12 +59,14 @@ static uint64_t qvirtio_scsi_alloc(QVirtioSCSIQueues *vs, size_t alloc_size,
     return addr;
 }
 
-static uint8_t virtio_scsi_do_command(QVirtioSCSIQueues *vs,
-                                      const uint8_t *cdb,
-                                      const uint8_t *data_in,
-                                      size_t data_in_len,
-                                      uint8_t *data_out, size_t data_out_len,
-                                      struct virtio_scsi_cmd_resp *resp_out)
+/* Send a command on the request virtqueue @queue */
+static uint8_t virtio_scsi_do_command_on(QVirtioSCSIQueues *vs, int queue,
+                                         const uint8_t *cdb,
+                                         const uint8_t *data_in,
+                                         size_t data_in_len,
+                                         uint8_t *data_out,
+                                         size_t data_out_len,
+                                         struct virtio_scsi_cmd_resp *resp_out)
 {
     QVirtQueue *vq;
     struct virtio_scsi_cmd_req req = { { 0 } };
@@ -74,7 +76,8 @@ static uint8_t virtio_scsi_do_command(QVirtioSCSIQueues *vs,
     uint32_t free_head;
     QTestState *qts = global_qtest;
 
-    vq = vs->vq[2];
+    g_assert_cmpint(queue, <, vs->num_queues);
+    vq = vs->vq[2 + queue];
 
     req.lun[0] = 1; /* Select LUN */
     req.lun[1] = 1; /* Select target 1 */
@@ -118,6 +121,17 @@ static uint8_t virtio_scsi_do_command(QVirtioSCSIQueues *vs,
     return response;
 }
 
+static uint8_t virtio_scsi_do_command(QVirtioSCSIQueues *vs,
+                                      const uint8_t *cdb,
+                                      const uint8_t *data_in,
+                                      size_t data_in_len,
+                                      uint8_t *data_out, size_t data_out_len,
+                                      struct virtio_scsi_cmd_resp *resp_out)
+{
+    return virtio_scsi_do_command_on(vs, 0, cdb, data_in, data_in_len,
+                                     data_out, data_out_len, resp_out);
+}
+
 static QVirtioSCSIQueues *qvirtio_scsi_init(QVirtioDevice *dev)
 {
     QVirtioSCSIQueues *vs;
@@ -249,6 +263,37 @@ fail:
     unlink(tmp_path);
 }
 
+/* The device keeps its iothreads alive until it goes away */
+static void test_iothreads_object_del(void *obj, void *data,
+                                      QGuestAllocator *t_alloc)
+{
+    QVirtioSCSIPCI *scsi_pci = obj;
+    QVirtioSCSI *scsi = &scsi_pci->scsi;
+    QTestState *qts = scsi_pci->pci_vdev.pdev->bus->qts;
+    QVirtioSCSIQueues *vs;
+    uint8_t buf[512] = { 0 };
+    const uint8_t write_cdb[VIRTIO_SCSI_CDB_SIZE] = {
+        /* WRITE(10) to LBA 0, transfer length 1 */
+        0x2a, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00
+    };
+    int i;
+
+    alloc = t_alloc;
+    vs = qvirtio_scsi_init(scsi->vdev);
+
+    qtest_qmp_assert_success(qts, "{'execute': 'object-del',"
+                                  " 'arguments': {'id': 'thread0'}}");
+    qtest_qmp_assert_success(qts, "{'execute': 'object-del',"
+                                  " 'arguments': {'id': 'thread1'}}");
+
+    for (i = 0; i < vs->num_queues; i++) {
+        g_assert_cmphex(virtio_scsi_do_command_on(vs, i, write_cdb, NULL, 0,
+                                                  buf, 512, NULL), ==, 0);
+    }
+
+    qvirtio_scsi_pci_free(vs);
+}
+
 static void *virtio_scsi_hotplug_setup(GString *cmd_line, void *arg)
 {
     g_string_append(cmd_line,
@@ -276,6 +321,16 @@ static void *virtio_scsi_setup_iothread(GString *cmd_line, void *arg)
     return arg;
 }
 
+static void *virtio_scsi_setup_iothreads(GString *cmd_line, void *arg)
+{
+    g_string_append(cmd_line,
+                    " -object iothread,id=thread0"
+                    " -object iothread,id=thread1"
+                    " -blockdev driver=null-co,read-zeroes=on,node-name=null0"
+                    " -device scsi-hd,drive=null0,scsi-id=1,lun=0");
+    return arg;
+}
+
 static void register_virtio_scsi_test(void)
 {
     QOSGraphTestOptions opts = { };
@@ -293,6 +348,14 @@ static void register_virtio_scsi_test(void)
     };
     qos_add_test("iothread-attach-node", "virtio-scsi-pci",
                  test_iothread_attach_node, &opts);
+
+    opts.before = virtio_scsi_setup_iothreads;
+    opts.edge = (QOSGraphEdgeOptions) {
+        .extra_device_opts = "num_queues=2,len-iothreads=2,"
+                             "iothreads[0]=thread0,iothreads[1]=thread1",
+    };
+    qos_add_test("iothreads-object-del", "virtio-scsi-pci",
+                 test_iothreads_object_del, &opts);
 }
 
 libqos_init(register_virtio_scsi_test);
@@ -0,0 +1,105 @@
+/*
+ * Migration page cache unit tests.
+ *
+ * This work is licensed under the terms of the GNU GPL, version 2 or later.
+ * See the COPYING file in the top-level directory.
+ *
+ */
+#include "qemu/osdep.h"
+#include "qapi/error.h"
+#include "../migration/page_cache.h"
+
+#define PAGE_SIZE 4096
+/* Two sets of eight pages */
+#define CACHE_PAGES 16
+
+/* Address of the n-th page that hashes to the first set */
+static uint64_t set0_addr(int n)
+{
+    return (uint64_t)n * 2 * PAGE_SIZE;
+}
+
+static void test_associative(void)
+{
+    PageCache *cache = cache_init(CACHE_PAGES, PAGE_SIZE, &error_abort);
+    uint8_t page[PAGE_SIZE];
+    int i;
+
+    /* Pages of the same set do not evict each other until it is full */
+    for (i = 0; i < 8; i++) {
+        memset(page, i, PAGE_SIZE);
+        g_assert(cache_insert(cache, set0_addr(i), page, 0, NULL) == 0);
+    }
+    for (i = 0; i < 8; i++) {
+        g_assert(cache_is_cached(cache, set0_addr(i), 0, NULL));
+        g_assert(get_cached_data(cache, set0_addr(i))[0] == i);
+    }
+
+    /* All the pages are fresh, a ninth one is not cached */
+    g_assert(cache_insert(cache, set0_addr(8), page, 1, NULL) == -1);
+    g_assert(!cache_is_cached(cache, set0_addr(8), 1, NULL));
+
+    /* The other set is still empty */
+    g_assert(cache_insert(cache, PAGE_SIZE, page, 1, NULL) == 0);
+
+    cache_fini(cache);
+}
+
+static void test_replacement(void)
+{
+    PageCache *cache = cache_init(CACHE_PAGES, PAGE_SIZE, &error_abort);
+    PageCacheStats stats = { };
+    uint8_t page[PAGE_SIZE] = { };
+    int i;
+
+    for (i = 0; i < 8; i++) {
+        g_assert(cache_insert(cache, set0_addr(i), page, 0, &stats) == 0);
+    }
+    /* Everything but page 3 is used again later */
+    for (i = 0; i < 8; i++) {
+        if (i != 3) {
+            g_assert(cache_is_cached(cache, set0_addr(i), 1, &stats));
+        }
+    }
+    g_assert_cmpuint(stat64_get(&stats.hits), ==, 7);
+
+    /* Page 3 is old enough, and the least recently used */
+    g_assert(cache_insert(cache, set0_addr(8), page, 3, &stats) == 0);
+    g_assert(!cache_is_cached(cache, set0_addr(3), 3, &stats));
+    g_assert(cache_is_cached(cache, set0_addr(8), 3, &stats));
+    g_assert_cmpuint(stat64_get(&stats.evictions), ==, 1);
+    g_assert_cmpuint(stat64_get(&stats.misses), ==, 1);
+
+    cache_fini(cache);
+}
+
+static void test_invalidate(void)
+{
+    PageCache *cache = cache_init(CACHE_PAGES, PAGE_SIZE, &error_abort);
+    uint8_t page[PAGE_SIZE];
+    uint8_t *data;
+
+    memset(page, 1, PAGE_SIZE);
+    g_assert(cache_insert(cache, set0_addr(0), page, 0, NULL) == 0);
+
+    data = cache_lookup_lock(cache, set0_addr(0), 0, NULL);
+    g_assert(data);
+    memset(data, 2, PAGE_SIZE);
+    cache_unlock(cache, set0_addr(0));
+    g_assert(get_cached_data(cache, set0_addr(0))[0] == 2);
+
+    cache_invalidate(cache, set0_addr(0));
+    g_assert(!cache_lookup_lock(cache, set0_addr(0), 0, NULL));
+    g_assert(!cache_is_cached(cache, set0_addr(0), 0, NULL));
+
+    cache_fini(cache);
+}
+
+int main(int argc, char **argv)
+{
+    g_test_init(&argc, &argv, NULL);
+    g_test_add_func("/page_cache/associative", test_associative);
+    g_test_add_func("/page_cache/replacement", test_replacement);
+    g_test_add_func("/page_cache/invalidate", test_invalidate);
+    return g_test_run();
+}
@@ -174,6 +174,79 @@ static void test_encode_decode(void)
     }
 }
 
+/*
+ * Scatter changed runs of random length over a random page, with some
+ * unchanged bytes inside them, and check that the selected encoder and
+ * the portable one produce the same output.  The source length, in
+ * longs as the portable encoder wants, and the room for the output vary
+ * so that the tails and the overflow paths are covered too.
+ */
+static void encode_accel_range(void)
+{
+    uint8_t *old_buf = g_malloc(PAGE_SIZE);
+    uint8_t *new_buf = g_malloc(PAGE_SIZE);
+    uint8_t *compressed = g_malloc(PAGE_SIZE);
+    uint8_t *compressed_int = g_malloc(PAGE_SIZE);
+    int slen = PAGE_SIZE - g_test_rand_int_range(0, 8) * sizeof(long);
+    int dlen = g_test_rand_int_range(PAGE_SIZE / 8, PAGE_SIZE + 1);
+    int nr_runs = g_test_rand_int_range(0, 64);
+    int i, j, start, len;
+    int rc, rc_int;
+
+    for (i = 0; i < PAGE_SIZE; i++) {
+        old_buf[i] = g_test_rand_int();
+    }
+    memcpy(new_buf, old_buf, PAGE_SIZE);
+
+    for (i = 0; i < nr_runs; i++) {
+        start = g_test_rand_int_range(0, PAGE_SIZE);
+        len = MIN(g_test_rand_int_range(1, 300), PAGE_SIZE - start);
+        for (j = start; j < start + len; j++) {
+            new_buf[j] = old_buf[j] + g_test_rand_int_range(1, 256);
+        }
+        if (g_test_rand_bit()) {
+            j = start + g_test_rand_int_range(0, len);
+            new_buf[j] = old_buf[j];
+        }
+    }
+
+    rc = xbzrle_encode_buffer(old_buf, new_buf, slen, compressed, dlen);
+    rc_int = test_xbzrle_encode_buffer_int(old_buf, new_buf, slen,
+                                           compressed_int, dlen);
+    g_assert_cmpint(rc, ==, rc_int);
+    if (rc > 0) {
+        g_assert(memcmp(compressed, compressed_int, rc) == 0);
+    }
+
+    g_free(old_buf);
+    g_free(new_buf);
+    g_free(compressed);
+    g_free(compressed_int);
+}
+
+static void test_encode_accel(void)
+{
+    int i;
+
+    for (i = 0; i < 10000; i++) {
+        encode_accel_range();
+    }
+}
+
+static void test_encode_decode_accel(void)
+{
+    /* Run the tests again with each encoder supported by the host */
+    do {
+        g_test_message("encoder: %s", xbzrle_encode_accel());
+        test_encode_decode_zero();
+        test_encode_decode_unchanged();
+        test_encode_decode_1_byte();
+        test_encode_decode_overflow();
+        test_encode_decode();
+        test_encode_accel();
+    } while (test_xbzrle_encode_next_accel());
+}
+
 int main(int argc, char **argv)
 {
     g_test_init(&argc, &argv, NULL);
@@ -186,6 +259,8 @@ int main(int argc, char **argv)
     g_test_add_func("/xbzrle/encode_decode_overflow",
                     test_encode_decode_overflow);
     g_test_add_func("/xbzrle/encode_decode", test_encode_decode);
+    g_test_add_func("/xbzrle/encode_accel", test_encode_accel);
+    g_test_add_func("/xbzrle/encode_decode_accel", test_encode_decode_accel);
 
     return g_test_run();
 }